@@ -3,6 +3,7 @@
 #include "Buffer.h"
 
 #include "BufferUtils.h"
+#include "GatordStats.h"
 #include "Logging.h"
 #include "Protocol.h"
 #include "Sender.h"
@@ -24,7 +25,8 @@ Buffer::Buffer(const int32_t core,
                sem_t & readerSem,
                uint64_t commitRate,
                bool includeResponseType)
-    : mBuf(new char[size]),
+    : mStorage(size),
+      mBuf(mStorage.data()),
       mReaderSem(readerSem),
       mCommitRate(commitRate),
       mCommitTime(commitRate),
@@ -42,11 +44,15 @@ Buffer::Buffer(const int32_t core,
       mLastEventTid(0)
 {
     if ((mSize & mask) != 0) {
-        delete[] mBuf;
         logg.logError("Buffer size is not a power of 2");
         handleException();
     }
 
+    if (!mStorage) {
+        logg.logError("Unable to allocate a buffer of %d bytes", size);
+        handleException();
+    }
+
     runtime_assert(mSize > 8192, "Buffer::mSize is too small");
 
     sem_init(&mWriterSem, 0, 0);
@@ -58,7 +64,6 @@ Buffer::Buffer(const int32_t core,
 
 Buffer::~Buffer()
 {
-    delete[] mBuf;
     sem_destroy(&mWriterSem);
 }
 
@@ -84,6 +89,11 @@ void Buffer::write(ISender & sender)
         length2 = commitPos;
     }
 
+    // The fill peaks just before the sender frees the space, so measure it here on the sender thread rather than
+    // having every producer core contend on the stat in commit
+    GatordStats::updateMax(gGatordStats.mBufferHighWater,
+                           static_cast<int>((static_cast<int64_t>(length1 + length2) * 100) / mSize));
+
     logg.logMessage("Sending data length1: %i length2: %i", length1, length2);
 
     constexpr std::size_t numberOfParts = 2;
@@ -118,6 +128,11 @@ int Buffer::bytesAvailable() const
 
 void Buffer::waitForSpace(int bytes, uint64_t time)
 {
+    if (checkSpace(bytes)) {
+        return;
+    }
+
+    GatordStats::ScopedTimer waitTimer {gGatordStats.mBufferWaitTime};
     while (!checkSpace(bytes)) {
         // do all this in the slow path where we have to wait
         if (bytes > mSize) {
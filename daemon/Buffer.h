@@ -5,6 +5,7 @@
 
 #include "IBuffer.h"
 #include "Protocol.h"
+#include "lib/LargeBuffer.h"
 #ifdef BUFFER_USE_SESSION_DATA
 #include "SessionData.h"
 #endif
@@ -73,6 +74,7 @@ private:
     void frame();
     bool checkSpace(int bytes) const;
 
+    lib::LargeBuffer mStorage;
     char * const mBuf;
     sem_t & mReaderSem;
     const uint64_t mCommitRate;
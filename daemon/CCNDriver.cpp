@@ -248,7 +248,7 @@ void CCNDriver::readEvents(mxml_node_t * const /*unused*/)
     }
 }
 
-int CCNDriver::writeCounters(mxml_node_t * const /*root*/) const
+int CCNDriver::writeCounters(XmlWriter & /*writer*/) const
 {
     // Handled by PerfDriver
     return 0;
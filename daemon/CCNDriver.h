@@ -17,7 +17,7 @@ public:
     void setupCounter(Counter & counter) override;
 
     void readEvents(mxml_node_t * const /*unused*/) override;
-    int writeCounters(mxml_node_t * root) const override;
+    int writeCounters(XmlWriter & writer) const override;
     void writeEvents(mxml_node_t * const /*unused*/) const override;
 
     static std::string validateCounters();
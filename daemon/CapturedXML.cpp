@@ -9,7 +9,7 @@
 #include "PrimarySourceProvider.h"
 #include "SessionData.h"
 #include "lib/FsEntry.h"
-#include "xml/MxmlUtils.h"
+#include "xml/XmlWriter.h"
 
 #include <algorithm>
 #include <cassert>
@@ -68,61 +68,68 @@ static const char * detectOs()
 }
 #endif
 
-/** Generate the xml tree for capture.xml */
-static mxml_node_t * getTree(bool includeTime,
-                             lib::Span<const CapturedSpe> spes,
-                             const PrimarySourceProvider & primarySourceProvider,
-                             const std::map<unsigned, unsigned> & maliGpuIds)
+/** Generate the xml for captured.xml */
+static std::unique_ptr<char, void (*)(void *)> getXmlString(bool includeTime,
+                                                            bool compressed,
+                                                            lib::Span<const CapturedSpe> spes,
+                                                            const PrimarySourceProvider & primarySourceProvider,
+                                                            const std::map<unsigned, unsigned> & maliGpuIds)
 {
-    auto * const xml = mxmlNewXML("1.0");
-    auto * const captured = mxmlNewElement(xml, "captured");
-    mxmlElementSetAttr(captured, "version", "1");
-    mxmlElementSetAttr(captured,
-                       "backtrace_processing",
-                       (gSessionData.mBacktraceDepth > 0) ? primarySourceProvider.getBacktraceProcessingMode()
-                                                          : "none");
-    mxmlElementSetAttr(captured, "type", primarySourceProvider.getCaptureXmlTypeValue());
-    mxmlElementSetAttrf(captured, "protocol", "%d", PROTOCOL_VERSION);
+    XmlWriter xml;
+    xml.startDocument();
+    xml.startElement("captured");
+    xml.attribute("version", "1");
+    xml.attribute("backtrace_processing",
+                  (gSessionData.mBacktraceDepth > 0) ? primarySourceProvider.getBacktraceProcessingMode() : "none");
+    xml.attribute("type", primarySourceProvider.getCaptureXmlTypeValue());
+    xml.attributef("protocol", "%d", PROTOCOL_VERSION);
+    if (gSessionData.mSampleAggregationWindowMs > 0) {
+        xml.attributef("sample_aggregation_window_ms", "%d", gSessionData.mSampleAggregationWindowMs);
+    }
+    if (compressed) {
+        xml.attribute("compression", "lz4");
+    }
     if (includeTime) {                    // Send the following only after the capture is complete
         if (time(nullptr) > 1267000000) { // If the time is reasonable (after Feb 23, 2010)
-            mxmlElementSetAttrf(captured, "created", "%lu", time(nullptr)); // Valid until the year 2038
+            xml.attributef("created", "%lu", time(nullptr)); // Valid until the year 2038
         }
     }
 
-    auto * const target = mxmlNewElement(captured, "target");
-    mxmlElementSetAttrf(target, "sample_rate", "%d", gSessionData.mSampleRate);
+    xml.startElement("target");
+    xml.attributef("sample_rate", "%d", gSessionData.mSampleRate);
     const auto & cpuInfo = primarySourceProvider.getCpuInfo();
-    mxmlElementSetAttr(target, "name", cpuInfo.getModelName());
+    xml.attribute("name", cpuInfo.getModelName());
     const auto cpuIds = cpuInfo.getCpuIds();
-    mxmlElementSetAttrf(target, "cores", "%zu", cpuIds.size());
+    xml.attributef("cores", "%zu", cpuIds.size());
     //GPU cores
-    mxmlElementSetAttrf(target, "gpu_cores", "%zu", maliGpuIds.size());
+    xml.attributef("gpu_cores", "%zu", maliGpuIds.size());
     //gatord src md5
-    mxmlElementSetAttrf(target, "gatord_src_md5sum", "%s", gSrcMd5);
+    xml.attributef("gatord_src_md5sum", "%s", gSrcMd5);
     //gatord build commit id
-    mxmlElementSetAttrf(target, "gatord_build_id", "%s", STRIFY(GATORD_BUILD_ID));
+    xml.attributef("gatord_build_id", "%s", STRIFY(GATORD_BUILD_ID));
 
     assert(cpuIds.size() > 0); // gatord should've died earlier if there were no cpus
-    mxmlElementSetAttrf(target, "cpuid", "0x%x", *std::max_element(begin(cpuIds), end(cpuIds)));
+    xml.attributef("cpuid", "0x%x", *std::max_element(begin(cpuIds), end(cpuIds)));
 
     /* SDDAP-10049: Removed `&& (gSessionData.mSampleRate > 0)` - this allows sample rate: none
      * to work with live mode, at the risk that live display is 'jittery' as data sending is dependent
      * on CPU's being active and doing some context switching. */
     if (!gSessionData.mOneShot) {
-        mxmlElementSetAttr(target, "supports_live", "yes");
+        xml.attribute("supports_live", "yes");
     }
 
     if (gSessionData.mLocalCapture) {
-        mxmlElementSetAttr(target, "local_capture", "yes");
+        xml.attribute("local_capture", "yes");
     }
 
     // add some OS information
 #if defined(GATOR_TARGET_OS)
-    mxmlElementSetAttr(target, "os", GATOR_TARGET_OS);
+    xml.attribute("os", GATOR_TARGET_OS);
 #if defined(GATOR_TARGET_OS_VERSION)
-    mxmlElementSetAttrf(target, "os_version", GATOR_TARGET_OS_VERSION_FMT, GATOR_TARGET_OS_VERSION);
+    xml.attributef("os_version", GATOR_TARGET_OS_VERSION_FMT, GATOR_TARGET_OS_VERSION);
 #endif
 #endif
+    xml.endElement(); // target
 
     // add mali gpu ids
     if (!maliGpuIds.empty()) {
@@ -132,45 +139,53 @@ static mxml_node_t * getTree(bool includeTime,
             uniqueGpuIds.insert(gpuid.second);
         }
 
-        mxml_node_t * const gpuids = mxmlNewElement(captured, "gpus");
+        xml.startElement("gpus");
 
         for (unsigned gpuid : uniqueGpuIds) {
-            mxml_node_t * const node = mxmlNewElement(gpuids, "gpu");
-            mxmlElementSetAttrf(node, "id", "0x%x", gpuid);
+            xml.startElement("gpu");
+            xml.attributef("id", "0x%x", gpuid);
+            xml.endElement();
         }
+
+        xml.endElement(); // gpus
     }
 
-    mxml_node_t * counters = nullptr;
+    bool hasCounters = false;
     for (const auto & counter : gSessionData.mCounters) {
         if (counter.isEnabled()) {
-            if (counters == nullptr) {
-                counters = mxmlNewElement(captured, "counters");
+            if (!hasCounters) {
+                xml.startElement("counters");
+                hasCounters = true;
             }
-            mxml_node_t * const node = mxmlNewElement(counters, "counter");
-            mxmlElementSetAttrf(node, "key", "0x%x", counter.getKey());
-            mxmlElementSetAttr(node, "type", counter.getType());
+            xml.startElement("counter");
+            xml.attributef("key", "0x%x", counter.getKey());
+            xml.attribute("type", counter.getType());
             if (counter.getEvent() != -1) {
-                mxmlElementSetAttrf(node, "event", "0x%x", counter.getEvent());
+                xml.attributef("event", "0x%x", counter.getEvent());
             }
             if (counter.getCount() > 0) {
-                mxmlElementSetAttrf(node, "count", "%d", counter.getCount());
+                xml.attributef("count", "%d", counter.getCount());
             }
             if (counter.getCores() > 0) {
-                mxmlElementSetAttrf(node, "cores", "%d", counter.getCores());
+                xml.attributef("cores", "%d", counter.getCores());
             }
+            xml.endElement();
         }
     }
 
     for (const auto & spe : spes) {
-        if (counters == nullptr) {
-            counters = mxmlNewElement(captured, "counters");
+        if (!hasCounters) {
+            xml.startElement("counters");
+            hasCounters = true;
         }
-        mxml_node_t * const node = mxmlNewElement(counters, "spe");
-        mxmlElementSetAttrf(node, "key", "0x%x", spe.key);
-        mxmlElementSetAttr(node, "id", spe.id.c_str());
+        xml.startElement("spe");
+        xml.attributef("key", "0x%x", spe.key);
+        xml.attribute("id", spe.id.c_str());
+        xml.endElement();
     }
 
-    return xml;
+    // ends counters and captured
+    return xml.release();
 }
 
 namespace captured_xml {
@@ -179,13 +194,11 @@ namespace captured_xml {
                                                    const PrimarySourceProvider & primarySourceProvider,
                                                    const std::map<unsigned, unsigned> & maliGpuIds)
     {
-        mxml_node_t * xml = getTree(includeTime, spes, primarySourceProvider, maliGpuIds);
-        char * xml_string = mxmlSaveAllocString(xml, mxmlWhitespaceCB);
-        mxmlDelete(xml);
-        return {xml_string, &free};
+        return getXmlString(includeTime, gSessionData.mCompression, spes, primarySourceProvider, maliGpuIds);
     }
 
     void write(const char * path,
+               bool compressed,
                lib::Span<const CapturedSpe> spes,
                const PrimarySourceProvider & primarySourceProvider,
                const std::map<unsigned, unsigned> & maliGpuIds)
@@ -194,7 +207,7 @@ namespace captured_xml {
         // Set full path
         snprintf(file, PATH_MAX, "%s/captured.xml", path);
 
-        if (writeToDisk(file, getXML(true, spes, primarySourceProvider, maliGpuIds).get()) < 0) {
+        if (writeToDisk(file, getXmlString(true, compressed, spes, primarySourceProvider, maliGpuIds).get()) < 0) {
             logg.logError("Error writing %s\nPlease verify the path.", file);
             handleException();
         }
@@ -23,7 +23,11 @@ namespace captured_xml {
                                                    lib::Span<const CapturedSpe> spes,
                                                    const PrimarySourceProvider & primarySourceProvider,
                                                    const std::map<unsigned, unsigned> & maliGpuIds);
+    /**
+     * @param compressed Whether the data file in path is lz4 compressed, which only the primary capture may be
+     */
     void write(const char * path,
+               bool compressed,
                lib::Span<const CapturedSpe> spes,
                const PrimarySourceProvider & primarySourceProvider,
                const std::map<unsigned, unsigned> & maliGpuIds);
@@ -10,6 +10,7 @@
 #include "Drivers.h"
 #include "ExternalSource.h"
 #include "ICpuInfo.h"
+#include "ISender.h"
 #include "LocalCapture.h"
 #include "Logging.h"
 #include "Monitor.h"
@@ -20,6 +21,7 @@
 #include "Sender.h"
 #include "SessionData.h"
 #include "StreamlineSetup.h"
+#include "ThreadFactory.h"
 #include "UserSpaceSource.h"
 #include "armnn/Source.h"
 #include "lib/Assert.h"
@@ -28,17 +30,42 @@
 #include "lib/Waiter.h"
 #include "mali_userspace/MaliHwCntrSource.h"
 #include "xml/EventsXML.h"
+#include "xml/MxmlUtils.h"
 
 #include <algorithm>
+#include <cinttypes>
 #include <cstdlib>
 #include <cstring>
 #include <sys/eventfd.h>
 #include <sys/prctl.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
 #include <utility>
 
+namespace {
+    /** Counts the bytes each source writes, for GatordDriver */
+    class CountingSender : public ISender {
+    public:
+        CountingSender(ISender & sender, std::atomic<std::uint64_t> & total) : mSender(sender), mTotal(total) {}
+
+        void writeDataParts(lib::Span<const lib::Span<const char, int>> dataParts,
+                            ResponseType type,
+                            bool ignoreLockErrors) override
+        {
+            for (const auto & data : dataParts) {
+                GatordStats::add(mTotal, data.length);
+            }
+            mSender.writeDataParts(dataParts, type, ignoreLockErrors);
+        }
+
+    private:
+        ISender & mSender;
+        std::atomic<std::uint64_t> & mTotal;
+    };
+}
+
 std::atomic<Child *> Child::gSingleton = ATOMIC_VAR_INIT(nullptr);
 
 extern void cleanUp();
@@ -66,6 +93,12 @@ void handleException()
             logg.logError("Could not remove incomplete APC directory.");
         }
     }
+    for (const char * apcDir : gSessionData.mMirrorAPCDirs) {
+        logg.logMessage("Cleaning incomplete mirror APC directory %s.", apcDir);
+        if (local_capture::removeDirAndAllContents(apcDir) != 0) {
+            logg.logError("Could not remove incomplete mirror APC directory %s.", apcDir);
+        }
+    }
 
     // don't call exit handlers / global destructors
     // because other threads may be still running
@@ -74,12 +107,12 @@ void handleException()
 
 std::unique_ptr<Child> Child::createLocal(Drivers & drivers, const Child::Config & config)
 {
-    return std::unique_ptr<Child>(new Child(drivers, nullptr, config));
+    return std::unique_ptr<Child>(new Child(drivers, nullptr, {}, config));
 }
 
-std::unique_ptr<Child> Child::createLive(Drivers & drivers, OlySocket & sock)
+std::unique_ptr<Child> Child::createLive(Drivers & drivers, OlySocket & sock, lib::AutoClosingFd watcherChannel)
 {
-    return std::unique_ptr<Child>(new Child(drivers, &sock, {}));
+    return std::unique_ptr<Child>(new Child(drivers, &sock, std::move(watcherChannel), {}));
 }
 
 Child * Child::getSingleton()
@@ -99,7 +132,7 @@ void Child::signalHandler(int signum)
     singleton->endSession(signum);
 }
 
-Child::Child(Drivers & drivers, OlySocket * sock, Child::Config config)
+Child::Child(Drivers & drivers, OlySocket * sock, lib::AutoClosingFd watcherChannel, Child::Config config)
     : haltPipeline(),
       senderSem(),
       primarySource(),
@@ -107,6 +140,7 @@ Child::Child(Drivers & drivers, OlySocket * sock, Child::Config config)
       drivers(drivers),
       socket(sock),
       numExceptions(0),
+      watcherChannel(std::move(watcherChannel)),
       sessionEnded(),
       config(std::move(config))
 {
@@ -149,11 +183,19 @@ void Child::run()
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-child"), 0, 0, 0);
 
     // Disable line wrapping when generating xml files; carriage returns and indentation to be added manually
-    mxmlSetWrapMargin(0);
+    setMxmlWrapMargin(0);
 
     // Instantiate the Sender - must be done first, after which error messages can be sent
     sender.reset(new Sender(socket));
 
+    // Connections made from now on see the capture data from the start
+    std::thread watcherThread {};
+    if (watcherChannel) {
+        sender->keepHistory(gSessionData.mWatchHistorySize);
+        watcherThread =
+            thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { watcherThreadEntryPoint(); });
+    }
+
     auto & primarySourceProvider = drivers.getPrimarySourceProvider();
     // Populate gSessionData with the configuration
 
@@ -239,12 +281,24 @@ void Child::run()
         }
 
         local_capture::createAPCDirectory(gSessionData.mTargetPath);
-        local_capture::copyImages(gSessionData.mImages);
+        local_capture::copyImages(gSessionData.mAPCDir, gSessionData.mImages);
         sender->createDataFile(gSessionData.mAPCDir);
         // Write events XML
-        events_xml::write(gSessionData.mAPCDir,
-                          drivers.getAllConst(),
-                          primarySourceProvider.getCpuInfo().getClusters());
+        events_xml::write(gSessionData.mAPCDir, drivers.getStaticEventsXml(), drivers.getAllConst());
+    }
+
+    // Each mirror is a complete copy of the capture, in both live and local mode
+    for (const char * target : gSessionData.mMirrorTargets) {
+        const char * const apcDir = local_capture::createMirrorAPCDirectory(target);
+        gSessionData.mMirrorAPCDirs.push_back(apcDir);
+        local_capture::copyImages(apcDir, gSessionData.mImages);
+        sender->addMirror(apcDir, gSessionData.mMirrorPolicy);
+        events_xml::write(apcDir, drivers.getStaticEventsXml(), drivers.getAllConst());
+    }
+
+    // Everything from here on is capture data so may be compressed
+    if (gSessionData.mCompression) {
+        sender->startCompression();
     }
 
     std::set<int> appPids;
@@ -274,7 +328,7 @@ void Child::run()
 
     // set up stop thread early, so that ping commands get replied to, even if the
     // setup phase below takes a long time.
-    std::thread stopThread {[this]() { stopThreadEntryPoint(); }};
+    std::thread stopThread = thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { stopThreadEntryPoint(); });
 
     if (gSessionData.mWaitForProcessCommand != nullptr) {
         logg.logMessage("Waiting for pids for command '%s'", gSessionData.mWaitForProcessCommand);
@@ -324,29 +378,52 @@ void Child::run()
         // Initialize ftrace source before child as it's slow and depends on nothing else
         // If initialized later, us gator with ftrace has time sync issues
         // Must be initialized before senderThread is started as senderThread checks externalSource
-        if (!prepareAndStart(new ExternalSource(*this, senderSem, drivers))) {
+        prepareStartedNs = GatordStats::nowNs();
+        if (!prepareAndStart(new ExternalSource(*this, senderSem, drivers), GatordStats::SourceKind::EXTERNAL)) {
             logg.logError("Unable to prepare external source for capture");
             handleException();
         }
 
-        // Must be after session XML is parsed
-        if (!primarySource->prepare()) {
-            logg.logError("%s", primarySourceProvider.getPrepareFailedMessage());
-            handleException();
-        }
         auto getMonotonicStarted = [&primarySourceProvider]() -> std::int64_t {
             return primarySourceProvider.getMonotonicStarted();
         };
+
+        // These only use the primary source's start time once they run, so may be set up while it is prepared
+        std::vector<IndependentSource> independentSources;
         // initialize midgard hardware counters
         if (drivers.getMaliHwCntrs().countersEnabled()) {
-            if (!prepareAndStart(new mali_userspace::MaliHwCntrSource(*this,
-                                                                      senderSem,
-                                                                      getMonotonicStarted,
-                                                                      drivers.getMaliHwCntrs()))) {
-                logg.logError("Unable to prepare midgard hardware counters source for capture");
-                handleException();
-            }
+            independentSources.push_back({[&]() -> Source * {
+                                              return new mali_userspace::MaliHwCntrSource(*this,
+                                                                                          senderSem,
+                                                                                          getMonotonicStarted,
+                                                                                          drivers.getMaliHwCntrs());
+                                          },
+                                          GatordStats::SourceKind::MALI_HWCNTR,
+                                          "midgard hardware counters"});
         }
+        if (UserSpaceSource::shouldStart(drivers.getAllPolledConst())) {
+            independentSources.push_back({[&]() -> Source * {
+                                              return new UserSpaceSource(*this,
+                                                                         senderSem,
+                                                                         getMonotonicStarted,
+                                                                         drivers.getAllPolled());
+                                          },
+                                          GatordStats::SourceKind::USERSPACE,
+                                          "userspace"});
+        }
+        independentSources.push_back({[&]() -> Source * {
+                                          return new armnn::Source(*this,
+                                                                   drivers.getArmnnDriver().getCaptureController(),
+                                                                   senderSem,
+                                                                   getMonotonicStarted);
+                                      },
+                                      GatordStats::SourceKind::ARMNN,
+                                      "ArmNN"});
+
+        // The primary source must be prepared after session XML is parsed
+        prepareConcurrently(independentSources, primarySourceProvider.getPrepareFailedMessage());
+        logg.logMessage("Sources prepared in %" PRIu64 " ms",
+                        static_cast<std::uint64_t>((GatordStats::nowNs() - prepareStartedNs) / NS_PER_MS));
 
         // Sender thread shall be halted until it is signaled for one shot mode
         sem_init(&haltPipeline, 0, gSessionData.mOneShot ? 0 : 2);
@@ -356,33 +433,22 @@ void Child::run()
 
         std::thread durationThread {};
         if (gSessionData.mDuration > 0) {
-            durationThread = std::thread([&]() { durationThreadEntryPoint(waitTillStart, waitTillEnd); });
+            durationThread = thread_factory::create(ThreadRole::HOUSEKEEPING,
+                                                    [&]() { durationThreadEntryPoint(waitTillStart, waitTillEnd); });
         }
 
         std::thread watchPidsThread {};
         if (gSessionData.mStopOnExit && !watchPids.empty()) {
-            watchPidsThread = std::thread([&]() { watchPidsThreadEntryPoint(watchPids, waitTillEnd); });
-        }
-
-        if (UserSpaceSource::shouldStart(drivers.getAllPolledConst())) {
-            if (!prepareAndStart(new UserSpaceSource(*this, senderSem, getMonotonicStarted, drivers.getAllPolled()))) {
-                logg.logError("Unable to prepare userspace source for capture");
-                handleException();
-            }
-        }
-
-        if (!prepareAndStart(new armnn::Source(*this,
-                                               drivers.getArmnnDriver().getCaptureController(),
-                                               senderSem,
-                                               getMonotonicStarted))) {
-            logg.logError("Unable to prepare ArmNN source for capture");
-            handleException();
+            watchPidsThread = thread_factory::create(ThreadRole::HOUSEKEEPING,
+                                                     [&]() { watchPidsThreadEntryPoint(watchPids, waitTillEnd); });
         }
 
         // must start sender thread after we've added all sources
-        std::thread senderThread {[this]() { senderThreadEntryPoint(); }};
+        std::thread senderThread =
+            thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { senderThreadEntryPoint(); });
 
-        // Start profiling
+        // Start profiling, the primary source runs on this thread
+        thread_factory::applyPlacement(ThreadRole::SOURCE);
         primarySource->run();
 
         logg.logMessage("Primary source finished running");
@@ -406,14 +472,27 @@ void Child::run()
 
     stopThread.join();
 
-    // Write the captured xml file
+    // The compressor only records that it could not send, see StreamCompressor
+    if (!sender->flush()) {
+        handleException();
+    }
+
+    // Write the captured xml file, the mirrors are never compressed
+    std::vector<std::pair<const char *, bool>> apcDirs;
     if (gSessionData.mLocalCapture) {
+        apcDirs.emplace_back(gSessionData.mAPCDir, gSessionData.mCompression);
+    }
+    for (const char * apcDir : gSessionData.mMirrorAPCDirs) {
+        apcDirs.emplace_back(apcDir, false);
+    }
+    for (const auto & apcDir : apcDirs) {
         auto & maliCntrDriver = drivers.getMaliHwCntrs();
-        captured_xml::write(gSessionData.mAPCDir,
+        captured_xml::write(apcDir.first,
+                            apcDir.second,
                             capturedSpes,
                             primarySourceProvider,
                             maliCntrDriver.getDeviceGpuIds());
-        counters_xml::write(gSessionData.mAPCDir,
+        counters_xml::write(apcDir.first,
                             primarySourceProvider.supportsMultiEbs(),
                             drivers.getAllConst(),
                             primarySourceProvider.getCpuInfo());
@@ -422,7 +501,14 @@ void Child::run()
     logg.logMessage("Profiling ended.");
 
     otherSources.clear();
+    otherSourceKinds.clear();
     primarySource.reset();
+
+    // Unblocks receiveFd, gator-main then refuses any more connections
+    if (watcherThread.joinable()) {
+        shutdown(*watcherChannel, SHUT_RDWR);
+        watcherThread.join();
+    }
     sender.reset();
 
     if (command) {
@@ -432,19 +518,78 @@ void Child::run()
     }
 }
 
-bool Child::prepareAndStart(Source * source)
+bool Child::prepareAndStart(Source * source, GatordStats::SourceKind kind)
 {
     std::unique_ptr<Source> s(source);
     if (!source->prepare()) {
         return false;
     }
+    start(std::move(s), kind);
+    return true;
+}
+
+std::vector<std::unique_ptr<Source>> Child::createAndPrepare(const std::vector<IndependentSource> & sources,
+                                                            const std::function<bool()> & prepareOnThisThread,
+                                                            bool & preparedOnThisThread)
+{
+    std::vector<std::unique_ptr<Source>> preparedSources(sources.size());
+    // not a vector<bool>, as each thread sets its own element
+    std::unique_ptr<bool[]> prepared(new bool[sources.size()]());
+
+    std::vector<std::thread> threads;
+    for (std::size_t index = 0; index < sources.size(); ++index) {
+        threads.push_back(thread_factory::create(ThreadRole::SOURCE, [&, index]() {
+            prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-prepare"), 0, 0, 0);
+            preparedSources[index].reset(sources[index].create());
+            prepared[index] = preparedSources[index]->prepare();
+        }));
+    }
+
+    preparedOnThisThread = prepareOnThisThread();
+
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    for (std::size_t index = 0; index < sources.size(); ++index) {
+        if (!prepared[index]) {
+            preparedSources[index].reset();
+        }
+    }
+
+    return preparedSources;
+}
+
+void Child::prepareConcurrently(const std::vector<IndependentSource> & sources,
+                                const char * const primaryPrepareFailedMessage)
+{
+    bool primaryPrepared = false;
+    std::vector<std::unique_ptr<Source>> preparedSources =
+        createAndPrepare(sources, [this]() { return primarySource->prepare(); }, primaryPrepared);
+
+    if (!primaryPrepared) {
+        logg.logError("%s", primaryPrepareFailedMessage);
+        handleException();
+    }
+
+    for (std::size_t index = 0; index < sources.size(); ++index) {
+        if (!preparedSources[index]) {
+            logg.logError("Unable to prepare %s source for capture", sources[index].description);
+            handleException();
+        }
+        start(std::move(preparedSources[index]), sources[index].kind);
+    }
+}
+
+void Child::start(std::unique_ptr<Source> source, GatordStats::SourceKind kind)
+{
     source->start();
     std::lock_guard<std::mutex> lock {sessionEndedMutex};
     if (sessionEnded) {
         source->interrupt();
     }
-    otherSources.push_back(std::move(s));
-    return true;
+    otherSources.push_back(std::move(source));
+    otherSourceKinds.push_back(kind);
 }
 
 void Child::endSession(int signum)
@@ -500,6 +645,7 @@ void Child::cleanupException()
         if (sender) {
             // send the error, regardless of the command sent by Streamline
             sender->writeData(logg.getLastError(), strlen(logg.getLastError()), ResponseType::ERROR, true);
+            sender->flush();
 
             // cannot close the socket before Streamline issues the command, so wait for the command before exiting
             if (gSessionData.mWaitingOnCommand) {
@@ -609,6 +755,27 @@ void Child::stopThreadEntryPoint()
     logg.logMessage("Exit stop thread");
 }
 
+void Child::watcherThreadEntryPoint()
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-watchers"), 0, 0, 0);
+
+    while (true) {
+        const int fd = receiveFd(*watcherChannel);
+        if (fd < 0) {
+            break;
+        }
+
+        if (sender->addWatcher(std::unique_ptr<OlySocket>(new OlySocket(fd)), gSessionData.mMirrorPolicy)) {
+            logg.logMessage("Connection %d is watching the capture", fd);
+        }
+        else {
+            logg.logMessage("Refused connection %d as the capture is too long to watch", fd);
+        }
+    }
+
+    logg.logMessage("Exit watcher thread");
+}
+
 void Child::senderThreadEntryPoint()
 {
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-sender"), 0, 0, 0);
@@ -634,18 +801,18 @@ void Child::senderThreadEntryPoint()
             }
         }
 
-        for (auto & source : otherSources) {
-            source->write(*sender);
+        for (std::size_t index = 0; index < otherSources.size(); ++index) {
+            writeSource(*otherSources[index], otherSourceKinds[index]);
         }
-        primarySource->write(*sender);
+        writeSource(*primarySource, GatordStats::SourceKind::PRIMARY);
     }
 
     // flush one more time to ensure any slop is cleared up
     {
-        for (auto & source : otherSources) {
-            source->write(*sender);
+        for (std::size_t index = 0; index < otherSources.size(); ++index) {
+            writeSource(*otherSources[index], otherSourceKinds[index]);
         }
-        primarySource->write(*sender);
+        writeSource(*primarySource, GatordStats::SourceKind::PRIMARY);
     }
 
     // write end-of-capture sequence
@@ -656,6 +823,23 @@ void Child::senderThreadEntryPoint()
     logg.logMessage("Exit sender thread");
 }
 
+void Child::writeSource(Source & source, GatordStats::SourceKind kind)
+{
+    auto & sourceBytes = gGatordStats.mSourceBytes[static_cast<int>(kind)];
+    const std::uint64_t bytesBefore = sourceBytes.load(std::memory_order_relaxed);
+
+    CountingSender countingSender {*sender, sourceBytes};
+    source.write(countingSender);
+
+    if (!sentFirstData && (sourceBytes.load(std::memory_order_relaxed) != bytesBefore)) {
+        sentFirstData = true;
+        const std::uint64_t timeToFirstData = GatordStats::nowNs() - prepareStartedNs;
+        gGatordStats.mTimeToFirstData.store(timeToFirstData, std::memory_order_relaxed);
+        logg.logMessage("First data sent %" PRIu64 " ms after preparing the sources",
+                        static_cast<std::uint64_t>(timeToFirstData / NS_PER_MS));
+    }
+}
+
 void Child::watchPidsThreadEntryPoint(std::set<int> & pids, const lib::Waiter & waiter)
 {
     // rename thread
@@ -4,10 +4,13 @@
 #define __CHILD_H__
 
 #include "Configuration.h"
+#include "GatordStats.h"
 #include "Source.h"
 #include "lib/AutoClosingFd.h"
 
 #include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <semaphore.h>
@@ -33,7 +36,13 @@ public:
     };
 
     static std::unique_ptr<Child> createLocal(Drivers & drivers, const Config & config);
-    static std::unique_ptr<Child> createLive(Drivers & drivers, OlySocket & sock);
+    /**
+     * @param watcherChannel Where gator-main sends the connections made while this session is in progress, which
+     * are added as watchers of it, or invalid to not have any
+     */
+    static std::unique_ptr<Child> createLive(Drivers & drivers,
+                                             OlySocket & sock,
+                                             lib::AutoClosingFd watcherChannel);
 
     ~Child();
 
@@ -41,6 +50,25 @@ public:
 
     void endSession(int signum = 0);
 
+    /** A source that does not depend on the primary source, so may be created and prepared alongside it */
+    struct IndependentSource {
+        std::function<Source *()> create;
+        GatordStats::SourceKind kind;
+        // for the error message if it cannot be prepared
+        const char * description;
+    };
+
+    /**
+     * Creates and prepares each of the sources on its own thread while this thread calls prepareOnThisThread, so
+     * this takes as long as the slowest rather than all of them
+     *
+     * @param preparedOnThisThread Set to what prepareOnThisThread returned
+     * @return The sources in order, with nullptr for those that could not be prepared
+     */
+    static std::vector<std::unique_ptr<Source>> createAndPrepare(const std::vector<IndependentSource> & sources,
+                                                                 const std::function<bool()> & prepareOnThisThread,
+                                                                 bool & preparedOnThisThread);
+
 private:
     friend void ::handleException();
 
@@ -54,19 +82,26 @@ private:
     sem_t senderSem;
     std::unique_ptr<Source> primarySource;
     std::vector<std::unique_ptr<Source>> otherSources {};
+    // parallel to otherSources
+    std::vector<GatordStats::SourceKind> otherSourceKinds {};
     std::unique_ptr<Sender> sender;
     Drivers & drivers;
     OlySocket * socket;
     int numExceptions;
     std::mutex sessionEndedMutex {};
     lib::AutoClosingFd sessionEndEventFd {};
+    lib::AutoClosingFd watcherChannel;
     std::atomic_bool sessionEnded;
     std::atomic_int signalNumber {0};
 
     Config config;
     std::shared_ptr<Command> command {};
+    // when the sources started being prepared, for gatord_time_to_first_data
+    std::uint64_t prepareStartedNs {0};
+    // only used by the sender thread
+    bool sentFirstData {false};
 
-    Child(Drivers & drivers, OlySocket * sock, Config config);
+    Child(Drivers & drivers, OlySocket * sock, lib::AutoClosingFd watcherChannel, Config config);
     // Intentionally unimplemented
     Child(const Child &) = delete;
     Child & operator=(const Child &) = delete;
@@ -77,12 +112,22 @@ private:
      * Prepares and if that was successful, starts and add to other sources
      * return true if prepare did
      */
-    bool prepareAndStart(Source * source);
+    bool prepareAndStart(Source * source, GatordStats::SourceKind kind);
+
+    /**
+     * Prepares the sources with createAndPrepare while this thread prepares the primary source, then starts those
+     * sources and adds them to the other sources in order. Calls handleException if any cannot be prepared
+     */
+    void prepareConcurrently(const std::vector<IndependentSource> & sources, const char * primaryPrepareFailedMessage);
+    /** Starts a prepared source and adds it to other sources */
+    void start(std::unique_ptr<Source> source, GatordStats::SourceKind kind);
 
     void cleanupException();
     void durationThreadEntryPoint(const lib::Waiter & waitTillStart, const lib::Waiter & waitTillEnd);
     void stopThreadEntryPoint();
+    void watcherThreadEntryPoint();
     void senderThreadEntryPoint();
+    void writeSource(Source & source, GatordStats::SourceKind kind);
     void watchPidsThreadEntryPoint(std::set<int> &, const lib::Waiter & waiter);
     void doEndSession();
 };
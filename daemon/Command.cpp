@@ -4,6 +4,7 @@
 
 #include "Logging.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
 #include "lib/FileDescriptor.h"
 
 #include <cstdio>
@@ -238,6 +239,12 @@ Command Command::run(const std::function<void()> & terminationCallback)
             goto fail_exit;
         }
 
+        // Nor should it be confined to the CPUs and scheduling that were chosen for gatord's threads
+        if (!thread_factory::restoreDefaults()) {
+            snprintf(buf, sizeof(buf), "Unable to restore the scheduling of the command: %s", strerror(errno));
+            goto fail_exit;
+        }
+
         if (name != nullptr) {
             if (setgroups(1, &gid) != 0) {
                 snprintf(buf,
@@ -297,7 +304,7 @@ Command Command::run(const std::function<void()> & terminationCallback)
         close(pipefd[1]);
 
         return {pid,
-                std::thread {[pipefd, pid, terminationCallback, &state]() {
+                thread_factory::create(ThreadRole::HOUSEKEEPING, [pipefd, pid, terminationCallback, &state]() {
                     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-command-reader"), 0, 0, 0);
                     char buf[bufSize];
                     ssize_t bytesRead = 0;
@@ -339,7 +346,7 @@ Command Command::run(const std::function<void()> & terminationCallback)
 
                         terminationCallback();
                     }
-                }},
+                }),
                 std::move(sharedData)};
     }
 }
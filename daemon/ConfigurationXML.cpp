@@ -13,6 +13,7 @@
 #include "lib/Format.h"
 #include "xml/EventsXML.h"
 #include "xml/MxmlUtils.h"
+#include "xml/XmlWriter.h"
 
 #include <cstdlib>
 #include <cstring>
@@ -131,8 +132,7 @@ namespace configuration_xml {
             mCounter.setEnabled(false);
         }
         const std::map<std::string, int> counterToEventMap =
-            events_xml::getCounterToEventMap(drivers.getAllConst(),
-                                             drivers.getPrimarySourceProvider().getCpuInfo().getClusters());
+            events_xml::getCounterToEventMap(drivers.getStaticEventsXml(), drivers.getAllConst());
         //Add counter
         int index = 0;
         for (const CounterConfiguration & cc : counterConfigurations) {
@@ -187,9 +187,10 @@ namespace configuration_xml {
             }
         }
 
-        char * str = mxmlSaveAllocString(xml, mxmlWhitespaceCB);
+        XmlWriter writer;
+        writer.writeTree(xml);
         mxmlDelete(xml);
-        return {str, &free};
+        return writer.release();
     }
 
     void getPath(char * path, size_t n)
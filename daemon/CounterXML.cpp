@@ -7,25 +7,28 @@
 #include "Logging.h"
 #include "OlyUtility.h"
 #include "SessionData.h"
-#include "xml/MxmlUtils.h"
 #include "xml/PmuXML.h"
+#include "xml/XmlWriter.h"
 
 #include <cstdlib>
 #include <cstring>
 #include <dirent.h>
 
-static mxml_node_t * getTree(bool supportsMultiEbs, lib::Span<const Driver * const> drivers, const ICpuInfo & cpuInfo)
+static std::unique_ptr<char, void (*)(void *)> getXmlString(bool supportsMultiEbs,
+                                                             lib::Span<const Driver * const> drivers,
+                                                             const ICpuInfo & cpuInfo)
 {
-    auto * const xml = mxmlNewXML("1.0");
-    auto * const counters = mxmlNewElement(xml, "counters");
+    XmlWriter writer;
+    writer.startDocument();
+    writer.startElement("counters");
 
     if (supportsMultiEbs) {
-        mxmlElementSetAttr(counters, "supports-multiple-ebs", "yes");
+        writer.attribute("supports-multiple-ebs", "yes");
     }
 
     int count = 0;
     for (const Driver * driver : drivers) {
-        count += driver->writeCounters(counters);
+        count += driver->writeCounters(writer);
     }
 
     if (count == 0) {
@@ -34,23 +37,26 @@ static mxml_node_t * getTree(bool supportsMultiEbs, lib::Span<const Driver * con
         handleException();
     }
 
-    mxml_node_t * setup = mxmlNewElement(counters, "setup_warnings");
-    mxmlNewText(setup, 0, logg.getSetup());
+    writer.startElement("setup_warnings");
+    writer.text(logg.getSetup());
+    writer.endElement();
 
     // always send the cluster information; even on devices where not all the information is available.
     for (size_t cluster = 0; cluster < cpuInfo.getClusters().size(); ++cluster) {
-        mxml_node_t * node = mxmlNewElement(counters, "cluster");
-        mxmlElementSetAttrf(node, "id", "%zi", cluster);
-        mxmlElementSetAttr(node, "name", cpuInfo.getClusters()[cluster].getId());
+        writer.startElement("cluster");
+        writer.attributef("id", "%zi", cluster);
+        writer.attribute("name", cpuInfo.getClusters()[cluster].getId());
+        writer.endElement();
     }
     for (size_t cpu = 0; cpu < cpuInfo.getClusterIds().size(); ++cpu) {
         if (cpuInfo.getClusterIds()[cpu] >= 0) {
-            mxml_node_t * node = mxmlNewElement(counters, "cpu");
-            mxmlElementSetAttrf(node, "id", "%zu", cpu);
-            mxmlElementSetAttrf(node, "cluster", "%i", cpuInfo.getClusterIds()[cpu]);
+            writer.startElement("cpu");
+            writer.attributef("id", "%zu", cpu);
+            writer.attributef("cluster", "%i", cpuInfo.getClusterIds()[cpu]);
+            writer.endElement();
         }
     }
-    return xml;
+    return writer.release();
 }
 
 namespace counters_xml {
@@ -59,10 +65,7 @@ namespace counters_xml {
                                                    lib::Span<const Driver * const> drivers,
                                                    const ICpuInfo & cpuInfo)
     {
-        mxml_node_t * xml = getTree(supportsMultiEbs, drivers, cpuInfo);
-        auto * const xml_string = mxmlSaveAllocString(xml, mxmlWhitespaceCB);
-        mxmlDelete(xml);
-        return {xml_string, &::free};
+        return getXmlString(supportsMultiEbs, drivers, cpuInfo);
     }
 
     void write(const char * path,
@@ -11,6 +11,7 @@
 
 class Counter;
 struct SpeConfiguration;
+class XmlWriter;
 
 class Driver {
 public:
@@ -36,9 +37,9 @@ public:
     // Performs any actions needed for setup or based on eventsXML
     virtual void readEvents(mxml_node_t * const /*unused*/) {}
 
-    // Emits available counters
+    // Emits available counters as children of the current element
     // @return number of counters added
-    virtual int writeCounters(mxml_node_t * root) const = 0;
+    virtual int writeCounters(XmlWriter & writer) const = 0;
 
     // Emits possible dynamically generated events/counters
     virtual void writeEvents(mxml_node_t * const /*unused*/) const {}
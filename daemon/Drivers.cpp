@@ -40,7 +40,8 @@ Drivers::Drivers(bool systemWide, PmuXML && pmuXml, bool disableCpuOnlining)
       mCcnDriver {},
       mArmnnDriver {},
       all {},
-      allPolled {}
+      allPolled {},
+      mStaticEventsXml {makeMxmlUniquePtr(nullptr)}
 {
     all.push_back(&mPrimarySourceProvider->getPrimaryDriver());
     for (PolledDriver * driver : mPrimarySourceProvider->getAdditionalPolledDrivers()) {
@@ -62,8 +63,8 @@ Drivers::Drivers(bool systemWide, PmuXML && pmuXml, bool disableCpuOnlining)
     all.push_back(&mCcnDriver);
     all.push_back(&mArmnnDriver);
 
-    auto staticEventsXml = events_xml::getStaticTree(mPrimarySourceProvider->getCpuInfo().getClusters());
+    mStaticEventsXml = events_xml::getStaticTree(mPrimarySourceProvider->getCpuInfo().getClusters());
     for (Driver * driver : all) {
-        driver->readEvents(staticEventsXml.get());
+        driver->readEvents(mStaticEventsXml.get());
     }
 }
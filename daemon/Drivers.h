@@ -15,6 +15,7 @@
 #include "lib/Span.h"
 #include "linux/perf/PerfDriver.h"
 #include "mali_userspace/MaliHwCntrDriver.h"
+#include "xml/MxmlUtils.h"
 
 #include <vector>
 
@@ -52,6 +53,12 @@ public:
 
     lib::Span<const PolledDriver * const> getAllPolledConst() const { return allPolled; }
 
+    /**
+     * The commandline/builtin events.xml, parsed once by gator-main so each capture inherits it rather than parsing
+     * it again. See events_xml::getDynamicXML
+     */
+    mxml_node_t & getStaticEventsXml() { return *mStaticEventsXml; }
+
 private:
     mali_userspace::MaliHwCntrDriver mMaliHwCntrs;
     std::unique_ptr<PrimarySourceProvider> mPrimarySourceProvider;
@@ -65,6 +72,7 @@ private:
     armnn::Driver mArmnnDriver;
     std::vector<Driver *> all;
     std::vector<PolledDriver *> allPolled;
+    mxml_unique_ptr mStaticEventsXml;
 
     Drivers(const Drivers &) = delete;
     Drivers & operator=(const Drivers &) = delete;
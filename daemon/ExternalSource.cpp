@@ -11,8 +11,12 @@
 #include "OlySocket.h"
 #include "PrimarySourceProvider.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
 #include "lib/FileDescriptor.h"
 
+#include <algorithm>
+#include <cinttypes>
+#include <climits>
 #include <fcntl.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
@@ -29,6 +33,9 @@ static const char MALI_UTGARD_STARTUP[] = "\0mali-utgard-startup";
 static const char FTRACE_V1[] = "FTRACE 1\n";
 static const char FTRACE_V2[] = "FTRACE 2\n";
 
+// How much a ready channel may read each time round the loop in run, half of mBuffer
+static constexpr int CHANNEL_QUANTUM = 64 * 1024;
+
 ExternalSource::ExternalSource(Child & child, sem_t & senderSem, Drivers & mDrivers)
     : Source(child),
       mBufferSem(),
@@ -44,7 +51,8 @@ ExternalSource::ExternalSource(Child & child, sem_t & senderSem, Drivers & mDriv
       mInterruptFd(-1),
       mMidgardUds(-1),
       mMveUds(-1),
-      mDrivers(mDrivers)
+      mDrivers(mDrivers),
+      mChannels()
 {
     sem_init(&mBufferSem, 0, 0);
 }
@@ -165,7 +173,7 @@ void ExternalSource::run()
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-external"), 0, 0, 0);
 
     // Gator runs at a high priority, reset the priority to the default
-    if (setpriority(PRIO_PROCESS, syscall(__NR_gettid), 0) == -1) {
+    if (!thread_factory::resetPriority(ThreadRole::SOURCE)) {
         logg.logError("setpriority failed");
         handleException();
     }
@@ -263,16 +271,7 @@ void ExternalSource::run()
                 // Means interrupt has been called and mSessionIsActive should be reread
             }
             else {
-                /* This can result in some starvation if there are multiple
-                 * threads which are annotating heavily, but it is not
-                 * recommended that threads annotate that much as it can also
-                 * starve out the gator data.
-                 */
-                while (gSessionData.mSessionIsActive) {
-                    if (!transfer(currTime, fd)) {
-                        break;
-                    }
-                }
+                drain(currTime, fd);
             }
         }
     }
@@ -282,8 +281,11 @@ void ExternalSource::run()
         // Read any slop
         const uint64_t currTime = getTime() - gSessionData.mMonotonicStarted;
         for (int fd : ftraceFds) {
-            transfer(currTime, fd);
-            close(fd);
+            int budget = INT_MAX;
+            if (transfer(currTime, fd, budget) != TransferResult::CLOSED) {
+                logChannel(fd);
+                close(fd);
+            }
         }
         mDrivers.getTtraceDriver().stop();
         mDrivers.getAtraceDriver().stop();
@@ -291,6 +293,10 @@ void ExternalSource::run()
 
     mBuffer.setDone();
 
+    while (!mChannels.empty()) {
+        logChannel(mChannels.begin()->first);
+    }
+
     if (mMveUds >= 0) {
         mDrivers.getMaliVideo().stop(mMveUds);
     }
@@ -300,18 +306,54 @@ void ExternalSource::run()
     close(pipefd[1]);
 }
 
-bool ExternalSource::transfer(const uint64_t currTime, const int fd)
+void ExternalSource::drain(const uint64_t currTime, const int fd)
+{
+    /* Deficit round robin, so one thread annotating heavily cannot starve the other channels. Each round, that is
+     * each time round the loop in run, a ready channel may read up to CHANNEL_QUANTUM bytes. Reads are byte granular
+     * so a channel with more data always uses its whole budget and there is no deficit to carry to the next round.
+     * What it could not read stays in its socket or pipe and, as epoll is level triggered, it is ready again after
+     * the channels that were waiting behind it.
+     */
+    int budget = CHANNEL_QUANTUM;
+    TransferResult result = TransferResult::MORE;
+    while (gSessionData.mSessionIsActive && (budget > 0) && (result == TransferResult::MORE)) {
+        const int before = budget;
+        result = transfer(currTime, fd, budget);
+        if (result != TransferResult::CLOSED) {
+            mChannels[fd].bytes += before - budget;
+        }
+    }
+
+    if ((result == TransferResult::MORE) && (budget <= 0)) {
+        ++mChannels[fd].deferrals;
+    }
+}
+
+void ExternalSource::logChannel(const int fd)
+{
+    const auto it = mChannels.find(fd);
+    if (it == mChannels.end()) {
+        return;
+    }
+    logg.logMessage("External channel %i read %" PRIu64 " bytes, deferred %" PRIu64 " times",
+                    fd,
+                    it->second.bytes,
+                    it->second.deferrals);
+    mChannels.erase(it);
+}
+
+ExternalSource::TransferResult ExternalSource::transfer(const uint64_t currTime, const int fd, int & budget)
 {
     // Wait until there is enough room for the fd, two headers and two ints
     waitFor(7 * buffer_utils::MAXSIZE_PACK32 + 2 * sizeof(uint32_t));
     mBuffer.packInt(fd);
-    const int contiguous = mBuffer.contiguousSpaceAvailable();
-    const int bytes = read(fd, mBuffer.getWritePos(), contiguous);
+    const int wanted = std::min(mBuffer.contiguousSpaceAvailable(), budget);
+    const int bytes = read(fd, mBuffer.getWritePos(), wanted);
     if (bytes < 0) {
         if (errno == EAGAIN) {
             // Nothing left to read
             mBuffer.commit(currTime, true);
-            return false;
+            return TransferResult::EMPTY;
         }
         // Something else failed, close the socket
         mBuffer.commit(currTime, true);
@@ -319,8 +361,9 @@ bool ExternalSource::transfer(const uint64_t currTime, const int fd)
         mBuffer.packInt(fd);
         // Here and other commits, always force-flush the buffer as this frame don't work like others
         mBuffer.commit(currTime, true);
+        logChannel(fd);
         close(fd);
-        return false;
+        return TransferResult::CLOSED;
     }
     else if (bytes == 0) {
         // The other side is closed
@@ -328,15 +371,17 @@ bool ExternalSource::transfer(const uint64_t currTime, const int fd)
         mBuffer.packInt(-1);
         mBuffer.packInt(fd);
         mBuffer.commit(currTime, true);
+        logChannel(fd);
         close(fd);
-        return false;
+        return TransferResult::CLOSED;
     }
 
     mBuffer.advanceWrite(bytes);
     mBuffer.commit(currTime, true);
+    budget -= bytes;
 
     // Short reads also mean nothing is left to read
-    return bytes >= contiguous;
+    return (bytes >= wanted ? TransferResult::MORE : TransferResult::EMPTY);
 }
 
 void ExternalSource::interrupt()
@@ -8,6 +8,8 @@
 #include "OlySocket.h"
 #include "Source.h"
 
+#include <cstdint>
+#include <map>
 #include <semaphore.h>
 
 class Drivers;
@@ -29,7 +31,26 @@ private:
     bool connectMidgard();
     bool connectMve();
     void connectFtrace();
-    bool transfer(uint64_t currTime, int fd);
+
+    enum class TransferResult {
+        /// the budget ran out, there may be more to read
+        MORE,
+        /// nothing left to read for now
+        EMPTY,
+        /// the other side closed or the read failed, fd has been closed
+        CLOSED,
+    };
+
+    TransferResult transfer(uint64_t currTime, int fd, int & budget);
+    void drain(uint64_t currTime, int fd);
+    void logChannel(int fd);
+
+    /// Accounting for each fd data is read from, such as an annotation connection or an ftrace pipe
+    struct Channel {
+        uint64_t bytes;
+        /// rounds that ended with data left because the channel used its whole budget
+        uint64_t deferrals;
+    };
 
     sem_t mBufferSem;
     Buffer mBuffer;
@@ -45,6 +66,7 @@ private:
     int mMidgardUds;
     int mMveUds;
     Drivers & mDrivers;
+    std::map<int, Channel> mChannels;
 
     // Intentionally unimplemented
     ExternalSource(const ExternalSource &) = delete;
@@ -4,6 +4,7 @@
 
 #include "Logging.h"
 #include "lib/Utils.h"
+#include "xml/XmlWriter.h"
 
 #include <fcntl.h>
 #include <regex.h>
@@ -146,14 +147,15 @@ void FSDriver::readEvents(mxml_node_t * const xml)
     }
 }
 
-int FSDriver::writeCounters(mxml_node_t * root) const
+int FSDriver::writeCounters(XmlWriter & writer) const
 {
     int count = 0;
     for (auto * counter = static_cast<FSCounter *>(getCounters()); counter != nullptr;
          counter = static_cast<FSCounter *>(counter->getNext())) {
         if (access(counter->getPath(), R_OK) == 0) {
-            mxml_node_t * node = mxmlNewElement(root, "counter");
-            mxmlElementSetAttr(node, "name", counter->getName());
+            writer.startElement("counter");
+            writer.attribute("name", counter->getName());
+            writer.endElement();
             ++count;
         }
     }
@@ -11,7 +11,7 @@ public:
 
     void readEvents(mxml_node_t * xml) override;
 
-    int writeCounters(mxml_node_t * root) const override;
+    int writeCounters(XmlWriter & writer) const override;
 
 private:
     // Intentionally unimplemented
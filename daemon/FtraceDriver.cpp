@@ -6,6 +6,7 @@
 #include "Logging.h"
 #include "PrimarySourceProvider.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
 #include "Tracepoints.h"
 #include "lib/FileDescriptor.h"
 #include "lib/Utils.h"
@@ -148,8 +149,8 @@ public:
     }
 
     void start();
-    bool interrupt() const;
-    bool join() const;
+    bool interrupt();
+    void join();
 
     static FtraceReader * getHead() { return mHead; }
     FtraceReader * getNext() const { return mNext; }
@@ -159,13 +160,12 @@ private:
     static FtraceReader * mHead;
     FtraceReader * const mNext;
     Barrier * const mBarrier;
-    pthread_t mThread;
+    std::thread mThread;
     const int mCpu;
     const int mTfd;
     const int mPfd0;
     const int mPfd1;
 
-    static void * runStatic(void * arg);
     void run();
 };
 
@@ -173,27 +173,17 @@ FtraceReader * FtraceReader::mHead;
 
 void FtraceReader::start()
 {
-    if (pthread_create(&mThread, nullptr, runStatic, this) != 0) {
-        logg.logError("Unable to start the ftraceReader thread");
-        handleException();
-    }
-}
-
-bool FtraceReader::interrupt() const
-{
-    return pthread_kill(mThread, SIGUSR1) == 0;
+    mThread = thread_factory::create(ThreadRole::PER_CPU_READER, [this]() { run(); }, mCpu);
 }
 
-bool FtraceReader::join() const
+bool FtraceReader::interrupt()
 {
-    return pthread_join(mThread, nullptr) == 0;
+    return pthread_kill(mThread.native_handle(), SIGUSR1) == 0;
 }
 
-void * FtraceReader::runStatic(void * arg)
+void FtraceReader::join()
 {
-    auto * const ftraceReader = static_cast<FtraceReader *>(arg);
-    ftraceReader->run();
-    return nullptr;
+    mThread.join();
 }
 
 #ifndef SPLICE_F_MOVE
@@ -221,7 +211,7 @@ void FtraceReader::run()
     }
 
     // Gator runs at a high priority, reset the priority to the default
-    if (setpriority(PRIO_PROCESS, syscall(__NR_gettid), 0) == -1) {
+    if (!thread_factory::resetPriority(ThreadRole::PER_CPU_READER)) {
         logg.logError("setpriority failed");
         handleException();
     }
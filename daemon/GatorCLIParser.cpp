@@ -8,42 +8,64 @@
 #include <algorithm>
 #include <sstream>
 
-static const char OPTSTRING_SHORT[] = "ac:d::e:f:hi:o:p:r:s:t:u:vw:x:A:C:E:F:N:O:P:Q:R:S:VX:Z:";
+static const char OPTSTRING_SHORT[] =
+    "ab:c:d::e:f:hi:j:k:l:m:o:p:r:s:t:u:vw:x:y:z:A:C:D:E:F:G:H:I:J:L:M:N:O:P:Q:R:S:U:VW:X:Y:Z:";
 
 static const struct option OPTSTRING_LONG[] = { // PLEASE KEEP THIS LIST IN ALPHANUMERIC ORDER TO ALLOW EASY SELECTION
                                                 // OF NEW ITEMS.
-    {"allow-command", /*********/ no_argument, /***/ nullptr, 'a'}, //
-    {"config-xml", /************/ required_argument, nullptr, 'c'}, //
-    {"debug", /*****************/ no_argument, /***/ nullptr, 'd'}, //
-    {"events-xml", /************/ required_argument, nullptr, 'e'}, //
-    {"use-efficient-ftrace", /**/ required_argument, nullptr, 'f'}, //
-    {"help", /******************/ no_argument, /***/ nullptr, 'h'}, //
-    {"pid", /*******************/ required_argument, nullptr, 'i'}, //
-    {"output", /****************/ required_argument, nullptr, 'o'}, //
-    {"port", /******************/ required_argument, nullptr, 'p'}, //
-    {"sample-rate", /***********/ required_argument, nullptr, 'r'}, //
-    {"session-xml", /***********/ required_argument, nullptr, 's'}, //
-    {"max-duration", /**********/ required_argument, nullptr, 't'}, //
-    {"call-stack-unwinding", /**/ required_argument, nullptr, 'u'}, //
-    {"version", /***************/ required_argument, nullptr, 'v'}, //
-    {"app-cwd", /***************/ required_argument, nullptr, 'w'}, //
-    {"stop-on-exit", /**********/ required_argument, nullptr, 'x'}, //
-    {"app", /*******************/ required_argument, nullptr, 'A'}, //
-    {"counters", /**************/ required_argument, nullptr, 'C'}, //
-    {"append-events-xml", /*****/ required_argument, nullptr, 'E'}, //
-    {"spe-sample-rate", /*******/ required_argument, nullptr, 'F'}, //
-    /******************************************************** 'N' ***/
-    {"disable-cpu-onlining", /**/ required_argument, nullptr, 'O'}, //
-    {"pmus-xml", /**************/ required_argument, nullptr, 'P'}, //
-    {"wait-process", /**********/ required_argument, nullptr, 'Q'}, //
-    {"print", /*****************/ required_argument, nullptr, 'R'}, //
-    {"system-wide", /***********/ required_argument, nullptr, 'S'}, //
-    {"version", /***************/ no_argument, /***/ nullptr, 'V'}, //
-    {"spe", /*******************/ required_argument, nullptr, 'X'}, //
-    {"mmap-pages", /************/ required_argument, nullptr, 'Z'}, //
+    {"allow-command", /************/ no_argument, /***/ nullptr, 'a'}, //
+    {"adaptive-sampling", /********/ required_argument, nullptr, 'b'}, //
+    {"config-xml", /***************/ required_argument, nullptr, 'c'}, //
+    {"debug", /********************/ no_argument, /***/ nullptr, 'd'}, //
+    {"events-xml", /***************/ required_argument, nullptr, 'e'}, //
+    {"use-efficient-ftrace", /*****/ required_argument, nullptr, 'f'}, //
+    {"help", /*********************/ no_argument, /***/ nullptr, 'h'}, //
+    {"pid", /**********************/ required_argument, nullptr, 'i'}, //
+    {"observer-cpus", /************/ required_argument, nullptr, 'j'}, //
+    {"kernel-filter", /************/ required_argument, nullptr, 'k'}, //
+    {"flight-recorder", /**********/ required_argument, nullptr, 'l'}, //
+    {"multiplex-counters", /*******/ required_argument, nullptr, 'm'}, //
+    {"output", /*******************/ required_argument, nullptr, 'o'}, //
+    {"port", /*********************/ required_argument, nullptr, 'p'}, //
+    {"sample-rate", /**************/ required_argument, nullptr, 'r'}, //
+    {"session-xml", /**************/ required_argument, nullptr, 's'}, //
+    {"max-duration", /*************/ required_argument, nullptr, 't'}, //
+    {"call-stack-unwinding", /*****/ required_argument, nullptr, 'u'}, //
+    {"version", /******************/ required_argument, nullptr, 'v'}, //
+    {"app-cwd", /******************/ required_argument, nullptr, 'w'}, //
+    {"stop-on-exit", /*************/ required_argument, nullptr, 'x'}, //
+    {"watch-history", /************/ required_argument, nullptr, 'y'}, //
+    {"compress", /*****************/ required_argument, nullptr, 'z'}, //
+    {"app", /**********************/ required_argument, nullptr, 'A'}, //
+    {"counters", /*****************/ required_argument, nullptr, 'C'}, //
+    {"mirror-policy", /************/ required_argument, nullptr, 'D'}, //
+    {"append-events-xml", /********/ required_argument, nullptr, 'E'}, //
+    {"spe-sample-rate", /**********/ required_argument, nullptr, 'F'}, //
+    {"aggregate-samples", /********/ required_argument, nullptr, 'G'}, //
+    {"reserved-huge-pages", /******/ required_argument, nullptr, 'H'}, //
+    {"intern-callchains", /********/ required_argument, nullptr, 'I'}, //
+    {"thread-placement", /*********/ required_argument, nullptr, 'J'}, //
+    {"flight-recorder-trigger", /**/ required_argument, nullptr, 'L'}, //
+    {"mirror-output", /************/ required_argument, nullptr, 'M'}, //
+    /*********************************************************** 'N' ***/
+    {"disable-cpu-onlining", /*****/ required_argument, nullptr, 'O'}, //
+    {"pmus-xml", /*****************/ required_argument, nullptr, 'P'}, //
+    {"wait-process", /*************/ required_argument, nullptr, 'Q'}, //
+    {"print", /********************/ required_argument, nullptr, 'R'}, //
+    {"system-wide", /**************/ required_argument, nullptr, 'S'}, //
+    {"userspace-counters", /*******/ required_argument, nullptr, 'U'}, //
+    {"version", /******************/ no_argument, /***/ nullptr, 'V'}, //
+    {"unwind-user-stacks", /*******/ required_argument, nullptr, 'W'}, //
+    {"spe", /**********************/ required_argument, nullptr, 'X'}, //
+    {"spe-single-sync-thread", /***/ required_argument, nullptr, 'Y'}, //
+    {"mmap-pages", /***************/ required_argument, nullptr, 'Z'}, //
     {nullptr, 0, nullptr, 0}};
 
 static const char PRINTABLE_SEPARATOR = ',';
+// perf records are at most 64k, including the copy of the user stack
+static const int MAX_USER_STACK_SIZE = 65528;
+// the history is sent to a new watcher as one message
+static const int MAX_WATCH_HISTORY_MB = 1024;
 
 using ExecutionMode = ParserResult::ExecutionMode;
 
@@ -63,23 +85,40 @@ ParserResult::ParserResult()
       mCaptureWorkingDir(),
       mCaptureCommand(),
       mPids(),
+      mMirrorTargets(),
       mSessionXMLPath(),
       mTargetPath(),
       mConfigurationXMLPath(),
       mEventsXMLPath(),
       mEventsXMLAppend(),
       mWaitForCommand(),
+      mFlightRecorderTrigger(),
       mBacktraceDepth(),
       mSampleRate(),
       mDuration(),
       mAndroidApiLevel(),
       mPerfMmapSizeInPages(-1),
       mSpeSampleRate(-1),
+      mSampleAggregationWindowMs(0),
+      mInternedCallchains(0),
+      mUserStackSize(0),
+      mAdaptiveSamplingMaxScale(1),
+      mWatchHistoryMB(0),
+      mMultiplexCounterLimit(0),
       mFtraceRaw(),
       mStopGator(false),
       mSystemWide(true),
       mAllowCommands(false),
       mDisableCpuOnlining(false),
+      mCompression(false),
+      mSpeSingleSyncThread(false),
+      mFlightRecorder(false),
+      mKernelFilter(false),
+      mUserspaceCounters(false),
+      mMultiplexCounters(false),
+      mReservedHugePages(false),
+      mMirrorPolicy(QueuedSink::SlowConsumerPolicy::BLOCK),
+      mThreadPlacements(),
       pmuPath(nullptr),
       port(DEFAULT_PORT),
       parameterSetFlag(0),
@@ -324,6 +363,7 @@ void GatorCLIParser::parseCLIArguments(int argc,
         argc = indexApp;
     }
     bool systemWideSet = false;
+    std::vector<int> observerCpus;
     optind = 1;
     opterr = 1;
     int c;
@@ -423,6 +463,47 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     return;
                 }
                 break;
+            case 'b': //adaptive-sampling
+                if (!stringToInt(&result.mAdaptiveSamplingMaxScale, optarg, 10) ||
+                    (result.mAdaptiveSamplingMaxScale < 1) || (result.mAdaptiveSamplingMaxScale > 1024)) {
+                    logg.logError("Invalid value for --adaptive-sampling (%s), a number between 1 and 1024 expected.",
+                                  optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'G': //aggregate-samples
+                if (!stringToInt(&result.mSampleAggregationWindowMs, optarg, 10) ||
+                    (result.mSampleAggregationWindowMs < 0)) {
+                    logg.logError("Invalid value for --aggregate-samples (%s), a positive number of milliseconds or 0 "
+                                  "expected.",
+                                  optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'I': //intern-callchains
+                if (!stringToInt(&result.mInternedCallchains, optarg, 10) || (result.mInternedCallchains < 0)) {
+                    logg.logError("Invalid value for --intern-callchains (%s), a positive number of stacks or 0 "
+                                  "expected.",
+                                  optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'W': //unwind-user-stacks
+                if (!stringToInt(&result.mUserStackSize, optarg, 10) || (result.mUserStackSize < 0) ||
+                    (result.mUserStackSize > MAX_USER_STACK_SIZE)) {
+                    logg.logError("Invalid value for --unwind-user-stacks (%s), a number of bytes up to %d or 0 "
+                                  "expected.",
+                                  optarg,
+                                  MAX_USER_STACK_SIZE);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                // perf copies the stack in whole words
+                result.mUserStackSize = (result.mUserStackSize + 7) & ~7;
+                break;
             case 'f': //use-efficient-ftrace
                 result.parameterSetFlag = result.parameterSetFlag | USE_CMDLINE_ARG_FTRACE_RAW;
                 if (optionInt < 0) {
@@ -458,6 +539,119 @@ void GatorCLIParser::parseCLIArguments(int argc,
                 }
                 result.mStopGator = optionInt == 1;
                 break;
+            case 'z': //compress
+                if (optionInt < 0) {
+                    logg.logError("Invalid value for --compress (%s), 'yes' or 'no' expected.", optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                result.mCompression = optionInt == 1;
+                break;
+            case 'Y': //spe-single-sync-thread
+                if (optionInt < 0) {
+                    logg.logError("Invalid value for --spe-single-sync-thread (%s), 'yes' or 'no' expected.", optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                result.mSpeSingleSyncThread = optionInt == 1;
+                break;
+            case 'l': //flight-recorder
+                if (optionInt < 0) {
+                    logg.logError("Invalid value for --flight-recorder (%s), 'yes' or 'no' expected.", optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                result.mFlightRecorder = optionInt == 1;
+                break;
+            case 'L': //flight-recorder-trigger
+                result.mFlightRecorderTrigger = optarg;
+                break;
+            case 'j': //observer-cpus
+                if (!thread_factory::parseCpuList(optarg, observerCpus) || observerCpus.empty()) {
+                    logg.logError("Invalid value for --observer-cpus (%s), a CPU list such as '0-1,4' expected.",
+                                  optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'J': //thread-placement
+                if (!thread_factory::parsePlacement(optarg, result.mThreadPlacements)) {
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'k': //kernel-filter
+                if (optionInt < 0) {
+                    logg.logError("Invalid value for --kernel-filter (%s), 'yes' or 'no' expected.", optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                result.mKernelFilter = optionInt == 1;
+                break;
+            case 'H': //reserved-huge-pages
+                if (optionInt < 0) {
+                    logg.logError("Invalid value for --reserved-huge-pages (%s), 'yes' or 'no' expected.", optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                result.mReservedHugePages = optionInt == 1;
+                break;
+            case 'U': //userspace-counters
+                if (optionInt < 0) {
+                    logg.logError("Invalid value for --userspace-counters (%s), 'yes' or 'no' expected.", optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                result.mUserspaceCounters = optionInt == 1;
+                break;
+            case 'm': //multiplex-counters
+                if (optionInt >= 0) {
+                    result.mMultiplexCounters = optionInt == 1;
+                    result.mMultiplexCounterLimit = 0;
+                }
+                else if (stringToInt(&result.mMultiplexCounterLimit, optarg, 10) &&
+                         (result.mMultiplexCounterLimit > 0)) {
+                    result.mMultiplexCounters = true;
+                }
+                else {
+                    logg.logError("Invalid value for --multiplex-counters (%s), 'yes', 'no' or a number of counters "
+                                  "greater than 0 expected.",
+                                  optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'M': //mirror-output
+                result.mMirrorTargets.push_back(optarg);
+                break;
+            case 'y': //watch-history
+                if (!stringToInt(&result.mWatchHistoryMB, optarg, 10) || (result.mWatchHistoryMB < 0) ||
+                    (result.mWatchHistoryMB > MAX_WATCH_HISTORY_MB)) {
+                    logg.logError("Invalid value for --watch-history (%s), a number of megabytes from 0 to %d "
+                                  "expected.",
+                                  optarg,
+                                  MAX_WATCH_HISTORY_MB);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
+            case 'D': //mirror-policy
+                if (strcmp(optarg, "block") == 0) {
+                    result.mMirrorPolicy = QueuedSink::SlowConsumerPolicy::BLOCK;
+                }
+                else if (strcmp(optarg, "drop") == 0) {
+                    result.mMirrorPolicy = QueuedSink::SlowConsumerPolicy::DROP;
+                }
+                else if (strcmp(optarg, "disconnect") == 0) {
+                    result.mMirrorPolicy = QueuedSink::SlowConsumerPolicy::DISCONNECT;
+                }
+                else {
+                    logg.logError("Invalid value for --mirror-policy (%s), 'block', 'drop' or 'disconnect' expected.",
+                                  optarg);
+                    result.mode = ExecutionMode::EXIT;
+                    return;
+                }
+                break;
             case 'C': //counter
                 if (perfCounterCount > maxPerformanceCounter) {
                     continue;
@@ -557,6 +751,97 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                        is useful for kernels that fail to\n"
                     "                                        handle this correctly (e.g., they\n"
                     "                                        reboot) (defaults to 'no').\n"
+                    "  -b|--adaptive-sampling <n>            Allow the sample periods to be stretched\n"
+                    "                                        by up to <n> times while the perf\n"
+                    "                                        buffers are filling faster than they\n"
+                    "                                        can be sent. Each change is recorded in\n"
+                    "                                        the capture (defaults to '1', disabled)\n"
+                    "  -G|--aggregate-samples <ms>           Count event based samples per thread\n"
+                    "                                        and call stack over windows of <ms>\n"
+                    "                                        milliseconds instead of sending every\n"
+                    "                                        sample, for long captures (defaults to\n"
+                    "                                        '0', disabled)\n"
+                    "  -I|--intern-callchains <n>            Send each distinct call stack once and\n"
+                    "                                        refer to it by id in later samples,\n"
+                    "                                        remembering up to <n> stacks. The host\n"
+                    "                                        must support stack definition frames\n"
+                    "                                        (defaults to '0', disabled)\n"
+                    "  -W|--unwind-user-stacks <bytes>       Copy up to <bytes> of the user stack\n"
+                    "                                        with each sample and unwind it in\n"
+                    "                                        gatord from the binaries' .eh_frame or\n"
+                    "                                        .ARM.exidx tables, for code built\n"
+                    "                                        without frame pointers. Requires call\n"
+                    "                                        stack unwinding (defaults to '0',\n"
+                    "                                        disabled)\n"
+                    "  -Y|--spe-single-sync-thread (yes|no)  Take the SPE timestamp sync records for\n"
+                    "                                        all CPUs from one thread rather than a\n"
+                    "                                        real time thread per CPU. Only valid if\n"
+                    "                                        the generic timer is synchronized across\n"
+                    "                                        all CPUs (defaults to 'no')\n"
+                    "  -l|--flight-recorder (yes|no)         Keep only the most recent perf data,\n"
+                    "                                        as much as fits in the perf buffers,\n"
+                    "                                        and write it out when the capture ends\n"
+                    "                                        rather than streaming it. The mmap and\n"
+                    "                                        comm records of processes that start\n"
+                    "                                        during the capture are overwritten\n"
+                    "                                        too, so samples of those processes may\n"
+                    "                                        not be attributed to their code.\n"
+                    "                                        Requires Linux 4.7 or later and cannot\n"
+                    "                                        be used with SPE (defaults to 'no')\n"
+                    "  -L|--flight-recorder-trigger <file>   With --flight-recorder, end the capture\n"
+                    "                                        as soon as <file> exists\n"
+                    "  -k|--kernel-filter (yes|no)           With --system-wide=yes and a process to\n"
+                    "                                        profile, have the kernel discard the\n"
+                    "                                        samples of all other processes rather\n"
+                    "                                        than sending them. Requires Linux 4.9\n"
+                    "                                        or later and root, samples from all\n"
+                    "                                        processes are sent if unavailable\n"
+                    "                                        (defaults to 'no')\n"
+                    "  -H|--reserved-huge-pages (yes|no)     Back gatord's buffers with the huge\n"
+                    "                                        pages reserved through\n"
+                    "                                        /proc/sys/vm/nr_hugepages when there\n"
+                    "                                        are enough, rather than only asking for\n"
+                    "                                        transparent huge pages. These are taken\n"
+                    "                                        from the pool the profiled workload may\n"
+                    "                                        need (defaults to 'no')\n"
+                    "  -U|--userspace-counters (yes|no)      Read the CPU counters that are not\n"
+                    "                                        event based from a gatord thread on\n"
+                    "                                        each CPU, with rdpmc where the kernel\n"
+                    "                                        allows it, instead of having perf\n"
+                    "                                        sample them. Counters are then not\n"
+                    "                                        attributed to threads (defaults to 'no')\n"
+                    "  -m|--multiplex-counters (yes|no|<n>)  Split the counters of each PMU into\n"
+                    "                                        groups that fit it and have the kernel\n"
+                    "                                        rotate through them, recording how long\n"
+                    "                                        each group ran so the host can scale the\n"
+                    "                                        counts. Requires --system-wide=yes and\n"
+                    "                                        Linux 3.12 or later (defaults to 'no').\n"
+                    "                                        For testing, <n> splits them into\n"
+                    "                                        groups of <n> instead, software counters\n"
+                    "                                        included\n"
+                    "  -j|--observer-cpus <cpu_list>         Run gatord's source and housekeeping\n"
+                    "                                        threads on these CPUs, for example\n"
+                    "                                        '0-1', unless --thread-placement gives\n"
+                    "                                        them cpus of their own. Threads that\n"
+                    "                                        read one CPU always run on that CPU\n"
+                    "  -J|--thread-placement                 Where and how the threads of a role\n"
+                    "     <role>:<key>=<value>[:...]         run, may be given once per role. <role>\n"
+                    "                                        is reader, source or housekeeping and\n"
+                    "                                        <key> is one of cpus=<cpu_list> (not\n"
+                    "                                        for reader), nice=<-20..19>,\n"
+                    "                                        policy=(other|batch|idle|fifo|rr),\n"
+                    "                                        priority=<0..99> or node=<numa_node>.\n"
+                    "                                        For example\n"
+                    "                                        'housekeeping:cpus=0:nice=10'\n"
+                    "  -M|--mirror-output <apc_dir>          Also write a complete copy of the\n"
+                    "                                        capture to <apc_dir>. May be given more\n"
+                    "                                        than once\n"
+                    "  -D|--mirror-policy                    What to do when a --mirror-output or a\n"
+                    "     (block|drop|disconnect)            --watch-history connection cannot keep\n"
+                    "                                        up: slow the capture down, discard data\n"
+                    "                                        for that copy only, which may leave it\n"
+                    "                                        unreadable, or stop writing that copy\n"
+                    "                                        (defaults to 'block')\n"
                     "* Arguments available in daemon mode only:\n"
                     "  -p|--port <port_number>|uds           Port upon which the server listens;\n"
                     "                                        default is 8080.\n"
@@ -574,6 +859,13 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                        in Streamline.\n"
                     "  -a|--allow-command                    Allow the user to issue a command from\n"
                     "                                        Streamline\n"
+                    "  -y|--watch-history <MB>               Let further connections watch a live\n"
+                    "                                        capture instead of refusing them while\n"
+                    "                                        it is in progress. Each is sent the\n"
+                    "                                        capture data from the start so must\n"
+                    "                                        connect before <MB> megabytes of it\n"
+                    "                                        have been sent (defaults to '0',\n"
+                    "                                        disabled)\n"
                     "* Arguments available to local capture mode only:\n"
                     "  -s|--session-xml <session_xml>        Take configuration from specified\n"
                     "                                        session.xml file. Any additional\n"
@@ -581,6 +873,8 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                        specified in this file.\n"
                     "  -o|--output <apc_dir>                 The path and name of the output for\n"
                     "                                        a local capture\n"
+                    "  -z|--compress (yes|no)                LZ4 compress the captured data as it is\n"
+                    "                                        written (defaults to 'no')\n"
                     "  -i|--pid <pids...>                    Comma separated list of process IDs to\n"
                     "                                        profile\n"
                     "  -C|--counters <counters>              A comma separated list of counters to\n"
@@ -698,6 +992,13 @@ void GatorCLIParser::parseCLIArguments(int argc,
     }
 
     // Defaults depending on other flags
+    for (const ThreadRole role : {ThreadRole::SOURCE, ThreadRole::HOUSEKEEPING}) {
+        std::vector<int> & cpus = result.mThreadPlacements[static_cast<int>(role)].cpus;
+        if (cpus.empty()) {
+            cpus = observerCpus;
+        }
+    }
+
     const bool haveProcess =
         !result.mCaptureCommand.empty() || !result.mPids.empty() || result.mWaitForCommand != nullptr;
 
@@ -759,6 +1060,11 @@ void GatorCLIParser::parseCLIArguments(int argc,
             result.mode = ExecutionMode::EXIT;
             return;
         }
+        if (result.mCompression) {
+            logg.logError("--compress is not applicable in daemon mode.");
+            result.mode = ExecutionMode::EXIT;
+            return;
+        }
     }
 
     if (result.mDuration < 0) {
@@ -767,6 +1073,42 @@ void GatorCLIParser::parseCLIArguments(int argc,
         return;
     }
 
+    if ((result.mFlightRecorderTrigger != nullptr) && !result.mFlightRecorder) {
+        logg.logError("--flight-recorder-trigger requires --flight-recorder yes");
+        result.mode = ExecutionMode::EXIT;
+        return;
+    }
+
+    if (result.mKernelFilter && !(result.mSystemWide && haveProcess)) {
+        logg.logError("--kernel-filter requires --system-wide=yes and one of --app, --wait-process or --pid");
+        result.mode = ExecutionMode::EXIT;
+        return;
+    }
+
+    if (result.mFlightRecorder && result.mUserspaceCounters) {
+        logg.logError("--userspace-counters cannot be used with --flight-recorder");
+        result.mode = ExecutionMode::EXIT;
+        return;
+    }
+
+    if (result.mMultiplexCounters && !result.mSystemWide) {
+        logg.logError("--multiplex-counters requires --system-wide=yes");
+        result.mode = ExecutionMode::EXIT;
+        return;
+    }
+
+    if (result.mMultiplexCounters && result.mUserspaceCounters) {
+        logg.logError("--multiplex-counters cannot be used with --userspace-counters");
+        result.mode = ExecutionMode::EXIT;
+        return;
+    }
+
+    if (result.mFlightRecorder && !result.mSpeConfigs.empty()) {
+        logg.logError("--spe cannot be used with --flight-recorder");
+        result.mode = ExecutionMode::EXIT;
+        return;
+    }
+
     if (indexApp > 0 && result.mCaptureCommand.empty()) {
         logg.logError("--app requires a command to be specified");
         result.mode = ExecutionMode::EXIT;
@@ -7,6 +7,8 @@
 #include "GatorCLIFlags.h"
 #include "Logging.h"
 #include "OlyUtility.h"
+#include "QueuedSink.h"
+#include "ThreadFactory.h"
 
 #include <cstring>
 #include <getopt.h>
@@ -46,12 +48,14 @@ public:
     const char * mCaptureWorkingDir;
     std::vector<std::string> mCaptureCommand;
     std::set<int> mPids;
+    std::vector<const char *> mMirrorTargets;
     const char * mSessionXMLPath;
     const char * mTargetPath;
     const char * mConfigurationXMLPath;
     const char * mEventsXMLPath;
     const char * mEventsXMLAppend;
     const char * mWaitForCommand;
+    const char * mFlightRecorderTrigger;
 
     int mBacktraceDepth;
     int mSampleRate;
@@ -59,12 +63,28 @@ public:
     int mAndroidApiLevel;
     int mPerfMmapSizeInPages;
     int mSpeSampleRate;
+    int mSampleAggregationWindowMs;
+    int mInternedCallchains;
+    int mUserStackSize;
+    int mAdaptiveSamplingMaxScale;
+    int mWatchHistoryMB;
+    int mMultiplexCounterLimit;
 
     bool mFtraceRaw;
     bool mStopGator;
     bool mSystemWide;
     bool mAllowCommands;
     bool mDisableCpuOnlining;
+    bool mCompression;
+    bool mSpeSingleSyncThread;
+    bool mFlightRecorder;
+    bool mKernelFilter;
+    bool mUserspaceCounters;
+    bool mMultiplexCounters;
+    bool mReservedHugePages;
+
+    QueuedSink::SlowConsumerPolicy mMirrorPolicy;
+    ThreadPlacement mThreadPlacements[NUMBER_OF_THREAD_ROLES];
 
     const char * pmuPath;
     int port;
@@ -0,0 +1,255 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "GatordDriver.h"
+
+#include "GatordStats.h"
+#include "Logging.h"
+#include "SessionData.h"
+#include "lib/FsEntry.h"
+#include "linux/proc/ProcPidStatFileRecord.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+    struct ThreadCounter {
+        const char * counterName;
+        const char * threadName;
+        // count every thread whose name starts with threadName, such as those numbered per CPU or GPU
+        bool isPrefix;
+    };
+
+    constexpr ThreadCounter THREAD_COUNTERS[] = {
+        // the primary source runs on the child thread, so for perf this is the time spent reading the rings
+        {"gatord_cpu_child", "gatord-child", false},
+        {"gatord_cpu_sender", "gatord-sender", false},
+        {"gatord_cpu_external", "gatord-external", false},
+        {"gatord_cpu_counters", "gatord-counters", false},
+        {"gatord_cpu_nrsrc", "gatord-nrsrc", false},
+        {"gatord_cpu_compress", "gatord-compress", false},
+        {"gatord_cpu_ftrace", "gatord-reader", true},
+        {"gatord_cpu_counter_readers", "gatord-cnt-", true},
+        {"gatord_cpu_mali", "gatord-malih", true},
+        {"gatord_cpu_mirror", "gatord-sink", false},
+    };
+
+    bool matches(const ThreadCounter & counter, const std::string & threadName)
+    {
+        return counter.isPrefix ? (threadName.compare(0, strlen(counter.threadName), counter.threadName) == 0)
+                              : (threadName == counter.threadName);
+    }
+
+    constexpr std::size_t NUMBER_OF_THREAD_COUNTERS = sizeof(THREAD_COUNTERS) / sizeof(THREAD_COUNTERS[0]);
+
+    const char * const SOURCE_BYTES_COUNTERS[GatordStats::NUMBER_OF_SOURCE_KINDS] = {
+        "gatord_bytes_primary",
+        "gatord_bytes_external",
+        "gatord_bytes_userspace",
+        "gatord_bytes_mali_hwcntr",
+        "gatord_bytes_armnn",
+    };
+
+    std::uint64_t loadTimeUs(const std::atomic<std::uint64_t> & total)
+    {
+        return total.load(std::memory_order_relaxed) / NS_PER_US;
+    }
+}
+
+class GatordCounter : public DriverCounter {
+public:
+    /**
+     * @param getValue returns a running total if isDelta, otherwise the value itself
+     */
+    GatordCounter(DriverCounter * next, const char * name, std::function<std::uint64_t()> getValue, bool isDelta);
+
+    int64_t read() override;
+
+private:
+    const std::function<std::uint64_t()> mGetValue;
+    const bool mIsDelta;
+    std::uint64_t mPrev;
+
+    // Intentionally unimplemented
+    GatordCounter(const GatordCounter &) = delete;
+    GatordCounter & operator=(const GatordCounter &) = delete;
+    GatordCounter(GatordCounter &&) = delete;
+    GatordCounter & operator=(GatordCounter &&) = delete;
+};
+
+GatordCounter::GatordCounter(DriverCounter * next,
+                             const char * const name,
+                             std::function<std::uint64_t()> getValue,
+                             const bool isDelta)
+    : DriverCounter(next, name), mGetValue(std::move(getValue)), mIsDelta(isDelta), mPrev(0)
+{
+}
+
+int64_t GatordCounter::read()
+{
+    const std::uint64_t value = mGetValue();
+    if (!mIsDelta) {
+        return value;
+    }
+
+    // per thread totals go backwards if a thread exits
+    const std::uint64_t result = (value > mPrev ? value - mPrev : 0);
+    mPrev = value;
+    return result;
+}
+
+GatordDriver::GatordDriver()
+    : PolledDriver("Gatord"),
+      mClockTicksPerSecond(sysconf(_SC_CLK_TCK)),
+      mThreadCpuTimes(NUMBER_OF_THREAD_COUNTERS, 0),
+      mProcessCpuTime(0)
+{
+}
+
+void GatordDriver::readEvents(mxml_node_t * const /*unused*/)
+{
+    if ((mClockTicksPerSecond > 0) && (access("/proc/self/task", R_OK) == 0)) {
+        for (std::size_t index = 0; index < NUMBER_OF_THREAD_COUNTERS; ++index) {
+            setCounters(new GatordCounter(
+                getCounters(),
+                THREAD_COUNTERS[index].counterName,
+                [this, index]() { return mThreadCpuTimes[index]; },
+                true));
+        }
+        setCounters(new GatordCounter(
+            getCounters(),
+            "gatord_cpu_total",
+            [this]() { return mProcessCpuTime; },
+            true));
+    }
+    else {
+        logg.logSetup("gatord counters\nCannot access /proc/self/task. gatord thread CPU time counters not available.");
+    }
+
+    for (std::size_t index = 0; index < GatordStats::NUMBER_OF_SOURCE_KINDS; ++index) {
+        setCounters(new GatordCounter(
+            getCounters(),
+            SOURCE_BYTES_COUNTERS[index],
+            [index]() { return gGatordStats.mSourceBytes[index].load(std::memory_order_relaxed); },
+            true));
+    }
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_bytes_total",
+        []() { return gGatordStats.mSentBytes.load(std::memory_order_relaxed); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_send_time",
+        []() { return loadTimeUs(gGatordStats.mSendTime); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_buffer_wait_time",
+        []() { return loadTimeUs(gGatordStats.mBufferWaitTime); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_buffer_high_water",
+        []() { return GatordStats::takeMax(gGatordStats.mBufferHighWater); },
+        false));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_perf_buffer_high_water",
+        []() { return GatordStats::takeMax(gGatordStats.mPerfBufferHighWater); },
+        false));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_perf_lost",
+        []() { return gGatordStats.mPerfLostRecords.load(std::memory_order_relaxed); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_perf_too_large",
+        []() { return gGatordStats.mPerfRecordsTooLarge.load(std::memory_order_relaxed); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_perf_sync_dropped",
+        []() { return gGatordStats.mPerfSyncDropped.load(std::memory_order_relaxed); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_proc_scan_time",
+        []() { return loadTimeUs(gGatordStats.mProcScanTime); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_perf_filter_passed",
+        []() { return gGatordStats.mPerfFilterPassed.load(std::memory_order_relaxed); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_perf_filter_dropped",
+        []() { return gGatordStats.mPerfFilterDropped.load(std::memory_order_relaxed); },
+        true));
+    setCounters(new GatordCounter(
+        getCounters(),
+        "gatord_time_to_first_data",
+        []() { return loadTimeUs(gGatordStats.mTimeToFirstData); },
+        false));
+}
+
+void GatordDriver::start()
+{
+    readThreadCpuTimes();
+
+    // Initialize previous values
+    for (DriverCounter * counter = getCounters(); counter != nullptr; counter = counter->getNext()) {
+        if (!counter->isEnabled()) {
+            continue;
+        }
+        counter->read();
+    }
+}
+
+void GatordDriver::read(IBlockCounterFrameBuilder & buffer)
+{
+    readThreadCpuTimes();
+    super::read(buffer);
+}
+
+void GatordDriver::readThreadCpuTimes()
+{
+    if (mClockTicksPerSecond <= 0) {
+        return;
+    }
+
+    const auto ticksToUs = [this](const lnx::ProcPidStatFileRecord & record) -> std::uint64_t {
+        return (static_cast<std::uint64_t>(record.getUtime()) + record.getStime()) * (NS_PER_S / NS_PER_US) /
+               mClockTicksPerSecond;
+    };
+
+    lnx::ProcPidStatFileRecord record;
+
+    // /proc/self/stat also includes the threads that have already exited
+    if (lnx::ProcPidStatFileRecord::parseStatFile(record,
+                                                  lib::readFileContents(lib::FsEntry::create("/proc/self/stat"))
+                                                      .c_str())) {
+        mProcessCpuTime = ticksToUs(record);
+    }
+
+    std::fill(mThreadCpuTimes.begin(), mThreadCpuTimes.end(), 0);
+
+    lib::FsEntryDirectoryIterator iterator = lib::FsEntry::create("/proc/self/task").children();
+    while (lib::Optional<lib::FsEntry> taskEntry = iterator.next()) {
+        const std::string statContents = lib::readFileContents(lib::FsEntry::create(*taskEntry, "stat"));
+        if (!lnx::ProcPidStatFileRecord::parseStatFile(record, statContents.c_str())) {
+            continue;
+        }
+
+        for (std::size_t index = 0; index < NUMBER_OF_THREAD_COUNTERS; ++index) {
+            if (matches(THREAD_COUNTERS[index], record.getComm())) {
+                mThreadCpuTimes[index] += ticksToUs(record);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,44 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_GATORD_DRIVER_H
+#define INCLUDE_GATORD_DRIVER_H
+
+#include "PolledDriver.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Counters for gatord's own overhead: the CPU time of its main threads, the bytes each source sends, how long the
+ * sender and the buffers are blocked, buffer high-water marks, lost perf records and time spent scanning /proc.
+ *
+ * Most of the values come from gGatordStats, the thread CPU times are read from /proc/self/task.
+ */
+class GatordDriver : public PolledDriver {
+private:
+    using super = PolledDriver;
+
+public:
+    GatordDriver();
+
+    void readEvents(mxml_node_t * root) override;
+    void start() override;
+    void read(IBlockCounterFrameBuilder & buffer) override;
+
+private:
+    void readThreadCpuTimes();
+
+    long mClockTicksPerSecond;
+    // indexed the same as THREAD_COUNTERS in the .cpp, in us
+    std::vector<std::uint64_t> mThreadCpuTimes;
+    // the whole process, including threads that have exited, in us
+    std::uint64_t mProcessCpuTime;
+
+    // Intentionally unimplemented
+    GatordDriver(const GatordDriver &) = delete;
+    GatordDriver & operator=(const GatordDriver &) = delete;
+    GatordDriver(GatordDriver &&) = delete;
+    GatordDriver & operator=(GatordDriver &&) = delete;
+};
+
+#endif // INCLUDE_GATORD_DRIVER_H
@@ -0,0 +1,49 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "GatordStats.h"
+
+#include <chrono>
+
+GatordStats gGatordStats;
+
+constexpr std::size_t GatordStats::NUMBER_OF_SOURCE_KINDS;
+
+std::uint64_t GatordStats::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+GatordStats::ScopedTimer::ScopedTimer(std::atomic<std::uint64_t> & total) : mTotal(total), mStart(nowNs())
+{
+}
+
+GatordStats::ScopedTimer::~ScopedTimer()
+{
+    add(mTotal, nowNs() - mStart);
+}
+
+GatordStats::GatordStats()
+    : mSourceBytes(),
+      mSentBytes(0),
+      mSendTime(0),
+      mBufferWaitTime(0),
+      mBufferHighWater(0),
+      mPerfBufferHighWater(0),
+      mPerfLostRecords(0),
+      mPerfRecordsTooLarge(0),
+      mPerfSyncDropped(0),
+      mProcScanTime(0),
+      mPerfFilterPassed(0),
+      mPerfFilterDropped(0),
+      mTimeToFirstData(0)
+{
+}
+
+void GatordStats::updateMax(std::atomic<int> & max, int value)
+{
+    int current = max.load(std::memory_order_relaxed);
+    while ((value > current) && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
@@ -0,0 +1,97 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_GATORD_STATS_H
+#define INCLUDE_GATORD_STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Running totals of how much work gatord itself is doing, exported as counters by GatordDriver.
+ *
+ * Everything is updated with relaxed atomics from whichever thread does the work, so the values are only
+ * approximately consistent with each other.
+ */
+class GatordStats {
+public:
+    /** The sources that have their output bytes counted separately */
+    enum class SourceKind : int {
+        PRIMARY,
+        EXTERNAL,
+        USERSPACE,
+        MALI_HWCNTR,
+        ARMNN,
+    };
+
+    static constexpr std::size_t NUMBER_OF_SOURCE_KINDS = 5;
+
+    /** Adds the time between construction and destruction to a time total */
+    class ScopedTimer {
+    public:
+        ScopedTimer(std::atomic<std::uint64_t> & total);
+        ~ScopedTimer();
+
+    private:
+        std::atomic<std::uint64_t> & mTotal;
+        std::uint64_t mStart;
+
+        // Intentionally unimplemented
+        ScopedTimer(const ScopedTimer &) = delete;
+        ScopedTimer & operator=(const ScopedTimer &) = delete;
+        ScopedTimer(ScopedTimer &&) = delete;
+        ScopedTimer & operator=(ScopedTimer &&) = delete;
+    };
+
+    GatordStats();
+
+    /** The clock the timers use, in ns */
+    static std::uint64_t nowNs();
+
+    static void add(std::atomic<std::uint64_t> & total, std::uint64_t value)
+    {
+        total.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void updateMax(std::atomic<int> & max, int value);
+
+    /** Reads a high-water mark and starts a new one */
+    static int takeMax(std::atomic<int> & max) { return max.exchange(0, std::memory_order_relaxed); }
+
+    // bytes written to the Sender by each source from the sender thread
+    std::atomic<std::uint64_t> mSourceBytes[NUMBER_OF_SOURCE_KINDS];
+    // bytes written to the Sender by anything, including responses and data not sent by a source
+    std::atomic<std::uint64_t> mSentBytes;
+    // ns spent by all threads in the Sender, including waiting for the lock, the socket and the disk
+    std::atomic<std::uint64_t> mSendTime;
+    // ns producers spent blocked waiting for the sender thread to empty a Buffer
+    std::atomic<std::uint64_t> mBufferWaitTime;
+    // the fullest any Buffer has been when the sender read it, in percent
+    std::atomic<int> mBufferHighWater;
+    // the fullest any perf ring has been when read, in percent
+    std::atomic<int> mPerfBufferHighWater;
+    // total of the lost counts in PERF_RECORD_LOST records
+    std::atomic<std::uint64_t> mPerfLostRecords;
+    // perf records dropped by gatord because even packed they do not fit in a frame
+    std::atomic<std::uint64_t> mPerfRecordsTooLarge;
+    // sync records, each a point correlating the clocks, dropped because the sender did not empty their ring in time
+    std::atomic<std::uint64_t> mPerfSyncDropped;
+    // ns spent walking /proc
+    std::atomic<std::uint64_t> mProcScanTime;
+    // samples let through and discarded by the kernel sample filter, see PerfSampleFilter
+    std::atomic<std::uint64_t> mPerfFilterPassed;
+    std::atomic<std::uint64_t> mPerfFilterDropped;
+    // ns from starting to prepare the sources to the sender first writing data from one of them, 0 until it has
+    std::atomic<std::uint64_t> mTimeToFirstData;
+
+private:
+    // Intentionally unimplemented
+    GatordStats(const GatordStats &) = delete;
+    GatordStats & operator=(const GatordStats &) = delete;
+    GatordStats(GatordStats &&) = delete;
+    GatordStats & operator=(GatordStats &&) = delete;
+};
+
+extern GatordStats gGatordStats;
+
+#endif // INCLUDE_GATORD_STATS_H
@@ -3,9 +3,15 @@
 #include "HwmonDriver.h"
 
 #include "Logging.h"
+#include "lib/AutoClosingFd.h"
 #include "libsensors/sensors.h"
 
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
 #include <memory>
+#include <unistd.h>
 
 // feature->type to input map
 static sensors_subfeature_type getInput(const sensors_feature_type type)
@@ -31,6 +37,30 @@ static sensors_subfeature_type getInput(const sensors_feature_type type)
     }
 }
 
+/**
+ * Parses a sysfs hwmon value, which is always a decimal integer optionally preceded by '-' and followed by a newline
+ *
+ * @return False if no digits were found
+ */
+static bool parseHwmonValue(const char * buf, int length, int64_t & value)
+{
+    const int negative = (length > 0) && (buf[0] == '-');
+
+    uint64_t result = 0;
+    int pos = negative;
+    for (; pos < length; ++pos) {
+        const unsigned digit = static_cast<unsigned char>(buf[pos]) - '0';
+        if (digit > 9) {
+            break;
+        }
+        result = result * 10 + digit;
+    }
+
+    // negate without a branch, -x == ~x + 1
+    value = static_cast<int64_t>((result ^ -static_cast<uint64_t>(negative)) + negative);
+    return pos > negative;
+}
+
 class HwmonCounter : public DriverCounter {
 public:
     HwmonCounter(DriverCounter * next, char * name, const sensors_chip_name * chip, const sensors_feature * feature);
@@ -47,10 +77,12 @@ public:
     int64_t read() override;
 
 private:
-    void init(const sensors_chip_name * chip, const sensors_feature * feature);
+    bool readValue(double & value);
 
     const sensors_chip_name * mChip;
     const sensors_feature * mFeature;
+    // the *_input file, kept open so that each read is a single pread; not used if libsensors must compute the value
+    lib::AutoClosingFd mInputFd;
     char * mLabel;
     const char * mTitle;
     const char * mDisplay;
@@ -74,6 +106,7 @@ HwmonCounter::HwmonCounter(DriverCounter * next,
     : DriverCounter(next, name),
       mChip(chip),
       mFeature(feature),
+      mInputFd(),
       mLabel(nullptr),
       mTitle(nullptr),
       mDisplay(nullptr),
@@ -86,6 +119,18 @@ HwmonCounter::HwmonCounter(DriverCounter * next,
 {
     mLabel = sensors_get_label(mChip, mFeature);
 
+    // Keep in sync with the read check in HwmonDriver::readEvents
+    const sensors_subfeature * const subfeature = sensors_get_subfeature(mChip, mFeature, getInput(mFeature->type));
+    if ((subfeature != nullptr) && ((subfeature->flags & SENSORS_COMPUTE_MAPPING) == 0)) {
+        // the same file sensors_get_value reads
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", mChip->path, subfeature->name);
+        mInputFd = open(path, O_RDONLY | O_CLOEXEC);
+        if (!mInputFd) {
+            logg.logMessage("Unable to open %s (%d) %s, using libsensors", path, errno, strerror(errno));
+        }
+    }
+
     switch (mFeature->type) {
         case SENSORS_FEATURE_IN:
             mTitle = "Voltage";
@@ -163,20 +208,31 @@ HwmonCounter::~HwmonCounter()
     free(mLabel);
 }
 
+bool HwmonCounter::readValue(double & value)
+{
+    if (mInputFd) {
+        // sysfs regenerates the contents on every read from offset 0
+        char buf[32];
+        const ssize_t bytes = pread(*mInputFd, buf, sizeof(buf), 0);
+        int64_t intValue;
+        if ((bytes <= 0) || !parseHwmonValue(buf, bytes, intValue)) {
+            return false;
+        }
+        value = intValue;
+        return true;
+    }
+
+    // Keep in sync with the read check in HwmonDriver::readEvents
+    const sensors_subfeature * const subfeature = sensors_get_subfeature(mChip, mFeature, getInput(mFeature->type));
+    return (subfeature != nullptr) && (sensors_get_value(mChip, subfeature->number, &value) == 0);
+}
+
 int64_t HwmonCounter::read()
 {
     double value;
     double result;
-    const sensors_subfeature * subfeature;
-
-    // Keep in sync with the read check in HwmonDriver::readEvents
-    subfeature = sensors_get_subfeature(mChip, mFeature, getInput(mFeature->type));
-    if (subfeature == nullptr) {
-        logg.logError("No input value for hwmon sensor %s", mLabel);
-        handleException();
-    }
 
-    if (sensors_get_value(mChip, subfeature->number, &value) != 0) {
+    if (!readValue(value)) {
         logg.logError("Can't get input value for hwmon sensor %s", mLabel);
         handleException();
     }
@@ -14,6 +14,8 @@ enum class ResponseType : char {
     APC_DATA = 3,
     ACK = 4,
     NAK = 5,
+    /// A block of the compressed response stream, see StreamCompressor
+    COMPRESSED_DATA = 6,
     ERROR = '\xFF'
 };
 
@@ -49,12 +49,17 @@ static char * createUniqueDirectory(const char * initialPath, const char * endin
 namespace local_capture {
     void createAPCDirectory(const char * target_path)
     {
-        gSessionData.mAPCDir = createUniqueDirectory(target_path, ".apc");
-        if ((removeDirAndAllContents(gSessionData.mAPCDir) != 0 ||
-             mkdir(gSessionData.mAPCDir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0)) {
-            logg.logError("Unable to create directory %s", gSessionData.mAPCDir);
+        gSessionData.mAPCDir = createMirrorAPCDirectory(target_path);
+    }
+
+    const char * createMirrorAPCDirectory(const char * target_path)
+    {
+        const char * const apcDir = createUniqueDirectory(target_path, ".apc");
+        if ((removeDirAndAllContents(apcDir) != 0 || mkdir(apcDir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0)) {
+            logg.logError("Unable to create directory %s", apcDir);
             handleException();
         }
+        return apcDir;
     }
 
     int removeDirAndAllContents(const char * path)
@@ -90,14 +95,14 @@ namespace local_capture {
         return error;
     }
 
-    void copyImages(const std::list<std::string> & list)
+    void copyImages(const char * apcDir, const std::list<std::string> & list)
     {
         char dstfilename[PATH_MAX];
 
         for (const auto & element : list) {
-            strncpy(dstfilename, gSessionData.mAPCDir, PATH_MAX);
+            strncpy(dstfilename, apcDir, PATH_MAX);
             dstfilename[PATH_MAX - 1] = 0; // strncpy does not guarantee a null-terminated string
-            if (gSessionData.mAPCDir[strlen(gSessionData.mAPCDir) - 1] != '/') {
+            if (apcDir[strlen(apcDir) - 1] != '/') {
                 strncat(dstfilename, "/", PATH_MAX - strlen(dstfilename) - 1);
             }
             strncat(dstfilename, getFilePart(element.c_str()), PATH_MAX - strlen(dstfilename) - 1);
@@ -7,8 +7,14 @@
 #include <string>
 
 namespace local_capture {
-    void copyImages(const std::list<std::string> & list);
+    void copyImages(const char * apcDir, const std::list<std::string> & list);
     void createAPCDirectory(const char * target_path);
+    /**
+     * Like createAPCDirectory but for an additional copy of the capture, see Sender::addMirror
+     *
+     * @return The path of the new, empty, directory
+     */
+    const char * createMirrorAPCDirectory(const char * target_path);
     int removeDirAndAllContents(const char * path);
 };
 
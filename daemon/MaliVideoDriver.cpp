@@ -90,14 +90,14 @@ void MaliVideoDriver::readEvents(mxml_node_t * const xml)
     }
 }
 
-int MaliVideoDriver::writeCounters(mxml_node_t * root) const
+int MaliVideoDriver::writeCounters(XmlWriter & writer) const
 {
     if (access("/dev/mv500", F_OK) != 0) {
         // Don't show the counters in counter configuration
         return 0;
     }
 
-    return super::writeCounters(root);
+    return super::writeCounters(writer);
 }
 
 bool MaliVideoDriver::claimCounter(Counter & counter) const
@@ -22,7 +22,7 @@ public:
 
     void readEvents(mxml_node_t * xml) override;
 
-    int writeCounters(mxml_node_t * root) const override;
+    int writeCounters(XmlWriter & writer) const override;
     bool claimCounter(Counter & counter) const override;
 
     bool start(int mveUds);
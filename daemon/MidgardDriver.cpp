@@ -6,10 +6,18 @@
 #include "Logging.h"
 #include "OlySocket.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
+#include "lib/AutoClosingFd.h"
 #include "lib/FileDescriptor.h"
+#include "lib/Syscall.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <cinttypes>
+#include <cstring>
+#include <sys/prctl.h>
 #include <unistd.h>
+#include <vector>
 
 static const uint32_t PACKET_SHARED_PARAMETER = 0x0000;
 static const uint32_t PACKET_HARDWARE_COUNTER_DIRECTORY = 0x0002;
@@ -96,133 +104,358 @@ private:
     MidgardCounter & operator=(MidgardCounter &&) = delete;
 };
 
-MidgardDriver::MidgardDriver() : SimpleDriver("MidgardDriver"), mQueried(false)
+namespace {
+    // A responsive Midgard sends its directory within a few ms, so the first query waits that long for it
+    constexpr std::uint64_t QUERY_WAIT_NS = 100 * NS_PER_MS;
+    constexpr std::uint64_t DISCOVERY_TIMEOUT_NS = 5 * NS_PER_S;
+    // how often the discovery thread checks whether it should stop
+    constexpr int STOP_CHECK_MS = 100;
+
+    /**
+     * Parses the MIPE packets from Midgard as they arrive, in whatever pieces the socket gives them, until the
+     * Hardware Counter Directory Packet. Malformed packets end the discovery rather than gatord.
+     */
+    class MipeDirectoryParser {
+    public:
+        enum class Result {
+            NEED_MORE,
+            FOUND,
+            NOT_FOUND,
+        };
+
+        MipeDirectoryParser()
+            : mState(State::HEADER),
+              mHeader(),
+              mSharedParameter(),
+              mFilled(0),
+              mRemaining(0),
+              mFirst(true),
+              mDirectory()
+        {
+        }
+
+        Result parse(const char * data, std::size_t length)
+        {
+            while (length > 0) {
+                std::size_t taken = 0;
+                Result result = Result::NEED_MORE;
+
+                switch (mState) {
+                    case State::HEADER:
+                        taken = fill(&mHeader, sizeof(mHeader), data, length);
+                        if (mFilled == sizeof(mHeader)) {
+                            result = onHeader();
+                        }
+                        break;
+
+                    case State::SHARED_PARAMETER:
+                        taken = fill(&mSharedParameter, sizeof(mSharedParameter), data, length);
+                        if (mFilled == sizeof(mSharedParameter)) {
+                            result = onSharedParameter();
+                        }
+                        break;
+
+                    case State::DIRECTORY:
+                        taken = fill(mDirectory.data(), mDirectory.size(), data, length);
+                        if (mFilled == mDirectory.size()) {
+                            result = Result::FOUND;
+                        }
+                        break;
+
+                    case State::SKIP:
+                        taken = std::min(length, mRemaining);
+                        mRemaining -= taken;
+                        if (mRemaining == 0) {
+                            startHeader();
+                        }
+                        break;
+                }
+
+                if (result != Result::NEED_MORE) {
+                    return result;
+                }
+                data += taken;
+                length -= taken;
+            }
+
+            return Result::NEED_MORE;
+        }
+
+        const std::vector<char> & getDirectory() const { return mDirectory; }
+
+    private:
+        enum class State {
+            HEADER,
+            SHARED_PARAMETER,
+            DIRECTORY,
+            SKIP,
+        };
+
+        /** Copies as much of data as the current struct still needs, @return the bytes copied */
+        std::size_t fill(void * dest, std::size_t size, const char * data, std::size_t length)
+        {
+            const std::size_t taken = std::min(length, size - mFilled);
+            memcpy(static_cast<char *>(dest) + mFilled, data, taken);
+            mFilled += taken;
+            mRemaining -= std::min(mRemaining, taken);
+            return taken;
+        }
+
+        void startHeader()
+        {
+            mState = State::HEADER;
+            mFilled = 0;
+        }
+
+        void startBody(State state, std::size_t length)
+        {
+            mFilled = 0;
+            mRemaining = length;
+            if (length == 0) {
+                startHeader();
+            }
+            else {
+                mState = state;
+            }
+        }
+
+        Result onHeader()
+        {
+            if (mFirst && (reinterpret_cast<const uint8_t *>(&mHeader)[0] != 0)) {
+                logg.logMessage("Midgard data is not in encapsulated format");
+                return Result::NOT_FOUND;
+            }
+            mFirst = false;
+
+            if (mHeader.mSequenceNumbered) {
+                logg.logWarning("sequence_numbered is true and is unsupported");
+                return Result::NOT_FOUND;
+            }
+
+            logg.logMessage("MIPE Packet: 0x%x 0x%x 0x%x 0x%x 0x%x",
+                            mHeader.mDataLength,
+                            mHeader.mImplSpec,
+                            mHeader.mPacketIdentifier,
+                            mHeader.mReserved0,
+                            mHeader.mReserved1);
+
+            switch (mHeader.mPacketIdentifier) {
+                case PACKET_SHARED_PARAMETER:
+                    if (mHeader.mDataLength < sizeof(mSharedParameter)) {
+                        logg.logWarning("Unable to read Shared Parameter Packet because it's at least %zu bytes long "
+                                        "but only %" PRIu32 " bytes were given",
+                                        sizeof(mSharedParameter),
+                                        mHeader.mDataLength);
+                        return Result::NOT_FOUND;
+                    }
+                    startBody(State::SHARED_PARAMETER, mHeader.mDataLength);
+                    return Result::NEED_MORE;
+
+                case PACKET_HARDWARE_COUNTER_DIRECTORY:
+                    if (mHeader.mImplSpec == 0) {
+                        constexpr size_t buffSize = sizeof(gSessionData.mSharedData->mMaliMidgardCounters);
+                        if (mHeader.mDataLength > buffSize) {
+                            logg.logWarning("Unable to read Hardware Counter Directory Packet because it's %" PRIu32
+                                            " bytes but no more than %zu bytes was expected",
+                                            mHeader.mDataLength,
+                                            buffSize);
+                            return Result::NOT_FOUND;
+                        }
+                        mDirectory.resize(mHeader.mDataLength);
+                        if (mDirectory.empty()) {
+                            return Result::FOUND;
+                        }
+                        startBody(State::DIRECTORY, mHeader.mDataLength);
+                        return Result::NEED_MORE;
+                    }
+                    // fall through
+
+                    /* no break */
+                case 0x0400:
+                case 0x0402:
+                case 0x0408:
+                    // Ignore
+                    startBody(State::SKIP, mHeader.mDataLength);
+                    return Result::NEED_MORE;
+
+                default:
+                    logg.logMessage("Unrecognized MIPE packet 0x%x, giving up on the Hardware Counter Directory",
+                                    mHeader.mPacketIdentifier);
+                    return Result::NOT_FOUND;
+            }
+        }
+
+        Result onSharedParameter()
+        {
+            if (mHeader.mImplSpec == 0 && mSharedParameter.mReserved2 == 0) {
+                if (mSharedParameter.mMaliMagic != 0x6D616C69) {
+                    logg.logWarning("mali_magic does not match expected value");
+                    return Result::NOT_FOUND;
+                }
+            }
+
+            // skip the pool
+            startBody(State::SKIP, mRemaining);
+            return Result::NEED_MORE;
+        }
+
+        State mState;
+        PacketHeader mHeader;
+        SharedParameterPacket mSharedParameter;
+        // the bytes of the current header, shared parameters or directory read so far
+        std::size_t mFilled;
+        // the bytes of the current packet's body still to come
+        std::size_t mRemaining;
+        bool mFirst;
+        std::vector<char> mDirectory;
+    };
+}
+
+MidgardDriver::MidgardDriver()
+    : SimpleDriver("MidgardDriver"),
+      mCountersCreated(false),
+      mDiscoveryStarted(false),
+      mDiscoveryThread(),
+      mDiscovering(false),
+      mStopDiscovery(false)
+{
+}
+
+MidgardDriver::~MidgardDriver()
+{
+    stopDiscovery();
+}
+
+void MidgardDriver::preChildFork()
 {
+    // The thread would not exist in the child, which must start its own
+    stopDiscovery();
+    mDiscoveryStarted = false;
+}
+
+void MidgardDriver::stopDiscovery() const
+{
+    if (mDiscoveryThread.joinable()) {
+        mStopDiscovery.store(true, std::memory_order_relaxed);
+        mDiscoveryThread.join();
+        mStopDiscovery.store(false, std::memory_order_relaxed);
+    }
 }
 
 void MidgardDriver::query() const
 {
-    if (mQueried) {
+    if (mCountersCreated) {
         return;
     }
-    // Only try once even if it fails otherwise not all the possible counters may be shown
-    mQueried = true;
 
     // Prefer not to requery once obtained as it could throw capture off, assume it doesn't change
-    if (gSessionData.mSharedData->mMaliMidgardCountersSize > 0) {
+    if (gSessionData.mSharedData->mMaliMidgardCountersSize.load(std::memory_order_acquire) > 0) {
         logg.logMessage("Using cached Midgard counters");
     }
     else {
-        int uds = OlySocket::connect(MALI_GRAPHICS, MALI_GRAPHICS_SIZE);
-        if (uds < 0) {
-            logg.logMessage("Unable to connect to Midgard");
+        // Only start once, a directory that arrives later is picked up by the next query
+        if (mDiscoveryStarted) {
+            return;
+        }
+        mDiscoveryStarted = true;
+
+        mDiscovering.store(true, std::memory_order_relaxed);
+        mDiscoveryThread = thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() {
+            prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-midgard"), 0, 0, 0);
+            discover();
+            mDiscovering.store(false, std::memory_order_release);
+        });
+
+        const uint64_t deadline = getTime() + QUERY_WAIT_NS;
+        while (mDiscovering.load(std::memory_order_acquire) && (getTime() < deadline)) {
+            usleep(1000);
         }
-        else {
-            logg.logMessage("Connected to midgard");
-            gSessionData.mSharedData->mMaliMidgardCountersSize = 0;
-
-            PacketHeader header;
-            bool first = true;
-
-            while (true) {
-                if (!lib::readAll(uds, &header, sizeof(PacketHeader))) {
-                    logg.logError("Unable to read Midgard header");
-                    handleException();
-                }
-                if (first && (reinterpret_cast<const uint8_t *>(&header)[0] != 0)) {
-                    logg.logMessage("Midgard data is not in encapsulated format");
-                    break;
-                }
-                first = false;
 
-                if (header.mSequenceNumbered) {
-                    logg.logError("sequence_numbered is true and is unsupported");
-                    handleException();
-                }
+        if (gSessionData.mSharedData->mMaliMidgardCountersSize.load(std::memory_order_acquire) == 0) {
+            if (mDiscovering.load(std::memory_order_relaxed)) {
+                logg.logMessage("Midgard has not sent its counters yet, they will be added when it does");
+            }
+            return;
+        }
+    }
 
-                logg.logMessage("MIPE Packet: 0x%x 0x%x 0x%x 0x%x 0x%x",
-                                header.mDataLength,
-                                header.mImplSpec,
-                                header.mPacketIdentifier,
-                                header.mReserved0,
-                                header.mReserved1);
-
-                switch (header.mPacketIdentifier) {
-                    case PACKET_SHARED_PARAMETER: {
-                        SharedParameterPacket packet;
-                        if (header.mDataLength < sizeof(packet)) {
-                            logg.logError("Unable to read Shared Parameter Packet because it's at least %zu bytes long "
-                                          "but only %" PRIu32 " bytes were given",
-                                          sizeof(packet),
-                                          header.mDataLength);
-                            handleException();
-                        }
-                        if (!lib::readAll(uds, &packet, sizeof(packet))) {
-                            logg.logError("Unable to read Shared Parameter Packet");
-                            handleException();
-                        }
-                        if (!lib::skipAll(uds, header.mDataLength - sizeof(packet))) {
-                            logg.logError("Unable to skip Shared Parameter Packet pool");
-                            handleException();
-                        }
+    createCounters();
+    mCountersCreated = true;
+}
 
-                        if (header.mImplSpec == 0 && packet.mReserved2 == 0) {
-                            if (packet.mMaliMagic != 0x6D616C69) {
-                                logg.logError("mali_magic does not match expected value");
-                                handleException();
-                            }
-                        }
-                        break;
-                    }
+void MidgardDriver::discover() const
+{
+    lib::AutoClosingFd uds {OlySocket::connect(MALI_GRAPHICS, MALI_GRAPHICS_SIZE)};
+    if (uds.get() < 0) {
+        logg.logMessage("Unable to connect to Midgard");
+        return;
+    }
+    logg.logMessage("Connected to midgard");
 
-                    case PACKET_HARDWARE_COUNTER_DIRECTORY: {
-                        if (header.mImplSpec == 0) {
-                            constexpr size_t buffSize = sizeof(gSessionData.mSharedData->mMaliMidgardCounters);
-                            if (header.mDataLength > buffSize) {
-                                logg.logError("Unable to read Hardware Counter Directory Packet because it's %" PRIu32
-                                              " bytes but no more than %zu bytes was expected",
-                                              header.mDataLength,
-                                              buffSize);
-                                handleException();
-                            }
-
-                            char * const buf = gSessionData.mSharedData->mMaliMidgardCounters;
-                            if (!lib::readAll(uds, buf, header.mDataLength)) {
-                                logg.logError("Unable to read Hardware Counter Directory Packet");
-                                handleException();
-                            }
-                            gSessionData.mSharedData->mMaliMidgardCountersSize = header.mDataLength;
-                            goto allDone;
-                        }
-                    }
-                    // fall through
+    if (!lib::setNonblock(uds.get())) {
+        logg.logMessage("Unable to make the Midgard connection non-blocking");
+        return;
+    }
 
-                    /* no break */
-                    case 0x0400:
-                    case 0x0402:
-                    case 0x0408: {
-                        // Ignore
-                        if (!lib::skipAll(uds, header.mDataLength)) {
-                            logg.logError("Unable to skip packet body");
-                            handleException();
-                        }
+    MipeDirectoryParser parser;
+    const uint64_t deadline = getTime() + DISCOVERY_TIMEOUT_NS;
+    while (!mStopDiscovery.load(std::memory_order_relaxed)) {
+        const uint64_t now = getTime();
+        if (now >= deadline) {
+            logg.logMessage("Timed out waiting for the Midgard Hardware Counter Directory");
+            return;
+        }
 
-                        break;
-                    }
+        struct pollfd pollFd;
+        pollFd.fd = uds.get();
+        pollFd.events = POLLIN;
+        pollFd.revents = 0;
+        const int timeoutMs = std::min<uint64_t>(STOP_CHECK_MS, (deadline - now + NS_PER_MS - 1) / NS_PER_MS);
+        const int ready = lib::poll(&pollFd, 1, timeoutMs);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logg.logMessage("Unable to poll the Midgard connection: %d (%s)", errno, strerror(errno));
+            return;
+        }
+        if (ready == 0) {
+            continue;
+        }
 
-                    default:
-                        // Unrecognized packet, give up
-                        goto allDone;
-                }
+        char buf[1 << 12];
+        const ssize_t bytes = read(uds.get(), buf, sizeof(buf));
+        if (bytes < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                continue;
             }
-        allDone:
+            logg.logMessage("Unable to read from Midgard: %d (%s)", errno, strerror(errno));
+            return;
+        }
+        if (bytes == 0) {
+            logg.logMessage("Midgard closed the connection before sending the Hardware Counter Directory");
+            return;
+        }
 
-            close(uds);
+        switch (parser.parse(buf, bytes)) {
+            case MipeDirectoryParser::Result::NEED_MORE:
+                break;
+            case MipeDirectoryParser::Result::FOUND: {
+                const std::vector<char> & directory = parser.getDirectory();
+                memcpy(gSessionData.mSharedData->mMaliMidgardCounters, directory.data(), directory.size());
+                gSessionData.mSharedData->mMaliMidgardCountersSize.store(directory.size(), std::memory_order_release);
+                return;
+            }
+            case MipeDirectoryParser::Result::NOT_FOUND:
+                return;
         }
     }
+}
 
+void MidgardDriver::createCounters() const
+{
     char * const buf = gSessionData.mSharedData->mMaliMidgardCounters;
-    const size_t size = gSessionData.mSharedData->mMaliMidgardCountersSize;
+    const size_t size = gSessionData.mSharedData->mMaliMidgardCountersSize.load(std::memory_order_acquire);
     CounterData cd;
     cd.mType = CounterData::PERF;
     for (int i = 0; i + sizeof(HardwareCounter) < size;) {
@@ -347,6 +580,12 @@ void MidgardDriver::resetCounters()
     super::resetCounters();
 }
 
+int MidgardDriver::writeCounters(XmlWriter & writer) const
+{
+    query();
+    return super::writeCounters(writer);
+}
+
 void MidgardDriver::setupCounter(Counter & counter)
 {
     auto * const midgardCounter = static_cast<MidgardCounter *>(findCounter(counter));
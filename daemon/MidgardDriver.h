@@ -5,22 +5,40 @@
 
 #include "SimpleDriver.h"
 
+#include <atomic>
+#include <thread>
+
 class MidgardDriver : public SimpleDriver {
     using super = SimpleDriver;
 
 public:
     MidgardDriver();
+    ~MidgardDriver() override;
 
     bool claimCounter(Counter & counter) const override;
     void resetCounters() override;
     void setupCounter(Counter & counter) override;
+    int writeCounters(XmlWriter & writer) const override;
+    void preChildFork() override;
 
     bool start(int midgardUds);
 
 private:
+    /**
+     * Creates the counters once the Hardware Counter Directory is cached, starting to discover it the first time
+     * and waiting briefly for that, so a later call picks up a directory that arrives late
+     */
     void query() const;
-
-    mutable bool mQueried;
+    void createCounters() const;
+    /** Reads the directory from Midgard until the deadline, run on mDiscoveryThread */
+    void discover() const;
+    void stopDiscovery() const;
+
+    mutable bool mCountersCreated;
+    mutable bool mDiscoveryStarted;
+    mutable std::thread mDiscoveryThread;
+    mutable std::atomic<bool> mDiscovering;
+    mutable std::atomic<bool> mStopDiscovery;
 
     // Intentionally unimplemented
     MidgardDriver(const MidgardDriver &) = delete;
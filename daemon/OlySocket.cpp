@@ -103,6 +103,70 @@ int accept_cloexec(int sockfd, struct sockaddr * addr, socklen_t * addrlen)
     return sock;
 }
 
+#ifndef WIN32
+
+bool sendFd(int channel, int fd)
+{
+    char data = 0;
+    struct iovec iov = {&data, sizeof(data)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(channel, &msg, MSG_NOSIGNAL) == sizeof(data);
+}
+
+int receiveFd(int channel)
+{
+    char data;
+    struct iovec iov = {&data, sizeof(data)};
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t result;
+    do {
+        result = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+    } while ((result < 0) && (errno == EINTR));
+    if (result <= 0) {
+        return -1;
+    }
+
+    const struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msg);
+    if ((cmsg == nullptr) || (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) ||
+        (cmsg->cmsg_len != CMSG_LEN(sizeof(int)))) {
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+#endif
+
 OlyServerSocket::OlyServerSocket(int port) : mFDServer(0)
 {
 #ifdef WIN32
@@ -299,20 +363,28 @@ int OlyServerSocket::acceptConnection()
 }
 
 void OlySocket::send(const char * buffer, int size)
+{
+    if (!trySend(buffer, size)) {
+        handleException();
+    }
+}
+
+bool OlySocket::trySend(const char * buffer, int size)
 {
     if (size <= 0 || buffer == nullptr) {
-        return;
+        return true;
     }
 
     while (size > 0) {
         int n = ::send(mSocketID, buffer, size, 0);
         if (n < 0) {
             logg.logError("Socket send error (%d): %s", errno, strerror(errno));
-            handleException();
+            return false;
         }
         size -= n;
         buffer += n;
     }
+    return true;
 }
 
 // Returns the number of bytes received
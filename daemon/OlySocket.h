@@ -25,6 +25,8 @@ public:
     void closeSocket();
     void shutdownConnection();
     void send(const char * buffer, int size);
+    /** Like send but returns false rather than calling handleException if the send fails */
+    bool trySend(const char * buffer, int size);
     int receive(char * buffer, int size);
     int receiveNBytes(char * buffer, int size);
     int receiveString(char * buffer, int size);
@@ -59,4 +61,12 @@ private:
 int socket_cloexec(int domain, int type, int protocol);
 int accept_cloexec(int sockfd, struct sockaddr * addr, socklen_t * addrlen);
 
+#ifndef WIN32
+/** Pass a copy of fd over a Unix domain socket, see receiveFd */
+bool sendFd(int channel, int fd);
+
+/** @return The fd sent by sendFd, close on exec, or -1 if the channel failed or was closed */
+int receiveFd(int channel);
+#endif
+
 #endif //__OLY_SOCKET_H__
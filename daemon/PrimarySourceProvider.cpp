@@ -6,6 +6,7 @@
 #include "CpuUtils.h"
 #include "DiskIODriver.h"
 #include "FSDriver.h"
+#include "GatordDriver.h"
 #include "HwmonDriver.h"
 #include "ICpuInfo.h"
 #include "Logging.h"
@@ -192,7 +193,12 @@ namespace {
         static std::vector<PolledDriver *> createPolledDrivers()
         {
             return std::vector<PolledDriver *> {
-                {new HwmonDriver(), new FSDriver(), new DiskIODriver(), new MemInfoDriver(), new NetDriver()}};
+                {new HwmonDriver(),
+                 new FSDriver(),
+                 new DiskIODriver(),
+                 new MemInfoDriver(),
+                 new NetDriver(),
+                 new GatordDriver()}};
         }
 
         PerfPrimarySource(PerfDriverConfiguration && configuration,
@@ -302,7 +308,12 @@ namespace {
         static std::vector<PolledDriver *> createPolledDrivers()
         {
             return std::vector<PolledDriver *> {
-                {new HwmonDriver(), new FSDriver(), new DiskIODriver(), new MemInfoDriver(), new NetDriver()}};
+                {new HwmonDriver(),
+                 new FSDriver(),
+                 new DiskIODriver(),
+                 new MemInfoDriver(),
+                 new NetDriver(),
+                 new GatordDriver()}};
         }
 
         NonRootPrimarySource(PmuXML && pmuXml, CpuInfo && cpuInfo)
@@ -94,6 +94,14 @@ bool readProcMaps(const uint64_t currTime, IPerfAttrsConsumer & buffer)
     return true;
 }
 
+bool readProcComms(const uint64_t currTime, IPerfAttrsConsumer & buffer)
+{
+    ReadProcSysDependenciesPollerVisiter poller(currTime, buffer);
+    poller.poll();
+
+    return true;
+}
+
 bool readKallsyms(const uint64_t currTime, IPerfAttrsConsumer & attrsConsumer, const std::atomic_bool & isDone)
 {
     int fd = ::open("/proc/kallsyms", O_RDONLY | O_CLOEXEC);
@@ -16,6 +16,7 @@ bool readProcSysDependencies(uint64_t currTime,
                              DynBuf * b1,
                              FtraceDriver & ftraceDriver);
 bool readProcMaps(uint64_t currTime, IPerfAttrsConsumer & buffer);
+bool readProcComms(uint64_t currTime, IPerfAttrsConsumer & buffer);
 bool readKallsyms(uint64_t currTime, IPerfAttrsConsumer & attrsConsumer, const std::atomic_bool & isDone);
 
 #endif // PROC_H
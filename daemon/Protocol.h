@@ -18,6 +18,9 @@ enum class FrameType : char {
     ACTIVITY_TRACE = 13,
     PERF_AUX = 14,
     PERF_SYNC = 15,
+    PERF_HISTOGRAM = 16,
+    PERF_STACKS = 17,
+    PERF_SAMPLE_READS = 18,
 };
 
 // PERF_ATTR messages
@@ -34,6 +37,7 @@ enum class CodeType : int {
     COUNTERS = 10,
     HEADER_PAGE = 11,
     HEADER_EVENT = 12,
+    SAMPLE_PERIOD_SCALE = 13,
 };
 
 // Summary Frame Messages
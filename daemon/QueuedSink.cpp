@@ -0,0 +1,120 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "QueuedSink.h"
+
+#include "Logging.h"
+#include "ThreadFactory.h"
+
+#include <sys/prctl.h>
+
+QueuedSink::QueuedSink(const char * name, Writer writer, std::size_t maxPendingSize, SlowConsumerPolicy policy)
+    : mName(name),
+      mWriter(std::move(writer)),
+      mMaxPendingSize(maxPendingSize),
+      mPolicy(policy),
+      mMutex(),
+      mDataAvailable(),
+      mSpaceAvailable(),
+      mPending(),
+      mDroppedMessages(0),
+      mDisconnected(false),
+      mStop(false),
+      mThread()
+{
+    mThread = thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { run(); });
+}
+
+QueuedSink::~QueuedSink()
+{
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mStop = true;
+    }
+    mDataAvailable.notify_all();
+    mThread.join();
+
+    if (mDroppedMessages > 0) {
+        logg.logMessage("%llu messages were not written to %s as it could not keep up",
+                        static_cast<unsigned long long>(mDroppedMessages),
+                        mName);
+    }
+}
+
+void QueuedSink::write(lib::Span<const char, int> header, lib::Span<const lib::Span<const char, int>> dataParts)
+{
+    std::size_t length = header.length;
+    for (const auto & data : dataParts) {
+        length += data.length;
+    }
+
+    std::unique_lock<std::mutex> lock {mMutex};
+
+    if (mDisconnected) {
+        return;
+    }
+
+    // a message larger than the limit is allowed through once everything before it has been taken
+    if ((!mPending.empty()) && (mPending.size() + length > mMaxPendingSize)) {
+        switch (mPolicy) {
+            case SlowConsumerPolicy::BLOCK:
+                mSpaceAvailable.wait(lock, [this, length]() {
+                    return mDisconnected || mPending.empty() || (mPending.size() + length <= mMaxPendingSize);
+                });
+                if (mDisconnected) {
+                    return;
+                }
+                break;
+            case SlowConsumerPolicy::DROP:
+                ++mDroppedMessages;
+                return;
+            case SlowConsumerPolicy::DISCONNECT:
+            default:
+                logg.logWarning("%s could not keep up with the capture and will not be written to again", mName);
+                mDisconnected = true;
+                mPending.clear();
+                return;
+        }
+    }
+
+    const bool wasEmpty = mPending.empty();
+    mPending.insert(mPending.end(), header.data, header.data + header.length);
+    for (const auto & data : dataParts) {
+        mPending.insert(mPending.end(), data.data, data.data + data.length);
+    }
+
+    if (wasEmpty) {
+        lock.unlock();
+        mDataAvailable.notify_one();
+    }
+}
+
+void QueuedSink::run()
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-sink"), 0, 0, 0);
+
+    std::vector<char> working;
+
+    std::unique_lock<std::mutex> lock {mMutex};
+    while (true) {
+        mDataAvailable.wait(lock, [this]() { return mStop || !mPending.empty(); });
+
+        if (mPending.empty()) {
+            break;
+        }
+
+        working.swap(mPending);
+        lock.unlock();
+        mSpaceAvailable.notify_all();
+
+        const bool ok = mWriter({working.data(), static_cast<int>(working.size())});
+        working.clear();
+
+        lock.lock();
+        if (!ok) {
+            logg.logWarning("Unable to write to %s, it will not be written to again", mName);
+            mDisconnected = true;
+            mPending.clear();
+            mSpaceAvailable.notify_all();
+        }
+    }
+}
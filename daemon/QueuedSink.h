@@ -0,0 +1,72 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_QUEUED_SINK_H
+#define INCLUDE_QUEUED_SINK_H
+
+#include "lib/Span.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * An extra consumer of the capture stream, written on a dedicated thread from a bounded queue so that it cannot hold
+ * up the sources or the other consumers unless its policy says so.
+ *
+ * Messages are only ever queued or dropped whole so that what does reach the writer is still correctly framed.
+ */
+class QueuedSink {
+public:
+    /** What to do with a message that does not fit in the queue */
+    enum class SlowConsumerPolicy {
+        /// wait for space, slowing the whole capture down to this consumer
+        BLOCK,
+        /// discard the message
+        DROP,
+        /// stop writing to this consumer altogether
+        DISCONNECT,
+    };
+
+    /** Writes some data, returns false if the consumer has failed and should not be written to again */
+    using Writer = std::function<bool(lib::Span<const char, int>)>;
+
+    QueuedSink(const char * name, Writer writer, std::size_t maxPendingSize, SlowConsumerPolicy policy);
+
+    /** Writes anything still queued then stops the thread */
+    ~QueuedSink();
+
+    /**
+     * Queue one message
+     *
+     * @param header Written before dataParts, may be empty
+     * @param dataParts The data
+     */
+    void write(lib::Span<const char, int> header, lib::Span<const lib::Span<const char, int>> dataParts);
+
+private:
+    void run();
+
+    const char * mName;
+    Writer mWriter;
+    const std::size_t mMaxPendingSize;
+    const SlowConsumerPolicy mPolicy;
+    std::mutex mMutex;
+    std::condition_variable mDataAvailable;
+    std::condition_variable mSpaceAvailable;
+    std::vector<char> mPending;
+    std::uint64_t mDroppedMessages;
+    bool mDisconnected;
+    bool mStop;
+    std::thread mThread;
+
+    // Intentionally unimplemented
+    QueuedSink(const QueuedSink &) = delete;
+    QueuedSink & operator=(const QueuedSink &) = delete;
+    QueuedSink(QueuedSink &&) = delete;
+    QueuedSink & operator=(QueuedSink &&) = delete;
+};
+
+#endif // INCLUDE_QUEUED_SINK_H
@@ -3,41 +3,70 @@
 #include "Sender.h"
 
 #include "BufferUtils.h"
+#include "GatordStats.h"
 #include "Logging.h"
 #include "OlySocket.h"
 #include "SessionData.h"
 #include "lib/File.h"
 
 #include <algorithm>
+#include <cerrno>
 #include <climits>
 #include <cstdlib>
 #include <cstring>
+#include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 Sender::Sender(OlySocket * socket)
-    : mDataSocket(socket), mDataFile(nullptr, fclose), mDataFileName(nullptr), mSendMutex()
+    : mDataSocket(socket),
+      mDataFile(nullptr, fclose),
+      mDataFileName(nullptr),
+      mCompressor(),
+      mMirrors(),
+      mWatchers(),
+      mHistory(),
+      mMaxHistorySize(0),
+      mHistoryComplete(false),
+      mMirrorParts(),
+      mSendMutex()
 {
     // Set up the socket connection
     if (socket != nullptr) {
+        static constexpr char STREAMLINE[] = "STREAMLINE";
+        static constexpr std::size_t STREAMLINE_LENGTH = sizeof(STREAMLINE) - 1;
         char streamline[64] = {0};
         mDataSocket = socket;
 
         // Receive magic sequence - can wait forever
         // Streamline will send data prior to the magic sequence for legacy support, which should be ignored for v4+
-        while (strcmp("STREAMLINE", streamline) != 0) {
+        // Newer hosts may follow the magic with a space separated list of the features they support
+        while (strncmp(STREAMLINE, streamline, STREAMLINE_LENGTH) != 0 ||
+               (streamline[STREAMLINE_LENGTH] != '\0' && streamline[STREAMLINE_LENGTH] != ' ')) {
             if (mDataSocket->receiveString(streamline, sizeof(streamline)) == -1) {
                 logg.logError("Socket disconnected");
                 handleException();
             }
         }
 
+        bool hostSupportsLz4 = false;
+        char * saveptr = nullptr;
+        for (char * feature = strtok_r(streamline + STREAMLINE_LENGTH, " ", &saveptr); feature != nullptr;
+             feature = strtok_r(nullptr, " ", &saveptr)) {
+            if (strcmp(feature, "lz4") == 0) {
+                hostSupportsLz4 = true;
+            }
+        }
+
         // Send magic sequence - must be done first, after which error messages can be sent
+        // The compression is only started after the setup messages have been exchanged
         char magic[32];
-        snprintf(magic, 32, "GATOR %i\n", PROTOCOL_VERSION);
+        snprintf(magic, 32, hostSupportsLz4 ? "GATOR %i lz4\n" : "GATOR %i\n", PROTOCOL_VERSION);
         mDataSocket->send(magic, strlen(magic));
 
+        gSessionData.mCompression = hostSupportsLz4;
         gSessionData.mWaitingOnCommand = true;
-        logg.logMessage("Completed magic sequence");
+        logg.logMessage("Completed magic sequence%s", hostSupportsLz4 ? " (lz4)" : "");
     }
 
     pthread_mutexattr_t attr;
@@ -50,6 +79,11 @@ Sender::Sender(OlySocket * socket)
 
 Sender::~Sender()
 {
+    // Stop compressing first so that everything still queued makes it out
+    mCompressor.reset();
+    mMirrors.clear();
+    mWatchers.clear();
+
     // Just close it as the client socket is on the stack
     if (mDataSocket != nullptr) {
         mDataSocket->closeSocket();
@@ -72,6 +106,113 @@ void Sender::createDataFile(const char * apcDir)
     }
 }
 
+void Sender::addMirror(const char * apcDir, QueuedSink::SlowConsumerPolicy policy)
+{
+    // Plenty for a short stall, see MAX_PENDING_SIZE in StreamCompressor
+    static constexpr std::size_t MAX_PENDING_SIZE = 16 * 1024 * 1024;
+
+    std::unique_ptr<char[]> fileName {new char[strlen(apcDir) + 12]};
+    sprintf(fileName.get(), "%s/0000000000", apcDir);
+    std::shared_ptr<FILE> file {lib::fopen_cloexec(fileName.get(), "wb"), fclose};
+    if (!file) {
+        logg.logError("Failed to open binary file: %s", fileName.get());
+        handleException();
+    }
+
+    mMirrors.emplace_back(new QueuedSink(apcDir,
+                                         [file](lib::Span<const char, int> data) {
+                                             return fwrite(data.data, 1, data.length, file.get()) ==
+                                                    static_cast<size_t>(data.length);
+                                         },
+                                         MAX_PENDING_SIZE,
+                                         policy));
+}
+
+void Sender::keepHistory(std::size_t maxHistorySize)
+{
+    mMaxHistorySize = maxHistorySize;
+    mHistoryComplete = (mDataSocket != nullptr);
+}
+
+bool Sender::addWatcher(std::unique_ptr<OlySocket> socket, QueuedSink::SlowConsumerPolicy policy)
+{
+    // Plenty for a short stall, see MAX_PENDING_SIZE in StreamCompressor
+    static constexpr std::size_t MAX_PENDING_SIZE = 16 * 1024 * 1024;
+
+    // A connection that stops reading is treated as one that cannot keep up, rather than holding up the sink forever
+    struct timeval timeout = {8, 0};
+    if (setsockopt(socket->getFd(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
+        logg.logMessage("setsockopt failed (%d) %s", errno, strerror(errno));
+    }
+
+    // The stream is never compressed for a watcher, so it does not offer lz4
+    char magic[32];
+    snprintf(magic, sizeof(magic), "GATOR %i\n", PROTOCOL_VERSION);
+
+    if (pthread_mutex_lock(&mSendMutex) != 0) {
+        logg.logError("pthread_mutex_lock failed");
+        handleException();
+    }
+
+    const bool added = mHistoryComplete;
+    if (added) {
+        std::shared_ptr<OlySocket> watcher {std::move(socket)};
+        mWatchers.emplace_back(new QueuedSink("a watching connection",
+                                              [watcher](lib::Span<const char, int> data) {
+                                                  return watcher->trySend(data.data, data.length);
+                                              },
+                                              MAX_PENDING_SIZE,
+                                              policy));
+        const lib::Span<const char, int> history[] = {{mHistory.data(), static_cast<int>(mHistory.size())}};
+        mWatchers.back()->write({magic, static_cast<int>(strlen(magic))}, history);
+    }
+
+    if (pthread_mutex_unlock(&mSendMutex) != 0) {
+        logg.logError("pthread_mutex_unlock failed");
+        handleException();
+    }
+
+    if (!added) {
+        // As gator-main does when there is no session to pass the connection on to
+        static constexpr char MESSAGE[] = "Session already in progress";
+        char header[5];
+        header[0] = static_cast<char>(ResponseType::ERROR);
+        buffer_utils::writeLEInt(header + 1, sizeof(MESSAGE) - 1);
+        if (socket->trySend(magic, strlen(magic)) && socket->trySend(header, sizeof(header))) {
+            socket->trySend(MESSAGE, sizeof(MESSAGE) - 1);
+        }
+        socket->shutdownConnection();
+    }
+
+    return added;
+}
+
+void Sender::startCompression()
+{
+    if (mCompressor) {
+        return;
+    }
+
+    if (mDataSocket != nullptr) {
+        mCompressor.reset(new StreamCompressor([this](lib::Span<const char, int> block) {
+            char header[5];
+            header[0] = static_cast<char>(ResponseType::COMPRESSED_DATA);
+            buffer_utils::writeLEInt(header + 1, block.length);
+            const lib::Span<const char, int> parts[] = {header, block};
+            return trySendToSocket(parts);
+        }));
+    }
+    else if (mDataFile) {
+        mCompressor.reset(
+            new StreamCompressor([this](lib::Span<const char, int> block) { return tryWriteToDataFile(block); }));
+    }
+}
+
+bool Sender::flush()
+{
+    return (!mCompressor) || mCompressor->flush();
+}
+
 void Sender::writeDataParts(lib::Span<const lib::Span<const char, int>> dataParts,
                             ResponseType type,
                             bool ignoreLockErrors)
@@ -94,6 +235,17 @@ void Sender::writeDataParts(lib::Span<const lib::Span<const char, int>> dataPart
         handleException();
     }
 
+    // The compressor thread cannot report its own failure, so whoever writes next does. The error response that
+    // follows is then sent without compression, on the off chance that the socket still works.
+    const bool compressorFailed = mCompressor && mCompressor->failed();
+    if (compressorFailed && (type != ResponseType::ERROR)) {
+        logg.logError("Unable to send the compressed capture data");
+        handleException();
+    }
+
+    GatordStats::ScopedTimer sendTimer {gGatordStats.mSendTime};
+    GatordStats::add(gGatordStats.mSentBytes, length);
+
     // Multiple threads call writeData()
     if (pthread_mutex_lock(&mSendMutex) != 0) {
         if (ignoreLockErrors) {
@@ -103,66 +255,212 @@ void Sender::writeDataParts(lib::Span<const lib::Span<const char, int>> dataPart
         handleException();
     }
 
-    // Send data over the socket connection
-    if (mDataSocket != nullptr) {
-        // Start alarm
-        const int alarmDuration = 8;
-        alarm(alarmDuration);
-
-        // Send data over the socket, sending the type and size first
-        logg.logMessage("Sending data with length %d", length);
-        if (type != ResponseType::RAW) {
+    if (compressorFailed) {
+        if (mDataSocket != nullptr) {
             char header[5];
             header[0] = static_cast<char>(type);
             buffer_utils::writeLEInt(header + 1, length);
-            mDataSocket->send(header, sizeof(header));
-        }
-
-        // 100Kbits/sec * alarmDuration sec / 8 bits/byte
-        const int chunkSize = 100 * 1000 * alarmDuration / 8;
-        for (const auto & data : dataParts) {
-            int pos = 0;
-            while (true) {
-                mDataSocket->send(data.data + pos, std::min(data.length - pos, chunkSize));
-                pos += chunkSize;
-                if (pos >= data.length) {
-                    break;
-                }
-
-                // Reset the alarm
-                alarm(alarmDuration);
-                logg.logMessage("Resetting the alarm");
+            const lib::Span<const char, int> headerPart[] = {header};
+            if (trySendToSocket(headerPart)) {
+                trySendToSocket(dataParts);
+            }
+        }
+    }
+    else if (mCompressor) {
+        // The compressed stream keeps exactly the same framing as the uncompressed one
+        if (mDataSocket != nullptr) {
+            char header[5];
+            header[0] = static_cast<char>(type);
+            buffer_utils::writeLEInt(header + 1, length);
+            mCompressor->write({header, type != ResponseType::RAW ? 5 : 0}, dataParts);
+        }
+        else if (type == ResponseType::APC_DATA || type == ResponseType::RAW) {
+            char header[4];
+            buffer_utils::writeLEInt(header, length);
+            mCompressor->write({header, type != ResponseType::RAW ? 4 : 0}, dataParts);
+        }
+    }
+    else {
+        // Send data over the socket connection
+        if (mDataSocket != nullptr) {
+            // Send data over the socket, sending the type and size first
+            logg.logMessage("Sending data with length %d", length);
+            if (type != ResponseType::RAW) {
+                char header[5];
+                header[0] = static_cast<char>(type);
+                buffer_utils::writeLEInt(header + 1, length);
+                const lib::Span<const char, int> headerPart[] = {header};
+                sendToSocket(headerPart);
+            }
+
+            sendToSocket(dataParts);
+        }
+
+        // Write data to disk as long as it is not meta data
+        if (mDataFile && (type == ResponseType::APC_DATA || type == ResponseType::RAW)) {
+            logg.logMessage("Writing data with length %d", length);
+
+            if (type != ResponseType::RAW) {
+                char header[4];
+                buffer_utils::writeLEInt(header, length);
+                writeToDataFile(header);
+            }
+
+            for (const auto & data : dataParts) {
+                writeToDataFile(data);
             }
         }
+    }
+
+    if ((!mMirrors.empty()) && (type == ResponseType::APC_DATA || type == ResponseType::RAW)) {
+        writeToMirrors(dataParts, type, length);
+    }
+
+    if ((mDataSocket != nullptr) && (mHistoryComplete || !mWatchers.empty())) {
+        writeToWatchers(dataParts, type, length);
+    }
+
+    if (pthread_mutex_unlock(&mSendMutex) != 0) {
+        logg.logError("pthread_mutex_unlock failed");
+        handleException();
+    }
+}
 
-        // Stop alarm
-        alarm(0);
+void Sender::writeToMirrors(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type, int length)
+{
+    // Same format as the data file
+    if ((type != ResponseType::RAW) || gSessionData.mLocalCapture) {
+        char header[4];
+        buffer_utils::writeLEInt(header, length);
+        for (const auto & mirror : mMirrors) {
+            mirror->write({header, type != ResponseType::RAW ? 4 : 0}, dataParts);
+        }
+        return;
     }
 
-    // Write data to disk as long as it is not meta data
-    if (mDataFile && (type == ResponseType::APC_DATA || type == ResponseType::RAW)) {
-        logg.logMessage("Writing data with length %d", length);
-        // Send data to the data file
-        auto writeData = [this](lib::Span<const char, int> data) {
-            if (fwrite(data.data, 1, data.length, mDataFile.get()) != static_cast<size_t>(data.length)) {
-                logg.logError("Failed writing binary file %s", mDataFileName.get());
+    // In live mode each Buffer frame starts with the response type for the socket, see Buffer::beginFrameOrMessage,
+    // which the data file does not have, so only take the length and data of each frame. A frame may straddle the
+    // parts.
+    mMirrorParts.clear();
+    std::size_t partIndex = 0;
+    int partOffset = 0;
+    const auto take = [&](int count, bool keep, char * copy) {
+        while (count > 0) {
+            if (partIndex >= dataParts.size()) {
+                logg.logError("Truncated frame in capture data");
                 handleException();
             }
-        };
+            const auto & part = dataParts[partIndex];
+            const int taken = std::min(count, part.length - partOffset);
+            if (keep && (taken > 0)) {
+                mMirrorParts.push_back({part.data + partOffset, taken});
+            }
+            if (copy != nullptr) {
+                memcpy(copy, part.data + partOffset, taken);
+                copy += taken;
+            }
+            partOffset += taken;
+            count -= taken;
+            if (partOffset == part.length) {
+                ++partIndex;
+                partOffset = 0;
+            }
+        }
+    };
 
-        if (type != ResponseType::RAW) {
-            char header[4];
-            buffer_utils::writeLEInt(header, length);
-            writeData(header);
+    int remaining = length;
+    while (remaining > 0) {
+        char frameHeader[5];
+        // ResponseType::APC_DATA packs to a single byte
+        take(1, false, frameHeader);
+        take(4, true, frameHeader + 1);
+        const int frameLength = buffer_utils::readLEInt(frameHeader + 1);
+        take(frameLength, true, nullptr);
+        remaining -= 5 + frameLength;
+    }
+
+    for (const auto & mirror : mMirrors) {
+        mirror->write({nullptr, 0}, mMirrorParts);
+    }
+}
+
+void Sender::writeToWatchers(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type, int length)
+{
+    // Same format as the socket before any compression
+    char header[5];
+    header[0] = static_cast<char>(type);
+    buffer_utils::writeLEInt(header + 1, length);
+    const lib::Span<const char, int> headerPart {header, type != ResponseType::RAW ? 5 : 0};
+
+    if (mHistoryComplete) {
+        if (mHistory.size() + headerPart.length + length > mMaxHistorySize) {
+            logg.logMessage("The capture is now too long for further connections to watch it");
+            mHistoryComplete = false;
+            std::vector<char>().swap(mHistory);
+        }
+        else {
+            mHistory.insert(mHistory.end(), headerPart.data, headerPart.data + headerPart.length);
+            for (const auto & data : dataParts) {
+                mHistory.insert(mHistory.end(), data.data, data.data + data.length);
+            }
         }
+    }
+
+    for (const auto & watcher : mWatchers) {
+        watcher->write(headerPart, dataParts);
+    }
+}
+
+void Sender::sendToSocket(lib::Span<const lib::Span<const char, int>> dataParts)
+{
+    if (!trySendToSocket(dataParts)) {
+        handleException();
+    }
+}
 
-        for (const auto & data : dataParts) {
-            writeData(data);
+bool Sender::trySendToSocket(lib::Span<const lib::Span<const char, int>> dataParts)
+{
+    // Start alarm
+    const int alarmDuration = 8;
+    alarm(alarmDuration);
+
+    // 100Kbits/sec * alarmDuration sec / 8 bits/byte
+    const int chunkSize = 100 * 1000 * alarmDuration / 8;
+    for (const auto & data : dataParts) {
+        int pos = 0;
+        while (true) {
+            if (!mDataSocket->trySend(data.data + pos, std::min(data.length - pos, chunkSize))) {
+                alarm(0);
+                return false;
+            }
+            pos += chunkSize;
+            if (pos >= data.length) {
+                break;
+            }
+
+            // Reset the alarm
+            alarm(alarmDuration);
+            logg.logMessage("Resetting the alarm");
         }
     }
 
-    if (pthread_mutex_unlock(&mSendMutex) != 0) {
-        logg.logError("pthread_mutex_unlock failed");
+    // Stop alarm
+    alarm(0);
+    return true;
+}
+
+void Sender::writeToDataFile(lib::Span<const char, int> data)
+{
+    if (!tryWriteToDataFile(data)) {
         handleException();
     }
 }
+
+bool Sender::tryWriteToDataFile(lib::Span<const char, int> data)
+{
+    if (fwrite(data.data, 1, data.length, mDataFile.get()) != static_cast<size_t>(data.length)) {
+        logg.logError("Failed writing binary file %s", mDataFileName.get());
+        return false;
+    }
+    return true;
+}
@@ -4,10 +4,13 @@
 #define __SENDER_H__
 
 #include "ISender.h"
+#include "QueuedSink.h"
+#include "StreamCompressor.h"
 
 #include <cstdio>
 #include <memory>
 #include <pthread.h>
+#include <vector>
 
 class OlySocket;
 
@@ -20,12 +23,61 @@ public:
                         bool ignoreLockErrors = false) override;
     void createDataFile(const char * apcDir);
 
+    /**
+     * Also write the capture data, uncompressed, to <apcDir>/0000000000 from a queue of its own
+     * so that a slow disk cannot hold up the other outputs unless policy is BLOCK
+     */
+    void addMirror(const char * apcDir, QueuedSink::SlowConsumerPolicy policy);
+
+    /**
+     * Keep the first maxHistorySize bytes of what is sent to the socket, so that addWatcher can send a late connection
+     * the capture from the start
+     */
+    void keepHistory(std::size_t maxHistorySize);
+
+    /**
+     * Also send what is sent to the socket, uncompressed, to another connection from a queue of its own, after a magic
+     * sequence of its own and the history. Anything the connection sends is ignored.
+     *
+     * @return False if the history is no longer complete, in which case the connection is sent an error and closed
+     */
+    bool addWatcher(std::unique_ptr<OlySocket> socket, QueuedSink::SlowConsumerPolicy policy);
+
+    /**
+     * Compress everything written from now on, either because Streamline asked for it
+     * during the handshake or because --compress was given for a local capture
+     */
+    void startCompression();
+
+    /**
+     * Wait until any data queued for compression has been sent
+     *
+     * @return false if it could not be sent, the error has already been logged
+     */
+    bool flush();
+
 private:
     OlySocket * mDataSocket;
     std::unique_ptr<FILE, int (*)(FILE *)> mDataFile;
     std::unique_ptr<char[]> mDataFileName;
+    std::unique_ptr<StreamCompressor> mCompressor;
+    std::vector<std::unique_ptr<QueuedSink>> mMirrors;
+    std::vector<std::unique_ptr<QueuedSink>> mWatchers;
+    // everything sent to the socket so far, for addWatcher
+    std::vector<char> mHistory;
+    std::size_t mMaxHistorySize;
+    bool mHistoryComplete;
+    // the parts of a RAW message that go to the mirrors, reused under mSendMutex
+    std::vector<lib::Span<const char, int>> mMirrorParts;
     pthread_mutex_t mSendMutex;
 
+    void sendToSocket(lib::Span<const lib::Span<const char, int>> dataParts);
+    bool trySendToSocket(lib::Span<const lib::Span<const char, int>> dataParts);
+    void writeToDataFile(lib::Span<const char, int> data);
+    bool tryWriteToDataFile(lib::Span<const char, int> data);
+    void writeToMirrors(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type, int length);
+    void writeToWatchers(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type, int length);
+
     // Intentionally unimplemented
     Sender(const Sender &) = delete;
     Sender & operator=(const Sender &) = delete;
@@ -14,6 +14,7 @@
 #include "SessionXML.h"
 #include "lib/File.h"
 #include "lib/Format.h"
+#include "lib/GenericTimerClock.h"
 #include "lib/Time.h"
 #include "mali_userspace/MaliInstanceLocator.h"
 
@@ -36,6 +37,7 @@ SessionData::SessionData()
     : mSharedData(),
       mImages(),
       mConfigurationXMLPath(),
+      mFlightRecorderTrigger(),
       mSessionXMLPath(),
       mEventsXMLPath(),
       mEventsXMLAppend(),
@@ -46,6 +48,11 @@ SessionData::SessionData()
       mCaptureUser(),
       mWaitForProcessCommand(),
       mPids(),
+      mMirrorTargets(),
+      mMirrorPolicy(QueuedSink::SlowConsumerPolicy::BLOCK),
+      mMirrorAPCDirs(),
+      mWatchHistorySize(0),
+      mThreadPlacements(),
       mStopOnExit(),
       mWaitingOnCommand(),
       mSessionIsActive(),
@@ -56,6 +63,13 @@ SessionData::SessionData()
       mAllowCommands(),
       mFtraceRaw(),
       mSystemWide(),
+      mCompression(),
+      mSingleSyncThread(),
+      mFlightRecorder(),
+      mKernelFilter(),
+      mUserspaceCounters(),
+      mMultiplexCounters(),
+      mMultiplexCounterLimit(0),
       mAndroidApiLevel(),
       mMonotonicStarted(),
       mBacktraceDepth(),
@@ -68,6 +82,11 @@ SessionData::SessionData()
       parameterSetFlag(),
       mPerfMmapSizeInPages(),
       mSpeSampleRate(-1),
+      mSampleAggregationWindowMs(0),
+      mInternedCallchains(0),
+      mUserStackSize(0),
+      mAdaptiveSamplingMaxScale(1),
+      mSamplePeriodScale(1),
       mCounters()
 {
 }
@@ -83,8 +102,23 @@ void SessionData::initialize()
     mAllowCommands = false;
     mFtraceRaw = false;
     mSystemWide = false;
+    mCompression = false;
+    mSingleSyncThread = false;
+    mFlightRecorder = false;
+    mKernelFilter = false;
+    mUserspaceCounters = false;
+    mMultiplexCounters = false;
+    mMultiplexCounterLimit = 0;
     mImages.clear();
     mConfigurationXMLPath = nullptr;
+    mFlightRecorderTrigger = nullptr;
+    mMirrorTargets.clear();
+    mMirrorPolicy = QueuedSink::SlowConsumerPolicy::BLOCK;
+    mMirrorAPCDirs.clear();
+    mWatchHistorySize = 0;
+    for (auto & placement : mThreadPlacements) {
+        placement = ThreadPlacement();
+    }
     mSessionXMLPath = nullptr;
     mEventsXMLPath = nullptr;
     mEventsXMLAppend = nullptr;
@@ -178,12 +212,7 @@ void SessionData::parseSessionXML(char * xmlString)
 
 uint64_t getTime()
 {
-    struct timespec ts;
-    if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0) {
-        logg.logError("Failed to get uptime");
-        handleException();
-    }
-    return (NS_PER_S * ts.tv_sec + ts.tv_nsec);
+    return lib::GenericTimerClock::instance().getTimeNs();
 }
 
 int getEventKey()
@@ -7,9 +7,12 @@
 #include "Configuration.h"
 #include "Counter.h"
 #include "GatorCLIFlags.h"
+#include "QueuedSink.h"
+#include "ThreadFactory.h"
 #include "lib/SharedMemory.h"
 #include "mxml/mxml.h"
 
+#include <atomic>
 #include <cstdint>
 #include <list>
 #include <map>
@@ -37,7 +40,8 @@ public:
 
     size_t mMaliUtgardCountersSize;
     char mMaliUtgardCounters[1 << 12];
-    size_t mMaliMidgardCountersSize;
+    /// written last, by whichever process first reads the directory from Midgard
+    std::atomic<size_t> mMaliMidgardCountersSize;
     char mMaliMidgardCounters[1 << 13];
 
 private:
@@ -61,6 +65,8 @@ public:
 
     std::list<std::string> mImages;
     const char * mConfigurationXMLPath;
+    // with mFlightRecorder, the capture ends once this file exists
+    const char * mFlightRecorderTrigger;
     const char * mSessionXMLPath;
     const char * mEventsXMLPath;
     const char * mEventsXMLAppend;
@@ -71,6 +77,15 @@ public:
     const char * mCaptureUser;
     const char * mWaitForProcessCommand;
     std::set<int> mPids;
+    // extra directories to write a copy of the capture to, see Sender::addMirror
+    std::vector<const char *> mMirrorTargets;
+    QueuedSink::SlowConsumerPolicy mMirrorPolicy;
+    // the APC directories created for mMirrorTargets, removed with the primary one if the capture fails
+    std::vector<const char *> mMirrorAPCDirs;
+    // how much of a live capture to keep for connections that watch it, 0 to refuse them, see Sender::addWatcher
+    std::size_t mWatchHistorySize;
+    // indexed by ThreadRole, see thread_factory::applyPlacement
+    ThreadPlacement mThreadPlacements[NUMBER_OF_THREAD_ROLES];
     bool mStopOnExit;
 
     bool mWaitingOnCommand;
@@ -83,6 +98,20 @@ public:
     bool mAllowCommands;
     bool mFtraceRaw;
     bool mSystemWide;
+    // compress the capture stream, see StreamCompressor
+    bool mCompression;
+    // take the per CPU SPE sync records from one thread, see PerfSyncThreadBuffer
+    bool mSingleSyncThread;
+    // keep only the most recent perf data and send it when the capture ends, see PerfBuffer::snapshot
+    bool mFlightRecorder;
+    // in system-wide mode, drop the samples of other processes in the kernel, see PerfSampleFilter
+    bool mKernelFilter;
+    // read counting events from gatord threads rather than through perf samples, see PerfCounterReader
+    bool mUserspaceCounters;
+    // split the counters of each PMU into flexible groups the kernel multiplexes, see PerfEventGroup::addEvent
+    bool mMultiplexCounters;
+    // with mMultiplexCounters, the counters per group, software ones included, instead of the PMU's, 0 for the PMU's
+    int mMultiplexCounterLimit;
     int mAndroidApiLevel;
 
     int64_t mMonotonicStarted;
@@ -97,6 +126,16 @@ public:
     int64_t parameterSetFlag;
     int mPerfMmapSizeInPages;
     int mSpeSampleRate;
+    // EBS samples are counted over windows of this length instead of being sent, 0 to disable
+    int mSampleAggregationWindowMs;
+    // the number of distinct callchains sent once and then referred to by id, 0 to disable
+    int mInternedCallchains;
+    // bytes of the user stack copied with each sample to be unwound in gatord, 0 to use the kernel's frame pointer walk
+    int mUserStackSize;
+    // the sample periods may be stretched up to this many times under buffer pressure, 1 to disable
+    int mAdaptiveSamplingMaxScale;
+    // the current stretch, see PerfSamplingGovernor
+    std::atomic<int> mSamplePeriodScale;
 
     // PMU Counters
     Counter mCounters[MAX_PERFORMANCE_COUNTERS];
@@ -3,6 +3,7 @@
 #include "SimpleDriver.h"
 
 #include "Counter.h"
+#include "xml/XmlWriter.h"
 
 SimpleDriver::~SimpleDriver()
 {
@@ -47,12 +48,13 @@ void SimpleDriver::setupCounter(Counter & counter)
     counter.setKey(driverCounter->getKey());
 }
 
-int SimpleDriver::writeCounters(mxml_node_t * root) const
+int SimpleDriver::writeCounters(XmlWriter & writer) const
 {
     int count = 0;
     for (DriverCounter * counter = mCounters; counter != nullptr; counter = counter->getNext()) {
-        mxml_node_t * node = mxmlNewElement(root, "counter");
-        mxmlElementSetAttr(node, "name", counter->getName());
+        writer.startElement("counter");
+        writer.attribute("name", counter->getName());
+        writer.endElement();
         ++count;
     }
 
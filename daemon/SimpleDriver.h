@@ -14,7 +14,7 @@ public:
     bool countersEnabled() const;
     void resetCounters() override;
     void setupCounter(Counter & counter) override;
-    int writeCounters(mxml_node_t * root) const override;
+    int writeCounters(XmlWriter & writer) const override;
 
 protected:
     SimpleDriver(const char * name) : Driver(name), mCounters(nullptr) {}
@@ -3,27 +3,18 @@
 #include "Source.h"
 
 #include "Child.h"
-#include "Logging.h"
+#include "ThreadFactory.h"
 
-Source::Source(Child & child) : mChild(child), mThreadID()
+Source::Source(Child & child) : mChild(child), mThread()
 {
 }
 
 void Source::start()
 {
-    if (pthread_create(&mThreadID, nullptr, runStatic, this) != 0) {
-        logg.logError("Failed to create source thread");
-        handleException();
-    }
+    mThread = thread_factory::create(ThreadRole::SOURCE, [this]() { run(); });
 }
 
-void Source::join() const
+void Source::join()
 {
-    pthread_join(mThreadID, nullptr);
-}
-
-void * Source::runStatic(void * arg)
-{
-    static_cast<Source *>(arg)->run();
-    return nullptr;
+    mThread.join();
 }
@@ -3,7 +3,7 @@
 #ifndef SOURCE_H
 #define SOURCE_H
 
-#include <pthread.h>
+#include <thread>
 
 class Child;
 class ISender;
@@ -17,7 +17,7 @@ public:
     void start();
     virtual void run() = 0;
     virtual void interrupt() = 0;
-    void join() const;
+    void join();
 
     virtual bool isDone() = 0;
     virtual void write(ISender & sender) = 0;
@@ -27,9 +27,7 @@ protected:
     Child & mChild;
 
 private:
-    static void * runStatic(void * arg);
-
-    pthread_t mThreadID;
+    std::thread mThread;
 
     // Intentionally undefined
     Source(const Source &) = delete;
@@ -44,6 +44,8 @@ GATORD_CXX_SRC_FILES := \
     FSDriver.cpp \
     FtraceDriver.cpp \
     GatorCLIParser.cpp \
+    GatordDriver.cpp \
+    GatordStats.cpp \
     HwmonDriver.cpp \
     armnn/PacketDecoder.cpp \
     armnn/PacketEncoder.cpp \
@@ -69,6 +71,9 @@ GATORD_CXX_SRC_FILES := \
     lib/File.cpp \
     lib/FileDescriptor.cpp \
     lib/FsEntry.cpp \
+    lib/GenericTimerClock.cpp \
+    lib/LargeBuffer.cpp \
+    lib/Lz4.cpp \
     lib/Popen.cpp \
     lib/Utils.cpp \
     lib/WaitForProcessPoller.cpp \
@@ -79,17 +84,25 @@ GATORD_CXX_SRC_FILES := \
     linux/SysfsSummaryInformation.cpp \
     linux/perf/PerfBuffer.cpp \
     linux/perf/PerfAttrsBuffer.cpp \
+    linux/perf/PerfCallchainInterner.cpp \
+    linux/perf/PerfCounterReader.cpp \
     linux/perf/PerfCpuOnlineMonitor.cpp \
     linux/perf/PerfDriver.cpp \
     linux/perf/PerfDriverConfiguration.cpp \
     linux/perf/PerfEventGroup.cpp \
     linux/perf/PerfEventGroupIdentifier.cpp \
     linux/perf/PerfGroups.cpp \
+    linux/perf/PerfSampleAggregator.cpp \
+    linux/perf/PerfSampleFilter.cpp \
+    linux/perf/PerfSamplingGovernor.cpp \
     linux/perf/PerfSource.cpp \
     linux/perf/PerfSyncThread.cpp \
     linux/perf/PerfSyncThreadBuffer.cpp \
+    linux/perf/PerfUnwindTable.cpp \
+    linux/perf/PerfUserStackUnwinder.cpp \
     linux/proc/ProcessChildren.cpp \
     linux/proc/ProcessPollerBase.cpp \
+    linux/proc/ProcessTreeTracker.cpp \
     linux/proc/ProcLoadAvgFileRecord.cpp \
     linux/proc/ProcPidStatFileRecord.cpp \
     linux/proc/ProcPidStatmFileRecord.cpp \
@@ -126,13 +139,16 @@ GATORD_CXX_SRC_FILES := \
     PolledDriver.cpp \
     PrimarySourceProvider.cpp \
     Proc.cpp \
+    QueuedSink.cpp \
     Sender.cpp \
     SessionData.cpp \
     SessionXML.cpp \
     SimpleDriver.cpp \
     Source.cpp \
+    StreamCompressor.cpp \
     StreamlineSetup.cpp \
     SummaryBuffer.cpp \
+    ThreadFactory.cpp \
     Tracepoints.cpp \
     TtraceDriver.cpp \
     UEvent.cpp \
@@ -141,4 +157,9 @@ GATORD_CXX_SRC_FILES := \
     xml/EventsXMLProcessor.cpp \
     xml/MxmlUtils.cpp \
     xml/PmuXML.cpp \
-    xml/PmuXMLParser.cpp
+    xml/PmuXMLParser.cpp \
+    xml/XmlWriter.cpp
+
+GATORD_BENCHMARK_CXX_SRC_FILES := \
+    benchmark/Benchmark.cpp \
+    benchmark/SyntheticProducers.cpp
@@ -0,0 +1,177 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "StreamCompressor.h"
+
+#include "BufferUtils.h"
+#include "Logging.h"
+#include "ThreadFactory.h"
+#include "lib/Lz4.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sys/prctl.h>
+
+constexpr std::uint32_t StreamCompressor::STORED_FLAG;
+constexpr std::size_t StreamCompressor::BLOCK_HEADER_SIZE;
+constexpr std::size_t StreamCompressor::BLOCK_SIZE;
+constexpr std::size_t StreamCompressor::MAX_PENDING_SIZE;
+
+StreamCompressor::StreamCompressor(Sink sink)
+    : mSink(std::move(sink)),
+      mMutex(),
+      mDataAvailable(),
+      mSpaceAvailable(),
+      mPending(),
+      mCompressed(BLOCK_HEADER_SIZE + lib::lz4::compressBound(BLOCK_SIZE)),
+      mBytesIn(0),
+      mBytesOut(0),
+      mFlushWaiters(0),
+      mBusy(false),
+      mStop(false),
+      mFailed(false),
+      mThread()
+{
+    mPending.reserve(BLOCK_SIZE);
+    mThread = thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { run(); });
+}
+
+StreamCompressor::~StreamCompressor()
+{
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mStop = true;
+    }
+    mDataAvailable.notify_all();
+
+    // should never happen as the sink cannot call handleException, but a thread cannot join itself
+    if (std::this_thread::get_id() == mThread.get_id()) {
+        mThread.detach();
+        return;
+    }
+    mThread.join();
+
+    logg.logMessage("Compressed %llu bytes to %llu bytes",
+                    static_cast<unsigned long long>(mBytesIn),
+                    static_cast<unsigned long long>(mBytesOut));
+}
+
+void StreamCompressor::write(lib::Span<const char, int> header,
+                             lib::Span<const lib::Span<const char, int>> dataParts)
+{
+    std::size_t length = header.length;
+    for (const auto & data : dataParts) {
+        length += data.length;
+    }
+
+    std::unique_lock<std::mutex> lock {mMutex};
+
+    // nothing will take it any more
+    if (failed()) {
+        return;
+    }
+
+    // a write larger than the limit is allowed through once everything before it has been taken; the
+    // compressor thread itself may end up here while reporting an error, so it must never wait
+    if (std::this_thread::get_id() != mThread.get_id()) {
+        mSpaceAvailable.wait(lock, [this, length]() {
+            return failed() || mPending.empty() || (mPending.size() + length <= MAX_PENDING_SIZE);
+        });
+        if (failed()) {
+            return;
+        }
+    }
+
+    mPending.insert(mPending.end(), header.data, header.data + header.length);
+    for (const auto & data : dataParts) {
+        mPending.insert(mPending.end(), data.data, data.data + data.length);
+    }
+    mBytesIn += length;
+
+    if (mPending.size() >= BLOCK_SIZE) {
+        lock.unlock();
+        mDataAvailable.notify_one();
+    }
+}
+
+bool StreamCompressor::flush()
+{
+    if (std::this_thread::get_id() == mThread.get_id()) {
+        return !failed();
+    }
+
+    std::unique_lock<std::mutex> lock {mMutex};
+    ++mFlushWaiters;
+    mDataAvailable.notify_one();
+    mSpaceAvailable.wait(lock, [this]() { return failed() || (mPending.empty() && !mBusy); });
+    --mFlushWaiters;
+    return !failed();
+}
+
+void StreamCompressor::run()
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-compress"), 0, 0, 0);
+
+    // Partial blocks are still sent after this long so that a live capture keeps updating
+    static constexpr std::chrono::milliseconds MAX_LATENCY {100};
+
+    std::vector<char> working;
+    working.reserve(BLOCK_SIZE);
+
+    std::unique_lock<std::mutex> lock {mMutex};
+    while (true) {
+        mDataAvailable.wait_for(lock, MAX_LATENCY, [this]() {
+            return mStop || (!mPending.empty() && ((mFlushWaiters > 0) || (mPending.size() >= BLOCK_SIZE)));
+        });
+
+        if (mPending.empty()) {
+            if (mStop) {
+                break;
+            }
+            continue;
+        }
+
+        working.swap(mPending);
+        mBusy = true;
+        lock.unlock();
+        mSpaceAvailable.notify_all();
+
+        bool sent = true;
+        for (std::size_t offset = 0; sent && (offset < working.size()); offset += BLOCK_SIZE) {
+            sent = compressAndSend(working.data() + offset, std::min(BLOCK_SIZE, working.size() - offset));
+        }
+        working.clear();
+
+        lock.lock();
+        mBusy = false;
+        if (!sent) {
+            mFailed.store(true, std::memory_order_release);
+            mPending.clear();
+        }
+        mSpaceAvailable.notify_all();
+    }
+}
+
+bool StreamCompressor::compressAndSend(const char * data, std::size_t length)
+{
+    char * const block = mCompressed.data();
+    std::size_t storedLength = lib::lz4::compressBlock(data,
+                                                       length,
+                                                       block + BLOCK_HEADER_SIZE,
+                                                       mCompressed.size() - BLOCK_HEADER_SIZE);
+    std::uint32_t storedFlag = 0;
+
+    // incompressible data is stored as is rather than making it bigger
+    if ((storedLength == 0) || (storedLength >= length)) {
+        memcpy(block + BLOCK_HEADER_SIZE, data, length);
+        storedLength = length;
+        storedFlag = STORED_FLAG;
+    }
+
+    buffer_utils::writeLEInt(block, storedLength | storedFlag);
+    buffer_utils::writeLEInt(block + 4, length);
+
+    const std::size_t blockLength = BLOCK_HEADER_SIZE + storedLength;
+    mBytesOut += blockLength;
+    return mSink({block, static_cast<int>(blockLength)});
+}
@@ -0,0 +1,87 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_STREAM_COMPRESSOR_H
+#define INCLUDE_STREAM_COMPRESSOR_H
+
+#include "lib/Span.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Compresses a byte stream on a dedicated thread so that the producers (the sender thread and friends)
+ * only pay for a memcpy.
+ *
+ * The output is a sequence of blocks, each of which is
+ *
+ *     [LE32 storedLength | STORED_FLAG if the payload is not compressed][LE32 rawLength][payload]
+ *
+ * where the compressed payloads use the LZ4 block format. Each block is passed to the sink in one call.
+ *
+ * The sink runs on the compressor thread so it must not call handleException; it returns false instead, after
+ * which everything else is discarded and failed() is true so that one of the producers can report it.
+ */
+class StreamCompressor {
+public:
+    using Sink = std::function<bool(lib::Span<const char, int>)>;
+
+    static constexpr std::uint32_t STORED_FLAG = 0x80000000U;
+    static constexpr std::size_t BLOCK_HEADER_SIZE = 8;
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+    StreamCompressor(Sink sink);
+
+    /** Compresses anything still pending then stops the thread */
+    ~StreamCompressor();
+
+    /**
+     * Queue some data for compression. Blocks while too much data is waiting to be compressed.
+     *
+     * @param header Written before dataParts, may be empty
+     * @param dataParts The data
+     */
+    void write(lib::Span<const char, int> header, lib::Span<const lib::Span<const char, int>> dataParts);
+
+    /**
+     * Wait until everything written so far has been passed to the sink
+     *
+     * @return false if the sink failed
+     */
+    bool flush();
+
+    /** @return true once the sink has failed */
+    bool failed() const { return mFailed.load(std::memory_order_acquire); }
+
+private:
+    static constexpr std::size_t MAX_PENDING_SIZE = 4 * 1024 * 1024;
+
+    Sink mSink;
+    std::mutex mMutex;
+    std::condition_variable mDataAvailable;
+    std::condition_variable mSpaceAvailable;
+    std::vector<char> mPending;
+    std::vector<char> mCompressed;
+    std::uint64_t mBytesIn;
+    std::uint64_t mBytesOut;
+    int mFlushWaiters;
+    bool mBusy;
+    bool mStop;
+    std::atomic<bool> mFailed;
+    std::thread mThread;
+
+    void run();
+    bool compressAndSend(const char * data, std::size_t length);
+
+    // Intentionally unimplemented
+    StreamCompressor(const StreamCompressor &) = delete;
+    StreamCompressor & operator=(const StreamCompressor &) = delete;
+    StreamCompressor(StreamCompressor &&) = delete;
+    StreamCompressor & operator=(StreamCompressor &&) = delete;
+};
+
+#endif // INCLUDE_STREAM_COMPRESSOR_H
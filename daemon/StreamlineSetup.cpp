@@ -124,8 +124,7 @@ void StreamlineSetup::handleRequest(char * xml)
         attr = mxmlElementGetAttr(node, ATTR_TYPE);
     }
     if ((attr != nullptr) && strcmp(attr, VALUE_EVENTS) == 0) {
-        const auto xml = events_xml::getDynamicXML(mDrivers.getAllConst(),
-                                                   mDrivers.getPrimarySourceProvider().getCpuInfo().getClusters());
+        const auto xml = events_xml::getDynamicXML(mDrivers.getStaticEventsXml(), mDrivers.getAllConst());
         sendString(xml.get(), ResponseType::XML);
         logg.logMessage("Sent events xml response");
     }
@@ -0,0 +1,291 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "ThreadFactory.h"
+
+#include "Logging.h"
+#include "SessionData.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace thread_factory {
+    namespace {
+        struct NamedValue {
+            const char * name;
+            int value;
+        };
+
+        constexpr NamedValue ROLES[] = {
+            {"reader", static_cast<int>(ThreadRole::PER_CPU_READER)},
+            {"source", static_cast<int>(ThreadRole::SOURCE)},
+            {"housekeeping", static_cast<int>(ThreadRole::HOUSEKEEPING)},
+        };
+
+        constexpr NamedValue POLICIES[] = {
+            {"other", SCHED_OTHER},
+            {"batch", SCHED_BATCH},
+            {"idle", SCHED_IDLE},
+            {"fifo", SCHED_FIFO},
+            {"rr", SCHED_RR},
+        };
+
+        template<std::size_t N>
+        bool findValue(const NamedValue (&values)[N], const std::string & name, int & value)
+        {
+            for (const auto & namedValue : values) {
+                if (name == namedValue.name) {
+                    value = namedValue.value;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Enough for 1024 NUMA nodes
+        constexpr std::size_t NODE_MASK_WORDS = 16;
+
+        struct Defaults {
+            cpu_set_t cpus;
+            int policy;
+            struct sched_param param;
+            int nice;
+            bool memoryPolicySaved;
+            int memoryPolicy;
+            unsigned long nodeMask[NODE_MASK_WORDS];
+        };
+
+        // Set in gatord-main before any other threads exist and copied into the child process by fork
+        bool defaultsSaved = false;
+        Defaults defaults;
+
+        bool parseInt(const std::string & string, int & value)
+        {
+            char * end = nullptr;
+            errno = 0;
+            const long result = strtol(string.c_str(), &end, 10);
+            if (string.empty() || (*end != '\0') || (errno != 0) || (result < INT_MIN) || (result > INT_MAX)) {
+                return false;
+            }
+            value = result;
+            return true;
+        }
+
+        bool restoreMemoryPolicy()
+        {
+            if (!defaults.memoryPolicySaved) {
+                return true;
+            }
+            // The kernel ignores the last bit of maxnode
+            return syscall(__NR_set_mempolicy,
+                           defaults.memoryPolicy,
+                           defaults.nodeMask,
+                           sizeof(defaults.nodeMask) * CHAR_BIT + 1) == 0;
+        }
+    }
+
+    bool parseCpuList(const char * list, std::vector<int> & cpus)
+    {
+        std::vector<int> result;
+
+        const std::string string {list};
+        std::size_t start = 0;
+        while (start <= string.size()) {
+            std::size_t end = string.find(',', start);
+            if (end == std::string::npos) {
+                end = string.size();
+            }
+            const std::string range = string.substr(start, end - start);
+            const std::size_t dash = range.find('-');
+            int first;
+            int last;
+            if (dash == std::string::npos) {
+                if (!parseInt(range, first)) {
+                    return false;
+                }
+                last = first;
+            }
+            else if (!parseInt(range.substr(0, dash), first) || !parseInt(range.substr(dash + 1), last)) {
+                return false;
+            }
+            if ((first < 0) || (last < first) || (last >= CPU_SETSIZE)) {
+                return false;
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                result.push_back(cpu);
+            }
+            start = end + 1;
+        }
+
+        cpus = std::move(result);
+        return true;
+    }
+
+    bool parsePlacement(const char * spec, ThreadPlacement (&placements)[NUMBER_OF_THREAD_ROLES])
+    {
+        const std::string string {spec};
+        std::size_t start = string.find(':');
+        int role;
+        if (!findValue(ROLES, string.substr(0, start), role)) {
+            logg.logError("Invalid role in --thread-placement (%s), 'reader', 'source' or 'housekeeping' expected.",
+                          spec);
+            return false;
+        }
+
+        ThreadPlacement placement = placements[role];
+        while (start != std::string::npos) {
+            const std::size_t end = string.find(':', start + 1);
+            const std::string setting = string.substr(start + 1, end - (start + 1));
+            const std::size_t equals = setting.find('=');
+            const std::string key = setting.substr(0, equals);
+            const std::string value = (equals == std::string::npos ? std::string() : setting.substr(equals + 1));
+
+            bool valid;
+            if (key == "cpus") {
+                valid = (role != static_cast<int>(ThreadRole::PER_CPU_READER)) &&
+                        parseCpuList(value.c_str(), placement.cpus);
+            }
+            else if (key == "nice") {
+                valid = parseInt(value, placement.nice) && (placement.nice >= -20) && (placement.nice <= 19);
+            }
+            else if (key == "policy") {
+                valid = findValue(POLICIES, value, placement.policy);
+            }
+            else if (key == "priority") {
+                valid = parseInt(value, placement.priority) && (placement.priority >= 0) &&
+                        (placement.priority <= 99);
+            }
+            else if (key == "node") {
+                valid = parseInt(value, placement.memoryNode) && (placement.memoryNode >= 0) &&
+                        (placement.memoryNode < static_cast<int>(sizeof(unsigned long) * CHAR_BIT));
+            }
+            else {
+                valid = false;
+            }
+
+            if (!valid) {
+                logg.logError("Invalid setting '%s' in --thread-placement (%s)", setting.c_str(), spec);
+                return false;
+            }
+
+            start = end;
+        }
+
+        placements[role] = std::move(placement);
+        return true;
+    }
+
+    void saveDefaults()
+    {
+        const pid_t tid = syscall(__NR_gettid);
+
+        errno = 0;
+        defaults.nice = getpriority(PRIO_PROCESS, tid);
+        defaults.policy = sched_getscheduler(tid);
+        if ((errno != 0) || (defaults.policy < 0) || (sched_getparam(tid, &defaults.param) != 0) ||
+            (sched_getaffinity(tid, sizeof(defaults.cpus), &defaults.cpus) != 0)) {
+            logg.logMessage("Unable to read the scheduling of gatord-main (%d) %s", errno, strerror(errno));
+            return;
+        }
+
+        // ENOSYS without NUMA support, in which case there is nothing to restore
+        memset(defaults.nodeMask, 0, sizeof(defaults.nodeMask));
+        defaults.memoryPolicySaved = syscall(__NR_get_mempolicy,
+                                             &defaults.memoryPolicy,
+                                             defaults.nodeMask,
+                                             sizeof(defaults.nodeMask) * CHAR_BIT,
+                                             nullptr,
+                                             0UL) == 0;
+
+        defaultsSaved = true;
+    }
+
+    bool restoreDefaults()
+    {
+        if (!defaultsSaved) {
+            return true;
+        }
+
+        const pid_t tid = syscall(__NR_gettid);
+        return (sched_setaffinity(tid, sizeof(defaults.cpus), &defaults.cpus) == 0) &&
+               (sched_setscheduler(tid, defaults.policy, &defaults.param) == 0) && restoreMemoryPolicy();
+    }
+
+    void applyPlacement(ThreadRole role, int cpu)
+    {
+        const ThreadPlacement & placement = gSessionData.mThreadPlacements[static_cast<int>(role)];
+        const pid_t tid = syscall(__NR_gettid);
+
+        // Anything not set is put back to the defaults, otherwise a thread would get the placement of whichever
+        // role created it
+        std::vector<int> cpus;
+        if (role != ThreadRole::PER_CPU_READER) {
+            cpus = placement.cpus;
+        }
+        else if (cpu >= 0) {
+            cpus.push_back(cpu);
+        }
+        if ((!cpus.empty()) || defaultsSaved) {
+            cpu_set_t cpuset = defaults.cpus;
+            if (!cpus.empty()) {
+                CPU_ZERO(&cpuset);
+                for (const int c : cpus) {
+                    CPU_SET(c, &cpuset);
+                }
+            }
+            // EINVAL if none of them are online
+            if (sched_setaffinity(tid, sizeof(cpuset), &cpuset) != 0) {
+                logg.logMessage("sched_setaffinity failed for %d (%d) %s", tid, errno, strerror(errno));
+            }
+        }
+
+        if ((placement.policy != ThreadPlacement::INHERIT) || defaultsSaved) {
+            int policy = defaults.policy;
+            struct sched_param param = defaults.param;
+            if (placement.policy != ThreadPlacement::INHERIT) {
+                policy = placement.policy;
+                memset(&param, 0, sizeof(param));
+                if ((policy == SCHED_FIFO) || (policy == SCHED_RR)) {
+                    param.sched_priority = std::max(placement.priority, sched_get_priority_min(policy));
+                }
+            }
+            if (sched_setscheduler(tid, policy, &param) != 0) {
+                logg.logMessage("sched_setscheduler failed for %d (%d) %s", tid, errno, strerror(errno));
+            }
+        }
+
+        if ((placement.nice != ThreadPlacement::INHERIT) || defaultsSaved) {
+            const int nice = (placement.nice != ThreadPlacement::INHERIT ? placement.nice : defaults.nice);
+            if (setpriority(PRIO_PROCESS, tid, nice) != 0) {
+                logg.logMessage("setpriority failed for %d (%d) %s", tid, errno, strerror(errno));
+            }
+        }
+
+        if (placement.memoryNode != ThreadPlacement::INHERIT) {
+            const unsigned long nodeMask = 1UL << placement.memoryNode;
+            // The kernel ignores the last bit of maxnode
+            if (syscall(__NR_set_mempolicy, MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * CHAR_BIT + 1) != 0) {
+                logg.logMessage("set_mempolicy failed for %d (%d) %s", tid, errno, strerror(errno));
+            }
+        }
+        else if (defaultsSaved && !restoreMemoryPolicy()) {
+            logg.logMessage("set_mempolicy failed for %d (%d) %s", tid, errno, strerror(errno));
+        }
+    }
+
+    bool resetPriority(ThreadRole role)
+    {
+        if (gSessionData.mThreadPlacements[static_cast<int>(role)].nice != ThreadPlacement::INHERIT) {
+            return true;
+        }
+        return setpriority(PRIO_PROCESS, syscall(__NR_gettid), 0) == 0;
+    }
+}
@@ -0,0 +1,97 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_THREAD_FACTORY_H
+#define INCLUDE_THREAD_FACTORY_H
+
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** What a gatord thread does, which decides where it runs, see ThreadPlacement */
+enum class ThreadRole {
+    /// reads the data of one CPU so runs on that CPU, for example the ftrace readers and perf sync threads
+    PER_CPU_READER,
+    /// runs a Source or a task of one, producing the capture data
+    SOURCE,
+    /// everything else, for example sending the data, watching processes and the Arm NN connections
+    HOUSEKEEPING,
+};
+
+constexpr std::size_t NUMBER_OF_THREAD_ROLES = 3;
+
+/**
+ * Where the threads of a role run and how they are scheduled, anything left as INHERIT is as it was for gatord-main
+ * when thread_factory::saveDefaults was called
+ */
+struct ThreadPlacement {
+    static constexpr int INHERIT = -1000;
+
+    /// the CPUs the threads may run on, not used for PER_CPU_READER which always runs on its own CPU
+    std::vector<int> cpus {};
+    int nice = INHERIT;
+    /// SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR
+    int policy = INHERIT;
+    /// only used for SCHED_FIFO and SCHED_RR
+    int priority = 0;
+    /// the NUMA node to prefer to allocate memory from
+    int memoryNode = INHERIT;
+};
+
+namespace thread_factory {
+    /**
+     * Parse a Linux CPU list such as "0-3,6"
+     *
+     * @return False if it is not valid
+     */
+    bool parseCpuList(const char * list, std::vector<int> & cpus);
+
+    /**
+     * Parse one --thread-placement "<role>:<key>=<value>[:<key>=<value>...]" into the placement for its role,
+     * logging an error if it is not valid
+     *
+     * @return False if it is not valid
+     */
+    bool parsePlacement(const char * spec, ThreadPlacement (&placements)[NUMBER_OF_THREAD_ROLES]);
+
+    /** Remember the scheduling of the calling thread, to use for anything not set in a ThreadPlacement */
+    void saveDefaults();
+
+    /**
+     * Put the affinity, scheduling policy and memory policy of the calling thread back to what saveDefaults saw,
+     * for processes such as the --app workload that must not run where gatord's own threads do. Does not log so
+     * that it can be called between fork and exec.
+     *
+     * @return False if any could not be restored, errno is set
+     */
+    bool restoreDefaults();
+
+    /**
+     * Apply the placement of the role from gSessionData to the calling thread, failures are only logged
+     *
+     * @param cpu For PER_CPU_READER, the CPU to run on or -1 if the thread does that itself
+     */
+    void applyPlacement(ThreadRole role, int cpu = -1);
+
+    /**
+     * gatord runs at a high priority, so threads that do not need it put themselves back to the default unless
+     * a nice value was given for their role
+     *
+     * @return False if setpriority failed
+     */
+    bool resetPriority(ThreadRole role);
+
+    /** Start a thread that applies the placement of its role before calling function */
+    template<typename Function>
+    std::thread create(ThreadRole role, Function function, int cpu = -1)
+    {
+        return std::thread(
+            [role, cpu](Function && f) {
+                applyPlacement(role, cpu);
+                f();
+            },
+            std::move(function));
+    }
+}
+
+#endif // INCLUDE_THREAD_FACTORY_H
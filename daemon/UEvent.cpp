@@ -5,6 +5,7 @@
 #include "Logging.h"
 #include "OlySocket.h"
 
+#include <cerrno>
 #include <cstring>
 #include <linux/netlink.h>
 #include <sys/socket.h>
@@ -47,12 +48,17 @@ bool UEvent::init()
     return true;
 }
 
-bool UEvent::read(UEventResult * const result)
+UEvent::ReadResult UEvent::read(UEventResult * const result)
 {
     ssize_t bytes = recv(mFd, result->mBuf, sizeof(result->mBuf), 0);
+    if ((bytes < 0) && (errno == ENOBUFS)) {
+        // The socket is still usable, but whatever was dropped must be recovered some other way
+        logg.logMessage("uevents lost");
+        return ReadResult::LOST_EVENTS;
+    }
     if (bytes <= 0) {
         logg.logMessage("recv failed");
-        return false;
+        return ReadResult::FAILED;
     }
 
     result->mAction = EMPTY;
@@ -73,5 +79,5 @@ bool UEvent::read(UEventResult * const result)
         }
     }
 
-    return true;
+    return ReadResult::OK;
 }
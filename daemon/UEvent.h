@@ -12,11 +12,18 @@ struct UEventResult {
 
 class UEvent {
 public:
+    enum class ReadResult {
+        OK,
+        /// The socket's receive buffer overflowed (ENOBUFS), some uevents were dropped
+        LOST_EVENTS,
+        FAILED,
+    };
+
     UEvent();
     ~UEvent();
 
     bool init();
-    bool read(UEventResult * result);
+    ReadResult read(UEventResult * result);
 
     int getFd() const { return mFd; }
 
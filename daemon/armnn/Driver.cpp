@@ -3,6 +3,7 @@
 #include "Driver.h"
 
 #include "../xml/EventsXMLProcessor.h"
+#include "../xml/XmlWriter.h"
 #include "SessionData.h"
 
 namespace armnn {
@@ -36,13 +37,14 @@ namespace armnn {
     }
 
     // Emits available counters
-    int Driver::writeCounters(mxml_node_t * const root) const
+    int Driver::writeCounters(XmlWriter & writer) const
     {
         int count = 0;
         std::vector<std::string> counterNames = mGlobalState.getAllCounterNames();
         for (auto & counterName : counterNames) {
-            mxml_node_t * node = mxmlNewElement(root, "counter");
-            mxmlElementSetAttr(node, "name", counterName.c_str());
+            writer.startElement("counter");
+            writer.attribute("name", counterName.c_str());
+            writer.endElement();
             ++count;
         }
 
@@ -27,7 +27,7 @@ namespace armnn {
         virtual void setupCounter(Counter & counter) override;
 
         // Emits available counters
-        virtual int writeCounters(mxml_node_t * root) const override;
+        virtual int writeCounters(XmlWriter & writer) const override;
 
         // Emits possible dynamically generated events/counters
         void writeEvents(mxml_node_t * const /*unused*/) const override;
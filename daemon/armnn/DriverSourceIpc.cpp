@@ -3,6 +3,7 @@
 #include "armnn/DriverSourceIpc.h"
 
 #include "Logging.h"
+#include "ThreadFactory.h"
 
 #include <cstdio>
 #include <cstring>
@@ -235,11 +236,11 @@ namespace armnn {
             mCountersChannel.set(ParentToChildCounterConsumer {});
         }
 
-        mControlThread = std::thread {[&]() -> void {
+        mControlThread = thread_factory::create(ThreadRole::HOUSEKEEPING, [&]() -> void {
             while (mControlChannel.consumeControlMsg(mArmnnController)) {
             }
             logg.logMessage("Finished listening for armnn start/stop messages");
-        }};
+        });
     }
 
     void DriverSourceIpc::onChildDeath()
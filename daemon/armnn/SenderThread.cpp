@@ -4,12 +4,14 @@
 
 #include "Logging.h"
 #include "SocketIO.h"
+#include "ThreadFactory.h"
 
 #include <cstring>
 
 namespace armnn {
     SenderThread::SenderThread(SocketIO & connection)
-        : mSenderQueue {new SenderQueue {connection}}, mSenderThread {&SenderThread::run, this}
+        : mSenderQueue {new SenderQueue {connection}},
+          mSenderThread {thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { run(); })}
     {
     }
 
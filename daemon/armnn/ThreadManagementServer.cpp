@@ -2,6 +2,7 @@
 #include "ThreadManagementServer.h"
 
 #include "Logging.h"
+#include "ThreadFactory.h"
 
 #include <cassert>
 
@@ -13,8 +14,8 @@ namespace armnn {
           mEnabled {false},
           mDone {false},
           mAcceptor {std::move(acceptor)},
-          mReaperThread {&ThreadManagementServer::reaperLoop, this},
-          mAcceptorThread {&ThreadManagementServer::acceptLoop, this}
+          mReaperThread {thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { reaperLoop(); })},
+          mAcceptorThread {thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { acceptLoop(); })}
     {
     }
 
@@ -86,10 +87,9 @@ namespace armnn {
                 std::unique_ptr<bool> done {new bool {false}};
                 ISession & sessionRef = *threadSession;
                 bool & doneRef = *done;
-                std::unique_ptr<std::thread> t {new std::thread {&ThreadManagementServer::runIndividualThread,
-                                                                 this,
-                                                                 std::ref(sessionRef),
-                                                                 std::ref(doneRef)}};
+                std::unique_ptr<std::thread> t {new std::thread {thread_factory::create(
+                    ThreadRole::HOUSEKEEPING,
+                    [this, &sessionRef, &doneRef]() { runIndividualThread(sessionRef, doneRef); })}};
 
                 addThreadToVector({std::move(t), std::move(threadSession), std::move(done)});
             }
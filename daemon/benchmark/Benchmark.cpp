@@ -0,0 +1,1080 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+/*
+ * End-to-end throughput benchmark of gatord's capture pipeline.
+ *
+ * Synthetic producers generate data the way the sources do, into the real PerfBuffer, Buffer, TimestampCorrector and
+ * armnn::PacketDecoder, and a sender thread that mirrors Child's writes it out through either a null ISender or the
+ * real Sender writing a capture file. The throughput, CPU time per MB and the latency from commit to send are
+ * reported.
+ *
+ * With --timestamps, the cost per call and the accuracy of the generic timer clock against clock_gettime are measured
+ * instead. With --uevents, the latency from a synthetic CPU hotplug uevent to PerfCpuOnlineMonitor's callback is.
+ * With --check-mirror, the same frames are written as a local capture and through a --mirror-output of a live one,
+ * which must produce identical files. With --check-compression, the compressed capture file is decoded block by block
+ * and compared with an uncompressed mirror of the same capture, and --decompress decodes an existing one. With
+ * --flight-recorder, every CPU is sampled into overwriting rings as
+ * --flight-recorder does, and the CPU time while they only overwrite and the latency from the trigger to the snapshot
+ * being sent are. With --prepare-sources, sources that are slow to prepare go through Child::createAndPrepare, which
+ * must take as long as the slowest of them rather than all of them.
+ */
+
+#include "Buffer.h"
+#include "BufferUtils.h"
+#include "Child.h"
+#include "Drivers.h"
+#include "GatordStats.h"
+#include "ISender.h"
+#include "Logging.h"
+#include "Proc.h"
+#include "Sender.h"
+#include "SessionData.h"
+#include "Source.h"
+#include "StreamCompressor.h"
+#include "benchmark/SyntheticProducers.h"
+#include "lib/GenericTimerClock.h"
+#include "lib/LargeBuffer.h"
+#include "lib/Lz4.h"
+#include "k/perf_event.h"
+#include "lib/Syscall.h"
+#include "linux/perf/PerfAttrsBuffer.h"
+#include "linux/perf/PerfBuffer.h"
+#include "linux/perf/PerfCpuOnlineMonitor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <getopt.h>
+#include <iterator>
+#include <linux/netlink.h>
+#include <memory>
+#include <mutex>
+#include <semaphore.h>
+#include <string>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Normally provided by main.cpp, which is not linked into the benchmark
+void cleanUp()
+{
+}
+
+namespace {
+    using namespace benchmark;
+
+    constexpr double BYTES_PER_MB = 1024.0 * 1024.0;
+
+    /** Discards everything, so only the cost of producing and framing the data is measured */
+    class NullSender : public ISender {
+    public:
+        void writeDataParts(lib::Span<const lib::Span<const char, int>> /*dataParts*/,
+                            ResponseType /*type*/,
+                            bool /*ignoreLockErrors*/) override
+        {
+        }
+    };
+
+    /** As Child's CountingSender, but per producer */
+    class CountingSender : public ISender {
+    public:
+        CountingSender(ISender & sender, std::uint64_t & bytes) : mSender(sender), mBytes(bytes) {}
+
+        void writeDataParts(lib::Span<const lib::Span<const char, int>> dataParts,
+                            ResponseType type,
+                            bool ignoreLockErrors) override
+        {
+            for (const auto & part : dataParts) {
+                mBytes += part.size();
+            }
+            mSender.writeDataParts(dataParts, type, ignoreLockErrors);
+        }
+
+    private:
+        ISender & mSender;
+        std::uint64_t & mBytes;
+    };
+
+    struct Options {
+        int durationSeconds = 5;
+        std::vector<std::string> producers {"perf", "counters", "annotate", "armnn"};
+        const char * outputDir = nullptr;
+        bool compress = false;
+        bool checkCompression = false;
+        const char * decompressFile = nullptr;
+        bool hugePages = true;
+        bool reservedHugePages = false;
+        bool timestamps = false;
+        int uevents = 0;
+        const char * checkMirrorDir = nullptr;
+        bool flightRecorder = false;
+        int prepareSources = 0;
+        ProducerConfig producerConfig {0, 100 * NS_PER_MS, true, 4, 1024 * 1024, 1024 * 1024, 0, 0, 0, false, 0};
+    };
+
+    void usage(const char * name)
+    {
+        fprintf(stderr,
+                "Usage: %s [options]\n"
+                "  -d, --duration <s>        how long to generate data for (default 5)\n"
+                "  -r, --rate <events/s>     events each producer generates per second, 0 for as fast as possible\n"
+                "                            (default 0)\n"
+                "  -p, --producers <list>    comma separated list of perf,counters,annotate,armnn (default all)\n"
+                "  -c, --cpus <n>            number of perf rings (default 4)\n"
+                "  -l, --commit-rate <ms>    how often buffers are committed, as the live rate (default 100)\n"
+                "  -b, --buffer-size <MB>    size of each Buffer, as --buffer-mode, huge pages need 2 or more\n"
+                "                            (default 1)\n"
+                "  -o, --output-dir <dir>    write a capture file with Sender rather than discarding the data\n"
+                "  -z, --compress            compress the capture file, requires --output-dir\n"
+                "  -x, --check-compression   also write an uncompressed mirror of the capture and check that the\n"
+                "                            capture file decompresses to it, requires --compress\n"
+                "  -X, --decompress <file>   check that an existing compressed capture file, an APC's\n"
+                "                            0000000000, decompresses to whole frames, rather than the pipeline\n"
+                "  -n, --no-huge-pages       back the Buffers with normal pages, to compare the drain cost\n"
+                "  -H, --reserved-huge-pages back the Buffers with reserved huge pages where there are enough, as\n"
+                "                            --reserved-huge-pages\n"
+                "  -s, --stacks <n>          draw perf callchains from <n> distinct stacks, 0 for random ones\n"
+                "                            (default 0)\n"
+                "  -i, --intern-callchains <n>\n"
+                "                            intern up to <n> perf callchains, as --intern-callchains (default 0)\n"
+                "  -g, --aggregate-samples <ms>\n"
+                "                            aggregate the perf samples into windows of <ms>, as --aggregate-samples,\n"
+                "                            and check that they are all counted, with the reads of those that\n"
+                "                            carry PERF_SAMPLE_READ, in less data (default 0)\n"
+                "  -v, --verify              decode the perf data that is sent and check that each callchain is\n"
+                "                            the stack that was sampled, requires --stacks\n"
+                "  -t, --timestamps          measure the cost and accuracy of the generic timer clock against\n"
+                "                            clock_gettime for the duration, rather than the pipeline\n"
+                "  -u, --uevents <n>         measure the latency from <n> synthetic CPU hotplug uevents to\n"
+                "                            PerfCpuOnlineMonitor's callback, rather than the pipeline, needs\n"
+                "                            CAP_NET_ADMIN\n"
+                "  -m, --check-mirror <dir>  check that a mirror of a live capture matches a local capture,\n"
+                "                            writing both to <dir>\n"
+                "  -f, --flight-recorder     measure the CPU time while every CPU is sampled into overwriting rings\n"
+                "                            for the duration, and the latency from the trigger to the snapshot\n"
+                "                            being sent, rather than the pipeline, needs perf_event_paranoid <= 0\n"
+                "  -P, --prepare-sources <n> check that <n> sources that are slow to prepare are prepared\n"
+                "                            concurrently, rather than the pipeline\n",
+                name);
+    }
+
+    bool parseOptions(int argc, char ** argv, Options & options)
+    {
+        static const struct option OPTIONS[] = {
+            {"duration", required_argument, nullptr, 'd'},
+            {"rate", required_argument, nullptr, 'r'},
+            {"producers", required_argument, nullptr, 'p'},
+            {"cpus", required_argument, nullptr, 'c'},
+            {"commit-rate", required_argument, nullptr, 'l'},
+            {"buffer-size", required_argument, nullptr, 'b'},
+            {"output-dir", required_argument, nullptr, 'o'},
+            {"compress", no_argument, nullptr, 'z'},
+            {"check-compression", no_argument, nullptr, 'x'},
+            {"decompress", required_argument, nullptr, 'X'},
+            {"no-huge-pages", no_argument, nullptr, 'n'},
+            {"reserved-huge-pages", no_argument, nullptr, 'H'},
+            {"stacks", required_argument, nullptr, 's'},
+            {"intern-callchains", required_argument, nullptr, 'i'},
+            {"aggregate-samples", required_argument, nullptr, 'g'},
+            {"verify", no_argument, nullptr, 'v'},
+            {"timestamps", no_argument, nullptr, 't'},
+            {"uevents", required_argument, nullptr, 'u'},
+            {"check-mirror", required_argument, nullptr, 'm'},
+            {"flight-recorder", no_argument, nullptr, 'f'},
+            {"prepare-sources", required_argument, nullptr, 'P'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0},
+        };
+
+        int c;
+        while ((c = getopt_long(argc, argv, "d:r:p:c:l:b:o:zxX:nHs:i:g:vtu:m:fP:h", OPTIONS, nullptr)) != -1) {
+            switch (c) {
+                case 'd':
+                    options.durationSeconds = atoi(optarg);
+                    break;
+                case 'r':
+                    options.producerConfig.eventsPerSecond = strtoull(optarg, nullptr, 0);
+                    break;
+                case 'p': {
+                    options.producers.clear();
+                    std::string list {optarg};
+                    std::size_t start = 0;
+                    while (start <= list.size()) {
+                        const std::size_t end = std::min(list.find(',', start), list.size());
+                        options.producers.push_back(list.substr(start, end - start));
+                        start = end + 1;
+                    }
+                    break;
+                }
+                case 'c':
+                    options.producerConfig.cpus = atoi(optarg);
+                    break;
+                case 'l':
+                    options.producerConfig.commitRate = strtoull(optarg, nullptr, 0) * NS_PER_MS;
+                    break;
+                case 'b':
+                    options.producerConfig.bufferSize = atoi(optarg) * 1024 * 1024;
+                    break;
+                case 'o':
+                    options.outputDir = optarg;
+                    break;
+                case 'z':
+                    options.compress = true;
+                    break;
+                case 'x':
+                    options.checkCompression = true;
+                    break;
+                case 'X':
+                    options.decompressFile = optarg;
+                    break;
+                case 'n':
+                    options.hugePages = false;
+                    break;
+                case 'H':
+                    options.reservedHugePages = true;
+                    break;
+                case 's':
+                    options.producerConfig.stacks = atoi(optarg);
+                    break;
+                case 'i':
+                    options.producerConfig.internedCallchains = atoi(optarg);
+                    break;
+                case 'g':
+                    options.producerConfig.aggregationWindowMs = atoi(optarg);
+                    break;
+                case 'v':
+                    options.producerConfig.verify = true;
+                    break;
+                case 't':
+                    options.timestamps = true;
+                    break;
+                case 'u':
+                    options.uevents = atoi(optarg);
+                    break;
+                case 'm':
+                    options.checkMirrorDir = optarg;
+                    break;
+                case 'f':
+                    options.flightRecorder = true;
+                    break;
+                case 'P':
+                    options.prepareSources = atoi(optarg);
+                    break;
+                default:
+                    usage(argv[0]);
+                    return false;
+            }
+        }
+
+        if ((options.durationSeconds <= 0) || (options.producerConfig.cpus <= 0) ||
+            (options.producerConfig.commitRate == 0) || (options.producerConfig.bufferSize <= 0)) {
+            fprintf(stderr, "duration, cpus, commit-rate and buffer-size must be greater than 0\n");
+            return false;
+        }
+        if ((options.producerConfig.stacks < 0) || (options.producerConfig.internedCallchains < 0)) {
+            fprintf(stderr, "stacks and intern-callchains must not be negative\n");
+            return false;
+        }
+        if (options.producerConfig.verify && (options.producerConfig.stacks == 0)) {
+            fprintf(stderr, "--verify requires --stacks\n");
+            return false;
+        }
+        if (options.compress && (options.outputDir == nullptr)) {
+            fprintf(stderr, "--compress requires --output-dir\n");
+            return false;
+        }
+        if (options.checkCompression && !options.compress) {
+            fprintf(stderr, "--check-compression requires --compress\n");
+            return false;
+        }
+
+        // Buffers are framed as they would be for the destination
+        options.producerConfig.includeResponseType = (options.outputDir == nullptr);
+        return true;
+    }
+
+    std::unique_ptr<SyntheticProducer> createProducer(const std::string & name,
+                                                      sem_t & senderSem,
+                                                      const ProducerConfig & config)
+    {
+        if (name == "perf") {
+            return createPerfRingProducer(senderSem, config);
+        }
+        if (name == "counters") {
+            return createBlockCounterProducer(senderSem, config);
+        }
+        if (name == "annotate") {
+            return createAnnotationProducer(senderSem, config);
+        }
+        if (name == "armnn") {
+            return createArmnnProducer(senderSem, config);
+        }
+        return nullptr;
+    }
+
+    std::uint64_t cpuTimeNs(clockid_t clock)
+    {
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    /** Mirrors Child::senderThreadEntryPoint */
+    void senderThreadEntryPoint(std::vector<std::unique_ptr<SyntheticProducer>> & producers,
+                                std::vector<std::uint64_t> & producerBytes,
+                                sem_t & senderSem,
+                                ISender & sender,
+                                std::uint64_t & cpuTime)
+    {
+        prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-sender"), 0, 0, 0);
+
+        const auto writeProducers = [&]() {
+            for (std::size_t index = 0; index < producers.size(); ++index) {
+                SyntheticProducer & producer = *producers[index];
+                LatencyRecorder & latencyRecorder = producer.getLatencyRecorder();
+                CountingSender countingSender {sender, producerBytes[index]};
+
+                latencyRecorder.takePending();
+                producer.write(countingSender);
+                latencyRecorder.sent(now());
+            }
+        };
+
+        while (!std::all_of(producers.begin(), producers.end(), [](const std::unique_ptr<SyntheticProducer> & p) {
+            return p->isDone();
+        })) {
+            timespec timeout;
+            if (clock_gettime(CLOCK_REALTIME, &timeout) != 0) {
+                logg.logError("clock_gettime failed: %d, (%s)", errno, strerror(errno));
+                handleException();
+            }
+            timeout.tv_sec += 1;
+            if ((sem_timedwait(&senderSem, &timeout) != 0) && (errno != ETIMEDOUT)) {
+                logg.logError("wait failed: %d, (%s)", errno, strerror(errno));
+            }
+
+            writeProducers();
+        }
+
+        writeProducers();
+
+        cpuTime = cpuTimeNs(CLOCK_THREAD_CPUTIME_ID);
+    }
+
+    double percentileMs(const std::vector<std::uint64_t> & sorted, double percentile)
+    {
+        if (sorted.empty()) {
+            return 0;
+        }
+        const std::size_t index = std::min(sorted.size() - 1, static_cast<std::size_t>(sorted.size() * percentile));
+        return static_cast<double>(sorted[index]) / NS_PER_MS;
+    }
+
+    /** @return The mean ns per call of readTime over iterations calls */
+    template<typename ReadTime>
+    double nsPerCall(ReadTime readTime, int iterations)
+    {
+        std::uint64_t sum = 0;
+        const std::uint64_t start = now();
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            sum += readTime();
+        }
+        const std::uint64_t end = now();
+
+        // keep the reads
+        volatile std::uint64_t unused = sum;
+        (void) unused;
+
+        return static_cast<double>(end - start) / iterations;
+    }
+
+    void runTimestampBenchmark(int durationSeconds)
+    {
+        constexpr int ITERATIONS = 1000000;
+        constexpr useconds_t SAMPLE_INTERVAL_US = 1000;
+
+        lib::GenericTimerClock & clock = lib::GenericTimerClock::instance();
+
+        // Sample the error as gatord reads the clock, every so often, which includes the calibrations
+        std::vector<double> absoluteErrors;
+        const std::uint64_t end = now() + durationSeconds * 1000000000ULL;
+        while (now() < end) {
+            const std::uint64_t before = lib::GenericTimerClock::readSyscallNs();
+            const std::uint64_t time = clock.getTimeNs();
+            const std::uint64_t after = lib::GenericTimerClock::readSyscallNs();
+            // Where the read falls between the two syscalls is unknown, so measure from the middle
+            absoluteErrors.push_back(std::fabs(static_cast<double>(static_cast<std::int64_t>(time - before)) -
+                                               static_cast<double>(after - before) / 2));
+            usleep(SAMPLE_INTERVAL_US);
+        }
+        std::sort(absoluteErrors.begin(), absoluteErrors.end());
+
+        const double syscallNs = nsPerCall(&lib::GenericTimerClock::readSyscallNs, ITERATIONS);
+        const double clockNs = nsPerCall([&clock]() { return clock.getTimeNs(); }, ITERATIONS);
+
+        printf("generic timer:       %s\n", clock.isUsingCounter() ? "yes" : "no, using clock_gettime");
+        printf("clock_gettime:       %.1f ns per call\n", syscallNs);
+        printf("clock:               %.1f ns per call\n", clockNs);
+        printf("error samples:       %zu\n", absoluteErrors.size());
+        if (!absoluteErrors.empty()) {
+            printf("abs error:           p50 %.0f ns, p99 %.0f ns, max %.0f ns\n",
+                   absoluteErrors[absoluteErrors.size() / 2],
+                   absoluteErrors[std::min(absoluteErrors.size() - 1, absoluteErrors.size() * 99 / 100)],
+                   absoluteErrors.back());
+        }
+    }
+
+    /**
+     * Sends uevents as the kernel would for a CPU that does not exist, so that sysfs and any real hotplug do not
+     * interfere, going offline and online in turn, and times each until the monitor calls back
+     *
+     * @return False if the uevents could not be sent or any of them was not notified
+     */
+    bool runUEventBenchmark(int count)
+    {
+        constexpr unsigned CPU = 4000;
+        constexpr std::uint64_t TIMEOUT_NS = 1000000000ULL;
+
+        std::mutex mutex;
+        std::condition_variable notified;
+        std::uint64_t notifiedTime = 0;
+        PerfCpuOnlineMonitor monitor {[&](unsigned cpu, bool /*online*/) {
+            if (cpu == CPU) {
+                std::lock_guard<std::mutex> lock {mutex};
+                notifiedTime = now();
+                notified.notify_one();
+            }
+            return true;
+        }};
+
+        const int fd = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (fd < 0) {
+            fprintf(stderr, "socket failed (%d) %s\n", errno, strerror(errno));
+            return false;
+        }
+        struct sockaddr_nl address;
+        memset(&address, 0, sizeof(address));
+        address.nl_family = AF_NETLINK;
+        // the group the monitor listens to for kernel uevents
+        address.nl_groups = 1;
+
+        // The monitor binds its socket on its own thread
+        usleep(100000);
+
+        std::vector<std::uint64_t> latencies;
+        int missed = 0;
+        // The first uevent only records the CPU as offline, as one not seen before
+        for (int event = -1; event < count; ++event) {
+            const char * const action = ((event % 2) != 0 ? "offline" : "online");
+            char message[256];
+            const int length = snprintf(message,
+                                        sizeof(message),
+                                        "%s@/devices/system/cpu/cpu%u%cACTION=%s%cDEVPATH=/devices/system/cpu/cpu%u%c"
+                                        "SUBSYSTEM=cpu%cSEQNUM=%d",
+                                        action,
+                                        CPU,
+                                        '\0',
+                                        action,
+                                        '\0',
+                                        CPU,
+                                        '\0',
+                                        '\0',
+                                        event + 1);
+
+            std::unique_lock<std::mutex> lock {mutex};
+            notifiedTime = 0;
+            const std::uint64_t sendTime = now();
+            if (sendto(fd, message, length + 1, 0, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) !=
+                length + 1) {
+                fprintf(stderr, "sendto failed (%d) %s\n", errno, strerror(errno));
+                close(fd);
+                return false;
+            }
+            if (event < 0) {
+                // nothing to wait for, but give the monitor time to see it
+                lock.unlock();
+                usleep(10000);
+                continue;
+            }
+            if (notified.wait_for(lock, std::chrono::nanoseconds(TIMEOUT_NS), [&]() { return notifiedTime != 0; })) {
+                latencies.push_back(notifiedTime - sendTime);
+            }
+            else {
+                ++missed;
+            }
+        }
+        close(fd);
+        std::sort(latencies.begin(), latencies.end());
+
+        printf("uevents:             %zu notified, %d missed\n", latencies.size(), missed);
+        if (!latencies.empty()) {
+            printf("latency:             p50 %.0f us, p99 %.0f us, max %.0f us\n",
+                   static_cast<double>(latencies[latencies.size() / 2]) / 1000,
+                   static_cast<double>(latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)]) / 1000,
+                   static_cast<double>(latencies.back()) / 1000);
+        }
+        return missed == 0;
+    }
+
+    /** Does nothing but take delayMs to prepare */
+    class DelayedSource : public Source {
+    public:
+        DelayedSource(Child & child, int delayMs) : Source(child), mDelayMs(delayMs) {}
+
+        bool prepare() override
+        {
+            usleep(mDelayMs * 1000);
+            return true;
+        }
+        void run() override {}
+        void interrupt() override {}
+        bool isDone() override { return true; }
+        void write(ISender & /*sender*/) override {}
+
+    private:
+        int mDelayMs;
+    };
+
+    /**
+     * Prepares count DelayedSources, the nth taking n steps, with Child::createAndPrepare while this thread takes one
+     * step as the primary source would
+     *
+     * @return False if any could not be prepared or if preparing took a step or more longer than the slowest
+     */
+    bool runPrepareBenchmark(int count)
+    {
+        constexpr int STEP_MS = 50;
+
+        // Child needs the drivers, but none of them are used
+        Drivers drivers {true, PmuXML {}, true};
+        const std::unique_ptr<Child> child = Child::createLocal(drivers, {});
+
+        std::vector<Child::IndependentSource> sources;
+        int totalMs = STEP_MS;
+        for (int index = 1; index <= count; ++index) {
+            sources.push_back({[&child, index]() -> Source * { return new DelayedSource(*child, index * STEP_MS); },
+                               GatordStats::SourceKind::USERSPACE,
+                               "delayed"});
+            totalMs += index * STEP_MS;
+        }
+        const int slowestMs = std::max(count, 1) * STEP_MS;
+
+        bool primaryPrepared = false;
+        const std::uint64_t startTime = now();
+        const std::vector<std::unique_ptr<Source>> prepared = Child::createAndPrepare(
+            sources,
+            []() {
+                usleep(STEP_MS * 1000);
+                return true;
+            },
+            primaryPrepared);
+        const double elapsedMs = static_cast<double>(now() - startTime) / NS_PER_MS;
+
+        printf("prepared:            %d sources in %.1f ms, the slowest takes %d ms and all of them %d ms\n",
+               count,
+               elapsedMs,
+               slowestMs,
+               totalMs);
+
+        if (!primaryPrepared ||
+            std::any_of(prepared.begin(), prepared.end(), [](const std::unique_ptr<Source> & source) {
+                return !source;
+            })) {
+            fprintf(stderr, "Not every source was prepared\n");
+            return false;
+        }
+        if (elapsedMs >= slowestMs + STEP_MS) {
+            fprintf(stderr, "The sources were not prepared concurrently\n");
+            return false;
+        }
+        return true;
+    }
+
+    /** Writes the same frames, which wrap around a small Buffer, framed for localCapture */
+    void writeMirrorCheckFrames(bool localCapture, Sender & sender)
+    {
+        constexpr int ROUNDS = 5000;
+        constexpr int BUFFER_SIZE = 16 * 1024;
+
+        gSessionData.mLocalCapture = localCapture;
+
+        sem_t readerSem;
+        sem_init(&readerSem, 0, 0);
+        {
+            Buffer buffer {0, FrameType::BLOCK_COUNTER, BUFFER_SIZE, readerSem, 0, !localCapture};
+            for (int round = 0; round < ROUNDS; ++round) {
+                // Several frames per write so that the frames are split at different points
+                for (int frame = 0; frame <= round % 7; ++frame) {
+                    const std::uint64_t time = static_cast<std::uint64_t>(round) * 1000 + frame;
+                    buffer.eventHeader(time);
+                    for (int key = 0; key <= (round + frame) % 13; ++key) {
+                        buffer.event64(key, static_cast<std::int64_t>(round) * key);
+                    }
+                    buffer.commit(time, true);
+                }
+                buffer.write(sender);
+            }
+        }
+        sem_destroy(&readerSem);
+    }
+
+    std::string readFile(const std::string & fileName)
+    {
+        std::ifstream file {fileName, std::ios::binary};
+        return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    }
+
+    /**
+     * Decodes the blocks StreamCompressor writes to a capture file
+     *
+     * @return False if a block is truncated or malformed
+     */
+    bool decompressCaptureFile(const std::string & compressed, std::string & decompressed, std::size_t & blocks)
+    {
+        std::vector<char> block(StreamCompressor::BLOCK_SIZE);
+        blocks = 0;
+        decompressed.clear();
+
+        std::size_t offset = 0;
+        while (offset < compressed.size()) {
+            if (compressed.size() - offset < StreamCompressor::BLOCK_HEADER_SIZE) {
+                fprintf(stderr, "Truncated header of block %zu at offset %zu\n", blocks, offset);
+                return false;
+            }
+            const std::uint32_t storedWord = buffer_utils::readLEInt(compressed.data() + offset);
+            const std::size_t storedLength = storedWord & ~StreamCompressor::STORED_FLAG;
+            const std::size_t rawLength = buffer_utils::readLEInt(compressed.data() + offset + 4);
+            const char * const payload = compressed.data() + offset + StreamCompressor::BLOCK_HEADER_SIZE;
+            offset += StreamCompressor::BLOCK_HEADER_SIZE;
+
+            if ((storedLength > compressed.size() - offset) || (rawLength > StreamCompressor::BLOCK_SIZE)) {
+                fprintf(stderr,
+                        "Block %zu at offset %zu claims %zu bytes stored and %zu raw, which do not fit\n",
+                        blocks,
+                        offset - StreamCompressor::BLOCK_HEADER_SIZE,
+                        storedLength,
+                        rawLength);
+                return false;
+            }
+
+            if ((storedWord & StreamCompressor::STORED_FLAG) != 0) {
+                if (storedLength != rawLength) {
+                    fprintf(stderr, "Stored block %zu has %zu bytes, not %zu\n", blocks, storedLength, rawLength);
+                    return false;
+                }
+                decompressed.append(payload, storedLength);
+            }
+            else {
+                const long length = lib::lz4::decompressBlock(payload, storedLength, block.data(), block.size());
+                if ((length < 0) || (static_cast<std::size_t>(length) != rawLength)) {
+                    fprintf(stderr, "Block %zu decompressed to %ld bytes, not %zu\n", blocks, length, rawLength);
+                    return false;
+                }
+                decompressed.append(block.data(), length);
+            }
+
+            offset += storedLength;
+            ++blocks;
+        }
+        return true;
+    }
+
+    /** @return The number of [LE32 length][data] frames that make up all of the data, or -1 if they do not */
+    long countFileFrames(const std::string & data)
+    {
+        long frames = 0;
+        std::size_t offset = 0;
+        while (offset < data.size()) {
+            if ((data.size() - offset < 4) || (buffer_utils::readLEInt(data.data() + offset) > data.size() - offset - 4)) {
+                fprintf(stderr, "Frame %ld at offset %zu is truncated\n", frames, offset);
+                return -1;
+            }
+            offset += 4 + buffer_utils::readLEInt(data.data() + offset);
+            ++frames;
+        }
+        return frames;
+    }
+
+    /**
+     * @param uncompressedFileName The capture file it should decompress to, or empty to only check that it
+     * decompresses to whole frames
+     */
+    bool checkCompressedFile(const std::string & fileName, const std::string & uncompressedFileName)
+    {
+        const std::string compressed = readFile(fileName);
+        std::string decompressed;
+        std::size_t blocks;
+        const bool decoded = decompressCaptureFile(compressed, decompressed, blocks);
+        printf("compressed blocks:   %zu, %.2f MB to %.2f MB\n",
+               blocks,
+               compressed.size() / BYTES_PER_MB,
+               decompressed.size() / BYTES_PER_MB);
+        if (!decoded) {
+            return false;
+        }
+
+        const long frames = countFileFrames(decompressed);
+        printf("decompressed frames: %ld\n", frames);
+        if (frames < 0) {
+            return false;
+        }
+
+        if (uncompressedFileName.empty()) {
+            return true;
+        }
+        const std::string uncompressed = readFile(uncompressedFileName);
+        const bool matches = (decompressed == uncompressed);
+        printf("round trip matches:  %s\n", matches ? "yes" : "no");
+        return matches;
+    }
+
+    bool runMirrorCheck(const char * dir)
+    {
+        const std::string localDir = std::string(dir) + "/local.apc";
+        const std::string mirrorDir = std::string(dir) + "/mirror.apc";
+        mkdir(dir, 0755);
+        mkdir(localDir.c_str(), 0755);
+        mkdir(mirrorDir.c_str(), 0755);
+
+        {
+            Sender sender {nullptr};
+            sender.createDataFile(localDir.c_str());
+            writeMirrorCheckFrames(true, sender);
+        }
+        {
+            // Only the mirror, the socket would have the live data
+            Sender sender {nullptr};
+            sender.addMirror(mirrorDir.c_str(), QueuedSink::SlowConsumerPolicy::BLOCK);
+            writeMirrorCheckFrames(false, sender);
+        }
+
+        const std::string local = readFile(localDir + "/0000000000");
+        const std::string mirror = readFile(mirrorDir + "/0000000000");
+        const bool matches = (!local.empty()) && (local == mirror);
+        printf("local capture:       %zu bytes\n", local.size());
+        printf("live mirror:         %zu bytes\n", mirror.size());
+        printf("mirror matches:      %s\n", matches ? "yes" : "no");
+        return matches;
+    }
+
+    double processCpuTimeMs()
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+    }
+
+    /**
+     * Samples every CPU into write_backward rings and polls for a trigger file as PerfSource does with
+     * --flight-recorder-trigger, which is created once the duration is up. The snapshot is then taken as PerfSource
+     * takes it, including re-reading the comm and maps of every process, and sent to a NullSender.
+     *
+     * @return False if the events could not be opened or nothing was sent
+     */
+    bool runFlightRecorderBenchmark(int durationSeconds, std::size_t ringSize)
+    {
+        // As PerfSource::run
+        constexpr int POLL_INTERVAL_MS = 100;
+        constexpr std::uint64_t SAMPLE_PERIOD_NS = 100000;
+
+        const long pageSize = sysconf(_SC_PAGESIZE);
+        const long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        const std::uint64_t monotonicStarted = now();
+
+        PerfBuffer perfBuffer {{static_cast<std::size_t>(pageSize), ringSize, 0, true}};
+        std::vector<int> fds;
+        bool opened = true;
+        for (int cpu = 0; opened && (cpu < cpus); ++cpu) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CPU_CLOCK;
+            attr.sample_period = SAMPLE_PERIOD_NS;
+            attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU;
+            attr.sample_id_all = 1;
+            attr.mmap = 1;
+            attr.comm = 1;
+            attr.task = 1;
+            attr.write_backward = 1;
+
+            const int fd = lib::perf_event_open(&attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+            if (fd < 0) {
+                // offline
+                if (errno == ENODEV) {
+                    continue;
+                }
+                fprintf(stderr, "perf_event_open failed for cpu %i (%d) %s\n", cpu, errno, strerror(errno));
+                opened = false;
+                continue;
+            }
+            fds.push_back(fd);
+            if (!perfBuffer.useFd(fd, cpu)) {
+                fprintf(stderr, "PerfBuffer::useFd failed for cpu %i\n", cpu);
+                opened = false;
+            }
+        }
+        const auto closeFds = [&fds]() {
+            for (int fd : fds) {
+                close(fd);
+            }
+        };
+        if ((!opened) || fds.empty()) {
+            closeFds();
+            return false;
+        }
+
+        char triggerPath[] = "/tmp/gatord-benchmark-trigger-XXXXXX";
+        const int triggerFd = mkstemp(triggerPath);
+        if (triggerFd < 0) {
+            fprintf(stderr, "mkstemp failed (%d) %s\n", errno, strerror(errno));
+            closeFds();
+            return false;
+        }
+        close(triggerFd);
+        unlink(triggerPath);
+
+        sem_t senderSem;
+        sem_init(&senderSem, 0, 0);
+        std::unique_ptr<PerfAttrsBuffer> attrsBuffer {new PerfAttrsBuffer(32 * 1024 * 1024, senderSem)};
+
+        std::uint64_t triggerTime = 0;
+        std::thread triggerThread {[&]() {
+            sleep(durationSeconds);
+            triggerTime = now();
+            const int fd = open(triggerPath, O_CREAT | O_WRONLY | O_CLOEXEC, 0600);
+            if (fd >= 0) {
+                close(fd);
+            }
+        }};
+
+        // The steady state, where nothing is drained and only the trigger is polled for
+        const double startCpuMs = processCpuTimeMs();
+        const std::uint64_t startTime = now();
+        while (access(triggerPath, F_OK) != 0) {
+            usleep(POLL_INTERVAL_MS * 1000);
+        }
+        const std::uint64_t detectedTime = now();
+        const double steadyCpuMs = processCpuTimeMs() - startCpuMs;
+        triggerThread.join();
+        unlink(triggerPath);
+
+        // As PerfSource::run, dated from the start
+        perfBuffer.pauseOutput();
+        const std::uint64_t pausedTime = now();
+        readProcComms(0, *attrsBuffer);
+        readProcMaps(0, *attrsBuffer);
+        attrsBuffer->commit(pausedTime - monotonicStarted);
+        perfBuffer.snapshot();
+        const std::uint64_t snapshotTime = now();
+
+        std::uint64_t attrsBytes = 0;
+        std::uint64_t perfBytes = 0;
+        NullSender nullSender;
+        CountingSender attrsSender {nullSender, attrsBytes};
+        attrsBuffer->write(attrsSender);
+        CountingSender perfSender {nullSender, perfBytes};
+        while (!perfBuffer.isEmpty()) {
+            if (!perfBuffer.send(perfSender)) {
+                fprintf(stderr, "PerfBuffer::send failed\n");
+                break;
+            }
+        }
+        const std::uint64_t sentTime = now();
+
+        const double elapsedS = static_cast<double>(detectedTime - startTime) / 1e9;
+        printf("cpus sampled:        %zu at %" PRIu64 " Hz into %zu KB rings\n",
+               fds.size(),
+               static_cast<std::uint64_t>(NS_PER_S) / SAMPLE_PERIOD_NS,
+               ringSize / 1024);
+        printf("steady state cpu:    %.3f ms/s (%.3f ms in %.2f s)\n", steadyCpuMs / elapsedS, steadyCpuMs, elapsedS);
+        printf("trigger to detect:   %.3f ms, polled every %d ms\n",
+               static_cast<double>(detectedTime - triggerTime) / NS_PER_MS,
+               POLL_INTERVAL_MS);
+        printf("detect to pause:     %.3f ms\n", static_cast<double>(pausedTime - detectedTime) / NS_PER_MS);
+        printf("re-read comm, maps:  %.3f ms, %.2f MB\n",
+               static_cast<double>(snapshotTime - pausedTime) / NS_PER_MS,
+               attrsBytes / BYTES_PER_MB);
+        printf("snapshot to sent:    %.3f ms, %.2f MB\n",
+               static_cast<double>(sentTime - snapshotTime) / NS_PER_MS,
+               perfBytes / BYTES_PER_MB);
+        printf("trigger to sent:     %.3f ms\n", static_cast<double>(sentTime - triggerTime) / NS_PER_MS);
+
+        attrsBuffer.reset();
+        sem_destroy(&senderSem);
+        closeFds();
+
+        return perfBytes > 0;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    // The per commit log messages would otherwise dominate the measurement
+    logg.setDebug(false);
+
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        return EXIT_FAILURE;
+    }
+
+    if (options.timestamps) {
+        runTimestampBenchmark(options.durationSeconds);
+        return EXIT_SUCCESS;
+    }
+    if (options.uevents > 0) {
+        return runUEventBenchmark(options.uevents) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (options.checkMirrorDir != nullptr) {
+        return runMirrorCheck(options.checkMirrorDir) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (options.decompressFile != nullptr) {
+        return checkCompressedFile(options.decompressFile, "") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (options.flightRecorder) {
+        return runFlightRecorderBenchmark(options.durationSeconds, options.producerConfig.perfRingSize) ? EXIT_SUCCESS
+                                                                                                         : EXIT_FAILURE;
+    }
+    if (options.prepareSources > 0) {
+        return runPrepareBenchmark(options.prepareSources) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Before the producers create their Buffers
+    lib::LargeBuffer::setUseHugePages(options.hugePages);
+    lib::LargeBuffer::setUseReservedHugePages(options.reservedHugePages);
+
+    sem_t senderSem;
+    sem_init(&senderSem, 0, 0);
+
+    options.producerConfig.monotonicStarted = now();
+
+    std::vector<std::unique_ptr<SyntheticProducer>> producers;
+    for (const std::string & name : options.producers) {
+        std::unique_ptr<SyntheticProducer> producer = createProducer(name, senderSem, options.producerConfig);
+        if (!producer) {
+            fprintf(stderr, "Unknown producer '%s'\n", name.c_str());
+            return EXIT_FAILURE;
+        }
+        producers.push_back(std::move(producer));
+    }
+    if (producers.empty()) {
+        fprintf(stderr, "No producers\n");
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<ISender> sender;
+    // Outlives the Sender, as the mirror keeps its name
+    std::string mirrorDir;
+    if (options.outputDir != nullptr) {
+        mkdir(options.outputDir, 0755);
+        auto * fileSender = new Sender(nullptr);
+        sender.reset(fileSender);
+        fileSender->createDataFile(options.outputDir);
+        if (options.checkCompression) {
+            // As the producers frame their Buffers for a file; mirrors are never compressed
+            gSessionData.mLocalCapture = true;
+            mirrorDir = std::string(options.outputDir) + "/uncompressed";
+            mkdir(mirrorDir.c_str(), 0755);
+            fileSender->addMirror(mirrorDir.c_str(), QueuedSink::SlowConsumerPolicy::BLOCK);
+        }
+        if (options.compress) {
+            fileSender->startCompression();
+        }
+    }
+    else {
+        sender.reset(new NullSender());
+    }
+
+    std::vector<std::uint64_t> producerBytes(producers.size(), 0);
+    std::uint64_t senderCpuTime = 0;
+
+    const double startCpuMs = processCpuTimeMs();
+    const std::uint64_t startTime = now();
+
+    std::thread senderThread {[&]() {
+        senderThreadEntryPoint(producers, producerBytes, senderSem, *sender, senderCpuTime);
+    }};
+    for (auto & producer : producers) {
+        producer->start();
+    }
+
+    sleep(options.durationSeconds);
+
+    for (auto & producer : producers) {
+        producer->stop();
+    }
+    sem_post(&senderSem);
+    senderThread.join();
+    // Closes the file, including waiting for any compression
+    sender.reset();
+
+    const double elapsedS = static_cast<double>(now() - startTime) / 1e9;
+    const double cpuMs = processCpuTimeMs() - startCpuMs;
+
+    printf("%-10s %12s %10s %10s %10s %10s\n", "producer", "events", "MB", "p50 ms", "p99 ms", "max ms");
+    std::uint64_t totalBytes = 0;
+    for (std::size_t index = 0; index < producers.size(); ++index) {
+        SyntheticProducer & producer = *producers[index];
+        const std::vector<std::uint64_t> & latencies = producer.getLatencyRecorder().getSortedLatencies();
+        printf("%-10s %12" PRIu64 " %10.2f %10.3f %10.3f %10.3f\n",
+               producer.getName(),
+               producer.getEvents(),
+               producerBytes[index] / BYTES_PER_MB,
+               percentileMs(latencies, 0.5),
+               percentileMs(latencies, 0.99),
+               latencies.empty() ? 0.0 : static_cast<double>(latencies.back()) / NS_PER_MS);
+        totalBytes += producerBytes[index];
+    }
+
+    const double totalMb = totalBytes / BYTES_PER_MB;
+    printf("\n");
+    printf("throughput:          %.2f MB/s (%.2f MB in %.2f s)\n", totalMb / elapsedS, totalMb, elapsedS);
+    if (totalMb > 0) {
+        printf("cpu per MB:          %.3f ms (process), %.3f ms (sender thread)\n",
+               cpuMs / totalMb,
+               (static_cast<double>(senderCpuTime) / NS_PER_MS) / totalMb);
+    }
+    printf("sender write time:   %.3f ms\n",
+           static_cast<double>(gGatordStats.mSendTime.load(std::memory_order_relaxed)) / NS_PER_MS);
+    printf("buffer wait time:    %.3f ms\n",
+           static_cast<double>(gGatordStats.mBufferWaitTime.load(std::memory_order_relaxed)) / NS_PER_MS);
+    printf("perf lost records:   %" PRIu64 "\n", gGatordStats.mPerfLostRecords.load(std::memory_order_relaxed));
+    printf("perf too large:      %" PRIu64 "\n", gGatordStats.mPerfRecordsTooLarge.load(std::memory_order_relaxed));
+    printf("sync dropped:        %" PRIu64 "\n", gGatordStats.mPerfSyncDropped.load(std::memory_order_relaxed));
+    printf("huge pages:          %s\n",
+           options.hugePages ? (options.reservedHugePages ? "reserved" : "transparent") : "no");
+    bool valid = true;
+    for (const auto & producer : producers) {
+        producer->printSummary();
+        valid &= producer->isValid();
+    }
+
+    if (options.outputDir != nullptr) {
+        const std::string fileName = std::string(options.outputDir) + "/0000000000";
+        struct stat fileStat;
+        if ((stat(fileName.c_str(), &fileStat) == 0) && (fileStat.st_size > 0)) {
+            printf("capture file:        %.2f MB (%.2fx)\n",
+                   fileStat.st_size / BYTES_PER_MB,
+                   static_cast<double>(totalBytes) / fileStat.st_size);
+        }
+        if (options.checkCompression) {
+            valid &= checkCompressedFile(fileName, mirrorDir + "/0000000000");
+        }
+    }
+
+    sem_destroy(&senderSem);
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
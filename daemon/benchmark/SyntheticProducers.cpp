@@ -0,0 +1,984 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "benchmark/SyntheticProducers.h"
+
+#include "Buffer.h"
+#include "BufferUtils.h"
+#include "ISender.h"
+#include "Logging.h"
+#include "SessionData.h"
+#include "armnn/IPacketConsumer.h"
+#include "armnn/PacketDecoder.h"
+#include "armnn/TimestampCorrector.h"
+#include "k/perf_event.h"
+#include "lib/Assert.h"
+#include "lib/EnumUtils.h"
+#include "lib/Span.h"
+#include "linux/perf/PerfBuffer.h"
+#include "linux/perf/PerfCallchainInterner.h"
+#include "linux/perf/PerfSampleAggregator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace benchmark {
+    std::uint64_t now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    }
+
+    namespace {
+        /** xorshift64, the data only needs to look varied, not be random */
+        class Random {
+        public:
+            Random(std::uint64_t seed) : mState(seed | 1) {}
+
+            std::uint64_t next()
+            {
+                mState ^= mState << 13;
+                mState ^= mState >> 7;
+                mState ^= mState << 17;
+                return mState;
+            }
+
+            std::uint64_t next(std::uint64_t bound) { return next() % bound; }
+
+        private:
+            std::uint64_t mState;
+        };
+    }
+
+    LatencyRecorder::LatencyRecorder() : mMutex(), mPending(), mInFlight(), mLatencies() {}
+
+    void LatencyRecorder::committed(std::uint64_t time)
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mPending.push_back(time);
+    }
+
+    void LatencyRecorder::takePending()
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mInFlight.insert(mInFlight.end(), mPending.begin(), mPending.end());
+        mPending.clear();
+    }
+
+    void LatencyRecorder::sent(std::uint64_t time)
+    {
+        for (const std::uint64_t committedTime : mInFlight) {
+            mLatencies.push_back(time - committedTime);
+        }
+        mInFlight.clear();
+    }
+
+    const std::vector<std::uint64_t> & LatencyRecorder::getSortedLatencies()
+    {
+        std::sort(mLatencies.begin(), mLatencies.end());
+        return mLatencies;
+    }
+
+    SyntheticProducer::SyntheticProducer(const char * name, const ProducerConfig & config)
+        : mConfig(config),
+          mLatencyRecorder(),
+          mName(name),
+          mEvents(0),
+          mStop(false),
+          mStopped(false),
+          mStartTime(0),
+          mThread()
+    {
+    }
+
+    void SyntheticProducer::start()
+    {
+        mStartTime = now();
+        mThread = std::thread([this]() {
+            run();
+            mStopped.store(true, std::memory_order_release);
+        });
+    }
+
+    void SyntheticProducer::stop()
+    {
+        mStop.store(true, std::memory_order_relaxed);
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    void SyntheticProducer::generated(std::uint64_t events)
+    {
+        const std::uint64_t total = mEvents.fetch_add(events, std::memory_order_relaxed) + events;
+        if (mConfig.eventsPerSecond == 0) {
+            return;
+        }
+
+        const std::uint64_t due = mStartTime + (total * 1000000000ULL) / mConfig.eventsPerSecond;
+        const std::uint64_t current = now();
+        if (due > current) {
+            usleep((due - current) / 1000);
+        }
+    }
+
+    namespace {
+        /**
+         * Decodes the PERF_STACKS and PERF_DATA frames that PerfBuffer sends, as Streamline does, and checks that the
+         * callchain of each sample is the stack that was sampled, which the period of the sample identifies
+         */
+        class CallchainChecker {
+        public:
+            CallchainChecker(const std::vector<std::vector<std::uint64_t>> & stacks, std::uint64_t period)
+                : mStacks(stacks), mPeriod(period), mDefinitions(), mRecord(), mChecked(0), mWrong(0)
+            {
+            }
+
+            void decode(const char * data, int length)
+            {
+                int pos = 0;
+                const auto frameType = static_cast<FrameType>(buffer_utils::unpackInt(data, pos));
+                if (frameType == FrameType::PERF_STACKS) {
+                    while (pos < length) {
+                        const std::uint32_t id = buffer_utils::unpackInt(data, pos);
+                        std::vector<std::uint64_t> & stack = mDefinitions[id];
+                        stack.resize(buffer_utils::unpackInt(data, pos));
+                        for (std::uint64_t & ip : stack) {
+                            ip = buffer_utils::unpackInt64(data, pos);
+                        }
+                    }
+                }
+                else if (frameType == FrameType::PERF_DATA) {
+                    while (pos < length) {
+                        // cpu
+                        buffer_utils::unpackInt(data, pos);
+                        const int end = pos + sizeof(std::uint32_t) + buffer_utils::readLEInt(data + pos);
+                        pos += sizeof(std::uint32_t);
+                        while (pos < end) {
+                            const std::uint64_t headerWord = buffer_utils::unpackInt64(data, pos);
+                            struct perf_event_header header;
+                            memcpy(&header, &headerWord, sizeof(header));
+                            mRecord.resize(header.size / sizeof(std::uint64_t) - 1);
+                            for (std::uint64_t & word : mRecord) {
+                                word = buffer_utils::unpackInt64(data, pos);
+                            }
+                            if (header.type == PERF_RECORD_SAMPLE) {
+                                checkSample();
+                            }
+                        }
+                    }
+                }
+            }
+
+            std::uint64_t getChecked() const { return mChecked; }
+            std::uint64_t getWrong() const { return mWrong; }
+
+        private:
+            // identifier, ip, tid, time, cpu, period, then the callchain
+            static constexpr std::size_t PERIOD_INDEX = 5;
+            static constexpr std::size_t CALLCHAIN_INDEX = 6;
+
+            void checkSample()
+            {
+                if ((mRecord.size() <= CALLCHAIN_INDEX) || (mRecord[PERIOD_INDEX] <= mPeriod)) {
+                    // a random callchain
+                    return;
+                }
+                const std::vector<std::uint64_t> & expected = mStacks[mRecord[PERIOD_INDEX] - mPeriod - 1];
+
+                ++mChecked;
+                const auto nr = static_cast<std::int64_t>(mRecord[CALLCHAIN_INDEX]);
+                if (nr < 0) {
+                    const auto it = mDefinitions.find(static_cast<std::uint32_t>(~nr));
+                    if ((it == mDefinitions.end()) || (it->second != expected)) {
+                        ++mWrong;
+                    }
+                }
+                else if ((mRecord.size() < CALLCHAIN_INDEX + 1 + nr) ||
+                         !std::equal(expected.begin(), expected.end(), mRecord.begin() + CALLCHAIN_INDEX + 1) ||
+                         (static_cast<std::size_t>(nr) != expected.size())) {
+                    ++mWrong;
+                }
+            }
+
+            const std::vector<std::vector<std::uint64_t>> & mStacks;
+            const std::uint64_t mPeriod;
+            std::map<std::uint32_t, std::vector<std::uint64_t>> mDefinitions;
+            std::vector<std::uint64_t> mRecord;
+            std::uint64_t mChecked;
+            std::uint64_t mWrong;
+        };
+
+        /**
+         * Decodes the PERF_HISTOGRAM and PERF_SAMPLE_READS frames that PerfSampleAggregator sends and checks them
+         * against the samples that were written: each sample must be counted exactly once, none may be sent raw, and
+         * each perf id must report its last read of every window
+         */
+        class AggregateChecker {
+        public:
+            AggregateChecker(std::uint64_t windowLength)
+                : mWindowLength(windowLength),
+                  mSamplesWritten(0),
+                  mBytesWritten(0),
+                  mExpectedReads(),
+                  mSamplesCounted(0),
+                  mRawSamplesSent(0),
+                  mEntriesSent(0),
+                  mBytesSent(0),
+                  mReadsSent()
+            {
+            }
+
+            /** Called by the producer for each sample that was written to a ring */
+            void written(std::size_t bytes)
+            {
+                ++mSamplesWritten;
+                mBytesWritten += bytes;
+            }
+
+            /** Called by the producer for each sample with PERF_SAMPLE_READ that was written to a ring */
+            void writtenRead(std::uint64_t id, std::uint64_t time, const std::uint64_t * values, std::size_t count)
+            {
+                addRead(mExpectedReads, id, time, std::vector<std::uint64_t>(values, values + count));
+            }
+
+            void decode(const char * data, int length)
+            {
+                mBytesSent += length;
+
+                int pos = 0;
+                const auto frameType = static_cast<FrameType>(buffer_utils::unpackInt(data, pos));
+                if (frameType == FrameType::PERF_HISTOGRAM) {
+                    // window start and length
+                    buffer_utils::unpackInt64(data, pos);
+                    buffer_utils::unpackInt64(data, pos);
+                    while (pos < length) {
+                        // key, pid, tid
+                        buffer_utils::unpackInt(data, pos);
+                        buffer_utils::unpackInt(data, pos);
+                        buffer_utils::unpackInt(data, pos);
+                        mSamplesCounted += buffer_utils::unpackInt64(data, pos);
+                        const int numberOfIps = buffer_utils::unpackInt(data, pos);
+                        for (int ip = 0; ip < numberOfIps; ++ip) {
+                            buffer_utils::unpackInt64(data, pos);
+                        }
+                        ++mEntriesSent;
+                    }
+                }
+                else if (frameType == FrameType::PERF_SAMPLE_READS) {
+                    buffer_utils::unpackInt64(data, pos);
+                    buffer_utils::unpackInt64(data, pos);
+                    while (pos < length) {
+                        const std::uint64_t id = buffer_utils::unpackInt64(data, pos);
+                        const std::uint64_t time = buffer_utils::unpackInt64(data, pos);
+                        std::vector<std::uint64_t> values(buffer_utils::unpackInt(data, pos));
+                        for (std::uint64_t & value : values) {
+                            value = buffer_utils::unpackInt64(data, pos);
+                        }
+                        // a window that is sent again when a ring is drained late has the later read
+                        addRead(mReadsSent, id, time, std::move(values));
+                    }
+                }
+                else if (frameType == FrameType::PERF_DATA) {
+                    while (pos < length) {
+                        // cpu
+                        buffer_utils::unpackInt(data, pos);
+                        const int end = pos + sizeof(std::uint32_t) + buffer_utils::readLEInt(data + pos);
+                        pos += sizeof(std::uint32_t);
+                        while (pos < end) {
+                            const std::uint64_t headerWord = buffer_utils::unpackInt64(data, pos);
+                            struct perf_event_header header;
+                            memcpy(&header, &headerWord, sizeof(header));
+                            for (std::size_t word = 1; word < header.size / sizeof(std::uint64_t); ++word) {
+                                buffer_utils::unpackInt64(data, pos);
+                            }
+                            if (header.type == PERF_RECORD_SAMPLE) {
+                                ++mRawSamplesSent;
+                            }
+                        }
+                    }
+                }
+            }
+
+            void printSummary() const
+            {
+                printf("aggregated samples:  %" PRIu64 " samples of %.1f MB sent as %" PRIu64
+                       " histogram entries in %.1f MB, %.1f times less\n",
+                       mSamplesWritten,
+                       static_cast<double>(mBytesWritten) / (1024 * 1024),
+                       mEntriesSent,
+                       static_cast<double>(mBytesSent) / (1024 * 1024),
+                       mBytesSent > 0 ? static_cast<double>(mBytesWritten) / mBytesSent : 0.0);
+                printf("aggregated counts:   %" PRIu64 " samples counted, %" PRIu64 " sent raw, %zu of %zu reads\n",
+                       mSamplesCounted,
+                       mRawSamplesSent,
+                       mReadsSent.size(),
+                       mExpectedReads.size());
+            }
+
+            bool isValid() const
+            {
+                return (mSamplesCounted == mSamplesWritten) && (mRawSamplesSent == 0) &&
+                       (mReadsSent == mExpectedReads) && (mBytesSent < mBytesWritten);
+            }
+
+        private:
+            /// (window index, perf id) -> (time, values) of the last read
+            using Reads = std::map<std::pair<std::uint64_t, std::uint64_t>,
+                                   std::pair<std::uint64_t, std::vector<std::uint64_t>>>;
+
+            void addRead(Reads & reads, std::uint64_t id, std::uint64_t time, std::vector<std::uint64_t> values)
+            {
+                auto & read = reads[std::make_pair(time / mWindowLength, id)];
+                if (read.second.empty() || (time >= read.first)) {
+                    read.first = time;
+                    read.second = std::move(values);
+                }
+            }
+
+            const std::uint64_t mWindowLength;
+            // written by the producer
+            std::uint64_t mSamplesWritten;
+            std::uint64_t mBytesWritten;
+            Reads mExpectedReads;
+            // decoded from what was sent
+            std::uint64_t mSamplesCounted;
+            std::uint64_t mRawSamplesSent;
+            std::uint64_t mEntriesSent;
+            std::uint64_t mBytesSent;
+            Reads mReadsSent;
+        };
+
+        /** Passes everything to the checkers that are not null on its way to the sender */
+        class CheckingSender : public ISender {
+        public:
+            CheckingSender(ISender & sender, CallchainChecker * checker, AggregateChecker * aggregateChecker)
+                : mSender(sender), mChecker(checker), mAggregateChecker(aggregateChecker), mData()
+            {
+            }
+
+            void writeDataParts(lib::Span<const lib::Span<const char, int>> dataParts,
+                                ResponseType type,
+                                bool ignoreLockErrors) override
+            {
+                mData.clear();
+                for (const auto & part : dataParts) {
+                    mData.insert(mData.end(), part.data, part.data + part.length);
+                }
+                if (mChecker != nullptr) {
+                    mChecker->decode(mData.data(), mData.size());
+                }
+                if (mAggregateChecker != nullptr) {
+                    mAggregateChecker->decode(mData.data(), mData.size());
+                }
+                mSender.writeDataParts(dataParts, type, ignoreLockErrors);
+            }
+
+        private:
+            ISender & mSender;
+            CallchainChecker * mChecker;
+            AggregateChecker * mAggregateChecker;
+            std::vector<char> mData;
+        };
+
+        class PerfRingProducer : public SyntheticProducer {
+        public:
+            PerfRingProducer(sem_t & senderSem, const ProducerConfig & config)
+                : SyntheticProducer("perf", config),
+                  mSenderSem(senderSem),
+                  mPageSize(sysconf(_SC_PAGESIZE)),
+                  mPerfBuffer({mPageSize, config.perfRingSize, 0, false}),
+                  mRings(),
+                  mRecord(),
+                  mRandom(1),
+                  mStacks(),
+                  mCallchainInterner(),
+                  mSampleAggregator(),
+                  mAggregatorFlushed(false),
+                  mChecker(mStacks, PERIOD),
+                  mAggregateChecker(config.aggregationWindowMs * NS_PER_MS)
+            {
+                for (int stack = 0; stack < config.stacks; ++stack) {
+                    mStacks.emplace_back(mRandom.next(MAX_CALLCHAIN_DEPTH + 1));
+                    for (std::uint64_t & ip : mStacks.back()) {
+                        ip = functionAddress();
+                    }
+                }
+
+                if (config.internedCallchains > 0) {
+                    mCallchainInterner.reset(new PerfCallchainInterner(config.internedCallchains));
+                    mPerfBuffer.setCallchainInterner(mCallchainInterner.get());
+                }
+
+                if (config.aggregationWindowMs > 0) {
+                    mSampleAggregator.reset(new PerfSampleAggregator(config.aggregationWindowMs * NS_PER_MS));
+                    mPerfBuffer.setSampleAggregator(mSampleAggregator.get());
+                }
+
+                for (int cpu = 0; cpu < config.cpus; ++cpu) {
+                    mRings.push_back(createRing(cpu));
+                }
+            }
+
+            ~PerfRingProducer() override
+            {
+                for (const Ring & ring : mRings) {
+                    munmap(ring.mapping, mPageSize + mConfig.perfRingSize);
+                    close(ring.fd);
+                }
+            }
+
+            bool isDone() override
+            {
+                return isStopped() && mPerfBuffer.isEmpty() && (!mSampleAggregator || mAggregatorFlushed);
+            }
+
+            void printSummary() const override
+            {
+                if (mConfig.verify) {
+                    printf("verified callchains: %" PRIu64 " decoded, %" PRIu64 " wrong\n",
+                           mChecker.getChecked(),
+                           mChecker.getWrong());
+                }
+                if (mSampleAggregator) {
+                    mAggregateChecker.printSummary();
+                }
+                if (!mCallchainInterner) {
+                    return;
+                }
+                const PerfCallchainInterner::Stats & stats = mCallchainInterner->getStats();
+                const std::uint64_t hits = stats.interned - stats.definitions;
+                printf("interned callchains: %" PRIu64 " of %" PRIu64 " samples, %" PRIu64
+                       " stack definitions, %.1f%% hit rate, %" PRId64 " words saved\n",
+                       stats.interned,
+                       stats.samples,
+                       stats.definitions,
+                       stats.samples > 0 ? (100.0 * hits) / stats.samples : 0.0,
+                       stats.wordsSaved);
+            }
+
+            bool isValid() const override
+            {
+                return (mChecker.getWrong() == 0) && (!mSampleAggregator || mAggregateChecker.isValid());
+            }
+
+            void write(ISender & sender) override
+            {
+                CheckingSender checkingSender {sender,
+                                               (mConfig.verify ? &mChecker : nullptr),
+                                               (mSampleAggregator ? &mAggregateChecker : nullptr)};
+                ISender & perfSender = ((mConfig.verify || mSampleAggregator) ? checkingSender : sender);
+
+                // Before sending, so that nothing can be written after the last of the samples are consumed
+                const bool stopped = isStopped();
+                if (!mPerfBuffer.send(perfSender)) {
+                    logg.logError("PerfBuffer::send failed");
+                    handleException();
+                }
+                if (mSampleAggregator) {
+                    // As PerfSource::write, once done send the partial windows too
+                    mAggregatorFlushed = stopped && mPerfBuffer.isEmpty();
+                    mSampleAggregator->send(perfSender, mAggregatorFlushed ? UINT64_MAX : currTime());
+                }
+            }
+
+        protected:
+            void run() override
+            {
+                // Samples are written in batches as the kernel only wakes the reader at the watermark
+                static constexpr int BATCH_SIZE = 32;
+
+                while (!shouldStop()) {
+                    std::uint64_t written = 0;
+                    for (Ring & ring : mRings) {
+                        for (int i = 0; i < BATCH_SIZE; ++i) {
+                            if (writeSample(ring)) {
+                                ++written;
+                            }
+                        }
+                        __atomic_store_n(&ring.page->data_head, ring.head, __ATOMIC_RELEASE);
+                    }
+                    mLatencyRecorder.committed(now());
+                    sem_post(&mSenderSem);
+                    generated(written);
+                }
+            }
+
+        private:
+            struct Ring {
+                int fd;
+                int cpu;
+                char * mapping;
+                struct perf_event_mmap_page * page;
+                char * data;
+                std::uint64_t head;
+                std::uint64_t lost;
+                std::uint64_t samples;
+                /// the counts of the group that PERF_SAMPLE_READ samples carry
+                std::uint64_t readValues[2];
+            };
+
+            static constexpr std::uint64_t MAX_CALLCHAIN_DEPTH = 32;
+            static constexpr int NUMBER_OF_THREADS = 16;
+            static constexpr int NUMBER_OF_FUNCTIONS = 4096;
+            static constexpr std::uint64_t PERIOD = 100000;
+            /// keys of the events whose samples are aggregated
+            static constexpr int SAMPLE_KEY = 1;
+            static constexpr int READ_SAMPLE_KEY = 2;
+
+            /** @return the perf id of the group leader of the PERF_SAMPLE_READ samples, the member's is one more */
+            static std::uint64_t readId(int cpu) { return (1 << 20) + (2 * cpu); }
+
+            /** A perf ring the PerfBuffer maps from an unlinked temporary file rather than a perf fd */
+            Ring createRing(int cpu)
+            {
+                char path[] = "/tmp/gatord-benchmark-XXXXXX";
+                const int fd = mkstemp(path);
+                if (fd < 0) {
+                    logg.logError("mkstemp failed (%d) %s", errno, strerror(errno));
+                    handleException();
+                }
+                unlink(path);
+
+                const std::size_t length = mPageSize + mConfig.perfRingSize;
+                if (ftruncate(fd, length) != 0) {
+                    logg.logError("ftruncate failed (%d) %s", errno, strerror(errno));
+                    handleException();
+                }
+
+                void * const mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    logg.logError("mmap failed (%d) %s", errno, strerror(errno));
+                    handleException();
+                }
+
+                if (!mPerfBuffer.useFd(fd, cpu)) {
+                    logg.logError("PerfBuffer::useFd failed");
+                    handleException();
+                }
+
+                if (mCallchainInterner) {
+                    // The identifier of the samples is the cpu
+                    struct perf_event_attr attr;
+                    memset(&attr, 0, sizeof(attr));
+                    attr.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+                                       PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD | PERF_SAMPLE_CALLCHAIN;
+                    mCallchainInterner->addEvent(cpu, attr);
+                }
+
+                if (mSampleAggregator) {
+                    struct perf_event_attr attr;
+                    memset(&attr, 0, sizeof(attr));
+                    attr.sample_period = PERIOD;
+                    attr.sample_type = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+                                       PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD | PERF_SAMPLE_CALLCHAIN;
+                    mSampleAggregator->addEvent(cpu, SAMPLE_KEY, attr);
+                    attr.sample_type |= PERF_SAMPLE_READ;
+                    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+                    mSampleAggregator->addEvent(readId(cpu), READ_SAMPLE_KEY, attr);
+                }
+
+                char * const bytes = static_cast<char *>(mapping);
+                auto * const page = static_cast<struct perf_event_mmap_page *>(mapping);
+                return Ring {fd, cpu, bytes, page, bytes + mPageSize, 0, 0, 0, {0, 0}};
+            }
+
+            /**
+             * Like the kernel, a record that does not fit is dropped and later reported with PERF_RECORD_LOST
+             */
+            bool writeRecord(Ring & ring)
+            {
+                const std::size_t size = mRecord.size() * sizeof(std::uint64_t);
+                const std::uint64_t tail = __atomic_load_n(&ring.page->data_tail, __ATOMIC_ACQUIRE);
+                if (ring.head + size - tail > mConfig.perfRingSize) {
+                    return false;
+                }
+
+                // records are multiples of 8 bytes, so a word never straddles the end of the ring
+                const std::size_t mask = mConfig.perfRingSize - 1;
+                for (const std::uint64_t word : mRecord) {
+                    memcpy(ring.data + (ring.head & mask), &word, sizeof(word));
+                    ring.head += sizeof(word);
+                }
+                return true;
+            }
+
+            void beginRecord(std::uint32_t type)
+            {
+                mRecord.clear();
+                mRecord.push_back(type);
+            }
+
+            void endRecord()
+            {
+                struct perf_event_header header;
+                header.type = static_cast<std::uint32_t>(mRecord[0]);
+                header.misc = PERF_RECORD_MISC_USER;
+                header.size = mRecord.size() * sizeof(std::uint64_t);
+                memcpy(&mRecord[0], &header, sizeof(header));
+            }
+
+            /** @return true if the sample was written, false if it was lost */
+            bool writeSample(Ring & ring)
+            {
+                if (ring.lost > 0) {
+                    beginRecord(PERF_RECORD_LOST);
+                    mRecord.push_back(ring.cpu); // id
+                    mRecord.push_back(ring.lost);
+                    endRecord();
+                    if (!writeRecord(ring)) {
+                        ++ring.lost;
+                        return false;
+                    }
+                    ring.lost = 0;
+                }
+
+                const std::uint64_t tid = 1000 + mRandom.next(NUMBER_OF_THREADS);
+                const std::vector<std::uint64_t> * const stack =
+                    (mStacks.empty() ? nullptr : &mStacks[mRandom.next(mStacks.size())]);
+                const std::uint64_t depth = (stack != nullptr ? stack->size() : mRandom.next(MAX_CALLCHAIN_DEPTH + 1));
+
+                const bool withRead = mSampleAggregator && ((++ring.samples % 2) == 0);
+                const std::uint64_t id = (withRead ? readId(ring.cpu) : ring.cpu);
+                const std::uint64_t time = currTime();
+
+                // Laid out for PERF_SAMPLE_IDENTIFIER | IP | TID | TIME | CPU | PERIOD | CALLCHAIN, as for EBS
+                beginRecord(PERF_RECORD_SAMPLE);
+                mRecord.push_back(id);                 // identifier
+                mRecord.push_back(functionAddress());  // ip
+                mRecord.push_back((tid << 32) | 1000); // pid, tid
+                mRecord.push_back(time);               // time
+                mRecord.push_back(ring.cpu);           // cpu, res
+                // the period identifies the stack for CallchainChecker
+                mRecord.push_back(PERIOD + (stack != nullptr ? 1 + (stack - mStacks.data()) : 0));
+                const std::size_t readIndex = mRecord.size();
+                if (withRead) {
+                    // PERF_FORMAT_GROUP | PERF_FORMAT_ID, the leader then the member
+                    ring.readValues[0] += PERIOD;
+                    ring.readValues[1] += mRandom.next(PERIOD);
+                    mRecord.push_back(2); // nr
+                    mRecord.push_back(ring.readValues[0]);
+                    mRecord.push_back(id);
+                    mRecord.push_back(ring.readValues[1]);
+                    mRecord.push_back(id + 1);
+                }
+                const std::size_t readSize = mRecord.size() - readIndex;
+                mRecord.push_back(depth);
+                for (std::uint64_t i = 0; i < depth; ++i) {
+                    mRecord.push_back(stack != nullptr ? (*stack)[i] : functionAddress());
+                }
+                endRecord();
+
+                if (!writeRecord(ring)) {
+                    ++ring.lost;
+                    return false;
+                }
+                if (mSampleAggregator) {
+                    mAggregateChecker.written(mRecord.size() * sizeof(std::uint64_t));
+                    if (withRead) {
+                        mAggregateChecker.writtenRead(id, time, mRecord.data() + readIndex, readSize);
+                    }
+                }
+                return true;
+            }
+
+            std::uint64_t functionAddress() { return 0x400000 + (mRandom.next(NUMBER_OF_FUNCTIONS) * 0x40); }
+
+            sem_t & mSenderSem;
+            const std::size_t mPageSize;
+            PerfBuffer mPerfBuffer;
+            std::vector<Ring> mRings;
+            std::vector<std::uint64_t> mRecord;
+            Random mRandom;
+            std::vector<std::vector<std::uint64_t>> mStacks;
+            std::unique_ptr<PerfCallchainInterner> mCallchainInterner;
+            std::unique_ptr<PerfSampleAggregator> mSampleAggregator;
+            // only used by the sender thread
+            bool mAggregatorFlushed;
+            CallchainChecker mChecker;
+            AggregateChecker mAggregateChecker;
+        };
+
+        /** The Buffer is committed at ProducerConfig::commitRate by the producer, so each commit can be timed */
+        class BufferProducer : public SyntheticProducer {
+        public:
+            BufferProducer(const char * name,
+                           FrameType frameType,
+                           int bufferSize,
+                           sem_t & senderSem,
+                           const ProducerConfig & config)
+                : SyntheticProducer(name, config),
+                  mBuffer(0, frameType, bufferSize, senderSem, 0, config.includeResponseType),
+                  mNextCommitTime(0)
+            {
+                runtime_assert(config.commitRate != 0, "commitRate must not be 0");
+            }
+
+            bool isDone() override { return mBuffer.isDone(); }
+
+            void write(ISender & sender) override { mBuffer.write(sender); }
+
+        protected:
+            /** Also commits when the Buffer is getting full, as Buffer::check would */
+            void commitIfDue(std::uint64_t time, bool force = false)
+            {
+                bool committed;
+                if (force || (time >= mNextCommitTime)) {
+                    committed = mBuffer.commit(time, force);
+                    mNextCommitTime = time + mConfig.commitRate;
+                }
+                else {
+                    committed = mBuffer.check(time);
+                }
+
+                if (committed) {
+                    mLatencyRecorder.committed(now());
+                }
+            }
+
+            void setDone()
+            {
+                mBuffer.setDone();
+                mLatencyRecorder.committed(now());
+            }
+
+            Buffer mBuffer;
+
+        private:
+            std::uint64_t mNextCommitTime;
+        };
+
+        class BlockCounterProducer : public BufferProducer {
+        public:
+            BlockCounterProducer(sem_t & senderSem, const ProducerConfig & config)
+                : BufferProducer("counters", FrameType::BLOCK_COUNTER, config.bufferSize, senderSem, config)
+            {
+            }
+
+        protected:
+            void run() override
+            {
+                static constexpr int NUMBER_OF_COUNTERS = 32;
+                static constexpr int FIRST_KEY = 100;
+                static constexpr int FRAME_SIZE =
+                    (NUMBER_OF_COUNTERS + 1) * (buffer_utils::MAXSIZE_PACK32 + buffer_utils::MAXSIZE_PACK64);
+
+                Random random {2};
+                std::int64_t values[NUMBER_OF_COUNTERS] = {0};
+
+                while (!shouldStop()) {
+                    const std::uint64_t time = currTime();
+                    mBuffer.waitForSpace(FRAME_SIZE, time);
+                    mBuffer.eventHeader(time);
+                    for (int i = 0; i < NUMBER_OF_COUNTERS; ++i) {
+                        // a mix of slowly changing absolute values and small deltas
+                        values[i] = ((i & 1) == 0) ? values[i] + random.next(16) : random.next(1 << 20);
+                        mBuffer.event64(FIRST_KEY + i, values[i]);
+                    }
+                    commitIfDue(time);
+                    generated(NUMBER_OF_COUNTERS);
+                }
+
+                setDone();
+            }
+        };
+
+        class AnnotationProducer : public BufferProducer {
+        public:
+            AnnotationProducer(sem_t & senderSem, const ProducerConfig & config)
+                // Same size as ExternalSource's buffer
+                : BufferProducer("annotate", FrameType::EXTERNAL, 128 * 1024, senderSem, config), mStream()
+            {
+                createStream();
+            }
+
+        protected:
+            void run() override
+            {
+                // Any fd number will do, it identifies the connection to Streamline
+                static constexpr int FD = 42;
+                static constexpr std::size_t MAX_READ_SIZE = 4096;
+
+                Random random {3};
+                std::size_t streamPos = 0;
+
+                while (!shouldStop()) {
+                    const std::uint64_t time = currTime();
+
+                    // Same as ExternalSource::transfer, the annotation connection is read straight into the buffer
+                    mBuffer.waitForSpace(7 * buffer_utils::MAXSIZE_PACK32 + 2 * sizeof(std::uint32_t), time);
+                    mBuffer.packInt(FD);
+                    const std::size_t readSize = std::min<std::size_t>(
+                        std::min<std::size_t>(mBuffer.contiguousSpaceAvailable(), 64 + random.next(MAX_READ_SIZE)),
+                        mStream.size() - streamPos);
+                    memcpy(mBuffer.getWritePos(), mStream.data() + streamPos, readSize);
+                    mBuffer.advanceWrite(readSize);
+                    commitIfDue(time, true);
+
+                    streamPos += readSize;
+                    if (streamPos == mStream.size()) {
+                        streamPos = 0;
+                    }
+                    generated(1);
+                }
+
+                setDone();
+            }
+
+        private:
+            /** Text annotations with a small header, roughly the size of those from streamline_annotate.c */
+            void createStream()
+            {
+                static constexpr int NUMBER_OF_MESSAGES = 4096;
+
+                Random random {4};
+                for (int i = 0; i < NUMBER_OF_MESSAGES; ++i) {
+                    char message[160];
+                    const int length = snprintf(message,
+                                                sizeof(message),
+                                                "frame %d: draw call %d of %d",
+                                                i,
+                                                static_cast<int>(random.next(1000)),
+                                                1000);
+                    char header[1 + 4 * buffer_utils::MAXSIZE_PACK32];
+                    int pos = 0;
+                    header[pos++] = 4; // string annotation
+                    buffer_utils::packInt(header, pos, 1000 + static_cast<int>(random.next(16)));
+                    buffer_utils::packInt(header, pos, i * 16667);
+                    buffer_utils::packInt(header, pos, length);
+                    mStream.insert(mStream.end(), header, header + pos);
+                    mStream.insert(mStream.end(), message, message + length);
+                }
+            }
+
+            std::vector<char> mStream;
+        };
+
+        class ArmnnProducer : public BufferProducer, private armnn::IPacketConsumer {
+        public:
+            ArmnnProducer(sem_t & senderSem, const ProducerConfig & config)
+                : BufferProducer("armnn", FrameType::BLOCK_COUNTER, config.bufferSize, senderSem, config),
+                  mTimestampCorrector(mBuffer,
+                                      [config]() -> std::int64_t { return config.monotonicStarted; }),
+                  mDecoder(armnn::ByteOrder::LITTLE, *this),
+                  mPacket()
+            {
+            }
+
+        protected:
+            void run() override
+            {
+                static constexpr int NUMBER_OF_COUNTERS = 32;
+                static constexpr int MESSAGE_SIZE =
+                    4 * buffer_utils::MAXSIZE_PACK32 + 2 * buffer_utils::MAXSIZE_PACK64;
+
+                Random random {5};
+
+                while (!shouldStop()) {
+                    const std::uint64_t time = currTime();
+
+                    // A periodic counter capture packet body: u64 timestamp, then (u16 index, u32 value) pairs
+                    mPacket.clear();
+                    appendLE(now(), 8);
+                    for (int i = 0; i < NUMBER_OF_COUNTERS; ++i) {
+                        appendLE(i, 2);
+                        appendLE(random.next(1 << 24), 4);
+                    }
+
+                    mBuffer.waitForSpace(NUMBER_OF_COUNTERS * MESSAGE_SIZE, time);
+                    if (mDecoder.decodePacket(
+                            lib::toEnumValue(armnn::PacketType::PeriodicCounterCapturePkt),
+                            {mPacket.data(), mPacket.size()}) != armnn::DecodingStatus::Ok) {
+                        logg.logError("Failed to decode periodic counter capture packet");
+                        handleException();
+                    }
+                    commitIfDue(time);
+                    generated(NUMBER_OF_COUNTERS);
+                }
+
+                setDone();
+            }
+
+        private:
+            static constexpr int FIRST_KEY = 200;
+
+            void appendLE(std::uint64_t value, int bytes)
+            {
+                for (int i = 0; i < bytes; ++i) {
+                    mPacket.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+                }
+            }
+
+            bool onPeriodicCounterCapture(std::uint64_t timeStamp,
+                                          std::map<std::uint16_t, std::uint32_t> counterIndexValues) override
+            {
+                for (const auto & indexAndValue : counterIndexValues) {
+                    if (!mTimestampCorrector.consumerCounterValue(timeStamp,
+                                                                  {FIRST_KEY + indexAndValue.first, 0},
+                                                                  indexAndValue.second)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool onCounterDirectory(std::map<std::uint16_t, DeviceRecord> /*devices*/,
+                                    std::map<std::uint16_t, CounterSetRecord> /*counterSets*/,
+                                    std::vector<CategoryRecord> /*categories*/) override
+            {
+                return true;
+            }
+
+            bool onPeriodicCounterSelection(std::uint32_t /*period*/, std::set<std::uint16_t> /*uids*/) override
+            {
+                return true;
+            }
+
+            bool onPerJobCounterSelection(std::uint64_t /*objectId*/, std::set<std::uint16_t> /*uids*/) override
+            {
+                return true;
+            }
+
+            bool onPerJobCounterCapture(bool /*isPre*/,
+                                        std::uint64_t /*timeStamp*/,
+                                        std::uint64_t /*objectRef*/,
+                                        std::map<std::uint16_t, std::uint32_t> /*counterIndexValues*/) override
+            {
+                return true;
+            }
+
+            armnn::TimestampCorrector mTimestampCorrector;
+            armnn::PacketDecoder mDecoder;
+            std::vector<std::uint8_t> mPacket;
+        };
+    }
+
+    std::unique_ptr<SyntheticProducer> createPerfRingProducer(sem_t & senderSem, const ProducerConfig & config)
+    {
+        return std::unique_ptr<SyntheticProducer>(new PerfRingProducer(senderSem, config));
+    }
+
+    std::unique_ptr<SyntheticProducer> createBlockCounterProducer(sem_t & senderSem, const ProducerConfig & config)
+    {
+        return std::unique_ptr<SyntheticProducer>(new BlockCounterProducer(senderSem, config));
+    }
+
+    std::unique_ptr<SyntheticProducer> createAnnotationProducer(sem_t & senderSem, const ProducerConfig & config)
+    {
+        return std::unique_ptr<SyntheticProducer>(new AnnotationProducer(senderSem, config));
+    }
+
+    std::unique_ptr<SyntheticProducer> createArmnnProducer(sem_t & senderSem, const ProducerConfig & config)
+    {
+        return std::unique_ptr<SyntheticProducer>(new ArmnnProducer(senderSem, config));
+    }
+}
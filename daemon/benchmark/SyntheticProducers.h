@@ -0,0 +1,162 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_BENCHMARK_SYNTHETIC_PRODUCERS_H
+#define INCLUDE_BENCHMARK_SYNTHETIC_PRODUCERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <semaphore.h>
+#include <thread>
+#include <vector>
+
+class ISender;
+
+namespace benchmark {
+    /** @return CLOCK_MONOTONIC in ns */
+    std::uint64_t now();
+
+    /**
+     * Tracks how long committed data waits before the sender thread hands it to the ISender.
+     *
+     * The producer records the time of every commit. Just before the sender thread writes a producer it takes all the
+     * pending commit times, all of which are then sent by that write; once the write returns each of them becomes one
+     * latency sample.
+     */
+    class LatencyRecorder {
+    public:
+        LatencyRecorder();
+
+        /** Called by the producer after data is made visible to the sender thread */
+        void committed(std::uint64_t time);
+
+        /** Called by the sender thread before it writes the producer */
+        void takePending();
+
+        /** Called by the sender thread after it wrote the producer */
+        void sent(std::uint64_t time);
+
+        /** @return The sorted latencies in ns, only valid once the sender thread has stopped */
+        const std::vector<std::uint64_t> & getSortedLatencies();
+
+    private:
+        std::mutex mMutex;
+        std::vector<std::uint64_t> mPending;
+        std::vector<std::uint64_t> mInFlight;
+        std::vector<std::uint64_t> mLatencies;
+
+        // Intentionally unimplemented
+        LatencyRecorder(const LatencyRecorder &) = delete;
+        LatencyRecorder & operator=(const LatencyRecorder &) = delete;
+        LatencyRecorder(LatencyRecorder &&) = delete;
+        LatencyRecorder & operator=(LatencyRecorder &&) = delete;
+    };
+
+    struct ProducerConfig {
+        /// events generated per second, 0 to generate them as fast as possible
+        std::uint64_t eventsPerSecond;
+        /// how often Buffers are committed in ns, the equivalent of the live rate, must not be 0
+        std::uint64_t commitRate;
+        /// true to frame Buffers for a socket, false for a file
+        bool includeResponseType;
+        /// number of fake perf rings
+        int cpus;
+        /// perf ring size, must be a power of 2 multiple of the page size
+        std::size_t perfRingSize;
+        /// Buffer size, must be a power of 2
+        int bufferSize;
+        /// the time everything is relative to, as gSessionData.mMonotonicStarted is
+        std::uint64_t monotonicStarted;
+        /// perf samples take their callchains from this many distinct stacks, 0 for a random callchain every time
+        int stacks;
+        /// the number of stacks the PerfBuffer interns, as --intern-callchains, 0 to disable
+        int internedCallchains;
+        /// decode what is sent and check it against what was generated, where the producer can
+        bool verify;
+        /// the window of the PerfBuffer's PerfSampleAggregator in ms, as --aggregate-samples, 0 to disable
+        int aggregationWindowMs;
+    };
+
+    /**
+     * Generates data the way one of gatord's sources does and has it sent by the benchmark's sender thread, in the
+     * same way that Child's sender thread calls Source::write
+     */
+    class SyntheticProducer {
+    public:
+        SyntheticProducer(const char * name, const ProducerConfig & config);
+        virtual ~SyntheticProducer() = default;
+
+        const char * getName() const { return mName; }
+
+        void start();
+
+        /**
+         * Stops generating, the remaining data must still be written until isDone.
+         * Must be called before destruction.
+         */
+        void stop();
+
+        virtual bool isDone() = 0;
+        virtual void write(ISender & sender) = 0;
+
+        /** Print any results particular to this producer, called once it is done */
+        virtual void printSummary() const {}
+
+        /** @return false if what was sent did not decode to what was generated, see ProducerConfig::verify */
+        virtual bool isValid() const { return true; }
+
+        LatencyRecorder & getLatencyRecorder() { return mLatencyRecorder; }
+
+        std::uint64_t getEvents() const { return mEvents.load(std::memory_order_relaxed); }
+
+    protected:
+        /** Generate data until shouldStop, then mark any buffers done */
+        virtual void run() = 0;
+
+        bool shouldStop() const { return mStop.load(std::memory_order_relaxed); }
+
+        /** @return true once the generating thread has exited */
+        bool isStopped() const { return mStopped.load(std::memory_order_acquire); }
+
+        /** @return The current time relative to ProducerConfig::monotonicStarted */
+        std::uint64_t currTime() const { return now() - mConfig.monotonicStarted; }
+
+        /** Counts the events and sleeps if generating faster than ProducerConfig::eventsPerSecond */
+        void generated(std::uint64_t events);
+
+        const ProducerConfig mConfig;
+        LatencyRecorder mLatencyRecorder;
+
+    private:
+        const char * const mName;
+        std::atomic<std::uint64_t> mEvents;
+        std::atomic_bool mStop;
+        std::atomic_bool mStopped;
+        std::uint64_t mStartTime;
+        std::thread mThread;
+
+        // Intentionally unimplemented
+        SyntheticProducer(const SyntheticProducer &) = delete;
+        SyntheticProducer & operator=(const SyntheticProducer &) = delete;
+        SyntheticProducer(SyntheticProducer &&) = delete;
+        SyntheticProducer & operator=(SyntheticProducer &&) = delete;
+    };
+
+    /**
+     * PERF_RECORD_SAMPLEs with callchains written into PerfBuffer rings backed by temporary files. When aggregating,
+     * every other sample also carries the values of its group (PERF_SAMPLE_READ)
+     */
+    std::unique_ptr<SyntheticProducer> createPerfRingProducer(sem_t & senderSem, const ProducerConfig & config);
+
+    /** Block counter frames as written by UserSpaceSource */
+    std::unique_ptr<SyntheticProducer> createBlockCounterProducer(sem_t & senderSem, const ProducerConfig & config);
+
+    /** Annotation bytes copied into an EXTERNAL Buffer as ExternalSource::transfer does */
+    std::unique_ptr<SyntheticProducer> createAnnotationProducer(sem_t & senderSem, const ProducerConfig & config);
+
+    /** Periodic counter capture packets decoded by armnn::PacketDecoder and written through TimestampCorrector */
+    std::unique_ptr<SyntheticProducer> createArmnnProducer(sem_t & senderSem, const ProducerConfig & config);
+}
+
+#endif // INCLUDE_BENCHMARK_SYNTHETIC_PRODUCERS_H
@@ -0,0 +1,256 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "lib/GenericTimerClock.h"
+
+#include "Logging.h"
+#include "lib/GenericTimer.h"
+#include "lib/Time.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <ctime>
+
+namespace lib {
+    namespace {
+        constexpr std::uint64_t NS_PER_S = 1000000000ULL;
+        // the scale is ns per tick in fixed point, which with the period below leaves ample room before the product
+        // of a tick delta and the scale overflows
+        constexpr int SCALE_SHIFT = 24;
+        constexpr double SCALE_MULTIPLIER = 1 << SCALE_SHIFT;
+        constexpr std::uint64_t INITIAL_PERIOD_NS = 1000000;
+        constexpr std::uint64_t MAX_PERIOD_NS = 100000000;
+        // the furthest the scale is slewed from the measured rate to correct drift
+        constexpr double MAX_SLEW = 0.01;
+        // beyond this the clocks have diverged, such as over a suspend, and the clock steps to clock_gettime
+        constexpr double MAX_ERROR_NS = 100000;
+        constexpr std::uint64_t MIN_FREQUENCY = 1000000;
+        constexpr int PAIR_ATTEMPTS = 3;
+        constexpr int COST_SAMPLES = 64;
+    }
+
+    GenericTimerClock & GenericTimerClock::instance()
+    {
+#if defined(__aarch64__)
+        // arm64 Linux always lets userspace read the virtual counter; where it traps the reads to work around errata
+        // they are slower than clock_gettime, which the constructor detects
+        static GenericTimerClock clock {&get_cntvct_el0, get_cntfreq_el0()};
+#else
+        // arm Linux need not let userspace read the counter, and other architectures do not have it
+        static GenericTimerClock clock {nullptr, 0};
+#endif
+        return clock;
+    }
+
+    std::uint64_t GenericTimerClock::readSyscallNs()
+    {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0) {
+            logg.logError("Failed to get uptime");
+            handleException();
+        }
+        return (NS_PER_S * ts.tv_sec + ts.tv_nsec);
+    }
+
+    GenericTimerClock::GenericTimerClock(std::uint64_t (*readCounter)(), std::uint64_t frequency)
+        : mReadCounter(readCounter),
+          mFrequency(frequency),
+          mUsingCounter(false),
+          mSequence(0),
+          mBaseCounter(0),
+          mBaseNs(0),
+          mScale(0),
+          mPeriodTicks(0),
+          mCalibrationMutex(),
+          mSyncCounter(0),
+          mSyncNs(0),
+          mPeriodNs(0),
+          mHasRate(false)
+    {
+        if ((mReadCounter == nullptr) || (mFrequency == 0)) {
+            return;
+        }
+        if (!isCounterCheaper()) {
+            logg.logMessage("Reading the generic timer is no cheaper than clock_gettime, so it will not be used");
+            return;
+        }
+
+        // Until the first calibration, mPeriodTicks of 0 sends every read to calibrate
+        readPair(mSyncCounter, mSyncNs);
+        mUsingCounter.store(true, std::memory_order_relaxed);
+    }
+
+    std::uint64_t GenericTimerClock::getTimeNs()
+    {
+        if (!mUsingCounter.load(std::memory_order_relaxed)) {
+            return readSyscallNs();
+        }
+
+        while (true) {
+            const std::uint32_t sequence = mSequence.load(std::memory_order_acquire);
+            if ((sequence & 1) != 0) {
+                // being published
+                continue;
+            }
+            const std::uint64_t counter = mReadCounter();
+            const std::uint64_t baseCounter = mBaseCounter.load(std::memory_order_relaxed);
+            const std::uint64_t baseNs = mBaseNs.load(std::memory_order_relaxed);
+            const std::uint64_t scale = mScale.load(std::memory_order_relaxed);
+            const std::uint64_t periodTicks = mPeriodTicks.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (mSequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+
+            const std::uint64_t delta = counter - baseCounter;
+            if (delta < periodTicks) {
+                return baseNs + ((delta * scale) >> SCALE_SHIFT);
+            }
+
+            std::unique_lock<std::mutex> lock {mCalibrationMutex, std::try_to_lock};
+            if (lock.owns_lock()) {
+                return calibrate();
+            }
+            // Another thread is calibrating, the line stays accurate, and the product in range, for another period
+            if (delta < 2 * periodTicks) {
+                return baseNs + ((delta * scale) >> SCALE_SHIFT);
+            }
+            return readSyscallNs();
+        }
+    }
+
+    void GenericTimerClock::readPair(std::uint64_t & counter, std::uint64_t & ns) const
+    {
+        // Take the counter halfway through clock_gettime, from the attempt that was least disturbed
+        std::uint64_t bestTicks = UINT64_MAX;
+        for (int attempt = 0; attempt < PAIR_ATTEMPTS; ++attempt) {
+            const std::uint64_t before = mReadCounter();
+            const std::uint64_t syscallNs = readSyscallNs();
+            const std::uint64_t after = mReadCounter();
+            if (after - before < bestTicks) {
+                bestTicks = after - before;
+                counter = before + bestTicks / 2;
+                ns = syscallNs;
+            }
+        }
+    }
+
+    bool GenericTimerClock::isCounterCheaper() const
+    {
+        std::uint64_t sum = 0;
+        const std::uint64_t start = readSyscallNs();
+        for (int sample = 0; sample < COST_SAMPLES; ++sample) {
+            sum += mReadCounter();
+        }
+        const std::uint64_t counterEnd = readSyscallNs();
+        for (int sample = 0; sample < COST_SAMPLES; ++sample) {
+            sum += readSyscallNs();
+        }
+        const std::uint64_t syscallEnd = readSyscallNs();
+
+        // keep the reads
+        volatile std::uint64_t unused = sum;
+        (void) unused;
+
+        // Scaling the count and checking the sequence costs about as much again as reading the counter
+        return 2 * (counterEnd - start) < (syscallEnd - counterEnd);
+    }
+
+    std::uint64_t GenericTimerClock::calibrate()
+    {
+        const std::uint64_t baseCounter = mBaseCounter.load(std::memory_order_relaxed);
+        const std::uint64_t baseNs = mBaseNs.load(std::memory_order_relaxed);
+        const std::uint64_t scale = mScale.load(std::memory_order_relaxed);
+        const std::uint64_t periodTicks = mPeriodTicks.load(std::memory_order_relaxed);
+
+        {
+            // Another thread may have calibrated since this one read the line
+            const std::uint64_t delta = mReadCounter() - baseCounter;
+            if (delta < periodTicks) {
+                return baseNs + ((delta * scale) >> SCALE_SHIFT);
+            }
+        }
+
+        std::uint64_t counter;
+        std::uint64_t ns;
+        readPair(counter, ns);
+
+        const double elapsedTicks = counter - mSyncCounter;
+        const double elapsedNs = ns - mSyncNs;
+
+        if (!mHasRate) {
+            if (elapsedNs < INITIAL_PERIOD_NS) {
+                return ns;
+            }
+
+            const double frequency = elapsedTicks * NS_PER_S / elapsedNs;
+            if (frequency < MIN_FREQUENCY) {
+                logg.logMessage("The generic timer counted at %.0f Hz, so clock_gettime will be used", frequency);
+                mUsingCounter.store(false, std::memory_order_relaxed);
+                return ns;
+            }
+            if (std::fabs(frequency - mFrequency) > 0.1 * mFrequency) {
+                logg.logMessage("The generic timer counts at %.0f Hz rather than the %" PRIu64 " Hz in CNTFRQ",
+                                frequency,
+                                mFrequency);
+            }
+
+            mHasRate = true;
+            mPeriodNs = INITIAL_PERIOD_NS;
+            mSyncCounter = counter;
+            mSyncNs = ns;
+            const double nsPerTick = elapsedNs / elapsedTicks;
+            publish(counter, ns, std::llround(nsPerTick * SCALE_MULTIPLIER), std::llround(mPeriodNs / nsPerTick));
+            return ns;
+        }
+
+        // Where the current line puts this counter, and how far behind clock_gettime that is
+        const double lineOffset = static_cast<double>(counter - baseCounter) * scale / SCALE_MULTIPLIER;
+        const double error = static_cast<double>(static_cast<std::int64_t>(ns - baseNs)) - lineOffset;
+
+        std::uint64_t nextBaseNs;
+        double nextScale;
+        double nextPeriodTicks;
+        if (std::fabs(error) > MAX_ERROR_NS) {
+            // Over a suspend the counter keeps counting but clock_gettime does not, so the rate measured across the
+            // gap is wrong. Keep the scale and measure the rate again from here, starting with a short period.
+            mPeriodNs = INITIAL_PERIOD_NS;
+            nextBaseNs = ns;
+            nextScale = scale;
+            nextPeriodTicks = mPeriodNs * SCALE_MULTIPLIER / scale;
+        }
+        else {
+            const double nsPerTick = elapsedNs / elapsedTicks;
+            const double rateScale = nsPerTick * SCALE_MULTIPLIER;
+            mPeriodNs = std::min(2 * mPeriodNs, MAX_PERIOD_NS);
+            nextPeriodTicks = mPeriodNs / nsPerTick;
+
+            // Continue from where the line is now and converge on clock_gettime by the end of the next period
+            nextBaseNs = baseNs + std::llround(lineOffset);
+            const double slew = error * SCALE_MULTIPLIER / nextPeriodTicks;
+            nextScale = rateScale + std::max(-MAX_SLEW * rateScale, std::min(slew, MAX_SLEW * rateScale));
+        }
+
+        mSyncCounter = counter;
+        mSyncNs = ns;
+        publish(counter, nextBaseNs, std::llround(nextScale), std::llround(nextPeriodTicks));
+        return nextBaseNs;
+    }
+
+    void GenericTimerClock::publish(std::uint64_t baseCounter,
+                                    std::uint64_t baseNs,
+                                    std::uint64_t scale,
+                                    std::uint64_t periodTicks)
+    {
+        const std::uint32_t sequence = mSequence.load(std::memory_order_relaxed);
+        mSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        mBaseCounter.store(baseCounter, std::memory_order_relaxed);
+        mBaseNs.store(baseNs, std::memory_order_relaxed);
+        mScale.store(scale, std::memory_order_relaxed);
+        mPeriodTicks.store(periodTicks, std::memory_order_relaxed);
+
+        mSequence.store(sequence + 2, std::memory_order_release);
+    }
+}
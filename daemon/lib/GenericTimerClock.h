@@ -0,0 +1,79 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LIB_GENERIC_TIMER_CLOCK_H
+#define INCLUDE_LIB_GENERIC_TIMER_CLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace lib {
+    /**
+     * Reads CLOCK_MONOTONIC_RAW by scaling the generic timer's virtual count, which userspace can read without
+     * entering the kernel, falling back to clock_gettime where the counter cannot be read or is no cheaper.
+     *
+     * The scale is measured against clock_gettime by whichever thread first reads the clock once the calibration
+     * period has passed. Drift is corrected by slewing the scale so the clock converges on clock_gettime over the
+     * next period without jumping; only if the two have diverged, such as over a suspend, does it step to
+     * clock_gettime and measure the rate again. The period starts short and doubles, so the first readings after
+     * startup, or after a step, are calibrated quickly.
+     *
+     * The clock is not guaranteed to be monotonic across threads: a step, or a thread reading clock_gettime while
+     * another calibrates, can return less than another thread has already read.
+     */
+    class GenericTimerClock {
+    public:
+        /** @return The clock used by getTime and TimestampSource */
+        static GenericTimerClock & instance();
+
+        /** @return CLOCK_MONOTONIC_RAW from clock_gettime, for sync points that must be exact */
+        static std::uint64_t readSyscallNs();
+
+        /**
+         * @param readCounter Reads the counter, or nullptr if it cannot be read
+         * @param frequency The nominal frequency of the counter in Hz, or 0 if it is unknown
+         */
+        GenericTimerClock(std::uint64_t (*readCounter)(), std::uint64_t frequency);
+
+        /** @return CLOCK_MONOTONIC_RAW in nanoseconds */
+        std::uint64_t getTimeNs();
+
+        bool isUsingCounter() const { return mUsingCounter.load(std::memory_order_relaxed); }
+
+    private:
+        /** Reads the counter and clock_gettime as close together as possible */
+        void readPair(std::uint64_t & counter, std::uint64_t & ns) const;
+        bool isCounterCheaper() const;
+        /** Called with mCalibrationMutex held */
+        std::uint64_t calibrate();
+        void publish(std::uint64_t baseCounter, std::uint64_t baseNs, std::uint64_t scale, std::uint64_t periodTicks);
+
+        std::uint64_t (*const mReadCounter)();
+        const std::uint64_t mFrequency;
+        std::atomic<bool> mUsingCounter;
+
+        // The line from counter to ns that readers use, guarded by mSequence as a seqlock
+        std::atomic<std::uint32_t> mSequence;
+        std::atomic<std::uint64_t> mBaseCounter;
+        std::atomic<std::uint64_t> mBaseNs;
+        // ns per tick, scaled by 2^SCALE_SHIFT
+        std::atomic<std::uint64_t> mScale;
+        std::atomic<std::uint64_t> mPeriodTicks;
+
+        // Only accessed by the thread calibrating
+        std::mutex mCalibrationMutex;
+        // the counter and clock_gettime at the last calibration, which the rate is measured from
+        std::uint64_t mSyncCounter;
+        std::uint64_t mSyncNs;
+        std::uint64_t mPeriodNs;
+        bool mHasRate;
+
+        // Intentionally unimplemented
+        GenericTimerClock(const GenericTimerClock &) = delete;
+        GenericTimerClock & operator=(const GenericTimerClock &) = delete;
+        GenericTimerClock(GenericTimerClock &&) = delete;
+        GenericTimerClock & operator=(GenericTimerClock &&) = delete;
+    };
+}
+
+#endif // INCLUDE_LIB_GENERIC_TIMER_CLOCK_H
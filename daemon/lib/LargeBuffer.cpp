@@ -0,0 +1,121 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "lib/LargeBuffer.h"
+
+#include "Logging.h"
+#include "lib/Syscall.h"
+#include "lib/Utils.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace lib {
+    namespace {
+        std::atomic_bool useHugePages {true};
+        std::atomic_bool useReservedHugePages {false};
+
+        /** @return The size of a transparent huge page or 0 if they are not supported */
+        std::size_t getHugePageSize()
+        {
+            static const std::size_t hugePageSize = []() -> std::size_t {
+                std::int64_t value;
+                if ((readInt64FromFile("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", value) != 0) ||
+                    (value <= 0) || ((value & (value - 1)) != 0)) {
+                    return 0;
+                }
+                return value;
+            }();
+            return hugePageSize;
+        }
+
+        std::size_t roundUp(std::size_t size, std::size_t alignment)
+        {
+            return (size + alignment - 1) & ~(alignment - 1);
+        }
+
+        void * mapAnonymous(std::size_t size, int flags)
+        {
+            return lib::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+        }
+    }
+
+    void LargeBuffer::setUseHugePages(bool useHugePages_)
+    {
+        useHugePages.store(useHugePages_, std::memory_order_relaxed);
+    }
+
+    void LargeBuffer::setUseReservedHugePages(bool useReservedHugePages_)
+    {
+        useReservedHugePages.store(useReservedHugePages_, std::memory_order_relaxed);
+    }
+
+    LargeBuffer::LargeBuffer(std::size_t size)
+        : mMapping(MAP_FAILED), mMappingSize(0), mData(nullptr), mSize(size), mUsesHugePages(false)
+    {
+        const std::size_t hugePageSize = (useHugePages.load(std::memory_order_relaxed) ? getHugePageSize() : 0);
+
+        if ((hugePageSize != 0) && (size >= hugePageSize)) {
+            const std::size_t alignedSize = roundUp(size, hugePageSize);
+            if (useReservedHugePages.load(std::memory_order_relaxed)) {
+                // Fails unless huge pages were reserved through /proc/sys/vm/nr_hugepages
+                mMappingSize = alignedSize;
+                mMapping = mapAnonymous(mMappingSize, MAP_HUGETLB);
+                if (mMapping != MAP_FAILED) {
+                    mData = static_cast<char *>(mMapping);
+                    mUsesHugePages = true;
+                    return;
+                }
+                logg.logMessage("Unable to map %zu bytes of reserved huge pages (%d) %s",
+                                alignedSize,
+                                errno,
+                                strerror(errno));
+            }
+
+            // Over allocate so that a huge page aligned range can be kept and the rest unmapped
+            mMappingSize = alignedSize + hugePageSize;
+            mMapping = mapAnonymous(mMappingSize, 0);
+            if (mMapping != MAP_FAILED) {
+                const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(mMapping);
+                const std::uintptr_t alignedStart = roundUp(start, hugePageSize);
+                const std::size_t head = alignedStart - start;
+                if (head != 0) {
+                    lib::munmap(mMapping, head);
+                }
+                const std::size_t tail = mMappingSize - head - alignedSize;
+                if (tail != 0) {
+                    lib::munmap(reinterpret_cast<void *>(alignedStart + alignedSize), tail);
+                }
+                mMapping = reinterpret_cast<void *>(alignedStart);
+                mMappingSize = alignedSize;
+                mData = static_cast<char *>(mMapping);
+
+                // EINVAL if the kernel does not have transparent huge pages, then it is just normal memory
+                if (madvise(mMapping, mMappingSize, MADV_HUGEPAGE) == 0) {
+                    mUsesHugePages = true;
+                }
+                else {
+                    logg.logMessage("madvise MADV_HUGEPAGE failed (%d) %s", errno, strerror(errno));
+                }
+                return;
+            }
+        }
+
+        mMappingSize = size;
+        mMapping = mapAnonymous(mMappingSize, 0);
+        if (mMapping == MAP_FAILED) {
+            logg.logMessage("Unable to map %zu bytes (%d) %s", size, errno, strerror(errno));
+            return;
+        }
+        mData = static_cast<char *>(mMapping);
+    }
+
+    LargeBuffer::~LargeBuffer()
+    {
+        if (mMapping != MAP_FAILED) {
+            lib::munmap(mMapping, mMappingSize);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LIB_LARGE_BUFFER_H
+#define INCLUDE_LIB_LARGE_BUFFER_H
+
+#include <cstddef>
+
+namespace lib {
+    /**
+     * Anonymous memory for a large buffer that is continuously written and read, such as the ring of a Buffer.
+     *
+     * A buffer of at least a huge page is aligned to a huge page and madvised so the kernel can back it with
+     * transparent huge pages, or if enabled with setUseReservedHugePages, is backed by explicit huge pages when any
+     * are reserved. Either saves the TLB misses of walking a ring of small pages on every send. Anything smaller, or
+     * if huge pages are not available, uses normal pages.
+     */
+    class LargeBuffer {
+    public:
+        /** Huge pages are used by default, this only affects buffers constructed afterwards */
+        static void setUseHugePages(bool useHugePages);
+
+        /**
+         * Explicit huge pages come from the pool reserved through /proc/sys/vm/nr_hugepages, which the profiled
+         * workload may depend on, so are not used by default. This only affects buffers constructed afterwards.
+         */
+        static void setUseReservedHugePages(bool useReservedHugePages);
+
+        /** @param size The usable size in bytes, the memory is zero filled */
+        explicit LargeBuffer(std::size_t size);
+        ~LargeBuffer();
+
+        /** @return False if the memory could not be allocated */
+        explicit operator bool() const { return mData != nullptr; }
+
+        char * data() const { return mData; }
+        std::size_t size() const { return mSize; }
+
+        /** @return True if backed by explicit huge pages or madvised for transparent ones */
+        bool usesHugePages() const { return mUsesHugePages; }
+
+    private:
+        void * mMapping;
+        std::size_t mMappingSize;
+        char * mData;
+        std::size_t mSize;
+        bool mUsesHugePages;
+
+        // Intentionally unimplemented
+        LargeBuffer(const LargeBuffer &) = delete;
+        LargeBuffer & operator=(const LargeBuffer &) = delete;
+        LargeBuffer(LargeBuffer &&) = delete;
+        LargeBuffer & operator=(LargeBuffer &&) = delete;
+    };
+}
+
+#endif // INCLUDE_LIB_LARGE_BUFFER_H
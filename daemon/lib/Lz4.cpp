@@ -0,0 +1,229 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "lib/Lz4.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace lib {
+    namespace lz4 {
+        namespace {
+            constexpr int HASH_LOG = 12;
+            constexpr std::size_t MIN_MATCH = 4;
+            /// The last match must start at least this many bytes before the end of the block
+            constexpr std::size_t MF_LIMIT = 12;
+            /// The last bytes of a block are always literals
+            constexpr std::size_t LAST_LITERALS = 5;
+            constexpr std::size_t MAX_OFFSET = 65535;
+            constexpr unsigned RUN_MASK = 15;
+
+            inline std::uint32_t read32(const unsigned char * p)
+            {
+                std::uint32_t value;
+                memcpy(&value, p, sizeof(value));
+                return value;
+            }
+
+            inline std::uint32_t hash(std::uint32_t sequence)
+            {
+                return (sequence * 2654435761U) >> (32 - HASH_LOG);
+            }
+
+            /**
+             * Write a length that did not fit in the token nibble
+             *
+             * @return false if dst would overflow
+             */
+            inline bool writeLength(unsigned char *& op, const unsigned char * oend, std::size_t length)
+            {
+                while (length >= 255) {
+                    if (op >= oend) {
+                        return false;
+                    }
+                    *op++ = 255;
+                    length -= 255;
+                }
+                if (op >= oend) {
+                    return false;
+                }
+                *op++ = static_cast<unsigned char>(length);
+                return true;
+            }
+
+            /**
+             * Write one sequence; a matchLength of zero means the final, literal only, sequence
+             *
+             * @return false if dst would overflow
+             */
+            bool writeSequence(unsigned char *& op,
+                               const unsigned char * oend,
+                               const unsigned char * literals,
+                               std::size_t literalLength,
+                               std::size_t offset,
+                               std::size_t matchLength)
+            {
+                if (op >= oend) {
+                    return false;
+                }
+                unsigned char * const token = op++;
+                const std::size_t matchCode = (matchLength == 0 ? 0 : matchLength - MIN_MATCH);
+
+                *token = static_cast<unsigned char>(
+                    ((literalLength < RUN_MASK ? literalLength : RUN_MASK) << 4) |
+                    (matchCode < RUN_MASK ? matchCode : RUN_MASK));
+
+                if ((literalLength >= RUN_MASK) && !writeLength(op, oend, literalLength - RUN_MASK)) {
+                    return false;
+                }
+                if (literalLength > static_cast<std::size_t>(oend - op)) {
+                    return false;
+                }
+                if (literalLength > 0) {
+                    memcpy(op, literals, literalLength);
+                    op += literalLength;
+                }
+
+                if (matchLength == 0) {
+                    return true;
+                }
+
+                if ((oend - op) < 2) {
+                    return false;
+                }
+                *op++ = static_cast<unsigned char>(offset & 0xff);
+                *op++ = static_cast<unsigned char>((offset >> 8) & 0xff);
+
+                return (matchCode < RUN_MASK) || writeLength(op, oend, matchCode - RUN_MASK);
+            }
+        }
+
+        std::size_t compressBlock(const char * src, std::size_t srcLength, char * dst, std::size_t dstCapacity)
+        {
+            const auto * const in = reinterpret_cast<const unsigned char *>(src);
+            auto * op = reinterpret_cast<unsigned char *>(dst);
+            const unsigned char * const oend = op + dstCapacity;
+
+            std::size_t anchor = 0;
+
+            if (srcLength > MF_LIMIT) {
+                std::int32_t table[1 << HASH_LOG];
+                for (auto & entry : table) {
+                    entry = -1;
+                }
+
+                const std::size_t matchStartLimit = srcLength - MF_LIMIT;
+                const std::size_t matchEndLimit = srcLength - LAST_LITERALS;
+
+                std::size_t ip = 0;
+                while (ip < matchStartLimit) {
+                    const std::uint32_t sequence = read32(in + ip);
+                    const std::uint32_t h = hash(sequence);
+                    const std::int32_t candidate = table[h];
+                    table[h] = static_cast<std::int32_t>(ip);
+
+                    if ((candidate < 0) || ((ip - candidate) > MAX_OFFSET) || (read32(in + candidate) != sequence)) {
+                        ++ip;
+                        continue;
+                    }
+
+                    std::size_t ref = candidate;
+
+                    // extend the match backwards into any pending literals
+                    while ((ip > anchor) && (ref > 0) && (in[ip - 1] == in[ref - 1])) {
+                        --ip;
+                        --ref;
+                    }
+
+                    // and forwards as far as allowed
+                    std::size_t matchLength = MIN_MATCH;
+                    while ((ip + matchLength < matchEndLimit) && (in[ref + matchLength] == in[ip + matchLength])) {
+                        ++matchLength;
+                    }
+
+                    if (!writeSequence(op, oend, in + anchor, ip - anchor, ip - ref, matchLength)) {
+                        return 0;
+                    }
+
+                    ip += matchLength;
+                    anchor = ip;
+
+                    // prime the table with the position just before the next search so that runs are found
+                    if (ip - 2 < matchStartLimit) {
+                        table[hash(read32(in + ip - 2))] = static_cast<std::int32_t>(ip - 2);
+                    }
+                }
+            }
+
+            if (!writeSequence(op, oend, in + anchor, srcLength - anchor, 0, 0)) {
+                return 0;
+            }
+
+            return op - reinterpret_cast<unsigned char *>(dst);
+        }
+
+        long decompressBlock(const char * src, std::size_t srcLength, char * dst, std::size_t dstCapacity)
+        {
+            const auto * ip = reinterpret_cast<const unsigned char *>(src);
+            const unsigned char * const iend = ip + srcLength;
+            auto * const out = reinterpret_cast<unsigned char *>(dst);
+            std::size_t op = 0;
+
+            const auto readLength = [&ip, iend](std::size_t & length) -> bool {
+                unsigned char byte;
+                do {
+                    if (ip >= iend) {
+                        return false;
+                    }
+                    byte = *ip++;
+                    length += byte;
+                } while (byte == 255);
+                return true;
+            };
+
+            while (ip < iend) {
+                const unsigned token = *ip++;
+
+                std::size_t literalLength = token >> 4;
+                if ((literalLength == RUN_MASK) && !readLength(literalLength)) {
+                    return -1;
+                }
+                if ((literalLength > static_cast<std::size_t>(iend - ip)) || (literalLength > dstCapacity - op)) {
+                    return -1;
+                }
+                memcpy(out + op, ip, literalLength);
+                ip += literalLength;
+                op += literalLength;
+
+                // the final sequence has no match part
+                if (ip == iend) {
+                    break;
+                }
+
+                if ((iend - ip) < 2) {
+                    return -1;
+                }
+                const std::size_t offset = ip[0] | (ip[1] << 8);
+                ip += 2;
+                if ((offset == 0) || (offset > op)) {
+                    return -1;
+                }
+
+                std::size_t matchLength = token & RUN_MASK;
+                if ((matchLength == RUN_MASK) && !readLength(matchLength)) {
+                    return -1;
+                }
+                matchLength += MIN_MATCH;
+                if (matchLength > dstCapacity - op) {
+                    return -1;
+                }
+
+                // byte by byte as the match may overlap the output
+                for (std::size_t i = 0; i < matchLength; ++i, ++op) {
+                    out[op] = out[op - offset];
+                }
+            }
+
+            return static_cast<long>(op);
+        }
+    }
+}
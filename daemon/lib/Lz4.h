@@ -0,0 +1,39 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LIB_LZ4_H
+#define INCLUDE_LIB_LZ4_H
+
+#include <cstddef>
+
+namespace lib {
+    namespace lz4 {
+        /**
+         * @return the largest size compressBlock can produce for an input of length srcLength
+         */
+        constexpr std::size_t compressBound(std::size_t srcLength) { return srcLength + (srcLength / 255) + 16; }
+
+        /**
+         * Compress one block of data using the LZ4 block format (no frame header or checksum)
+         *
+         * @param src The data to compress
+         * @param srcLength The length of src, must be less than 2GiB
+         * @param dst The output buffer
+         * @param dstCapacity The size of dst
+         * @return The number of bytes written to dst, or 0 if the output did not fit
+         */
+        std::size_t compressBlock(const char * src, std::size_t srcLength, char * dst, std::size_t dstCapacity);
+
+        /**
+         * Decompress one block produced by compressBlock
+         *
+         * @param src The compressed data
+         * @param srcLength The length of src
+         * @param dst The output buffer
+         * @param dstCapacity The size of dst
+         * @return The number of bytes written to dst, or -1 if the input is malformed or does not fit
+         */
+        long decompressBlock(const char * src, std::size_t srcLength, char * dst, std::size_t dstCapacity);
+    }
+}
+
+#endif // INCLUDE_LIB_LZ4_H
@@ -32,6 +32,8 @@ namespace lib {
         return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
     }
 
+    int bpf(int cmd, union bpf_attr * attr, unsigned int size) { return syscall(__NR_bpf, cmd, attr, size); }
+
     int accept4(int sockfd, struct sockaddr * addr, socklen_t * addrlen, int flags)
     {
         return syscall(__NR_accept4, sockfd, addr, addrlen, flags);
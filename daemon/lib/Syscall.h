@@ -13,6 +13,8 @@ struct sockaddr;
 
 struct utsname;
 
+union bpf_attr;
+
 namespace lib {
     int close(int fd);
 
@@ -27,6 +29,8 @@ namespace lib {
 
     int perf_event_open(struct perf_event_attr * attr, pid_t pid, int cpu, int group_fd, unsigned long flags);
 
+    int bpf(int cmd, union bpf_attr * attr, unsigned int size);
+
     int accept4(int sockfd, struct sockaddr * addr, socklen_t * addrlen, int flags);
 
     ssize_t read(int fd, void * buf, size_t count);
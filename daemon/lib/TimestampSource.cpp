@@ -2,6 +2,9 @@
 
 #include "lib/TimestampSource.h"
 
+#include "lib/GenericTimerClock.h"
+#include "lib/Time.h"
+
 namespace lib {
     TimestampSource::TimestampSource(clockid_t id_) : base(0), id(id_) { base = getAbsTimestampNS(); }
 
@@ -11,6 +14,10 @@ namespace lib {
 
     unsigned long long TimestampSource::getAbsTimestampNS() const
     {
+        if (id == CLOCK_MONOTONIC_RAW) {
+            return GenericTimerClock::instance().getTimeNs();
+        }
+
         ::timespec ts;
         clock_gettime(id, &ts);
 
@@ -3,6 +3,7 @@
 #include "linux/PerCoreIdentificationThread.h"
 
 #include "Logging.h"
+#include "ThreadFactory.h"
 #include "lib/Assert.h"
 #include "lib/Optional.h"
 #include "lib/Utils.h"
@@ -34,7 +35,8 @@ PerCoreIdentificationThread::PerCoreIdentificationThread(bool ignoreOffline,
       cpu(cpu),
       ignoreOffline(ignoreOffline)
 {
-    thread = std::thread(launch, this);
+    // run pins the thread to its CPU itself, so that it can tell when it is offline
+    thread = thread_factory::create(ThreadRole::PER_CPU_READER, [this]() { launch(this); });
 }
 
 PerCoreIdentificationThread::~PerCoreIdentificationThread()
@@ -194,3 +194,12 @@ void PerfAttrsBuffer::marshalHeaderEvent(const uint64_t currTime, const char * c
     buffer.writeBytes(headerEvent, headerEventLen);
     buffer.check(currTime);
 }
+
+void PerfAttrsBuffer::marshalSamplePeriodScale(const uint64_t currTime, const int scale)
+{
+    buffer.waitForSpace(2 * buffer_utils::MAXSIZE_PACK32 + buffer_utils::MAXSIZE_PACK64, currTime);
+    buffer.packInt(static_cast<int32_t>(CodeType::SAMPLE_PERIOD_SCALE));
+    buffer.packInt64(currTime);
+    buffer.packInt(scale);
+    buffer.check(currTime);
+}
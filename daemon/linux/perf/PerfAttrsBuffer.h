@@ -34,6 +34,9 @@ public:
     void marshalHeaderPage(uint64_t currTime, const char * headerPage) override;
     void marshalHeaderEvent(uint64_t currTime, const char * headerEvent) override;
 
+    /** Record that the sample periods are now scale times their configured value */
+    void marshalSamplePeriodScale(uint64_t currTime, int scale);
+
     void setDone();
     bool isDone() const;
 
@@ -3,11 +3,15 @@
 #include "linux/perf/PerfBuffer.h"
 
 #include "BufferUtils.h"
+#include "GatordStats.h"
 #include "ISender.h"
 #include "Logging.h"
 #include "Protocol.h"
 #include "k/perf_event.h"
 #include "lib/Syscall.h"
+#include "linux/perf/PerfCallchainInterner.h"
+#include "linux/perf/PerfSampleAggregator.h"
+#include "linux/perf/PerfUserStackUnwinder.h"
 
 #include <cerrno>
 #include <cinttypes>
@@ -67,7 +71,16 @@ std::size_t PerfBuffer::getAuxBufferLength() const
     return mConfig.auxBufferSize;
 }
 
-PerfBuffer::PerfBuffer(PerfBuffer::Config config) : mConfig(config), mBuffers(), mDiscard()
+PerfBuffer::PerfBuffer(PerfBuffer::Config config)
+    : mConfig(config),
+      mBuffers(),
+      mDiscard(),
+      mBuffersMutex(),
+      mSampleAggregator(nullptr),
+      mCallchainInterner(nullptr),
+      mUserStackUnwinder(nullptr),
+      mMaxFillPercent(0),
+      mSnapshotTaken(false)
 {
     validate(mConfig);
 }
@@ -85,7 +98,9 @@ PerfBuffer::~PerfBuffer()
 bool PerfBuffer::useFd(const int fd, int cpu, bool collectAuxTrace)
 {
     auto mmap = [this, cpu](size_t length, size_t offset, int fd) {
-        void * const buf = lib::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+        // Without PROT_WRITE, data_tail cannot be written and the kernel does not stop when the buffer is full
+        const int prot = (mConfig.overwrite ? PROT_READ : PROT_READ | PROT_WRITE);
+        void * const buf = lib::mmap(nullptr, length, prot, MAP_SHARED, fd, offset);
 
         if (buf == MAP_FAILED) {
             logg.logMessage("mmap failed for fd %i (errno=%d, %s, mmapLength=%zu, offset=%zu)",
@@ -109,9 +124,18 @@ bool PerfBuffer::useFd(const int fd, int cpu, bool collectAuxTrace)
         return buf;
     };
 
-    auto buffer = mBuffers.find(cpu);
-    if (buffer != mBuffers.end()) {
-        if (lib::ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, buffer->second.fd) < 0) {
+    // Only the map is shared between CPUs, so the mmaps are not made under the lock
+    int outputFd = -1;
+    {
+        std::lock_guard<std::mutex> lock {mBuffersMutex};
+        const auto buffer = mBuffers.find(cpu);
+        if (buffer != mBuffers.end()) {
+            outputFd = buffer->second.fd;
+        }
+    }
+
+    if (outputFd >= 0) {
+        if (lib::ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, outputFd) < 0) {
             logg.logMessage("ioctl failed for fd %i (errno=%d, %s)", fd, errno, strerror(errno));
             return false;
         }
@@ -122,7 +146,10 @@ bool PerfBuffer::useFd(const int fd, int cpu, bool collectAuxTrace)
             return false;
         }
 
-        mBuffers[cpu] = Buffer {buf, nullptr, fd, -1};
+        {
+            std::lock_guard<std::mutex> lock {mBuffersMutex};
+            mBuffers[cpu] = Buffer {buf, nullptr, fd, -1};
+        }
 
         struct perf_event_mmap_page & pemp = *static_cast<struct perf_event_mmap_page *>(buf);
         // Check the version
@@ -133,8 +160,18 @@ bool PerfBuffer::useFd(const int fd, int cpu, bool collectAuxTrace)
         }
     }
 
+    if (collectAuxTrace && mConfig.overwrite) {
+        logg.logMessage("Aux data cannot be collected into overwriting buffers");
+        return false;
+    }
+
     if (collectAuxTrace) {
-        auto & buffer = mBuffers[cpu];
+        Buffer * bufferPtr;
+        {
+            std::lock_guard<std::mutex> lock {mBuffersMutex};
+            bufferPtr = &mBuffers[cpu];
+        }
+        Buffer & buffer = *bufferPtr;
         if (buffer.aux_buffer == nullptr) {
             const size_t offset = getDataMMapLength(mConfig);
             const size_t length = getAuxBufferLength();
@@ -171,6 +208,11 @@ void PerfBuffer::discard(int cpu)
 
 bool PerfBuffer::isEmpty()
 {
+    if (mConfig.overwrite) {
+        // nothing is sent until the snapshot, then each buffer is released once sent
+        return (!mSnapshotTaken.load(std::memory_order_acquire)) || mBuffers.empty();
+    }
+
     for (auto cpuAndBuf : mBuffers) {
         // Take a snapshot of the positions
         auto * pemp = static_cast<struct perf_event_mmap_page *>(cpuAndBuf.second.data_buffer);
@@ -191,6 +233,10 @@ bool PerfBuffer::isEmpty()
 
 bool PerfBuffer::isFull()
 {
+    if (mConfig.overwrite) {
+        return false;
+    }
+
     for (auto cpuAndBuf : mBuffers) {
         // Take a snapshot of the positions
         auto * pemp = static_cast<struct perf_event_mmap_page *>(cpuAndBuf.second.data_buffer);
@@ -213,7 +259,22 @@ bool PerfBuffer::isFull()
 
 class PerfDataFrame {
 public:
-    PerfDataFrame(ISender & sender) : mSender(sender), mWritePos(-1), mCpuSizePos(-1) {}
+    PerfDataFrame(ISender & sender,
+                  PerfSampleAggregator * sampleAggregator,
+                  PerfCallchainInterner * callchainInterner,
+                  PerfUserStackUnwinder * userStackUnwinder)
+        : mSender(sender),
+          mSampleAggregator(sampleAggregator),
+          mCallchainInterner(callchainInterner),
+          mUserStackUnwinder(userStackUnwinder),
+          mRecordCopy(),
+          mInternedRecord(),
+          mUnwoundRecord(),
+          mRecordPositions(),
+          mWritePos(-1),
+          mCpuSizePos(-1)
+    {
+    }
 
     void add(const int cpu, uint64_t head, uint64_t tail, const char * b, std::size_t length)
     {
@@ -222,18 +283,35 @@ public:
         const std::size_t bufferMask = length - 1;
 
         while (head > tail) {
-            const int count =
-                reinterpret_cast<const struct perf_event_header *>(b + (tail & bufferMask))->size / sizeof(uint64_t);
-            // Can this whole message be written as Streamline assumes events are not split between frames
-            if (sizeof(mBuf) <= mWritePos + count * buffer_utils::MAXSIZE_PACK64) {
-                send();
-                cpuHeader(cpu);
-            }
-            for (int i = 0; i < count; ++i) {
-                // Must account for message size
-                buffer_utils::packInt64(mBuf, mWritePos, *reinterpret_cast<const uint64_t *>(b + (tail & bufferMask)));
-                tail += sizeof(uint64_t);
+            const auto * const record = reinterpret_cast<const struct perf_event_header *>(b + (tail & bufferMask));
+            addRecord(cpu, tail, b, length);
+            tail += record->size;
+        }
+    }
+
+    /**
+     * Adds the records of a write_backward buffer. These run from head to the oldest record that has not been
+     * overwritten, newest first, so they are added in reverse.
+     */
+    void addBackward(const int cpu, uint64_t head, const char * b, std::size_t length)
+    {
+        cpuHeader(cpu);
+
+        const std::size_t bufferMask = length - 1;
+
+        mRecordPositions.clear();
+        for (uint64_t position = head; position - head < length;) {
+            const auto * const record = reinterpret_cast<const struct perf_event_header *>(b + (position & bufferMask));
+            // Either the buffer has not filled yet or this record was partly overwritten
+            if ((record->size == 0) || (position - head + record->size > length)) {
+                break;
             }
+            mRecordPositions.push_back(position);
+            position += record->size;
+        }
+
+        for (auto it = mRecordPositions.rbegin(); it != mRecordPositions.rend(); ++it) {
+            addRecord(cpu, *it, b, length);
         }
     }
 
@@ -241,6 +319,10 @@ public:
     {
         if (mWritePos > 0) {
             writeCpuSize();
+            if (mCallchainInterner != nullptr) {
+                // The stacks used by this frame must be defined first
+                mCallchainInterner->sendDefinitions(mSender);
+            }
             mSender.writeData(mBuf, mWritePos, ResponseType::APC_DATA);
             mWritePos = -1;
             mCpuSizePos = -1;
@@ -248,6 +330,96 @@ public:
     }
 
 private:
+    void addRecord(const int cpu, uint64_t position, const char * b, std::size_t length)
+    {
+        const std::size_t bufferMask = length - 1;
+
+        const auto * record =
+            contiguous(reinterpret_cast<const struct perf_event_header *>(b + (position & bufferMask)), b, length);
+        if (record->type == PERF_RECORD_LOST) {
+            countLost(record);
+        }
+        if ((mUserStackUnwinder != nullptr) && mUserStackUnwinder->process(record, mUnwoundRecord)) {
+            record = reinterpret_cast<const struct perf_event_header *>(mUnwoundRecord.data());
+        }
+        if ((mSampleAggregator != nullptr) && mSampleAggregator->consume(record)) {
+            return;
+        }
+        if (mCallchainInterner != nullptr) {
+            if (mCallchainInterner->isFull()) {
+                send();
+                cpuHeader(cpu);
+            }
+            if (mCallchainInterner->intern(record, mInternedRecord)) {
+                addWords(cpu, mInternedRecord.data(), mInternedRecord.size());
+                return;
+            }
+        }
+
+        addWords(cpu, reinterpret_cast<const uint64_t *>(record), record->size / sizeof(uint64_t));
+    }
+
+    void addWords(const int cpu, const uint64_t * words, std::size_t count)
+    {
+        std::size_t size = count * buffer_utils::MAXSIZE_PACK64;
+        if (sizeof(mBuf) <= buffer_utils::MAX_FRAME_HEADER_SIZE + size) {
+            // Only a record carrying a large copy of the user stack gets near this, and most of its words pack small
+            size = packedSize(words, count);
+            if (sizeof(mBuf) <= buffer_utils::MAX_FRAME_HEADER_SIZE + size) {
+                // Streamline assumes events are not split between frames, so it cannot be sent
+                logg.logMessage("Dropping a perf record of %zu bytes that does not fit in a frame",
+                                count * sizeof(uint64_t));
+                GatordStats::add(gGatordStats.mPerfRecordsTooLarge, 1);
+                return;
+            }
+        }
+
+        // Can this whole message be written as Streamline assumes events are not split between frames
+        if (sizeof(mBuf) <= mWritePos + size) {
+            send();
+            cpuHeader(cpu);
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            // Must account for message size
+            buffer_utils::packInt64(mBuf, mWritePos, words[i]);
+        }
+    }
+
+    static std::size_t packedSize(const uint64_t * words, std::size_t count)
+    {
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            size += buffer_utils::sizeOfPackInt64(words[i]);
+        }
+        return size;
+    }
+
+    static void countLost(const struct perf_event_header * record)
+    {
+        // PERF_RECORD_LOST is the header followed by u64 id, u64 lost
+        if (record->size >= sizeof(*record) + 2 * sizeof(uint64_t)) {
+            GatordStats::add(gGatordStats.mPerfLostRecords, reinterpret_cast<const uint64_t *>(record + 1)[1]);
+        }
+    }
+
+    /** Returns the record itself, or a copy of it if it wraps around the end of the ring */
+    const struct perf_event_header * contiguous(const struct perf_event_header * record,
+                                                const char * b,
+                                                std::size_t length)
+    {
+        const std::size_t offset = reinterpret_cast<const char *>(record) - b;
+        if (offset + record->size <= length) {
+            return record;
+        }
+
+        const std::size_t firstSize = length - offset;
+        mRecordCopy.resize((record->size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        char * const copy = reinterpret_cast<char *>(mRecordCopy.data());
+        memcpy(copy, record, firstSize);
+        memcpy(copy + firstSize, b, record->size - firstSize);
+        return reinterpret_cast<const struct perf_event_header *>(copy);
+    }
+
     void frameHeader()
     {
         if (mWritePos < 0) {
@@ -280,6 +452,13 @@ private:
     // Pick a big size but something smaller than the chunkSize in Sender::writeData which is 100k
     char mBuf[1 << 16];
     ISender & mSender;
+    PerfSampleAggregator * mSampleAggregator;
+    PerfCallchainInterner * mCallchainInterner;
+    PerfUserStackUnwinder * mUserStackUnwinder;
+    std::vector<uint64_t> mRecordCopy;
+    std::vector<uint64_t> mInternedRecord;
+    std::vector<uint64_t> mUnwoundRecord;
+    std::vector<uint64_t> mRecordPositions;
     int mWritePos;
     int mCpuSizePos;
 
@@ -334,7 +513,11 @@ static void sendAuxFrame(ISender & sender,
 
 bool PerfBuffer::send(ISender & sender)
 {
-    PerfDataFrame frame(sender);
+    if (mConfig.overwrite) {
+        return sendSnapshot(sender);
+    }
+
+    PerfDataFrame frame(sender, mSampleAggregator, mCallchainInterner, mUserStackUnwinder);
 
     const std::size_t dataBufferLength = getDataBufferLength();
     const std::size_t auxBufferLength = getAuxBufferLength();
@@ -385,6 +568,13 @@ bool PerfBuffer::send(ISender & sender)
         if (dataHead > dataTail) {
             const char * const b = static_cast<char *>(dataBuf) + mConfig.pageSize;
 
+            const int fillPercent = static_cast<int>(((dataHead - dataTail) * 100) / dataBufferLength);
+            int maxFillPercent = mMaxFillPercent.load(std::memory_order_relaxed);
+            while ((fillPercent > maxFillPercent) &&
+                   !mMaxFillPercent.compare_exchange_weak(maxFillPercent, fillPercent, std::memory_order_relaxed)) {
+            }
+            GatordStats::updateMax(gGatordStats.mPerfBufferHighWater, fillPercent);
+
             frame.add(cpu, dataHead, dataTail, b, dataBufferLength);
 
             // Update tail with the data read and synchronize with the buffer writer
@@ -408,3 +598,57 @@ bool PerfBuffer::send(ISender & sender)
 
     return true;
 }
+
+void PerfBuffer::pauseOutput()
+{
+    for (const auto & cpuAndBuf : mBuffers) {
+        if (lib::ioctl(cpuAndBuf.second.fd, PERF_EVENT_IOC_PAUSE_OUTPUT, 1) != 0) {
+            logg.logMessage("Unable to pause the output of cpu %i (%d) %s", cpuAndBuf.first, errno, strerror(errno));
+        }
+    }
+}
+
+void PerfBuffer::snapshot()
+{
+    // Pausing again is harmless if pauseOutput was already called
+    pauseOutput();
+
+    mSnapshotTaken.store(true, std::memory_order_release);
+}
+
+bool PerfBuffer::sendSnapshot(ISender & sender)
+{
+    const bool snapshotTaken = mSnapshotTaken.load(std::memory_order_acquire);
+
+    PerfDataFrame frame(sender, mSampleAggregator, mCallchainInterner, mUserStackUnwinder);
+
+    for (auto cpuAndBufIt = mBuffers.begin(); cpuAndBufIt != mBuffers.end();) {
+        const int cpu = cpuAndBufIt->first;
+        void * const dataBuf = cpuAndBufIt->second.data_buffer;
+
+        auto discard = mDiscard.find(cpu);
+        const bool shouldDiscard = (discard != mDiscard.end());
+        if (shouldDiscard) {
+            // The history of a CPU that went offline is lost, as the buffer must be released before it comes back
+            mDiscard.erase(discard);
+        }
+        else if (!snapshotTaken) {
+            ++cpuAndBufIt;
+            continue;
+        }
+        else {
+            auto * pemp = static_cast<struct perf_event_mmap_page *>(dataBuf);
+            const uint64_t dataHead = __atomic_load_n(&pemp->data_head, __ATOMIC_ACQUIRE);
+            const char * const b = static_cast<char *>(dataBuf) + mConfig.pageSize;
+
+            frame.addBackward(cpu, dataHead, b, getDataBufferLength());
+        }
+
+        lib::munmap(dataBuf, getDataMMapLength(mConfig));
+        logg.logMessage("Unmapped cpu %i", cpu);
+        cpuAndBufIt = mBuffers.erase(cpuAndBufIt);
+    }
+    frame.send();
+
+    return true;
+}
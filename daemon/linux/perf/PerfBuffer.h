@@ -5,11 +5,17 @@
 
 #include "Config.h"
 
+#include <atomic>
+#include <cstddef>
 #include <map>
+#include <mutex>
 #include <set>
 #include <vector>
 
 class ISender;
+class PerfCallchainInterner;
+class PerfSampleAggregator;
+class PerfUserStackUnwinder;
 
 class PerfBuffer {
 public:
@@ -20,21 +26,64 @@ public:
         size_t dataBufferSize;
         /// must be power of 2 multiple of pageSize (or 0)
         size_t auxBufferSize;
+        /// map the data buffers read only so perf overwrites the oldest records, the events must use write_backward.
+        /// The mmap and comm records are in the same buffers, so are overwritten with the samples, see PerfSource::run.
+        bool overwrite;
     };
 
     PerfBuffer(Config config);
     ~PerfBuffer();
 
+    /** May be called concurrently for different CPUs, but not with the other members */
     bool useFd(int fd, int cpu, bool collectAuxTrace = false);
     void discard(int cpu);
     bool isEmpty();
     bool isFull();
     bool send(ISender & sender);
 
+    /**
+     * In overwrite mode, stop perf writing to the buffers. Their contents are kept until snapshot is called.
+     */
+    void pauseOutput();
+
+    /**
+     * In overwrite mode, stop perf writing to the buffers so that their contents are sent by the following calls to
+     * send. Until then send only releases discarded buffers.
+     */
+    void snapshot();
+
     std::size_t getDataBufferLength() const;
     std::size_t getAuxBufferLength() const;
 
+    /**
+     * Samples consumed by the aggregator are no longer sent as PERF_DATA
+     *
+     * @param sampleAggregator May be null to disable aggregation
+     */
+    void setSampleAggregator(PerfSampleAggregator * sampleAggregator) { mSampleAggregator = sampleAggregator; }
+
+    /**
+     * Samples that are not aggregated have their callchains interned
+     *
+     * @param callchainInterner May be null to send callchains as they are
+     */
+    void setCallchainInterner(PerfCallchainInterner * callchainInterner) { mCallchainInterner = callchainInterner; }
+
+    /**
+     * Samples with a copy of the user stack are unwound before they are aggregated or interned
+     *
+     * @param userStackUnwinder May be null if no event asks for the user stack
+     */
+    void setUserStackUnwinder(PerfUserStackUnwinder * userStackUnwinder) { mUserStackUnwinder = userStackUnwinder; }
+
+    /**
+     * @return The fullest any data buffer has been, as a percentage, when send found it since the last call
+     */
+    int takeMaxFillPercent() { return mMaxFillPercent.exchange(0, std::memory_order_relaxed); }
+
 private:
+    bool sendSnapshot(ISender & sender);
+
     Config mConfig;
 
     struct Buffer {
@@ -47,6 +96,13 @@ private:
     std::map<int, Buffer> mBuffers;
     // After the buffer is flushed it should be unmapped
     std::set<int> mDiscard;
+    /// guards mBuffers while useFd is called for several CPUs at once
+    std::mutex mBuffersMutex;
+    PerfSampleAggregator * mSampleAggregator;
+    PerfCallchainInterner * mCallchainInterner;
+    PerfUserStackUnwinder * mUserStackUnwinder;
+    std::atomic<int> mMaxFillPercent;
+    std::atomic<bool> mSnapshotTaken;
 
     // Intentionally undefined
     PerfBuffer(const PerfBuffer &) = delete;
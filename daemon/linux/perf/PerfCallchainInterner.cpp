@@ -0,0 +1,208 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfCallchainInterner.h"
+
+#include "BufferUtils.h"
+#include "ISender.h"
+#include "Logging.h"
+#include "Protocol.h"
+#include "linux/perf/PerfUtils.h"
+
+#include <cinttypes>
+#include <cstring>
+#include <iterator>
+
+namespace {
+    /// The one word sample fields that come between the identifier and the callchain, PERF_SAMPLE_READ comes after them
+    constexpr std::uint64_t FIELDS_BEFORE_CALLCHAIN = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+                                                      PERF_SAMPLE_ADDR | PERF_SAMPLE_ID | PERF_SAMPLE_STREAM_ID |
+                                                      PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD;
+
+    /// Shorter callchains are no bigger than the id
+    constexpr std::size_t MIN_INTERNED_DEPTH = 2;
+    /// Longer callchains are sent as they are, the kernel default limit is 127
+    constexpr std::size_t MAX_INTERNED_DEPTH = 512;
+
+    constexpr std::size_t MAX_DEFINITION_SIZE =
+        (2 * buffer_utils::MAXSIZE_PACK32) + (MAX_INTERNED_DEPTH * buffer_utils::MAXSIZE_PACK64);
+}
+
+std::size_t PerfCallchainInterner::StackHash::operator()(const Stack & stack) const
+{
+    // FNV-1a over the words
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const std::uint64_t ip : stack) {
+        hash ^= ip;
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+}
+
+PerfCallchainInterner::PerfCallchainInterner(std::size_t capacity)
+    : mMutex(),
+      mCapacity(capacity),
+      mFormats(),
+      mDictionary(),
+      mEntries(),
+      mLru(),
+      mScratchStack(),
+      mDefinitions(),
+      mDefinitionsPos(-1),
+      mSendCount(0),
+      mStats {0, 0, 0, 0}
+{
+    mDictionary.reserve(capacity);
+    mEntries.reserve(capacity);
+}
+
+PerfCallchainInterner::~PerfCallchainInterner()
+{
+    logg.logMessage("Interned %" PRIu64 " of %" PRIu64 " callchains using %" PRIu64
+                    " stack definitions, saving %" PRId64 " words",
+                    mStats.interned,
+                    mStats.samples,
+                    mStats.definitions,
+                    mStats.wordsSaved);
+}
+
+bool PerfCallchainInterner::addEvent(std::uint64_t id, const struct perf_event_attr & attr)
+{
+    const bool canParse = ((attr.sample_type & PERF_SAMPLE_CALLCHAIN) != 0) &&
+                          ((attr.sample_type & PERF_SAMPLE_IDENTIFIER) != 0);
+    if (!canParse) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock {mMutex};
+    mFormats[id] = Format {attr.sample_type, attr.read_format};
+    return true;
+}
+
+bool PerfCallchainInterner::isFull() const
+{
+    if ((mDefinitionsPos >= 0) &&
+        (sizeof(mDefinitions) < static_cast<std::size_t>(mDefinitionsPos) + MAX_DEFINITION_SIZE)) {
+        return true;
+    }
+    // The least recently used id is the one a new stack would take, if even that is used by an unsent sample so are
+    // all the others
+    return (mEntries.size() >= mCapacity) && (mEntries[mLru.back()].lastUsed == mSendCount);
+}
+
+bool PerfCallchainInterner::intern(const struct perf_event_header * record, std::vector<std::uint64_t> & interned)
+{
+    if ((record->type != PERF_RECORD_SAMPLE) || (record->size < sizeof(*record) + sizeof(std::uint64_t))) {
+        return false;
+    }
+
+    const auto * const words = reinterpret_cast<const std::uint64_t *>(record + 1);
+    const std::size_t numberOfWords = (record->size - sizeof(*record)) / sizeof(std::uint64_t);
+
+    Format format;
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+
+        // PERF_SAMPLE_IDENTIFIER is always first
+        const auto formatIt = mFormats.find(words[0]);
+        if (formatIt == mFormats.end()) {
+            return false;
+        }
+        format = formatIt->second;
+    }
+    ++mStats.samples;
+
+    std::size_t pos = 1 + __builtin_popcountll(format.sampleType & FIELDS_BEFORE_CALLCHAIN);
+    if ((format.sampleType & PERF_SAMPLE_READ) != 0) {
+        if (pos >= numberOfWords) {
+            return false;
+        }
+        const std::size_t size = perf_utils::sampleReadSize(format.readFormat, words + pos, numberOfWords - pos);
+        if (size == 0) {
+            return false;
+        }
+        pos += size;
+    }
+    if (pos >= numberOfWords) {
+        return false;
+    }
+
+    const std::uint64_t depth = words[pos];
+    if ((depth < MIN_INTERNED_DEPTH) || (depth > MAX_INTERNED_DEPTH) || (depth > numberOfWords - pos - 1) ||
+        isFull()) {
+        return false;
+    }
+
+    const std::uint32_t id = lookup(words + pos + 1, depth);
+    mEntries[id].lastUsed = mSendCount;
+
+    // The header, the fields before the callchain, the id and the fields after the callchain
+    interned.resize(1 + numberOfWords - depth);
+    std::uint64_t * const out = interned.data();
+    memcpy(out + 1, words, pos * sizeof(std::uint64_t));
+    out[1 + pos] = ~static_cast<std::uint64_t>(id);
+    memcpy(out + 2 + pos, words + pos + 1 + depth, (numberOfWords - pos - 1 - depth) * sizeof(std::uint64_t));
+
+    struct perf_event_header header = *record;
+    header.size = interned.size() * sizeof(std::uint64_t);
+    memcpy(out, &header, sizeof(header));
+
+    ++mStats.interned;
+    mStats.wordsSaved += depth;
+    return true;
+}
+
+std::uint32_t PerfCallchainInterner::lookup(const std::uint64_t * ips, std::size_t depth)
+{
+    mScratchStack.assign(ips, ips + depth);
+
+    const auto it = mDictionary.find(mScratchStack);
+    if (it != mDictionary.end()) {
+        const std::uint32_t id = it->second;
+        mLru.splice(mLru.begin(), mLru, mEntries[id].lruPosition);
+        return id;
+    }
+
+    std::uint32_t id;
+    if (mEntries.size() < mCapacity) {
+        id = mEntries.size();
+        mLru.push_front(id);
+        mEntries.push_back(Entry {nullptr, mLru.begin(), mSendCount});
+    }
+    else {
+        // Reuse the least recently used id
+        id = mLru.back();
+        mLru.splice(mLru.begin(), mLru, std::prev(mLru.end()));
+        mDictionary.erase(*mEntries[id].stack);
+    }
+
+    const auto inserted = mDictionary.emplace(mScratchStack, id);
+    mEntries[id].stack = &inserted.first->first;
+    define(id, inserted.first->first);
+    return id;
+}
+
+void PerfCallchainInterner::define(std::uint32_t id, const Stack & stack)
+{
+    if (mDefinitionsPos < 0) {
+        mDefinitionsPos = 0;
+        buffer_utils::packInt(mDefinitions, mDefinitionsPos, static_cast<uint32_t>(FrameType::PERF_STACKS));
+    }
+    buffer_utils::packInt(mDefinitions, mDefinitionsPos, id);
+    buffer_utils::packInt(mDefinitions, mDefinitionsPos, stack.size());
+    for (const std::uint64_t ip : stack) {
+        buffer_utils::packInt64(mDefinitions, mDefinitionsPos, ip);
+    }
+
+    ++mStats.definitions;
+    mStats.wordsSaved -= stack.size();
+}
+
+void PerfCallchainInterner::sendDefinitions(ISender & sender)
+{
+    if (mDefinitionsPos > 0) {
+        sender.writeData(mDefinitions, mDefinitionsPos, ResponseType::APC_DATA);
+        mDefinitionsPos = -1;
+    }
+    ++mSendCount;
+}
+
@@ -0,0 +1,121 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PERF_PERF_CALLCHAIN_INTERNER_H
+#define INCLUDE_LINUX_PERF_PERF_CALLCHAIN_INTERNER_H
+
+#include "k/perf_event.h"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ISender;
+
+/**
+ * Replaces the callchains of sampled records with the ids of stacks that have already been sent.
+ *
+ * The first time a callchain is seen it gets an id and its definition is sent in a PERF_STACKS frame, ahead of the
+ * PERF_DATA frame with the sample. In the sample the callchain's nr is replaced by ~id and the ips are left out, the
+ * rest of the record is unchanged. As a signed value ~id is negative, so it cannot be mistaken for a real nr, and it
+ * packs into as few bytes as the id does. The dictionary holds a fixed number of stacks; when it is full the least
+ * recently used one is evicted and its id is defined again for the next new stack. As all the definitions are sent
+ * ahead of the frame, an id used by a sample that has not been sent yet is never redefined, the frame is sent first.
+ *
+ * Only samples that have PERF_SAMPLE_IDENTIFIER are interned, everything else is sent as it is. Apart from addEvent,
+ * everything must be called from the thread that sends the perf data.
+ */
+class PerfCallchainInterner {
+public:
+    struct Stats {
+        std::uint64_t samples;
+        std::uint64_t interned;
+        std::uint64_t definitions;
+        /// callchain words that were not sent because they were interned, less the definitions
+        std::int64_t wordsSaved;
+    };
+
+    /** @param capacity The number of stacks to remember */
+    explicit PerfCallchainInterner(std::size_t capacity);
+    ~PerfCallchainInterner();
+
+    /**
+     * Register a perf id, does nothing if the event's samples cannot be interned
+     *
+     * @return true if the callchains of samples from this id will be interned
+     */
+    bool addEvent(std::uint64_t id, const struct perf_event_attr & attr);
+
+    /**
+     * @return true if the definitions waiting to be sent, and the samples using them, must be sent before anything
+     * else can be interned
+     */
+    bool isFull() const;
+
+    /**
+     * @param record A complete record, 8 byte aligned
+     * @param interned Set to the record to send instead, the header is the first word
+     * @return true if interned was set, false if the record must be sent as is
+     */
+    bool intern(const struct perf_event_header * record, std::vector<std::uint64_t> & interned);
+
+    /**
+     * Send the definitions of the stacks interned since the last call, must come immediately before the samples using
+     * them, which are then taken to have been sent
+     */
+    void sendDefinitions(ISender & sender);
+
+    const Stats & getStats() const { return mStats; }
+
+private:
+    using Stack = std::vector<std::uint64_t>;
+
+    struct StackHash {
+        std::size_t operator()(const Stack & stack) const;
+    };
+
+    using Dictionary = std::unordered_map<Stack, std::uint32_t, StackHash>;
+
+    struct Format {
+        std::uint64_t sampleType;
+        std::uint64_t readFormat;
+    };
+
+    struct Entry {
+        /// the key in mDictionary, which is not moved by a rehash
+        const Stack * stack;
+        /// position in mLru
+        std::list<std::uint32_t>::iterator lruPosition;
+        /// the value of mSendCount when a sample last used this id
+        std::uint64_t lastUsed;
+    };
+
+    std::uint32_t lookup(const std::uint64_t * ips, std::size_t depth);
+    void define(std::uint32_t id, const Stack & stack);
+
+    /// only for mFormats
+    std::mutex mMutex;
+    const std::size_t mCapacity;
+    std::unordered_map<std::uint64_t, Format> mFormats;
+    Dictionary mDictionary;
+    /// indexed by id
+    std::vector<Entry> mEntries;
+    /// ids, most recently used first
+    std::list<std::uint32_t> mLru;
+    Stack mScratchStack;
+    /// a PERF_STACKS frame
+    char mDefinitions[1 << 16];
+    int mDefinitionsPos;
+    /// the number of times sendDefinitions was called, so the samples using an id have been sent if it has changed
+    std::uint64_t mSendCount;
+    Stats mStats;
+
+    // Intentionally unimplemented
+    PerfCallchainInterner(const PerfCallchainInterner &) = delete;
+    PerfCallchainInterner & operator=(const PerfCallchainInterner &) = delete;
+    PerfCallchainInterner(PerfCallchainInterner &&) = delete;
+    PerfCallchainInterner & operator=(PerfCallchainInterner &&) = delete;
+};
+
+#endif // INCLUDE_LINUX_PERF_PERF_CALLCHAIN_INTERNER_H
@@ -13,6 +13,7 @@ struct PerfConfig {
     bool has_attr_context_switch;  // >= 4.3
     bool has_ioctl_read_id;        // >= 3.12
     bool has_aux_support;          // >= 4.1
+    bool has_write_backward;       // >= 4.7
 
     bool is_system_wide;
     bool exclude_kernel;
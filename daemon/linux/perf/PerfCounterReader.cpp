@@ -0,0 +1,474 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfCounterReader.h"
+
+#include "ISender.h"
+#include "Logging.h"
+#include "SessionData.h"
+#include "ThreadFactory.h"
+#include "k/perf_event.h"
+#include "lib/Syscall.h"
+#include "lib/Utils.h"
+#include "xml/PmuXML.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr int BUFFER_SIZE = 128 * 1024;
+    constexpr uint64_t NS_PER_TICK_WITHOUT_SAMPLE_RATE = 100 * NS_PER_MS;
+
+    /** @return False if this architecture cannot read hardware counters from userspace */
+    inline bool readPmc(uint32_t counter, uint64_t & value)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        uint32_t low;
+        uint32_t high;
+        asm volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+        value = (static_cast<uint64_t>(high) << 32) | low;
+        return true;
+#else
+        (void) counter;
+        (void) value;
+        return false;
+#endif
+    }
+
+    /**
+     * The self monitoring sequence from the perf_event_mmap_page documentation, only valid on the CPU the event
+     * is counting on
+     *
+     * @return False if the counter cannot be read this way right now
+     */
+    bool readUserPage(const perf_event_mmap_page & userPage, uint64_t & value)
+    {
+        const volatile perf_event_mmap_page & page = userPage;
+        uint32_t seq;
+        do {
+            seq = page.lock;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+
+            const uint32_t index = page.index;
+            const uint16_t width = page.pmc_width;
+            if ((page.cap_user_rdpmc == 0) || (index == 0) || (width == 0) || (width > 64)) {
+                return false;
+            }
+            uint64_t count;
+            if (!readPmc(index - 1, count)) {
+                return false;
+            }
+            // the hardware counter is only pmc_width bits, sign extend it
+            const unsigned shift = 64 - width;
+            value = page.offset + static_cast<uint64_t>(static_cast<int64_t>(count << shift) >> shift);
+
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (page.lock != seq);
+        return true;
+    }
+
+    int openEvent(struct perf_event_attr & attr, int tid, int cpu, int groupFd)
+    {
+        int fd = lib::perf_event_open(&attr, tid, cpu, groupFd, 0);
+        if ((fd < 0) && (errno == EACCES) && (attr.exclude_kernel == 0)) {
+            logg.logMessage("Failed when exclude_kernel == 0, retrying with exclude_kernel = 1");
+            attr.exclude_kernel = 1;
+            fd = lib::perf_event_open(&attr, tid, cpu, groupFd, 0);
+        }
+        if (fd < 0) {
+            return -1;
+        }
+        const int fdf = lib::fcntl(fd, F_GETFD);
+        if ((fdf == -1) || (lib::fcntl(fd, F_SETFD, fdf | FD_CLOEXEC) != 0)) {
+            lib::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
+
+PerfCounterReader::Cpu::Cpu(int cpu, sem_t & senderSem)
+    : buffer(cpu,
+             FrameType::BLOCK_COUNTER,
+             BUFFER_SIZE,
+             senderSem,
+             gSessionData.mLiveRate,
+             !gSessionData.mLocalCapture),
+      counters(),
+      values(),
+      thread(),
+      terminate(false),
+      rdpmcReads(0),
+      syscallReads(0)
+{
+}
+
+PerfCounterReader::PerfCounterReader(const PerfConfig & perfConfig,
+                                     lib::Span<const GatorCpu> clusters,
+                                     lib::Span<const int> clusterIds,
+                                     int sampleRate,
+                                     sem_t & senderSem)
+    : mPerfConfig(perfConfig),
+      mClusters(clusters),
+      mClusterIds(clusterIds),
+      mInterval(sampleRate > 0 ? NS_PER_S / sampleRate : NS_PER_TICK_WITHOUT_SAMPLE_RATE),
+      mMonotonicStarted(0),
+      mCounters(),
+      mCpus(),
+      mMutex(),
+      mThreadsRunning(false),
+      mPageSize(sysconf(_SC_PAGESIZE))
+{
+    for (std::size_t cpu = 0; cpu < clusterIds.size(); ++cpu) {
+        mCpus.emplace_back(new Cpu(cpu, senderSem));
+    }
+}
+
+PerfCounterReader::~PerfCounterReader()
+{
+    stopThreads();
+    for (auto & state : mCpus) {
+        closeCounters(*state);
+    }
+}
+
+bool PerfCounterReader::canRead(const PerfEventGroupIdentifier & groupIdentifier,
+                                const IPerfGroups::Attr & attr,
+                                bool hasAuxData)
+{
+    const PerfEventGroupIdentifier::Type type = groupIdentifier.getType();
+    return (attr.periodOrFreq == 0) && ((attr.sampleType & PERF_SAMPLE_RAW) == 0) && !hasAuxData &&
+           ((type == PerfEventGroupIdentifier::Type::PER_CLUSTER_CPU) ||
+            (type == PerfEventGroupIdentifier::Type::GLOBAL));
+}
+
+void PerfCounterReader::add(const PerfEventGroupIdentifier & groupIdentifier,
+                            int key,
+                            const IPerfGroups::Attr & attr)
+{
+    mCounters.push_back(Counter {groupIdentifier.getCluster(), key, attr});
+}
+
+void PerfCounterReader::onlineCPU(int cpu, const std::set<int> & tids, OnlineEnabledState enabledState)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    if ((cpu < 0) || (static_cast<std::size_t>(cpu) >= mCpus.size())) {
+        logg.logMessage("Counters not read on unexpected cpu %i", cpu);
+        return;
+    }
+    Cpu & state = *mCpus[cpu];
+    if (!state.counters.empty()) {
+        logg.logMessage("Counters of cpu %i are already open", cpu);
+        return;
+    }
+
+    const bool systemWide = mPerfConfig.is_system_wide;
+    const int clusterId = mClusterIds[cpu];
+
+    for (const Counter & counter : mCounters) {
+        if ((counter.cluster != nullptr) &&
+            ((clusterId < 0) || (static_cast<std::size_t>(clusterId) >= mClusters.size()) ||
+             !(*counter.cluster == mClusters[clusterId]))) {
+            continue;
+        }
+
+        // System-wide every counter of the CPU is in one group so that they are all counting or none are, and one
+        // read() gets them all. Inherited counters cannot be grouped that way or be read from userspace.
+        const bool leader = (!systemWide) || state.counters.empty();
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counter.attr.type;
+        attr.config = counter.attr.config;
+        attr.config1 = counter.attr.config1;
+        attr.config2 = counter.attr.config2;
+        attr.read_format = (systemWide ? PERF_FORMAT_GROUP : 0);
+        attr.inherit = (systemWide ? 0 : 1);
+        attr.pinned = (leader ? 1 : 0);
+        attr.disabled = ((leader && (enabledState != OnlineEnabledState::ENABLE_NOW)) ? 1 : 0);
+        attr.enable_on_exec = ((leader && (enabledState == OnlineEnabledState::ENABLE_ON_EXEC)) ? 1 : 0);
+        attr.exclude_kernel = (mPerfConfig.exclude_kernel ? 1 : 0);
+        attr.exclude_hv = (mPerfConfig.exclude_kernel ? 1 : 0);
+        attr.exclude_idle = (mPerfConfig.exclude_kernel ? 1 : 0);
+
+        const int groupFd = (leader ? -1 : state.counters.front().fds.front().get());
+
+        OpenCounter opened {counter.key, {}, nullptr, 0};
+        for (const int tid : tids) {
+            int fd = openEvent(attr, tid, cpu, groupFd);
+            if (fd < 0) {
+                // ESRCH if the thread has exited, anything else means the counter is not available on this CPU
+                logg.logMessage("Unable to open counter %i on cpu %i for tid %i (%d) %s",
+                                counter.key,
+                                cpu,
+                                tid,
+                                errno,
+                                strerror(errno));
+                continue;
+            }
+            opened.fds.emplace_back(fd);
+        }
+        if (opened.fds.empty()) {
+            continue;
+        }
+
+        if (systemWide) {
+            // Just the first page, there is no ring buffer
+            void * const page =
+                lib::mmap(nullptr, mPageSize, PROT_READ, MAP_SHARED, opened.fds.front().get(), 0);
+            if (page != MAP_FAILED) {
+                opened.userPage = static_cast<const perf_event_mmap_page *>(page);
+            }
+            else {
+                logg.logMessage("Unable to map the user page of counter %i on cpu %i (%d) %s",
+                                counter.key,
+                                cpu,
+                                errno,
+                                strerror(errno));
+            }
+        }
+
+        state.counters.push_back(std::move(opened));
+    }
+
+    logg.logMessage("Reading %zu counters on cpu %i from gatord", state.counters.size(), cpu);
+
+    if (mThreadsRunning && !state.counters.empty()) {
+        startThread(cpu);
+    }
+}
+
+void PerfCounterReader::offlineCPU(int cpu)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    if ((cpu < 0) || (static_cast<std::size_t>(cpu) >= mCpus.size())) {
+        return;
+    }
+    stopThread(cpu);
+    closeCounters(*mCpus[cpu]);
+}
+
+void PerfCounterReader::start()
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    for (const auto & state : mCpus) {
+        for (const OpenCounter & counter : state->counters) {
+            for (const lib::AutoClosingFd & fd : counter.fds) {
+                if (lib::ioctl(*fd, PERF_EVENT_IOC_ENABLE, 0) != 0) {
+                    logg.logMessage("Unable to enable counter %i (%d) %s", counter.key, errno, strerror(errno));
+                }
+            }
+            // the rest of the group follows its leader
+            if (mPerfConfig.is_system_wide) {
+                break;
+            }
+        }
+    }
+}
+
+void PerfCounterReader::stop()
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    for (const auto & state : mCpus) {
+        for (const OpenCounter & counter : state->counters) {
+            for (const lib::AutoClosingFd & fd : counter.fds) {
+                lib::ioctl(*fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+            if (mPerfConfig.is_system_wide) {
+                break;
+            }
+        }
+    }
+}
+
+void PerfCounterReader::startThreads(uint64_t monotonicStarted)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    mMonotonicStarted = monotonicStarted;
+    mThreadsRunning = true;
+    for (std::size_t cpu = 0; cpu < mCpus.size(); ++cpu) {
+        if (!mCpus[cpu]->counters.empty()) {
+            startThread(cpu);
+        }
+    }
+}
+
+void PerfCounterReader::stopThreads()
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    if (!mThreadsRunning) {
+        return;
+    }
+    mThreadsRunning = false;
+
+    uint64_t rdpmcReads = 0;
+    uint64_t syscallReads = 0;
+    for (std::size_t cpu = 0; cpu < mCpus.size(); ++cpu) {
+        stopThread(cpu);
+        Cpu & state = *mCpus[cpu];
+        state.buffer.setDone();
+        rdpmcReads += state.rdpmcReads;
+        syscallReads += state.syscallReads;
+    }
+    logg.logMessage("Counters were read %" PRIu64 " times from userspace and %" PRIu64 " times with read()",
+                    rdpmcReads,
+                    syscallReads);
+}
+
+bool PerfCounterReader::isDone() const
+{
+    for (const auto & state : mCpus) {
+        if (!state->buffer.isDone()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PerfCounterReader::write(ISender & sender)
+{
+    for (const auto & state : mCpus) {
+        if (!state->buffer.isDone()) {
+            state->buffer.write(sender);
+        }
+    }
+}
+
+void PerfCounterReader::startThread(int cpu)
+{
+    Cpu & state = *mCpus[cpu];
+    if (state.thread.joinable()) {
+        return;
+    }
+    state.terminate.store(false, std::memory_order_relaxed);
+    state.thread = thread_factory::create(ThreadRole::PER_CPU_READER, [this, cpu]() { run(cpu); }, cpu);
+}
+
+void PerfCounterReader::stopThread(int cpu)
+{
+    Cpu & state = *mCpus[cpu];
+    if (!state.thread.joinable()) {
+        return;
+    }
+    state.terminate.store(true, std::memory_order_release);
+    state.thread.join();
+}
+
+void PerfCounterReader::closeCounters(Cpu & state)
+{
+    for (OpenCounter & counter : state.counters) {
+        if (counter.userPage != nullptr) {
+            lib::munmap(const_cast<perf_event_mmap_page *>(counter.userPage), mPageSize);
+        }
+    }
+    state.counters.clear();
+}
+
+void PerfCounterReader::run(int cpu)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "gatord-cnt-%i", cpu);
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&name[0]), 0, 0, 0);
+
+    Cpu & state = *mCpus[cpu];
+    uint64_t nextTime = getTime() - mMonotonicStarted;
+    while (!state.terminate.load(std::memory_order_acquire)) {
+        const uint64_t currTime = getTime() - mMonotonicStarted;
+        readAndSend(cpu, currTime);
+
+        while (nextTime <= currTime) {
+            nextTime += mInterval;
+        }
+        const uint64_t now = getTime() - mMonotonicStarted;
+        if (nextTime > now) {
+            usleep((nextTime - now) / NS_PER_US);
+        }
+    }
+
+    // What was counted since the last tick
+    readAndSend(cpu, getTime() - mMonotonicStarted);
+}
+
+bool PerfCounterReader::readGroup(Cpu & state)
+{
+    std::vector<uint64_t> & values = state.values;
+
+    if (mPerfConfig.is_system_wide) {
+        // PERF_FORMAT_GROUP without the other formats is the number of counters followed by their values
+        const ssize_t size = values.size() * sizeof(values[0]);
+        if ((lib::read(*state.counters.front().fds.front(), values.data(), size) != size) ||
+            (values[0] != state.counters.size())) {
+            logg.logMessage("Reading the counter group failed (%d) %s", errno, strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    for (std::size_t index = 0; index < state.counters.size(); ++index) {
+        uint64_t sum = 0;
+        for (const lib::AutoClosingFd & fd : state.counters[index].fds) {
+            uint64_t value;
+            if (lib::read(*fd, &value, sizeof(value)) != sizeof(value)) {
+                logg.logMessage("Reading counter %i failed (%d) %s", state.counters[index].key, errno, strerror(errno));
+                return false;
+            }
+            sum += value;
+        }
+        values[index + 1] = sum;
+    }
+    return true;
+}
+
+void PerfCounterReader::readAndSend(int cpu, uint64_t currTime)
+{
+    Cpu & state = *mCpus[cpu];
+    if (state.counters.empty()) {
+        return;
+    }
+
+    std::vector<uint64_t> & values = state.values;
+    values.resize(state.counters.size() + 1);
+
+    // Only this CPU's counters can be read from userspace here, and only while the thread is still on it
+    bool fromUserspace = mPerfConfig.is_system_wide && (sched_getcpu() == cpu);
+    for (std::size_t index = 0; fromUserspace && (index < state.counters.size()); ++index) {
+        const perf_event_mmap_page * const userPage = state.counters[index].userPage;
+        fromUserspace = (userPage != nullptr) && readUserPage(*userPage, values[index + 1]);
+    }
+    if (fromUserspace) {
+        ++state.rdpmcReads;
+    }
+    else if (readGroup(state)) {
+        ++state.syscallReads;
+    }
+    else {
+        return;
+    }
+
+    const bool hasSpace = state.buffer.eventHeader(currTime) && state.buffer.eventCore(cpu);
+    for (std::size_t index = 0; index < state.counters.size(); ++index) {
+        OpenCounter & counter = state.counters[index];
+        const uint64_t value = values[index + 1];
+        // An inherited count can go down when a thread exits
+        const uint64_t delta = (value > counter.lastValue ? value - counter.lastValue : 0);
+        counter.lastValue = value;
+        if (hasSpace) {
+            state.buffer.event64(counter.key, delta);
+        }
+    }
+    state.buffer.check(currTime);
+}
@@ -0,0 +1,133 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef PERF_COUNTER_READER_H
+#define PERF_COUNTER_READER_H
+
+#include "Buffer.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/Span.h"
+#include "linux/perf/IPerfGroups.h"
+#include "linux/perf/PerfConfig.h"
+#include "linux/perf/PerfEventGroup.h"
+#include "linux/perf/PerfEventGroupIdentifier.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <semaphore.h>
+#include <set>
+#include <thread>
+#include <vector>
+
+class GatorCpu;
+class ISender;
+struct perf_event_mmap_page;
+
+/**
+ * Reads the counting (not event based) CPU counters from gatord instead of having perf sample them.
+ *
+ * Otherwise they are read by the kernel on every tick of a group leader, or in --app mode are each sampled at a
+ * frequency, and every value goes through a perf record. Here a thread per CPU, on that CPU, reads them at the
+ * sample rate and writes the deltas as BLOCK_COUNTER frames.
+ *
+ * System-wide, the counters of a CPU are one pinned group. When the kernel allows it (cap_user_rdpmc) a counter is
+ * read from userspace through its perf_event_mmap_page with rdpmc on x86, and otherwise with one read() of the group.
+ * arm64 only allows EL0 reads (kernel.perf_user_access) of events bound to the reading thread, never of these per
+ * CPU ones, so there the group is always read(). In --app mode the counters are per thread and inherited, which
+ * userspace cannot read, so they are each read() and summed over the threads. Either way the counts are per CPU and
+ * no longer attributed to threads.
+ */
+class PerfCounterReader {
+public:
+    PerfCounterReader(const PerfConfig & perfConfig,
+                      lib::Span<const GatorCpu> clusters,
+                      lib::Span<const int> clusterIds,
+                      int sampleRate,
+                      sem_t & senderSem);
+    ~PerfCounterReader();
+
+    /** @return True if the event is one this can read, otherwise it must go in a perf group */
+    static bool canRead(const PerfEventGroupIdentifier & groupIdentifier,
+                        const IPerfGroups::Attr & attr,
+                        bool hasAuxData);
+
+    /** Must be called before any CPU is onlined */
+    void add(const PerfEventGroupIdentifier & groupIdentifier, int key, const IPerfGroups::Attr & attr);
+
+    /**
+     * Open the counters of the CPU, its thread starts now if the others are already running
+     *
+     * @param tids -1 if system wide
+     */
+    void onlineCPU(int cpu, const std::set<int> & tids, OnlineEnabledState enabledState);
+    void offlineCPU(int cpu);
+
+    void start();
+    void stop();
+
+    /** Start reading the online CPUs, times are relative to monotonicStarted */
+    void startThreads(uint64_t monotonicStarted);
+    /** Read every CPU one last time and finish the buffers */
+    void stopThreads();
+
+    bool isDone() const;
+    void write(ISender & sender);
+
+private:
+    struct Counter {
+        const GatorCpu * cluster;
+        int key;
+        IPerfGroups::Attr attr;
+    };
+
+    struct OpenCounter {
+        int key;
+        /// one per tid
+        std::vector<lib::AutoClosingFd> fds;
+        /// only when system wide
+        const perf_event_mmap_page * userPage;
+        uint64_t lastValue;
+    };
+
+    struct Cpu {
+        Cpu(int cpu, sem_t & senderSem);
+
+        Buffer buffer;
+        std::vector<OpenCounter> counters;
+        /// the number of counters then their values, as PERF_FORMAT_GROUP reads them
+        std::vector<uint64_t> values;
+        std::thread thread;
+        std::atomic_bool terminate;
+        uint64_t rdpmcReads;
+        uint64_t syscallReads;
+    };
+
+    void startThread(int cpu);
+    void stopThread(int cpu);
+    void run(int cpu);
+    void readAndSend(int cpu, uint64_t currTime);
+    bool readGroup(Cpu & state);
+    void closeCounters(Cpu & state);
+
+    const PerfConfig & mPerfConfig;
+    lib::Span<const GatorCpu> mClusters;
+    lib::Span<const int> mClusterIds;
+    uint64_t mInterval;
+    uint64_t mMonotonicStarted;
+    std::vector<Counter> mCounters;
+    /// one per core, so that what was read from a CPU that went offline can still be sent
+    std::vector<std::unique_ptr<Cpu>> mCpus;
+    /// serializes onlining and offlining, which may come from another thread, with starting and stopping
+    std::mutex mMutex;
+    bool mThreadsRunning;
+    long mPageSize;
+
+    // Intentionally unimplemented
+    PerfCounterReader(const PerfCounterReader &) = delete;
+    PerfCounterReader & operator=(const PerfCounterReader &) = delete;
+    PerfCounterReader(PerfCounterReader &&) = delete;
+    PerfCounterReader & operator=(PerfCounterReader &&) = delete;
+};
+
+#endif // PERF_COUNTER_READER_H
@@ -2,17 +2,80 @@
 
 #include "linux/perf/PerfCpuOnlineMonitor.h"
 
+#include "Logging.h"
+#include "ThreadFactory.h"
+#include "UEvent.h"
 #include "lib/FsEntry.h"
 
+#include <cerrno>
 #include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/prctl.h>
 #include <unistd.h>
 #include <utility>
 
+static const char CPU_DEVPATH[] = "/devices/system/cpu/cpu";
+
+PerfCpuOnlineStates::PerfCpuOnlineStates(NotificationCallback callback) : states(), callback(std::move(callback))
+{
+}
+
+bool PerfCpuOnlineStates::rescan(bool notify)
+{
+    bool result = true;
+
+    const lib::FsEntry sysFsCpuRootPath = lib::FsEntry::create("/sys/devices/system/cpu");
+    lib::Optional<lib::FsEntry> child;
+    lib::FsEntryDirectoryIterator iterator = sysFsCpuRootPath.children();
+    while ((child = iterator.next()).valid()) {
+        const auto & name = child->name();
+        if ((name.length() > 3) && (name.find("cpu") == 0)) {
+            // find a CPU node
+            const unsigned cpu = strtoul(name.c_str() + 3, nullptr, 10);
+            // read its online state
+            const lib::FsEntry onlineFsEntry = lib::FsEntry::create(*child, "online");
+            const std::string contents = onlineFsEntry.readFileContentsSingleLine();
+            if (!contents.empty()) {
+                const unsigned online = strtoul(contents.c_str(), nullptr, 0);
+                result &= update(cpu, online != 0, notify);
+            }
+        }
+    }
+
+    return result;
+}
+
+bool PerfCpuOnlineStates::update(unsigned cpu, bool online, bool notify)
+{
+    const auto insertionResult = states.insert(std::make_pair(cpu, online));
+    if (insertionResult.second) {
+        // a CPU not seen before can only have been offline
+        return (!notify) || (!online) || callback(cpu, true);
+    }
+
+    if (insertionResult.first->second == online) {
+        return true;
+    }
+
+    insertionResult.first->second = online;
+    return (!notify) || callback(cpu, online);
+}
+
+bool PerfCpuOnlineStates::anyOffline() const
+{
+    for (const auto & state : states) {
+        if (!state.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
 PerfCpuOnlineMonitor::PerfCpuOnlineMonitor(NotificationCallback callback)
-    : thread(), onlineCores(), callback(std::move(callback)), terminated(false)
+    : thread(), onlineStates(std::move(callback)), wakeFd(eventfd(0, EFD_CLOEXEC)), terminated(false)
 {
-    thread = std::thread(launch, this);
+    thread = thread_factory::create(ThreadRole::HOUSEKEEPING, [this]() { launch(this); });
 }
 
 PerfCpuOnlineMonitor::~PerfCpuOnlineMonitor()
@@ -25,6 +88,12 @@ PerfCpuOnlineMonitor::~PerfCpuOnlineMonitor()
 void PerfCpuOnlineMonitor::terminate()
 {
     terminated.store(true, std::memory_order_release);
+    if (wakeFd) {
+        const uint64_t value = 1;
+        if (::write(*wakeFd, &value, sizeof(value)) != sizeof(value)) {
+            logg.logMessage("write failed");
+        }
+    }
     thread.join();
 }
 
@@ -38,57 +107,87 @@ void PerfCpuOnlineMonitor::run() noexcept
     // rename thread
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>("gatord-cpumon"), 0, 0, 0);
 
-    // monitor filesystem
-    bool firstPass = true;
-    const lib::FsEntry sysFsCpuRootPath = lib::FsEntry::create("/sys/devices/system/cpu");
+    // the socket must be bound before the first scan so that no change is missed in between
+    UEvent uevent;
+    const bool useUEvents = wakeFd && uevent.init();
+
+    onlineStates.rescan(false);
+
+    if (useUEvents && runUEvents(uevent)) {
+        return;
+    }
+
+    logg.logMessage("Polling for CPU online state changes");
+    runPolling();
+}
+
+bool PerfCpuOnlineMonitor::runUEvents(UEvent & uevent)
+{
+    struct pollfd fds[2];
+    fds[0].fd = uevent.getFd();
+    fds[0].events = POLLIN;
+    fds[1].fd = *wakeFd;
+    fds[1].events = POLLIN;
+
     while (!terminated.load(std::memory_order_acquire)) {
-        // loop through files
-        lib::Optional<lib::FsEntry> child;
-        lib::FsEntryDirectoryIterator iterator = sysFsCpuRootPath.children();
-
-        bool anyOffline = false;
-        while ((child = iterator.next()).valid()) {
-            const auto & name = child->name();
-            if ((name.length() > 3) && (name.find("cpu") == 0)) {
-                // find a CPU node
-                const unsigned cpu = strtoul(name.c_str() + 3, nullptr, 10);
-                // read its online state
-                const lib::FsEntry onlineFsEntry = lib::FsEntry::create(*child, "online");
-                const std::string contents = onlineFsEntry.readFileContentsSingleLine();
-                if (!contents.empty()) {
-                    const unsigned online = strtoul(contents.c_str(), nullptr, 0);
-                    const bool isOnline = (online != 0);
-                    anyOffline |= !isOnline;
-
-                    // process it
-                    process(firstPass, cpu, isOnline);
-                }
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            logg.logMessage("poll failed (%d) %s", errno, strerror(errno));
+            return false;
         }
 
-        // sleep a little before checking again.
-        // sleep longer if they are all online, otherwise just sleep a short amount of time so as to not miss the core coming back online by too much
-        usleep(anyOffline ? 200 : 1000);
+        if ((fds[0].revents & POLLIN) == 0) {
+            // woken by terminate
+            continue;
+        }
 
-        // not first pass any more
-        firstPass = false;
+        UEventResult result;
+        switch (uevent.read(&result)) {
+            case UEvent::ReadResult::OK:
+                break;
+            case UEvent::ReadResult::LOST_EVENTS:
+                // a CPU may have gone offline and come back online again in the lost events, in which case its
+                // counters are already gone, but that cannot be detected here
+                onlineStates.rescan(true);
+                continue;
+            case UEvent::ReadResult::FAILED:
+            default:
+                return false;
+        }
+
+        if ((strcmp(result.mSubsystem, "cpu") != 0) ||
+            (strncmp(result.mDevPath, CPU_DEVPATH, sizeof(CPU_DEVPATH) - 1) != 0)) {
+            continue;
+        }
+
+        char * end;
+        const unsigned cpu = strtoul(result.mDevPath + sizeof(CPU_DEVPATH) - 1, &end, 10);
+        if (*end != '\0') {
+            continue;
+        }
+
+        if (strcmp(result.mAction, "online") == 0) {
+            onlineStates.update(cpu, true);
+        }
+        else if (strcmp(result.mAction, "offline") == 0) {
+            onlineStates.update(cpu, false);
+        }
     }
+
+    return true;
 }
 
-void PerfCpuOnlineMonitor::process(bool first, unsigned cpu, bool online)
+void PerfCpuOnlineMonitor::runPolling()
 {
-    if (online) {
-        const auto insertionResult = onlineCores.insert(cpu);
-        if (insertionResult.second && !first) {
-            // set was modified so state changed from offline->online
-            callback(cpu, true);
-        }
-    }
-    else {
-        const auto removalResult = onlineCores.erase(cpu);
-        if ((removalResult > 0) && !first) {
-            // set was modified so state changed from online->offline
-            callback(cpu, false);
-        }
+    while (!terminated.load(std::memory_order_acquire)) {
+        // sleep a little before checking again.
+        // sleep longer if they are all online, otherwise just sleep a short amount of time so as to not miss the core coming back online by too much
+        usleep(onlineStates.anyOffline() ? 200 : 1000);
+
+        onlineStates.rescan(true);
     }
 }
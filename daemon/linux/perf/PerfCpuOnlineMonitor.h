@@ -3,18 +3,57 @@
 #ifndef INCLUDE_LINUX_PERF_PERF_CPU_ONLINE_MONITOR_H
 #define INCLUDE_LINUX_PERF_PERF_CPU_ONLINE_MONITOR_H
 
+#include "lib/AutoClosingFd.h"
+
 #include <atomic>
 #include <functional>
-#include <set>
+#include <map>
 #include <thread>
 
+class UEvent;
+
 /**
- * A thread that monitors CPU online / offline state (for when uevents are not available)
+ * The last known online state of each CPU, so that only actual changes are notified
+ * no matter whether they come from uevents or from reading sysfs
+ */
+class PerfCpuOnlineStates {
+public:
+    /** Notification callback, returns false on failure */
+    using NotificationCallback = std::function<bool(unsigned /* cpu */, bool /* is_online */)>;
+
+    PerfCpuOnlineStates(NotificationCallback callback);
+
+    /**
+     * Read the state of every CPU from /sys/devices/system/cpu/cpu{N}/online
+     *
+     * @param notify False to just record the states, e.g. on the first scan
+     * @return False if any notification failed
+     */
+    bool rescan(bool notify);
+
+    /**
+     * Record the state of one CPU, notifying if it changed
+     *
+     * @return False if the notification failed
+     */
+    bool update(unsigned cpu, bool online, bool notify = true);
+
+    bool anyOffline() const;
+
+private:
+    std::map<unsigned, bool> states;
+    NotificationCallback callback;
+};
+
+/**
+ * A thread that monitors CPU online / offline state, for when the source does not handle uevents itself.
+ *
+ * Uses a NETLINK_KOBJECT_UEVENT socket if possible, so the thread only wakes when a CPU changes state and sysfs is
+ * only read again if the kernel drops uevents. Otherwise falls back to polling sysfs.
  */
 class PerfCpuOnlineMonitor {
 public:
-    /** Notification callback */
-    using NotificationCallback = std::function<void(unsigned /* cpu */, bool /* is_online */)>;
+    using NotificationCallback = PerfCpuOnlineStates::NotificationCallback;
 
     /**
      * Constructor
@@ -37,11 +76,14 @@ private:
     static void launch(PerfCpuOnlineMonitor *) noexcept;
 
     void run() noexcept;
-    void process(bool first, unsigned cpu, bool online);
+    /** @return False if the uevent socket failed, in which case polling should take over */
+    bool runUEvents(UEvent & uevent);
+    void runPolling();
 
     std::thread thread;
-    std::set<unsigned> onlineCores;
-    NotificationCallback callback;
+    PerfCpuOnlineStates onlineStates;
+    // written by terminate to wake the thread from poll
+    lib::AutoClosingFd wakeFd;
     std::atomic<bool> terminated;
 };
 
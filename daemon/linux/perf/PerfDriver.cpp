@@ -19,6 +19,7 @@
 #include "linux/perf/PerfAttrsBuffer.h"
 #include "linux/perf/PerfEventGroupIdentifier.h"
 #include "xml/PmuXML.h"
+#include "xml/XmlWriter.h"
 
 #include <sys/utsname.h>
 #include <sys/wait.h>
@@ -650,7 +651,9 @@ void PerfDriver::addMidgardHwTracepoints(const char * const maliFamilyName)
     }
 }
 
-bool PerfDriver::summary(ISummaryConsumer & consumer, const std::function<uint64_t()> & getAndSetMonotonicStarted)
+bool PerfDriver::summary(ISummaryConsumer & consumer,
+                         const std::function<uint64_t()> & getAndSetMonotonicStarted,
+                         uint64_t onlineTimeNs)
 {
     struct utsname utsname;
     if (uname(&utsname) != 0) {
@@ -691,6 +694,7 @@ bool PerfDriver::summary(ISummaryConsumer & consumer, const std::function<uint64
     additionalAttributes["perf.is_system_wide"] = (getConfig().is_system_wide ? "1" : "0");
     additionalAttributes["perf.can_access_tracepoints"] = (getConfig().can_access_tracepoints ? "1" : "0");
     additionalAttributes["perf.has_attr_context_switch"] = (getConfig().has_attr_context_switch ? "1" : "0");
+    additionalAttributes["perf.online_time_ns"] = std::to_string(onlineTimeNs);
 
     lnx::addDefaultSysfsSummaryInformation(additionalAttributes);
 
@@ -893,14 +897,15 @@ bool PerfDriver::sendTracepointFormats(const uint64_t currTime, IPerfAttrsConsum
     return true;
 }
 
-int PerfDriver::writeCounters(mxml_node_t * root) const
+int PerfDriver::writeCounters(XmlWriter & writer) const
 {
-    int count = SimpleDriver::writeCounters(root);
+    int count = SimpleDriver::writeCounters(writer);
     for (const auto & perfCpu : mConfig.cpus) {
         const char * const speName = perfCpu.gator_cpu.getSpeName();
         if (speName != nullptr) {
-            mxml_node_t * node = mxmlNewElement(root, "spe");
-            mxmlElementSetAttr(node, "id", speName);
+            writer.startElement("spe");
+            writer.attribute("id", speName);
+            writer.endElement();
             ++count;
         }
     }
@@ -49,8 +49,11 @@ public:
     const PerfConfig & getConfig() const { return mConfig.config; }
 
     void readEvents(mxml_node_t * xml) override;
-    int writeCounters(mxml_node_t * root) const override;
-    bool summary(ISummaryConsumer & consumer, const std::function<uint64_t()> & getAndSetMonotonicStarted);
+    int writeCounters(XmlWriter & writer) const override;
+    /** @param onlineTimeNs How long it took to open, map and register the events of every CPU */
+    bool summary(ISummaryConsumer & consumer,
+                 const std::function<uint64_t()> & getAndSetMonotonicStarted,
+                 uint64_t onlineTimeNs);
     void coreName(uint64_t currTime, ISummaryConsumer & consumer, int cpu);
     void setupCounter(Counter & counter) override;
     lib::Optional<CapturedSpe> setupSpe(int sampleRate, const SpeConfiguration & spe) override;
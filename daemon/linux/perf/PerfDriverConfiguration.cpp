@@ -236,6 +236,7 @@ std::unique_ptr<PerfDriverConfiguration> PerfDriverConfiguration::detect(bool sy
     configuration->config.has_attr_context_switch = (kernelVersion >= KERNEL_VERSION(4, 3, 0));
     configuration->config.has_ioctl_read_id = (kernelVersion >= KERNEL_VERSION(3, 12, 0));
     configuration->config.has_aux_support = (kernelVersion >= KERNEL_VERSION(4, 1, 0));
+    configuration->config.has_write_backward = (kernelVersion >= KERNEL_VERSION(4, 7, 0));
 
     configuration->config.is_system_wide = systemWide;
     configuration->config.exclude_kernel = exclude_kernel;
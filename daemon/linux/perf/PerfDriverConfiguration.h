@@ -31,7 +31,8 @@ struct PerfDriverConfiguration {
     std::vector<PerfCpu> cpus {};
     std::vector<PerfUncore> uncores {};
     std::map<int, int> cpuNumberToSpeType {};
-    PerfConfig config {false, false, false, false, false, false, false, false, false, false, false, false, false};
+    PerfConfig config {
+        false, false, false, false, false, false, false, false, false, false, false, false, false, false};
 
     static std::unique_ptr<PerfDriverConfiguration> detect(bool systemWide,
                                                            lib::Span<const int> cpuIds,
@@ -9,9 +9,13 @@
 #include "lib/Optional.h"
 #include "lib/Syscall.h"
 #include "linux/perf/IPerfAttrsConsumer.h"
+#include "linux/perf/PerfCallchainInterner.h"
+#include "linux/perf/PerfSampleAggregator.h"
+#include "linux/perf/PerfUserStackUnwinder.h"
 #include "linux/perf/PerfUtils.h"
 #include "xml/PmuXML.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cinttypes>
 #include <climits>
@@ -23,6 +27,19 @@
 namespace {
     constexpr unsigned long NANO_SECONDS_IN_ONE_SECOND = 1000000000UL;
     constexpr unsigned long NANO_SECONDS_IN_100_MS = 100000000UL;
+    /// the rungs of the ladder of exclusions tried in turn while perf_event_open fails with EACCES
+    constexpr int EXCLUDE_NONE = 0;
+    constexpr int EXCLUDE_KERNEL = 1;
+    constexpr int EXCLUDE_ALL = 2;
+    /// the leader index of an event that leads its own perf_event_open group
+    constexpr int OWN_GROUP = -1;
+
+    /** @return true if events of this type take one of the PMU's counters */
+    bool usesCounter(std::uint32_t type)
+    {
+        return (type == PERF_TYPE_HARDWARE) || (type == PERF_TYPE_HW_CACHE) || (type == PERF_TYPE_RAW) ||
+               (type >= PERF_TYPE_MAX);
+    }
 
     int sys_perf_event_open(struct perf_event_attr * const attr,
                             const pid_t pid,
@@ -100,7 +117,12 @@ namespace {
 
 PerfEventGroup::PerfEventGroup(const PerfEventGroupIdentifier & groupIdentifier,
                                PerfEventGroupSharedConfig & sharedConfig)
-    : groupIdentifier(groupIdentifier), sharedConfig(sharedConfig), events(), cpuToEventIndexToTidToFdMap()
+    : groupIdentifier(groupIdentifier),
+      sharedConfig(sharedConfig),
+      events(),
+      cpuToEventIndexToTidToFdMap(),
+      multiplexLeaderIndex(OWN_GROUP),
+      countersInMultiplexGroup(0)
 {
 }
 
@@ -125,6 +147,22 @@ bool PerfEventGroup::hasLeader() const
     return requiresLeader() && (!events.empty());
 }
 
+bool PerfEventGroup::isReadFormatGroup() const
+{
+    // We can only use perf_event_open groups if PERF_FORMAT_GROUP is used to sample group members, and
+    // PERF_FORMAT_GROUP is not allowed with inherit
+    return requiresLeader() && sharedConfig.perfConfig.is_system_wide;
+}
+
+int PerfEventGroup::getNumberOfCounters() const
+{
+    const GatorCpu * const cluster = groupIdentifier.getCluster();
+    const UncorePmu * const uncorePmu = groupIdentifier.getUncorePmu();
+    const int counters =
+        (cluster != nullptr ? cluster->getPmncCounters() : (uncorePmu != nullptr ? uncorePmu->getPmncCounters() : 0));
+    return (counters > 0 ? counters : INT_MAX);
+}
+
 bool PerfEventGroup::addEvent(const bool leader,
                               const uint64_t timestamp,
                               IPerfAttrsConsumer & attrsConsumer,
@@ -136,12 +174,53 @@ bool PerfEventGroup::addEvent(const bool leader,
         assert(false && "Cannot set leader for non-empty group");
         return false;
     }
+
+    // When multiplexing, the counters of a read format group are split into flexible groups that each fit the PMU,
+    // which the kernel rotates through when they do not all fit at once
+    const int counterLimit = sharedConfig.multiplexCounterLimit;
+    const bool takesCounter = usesCounter(attr.type) || ((counterLimit > 0) && (attr.type == PERF_TYPE_SOFTWARE) &&
+                                                         (attr.periodOrFreq == 0) && (attr.config != PERF_COUNT_SW_DUMMY));
+    if (!leader && sharedConfig.multiplexCounters && isReadFormatGroup() && takesCounter && !hasAuxData) {
+        if ((multiplexLeaderIndex == OWN_GROUP) ||
+            (countersInMultiplexGroup >= (counterLimit > 0 ? counterLimit : getNumberOfCounters()))) {
+            multiplexLeaderIndex = events.size();
+            countersInMultiplexGroup = 0;
+            if (!createMultiplexGroupLeader(timestamp, attrsConsumer)) {
+                multiplexLeaderIndex = OWN_GROUP;
+                return false;
+            }
+            logg.logMessage("    Starting multiplexed group %i", multiplexLeaderIndex);
+        }
+        ++countersInMultiplexGroup;
+        return addEvent(multiplexLeaderIndex, true, timestamp, attrsConsumer, key, attr, hasAuxData);
+    }
+
+    // If the group has no leader, then all members are in separate perf_event_open groups (and hence their own leader)
+    return addEvent((leader || !isReadFormatGroup()) ? OWN_GROUP : 0,
+                    false,
+                    timestamp,
+                    attrsConsumer,
+                    key,
+                    attr,
+                    hasAuxData);
+}
+
+bool PerfEventGroup::addEvent(const int leaderIndex,
+                              const bool flexible,
+                              const uint64_t timestamp,
+                              IPerfAttrsConsumer & attrsConsumer,
+                              const int key,
+                              const IPerfGroups::Attr & attr,
+                              bool hasAuxData)
+{
     if (events.size() >= INT_MAX) {
         return false;
     }
 
+    const int eventIndex = events.size();
     events.emplace_back();
     PerfEvent & event = events.back();
+    event.leaderIndex = (leaderIndex == OWN_GROUP ? eventIndex : leaderIndex);
 
     event.attr.size = sizeof(event.attr);
     /* Emit time, read_format below, group leader id, and raw tracepoint info */
@@ -167,15 +246,15 @@ bool PerfEventGroup::addEvent(const bool leader,
     event.attr.inherit_stat = event.attr.inherit;
     /* Emit emit value in group format */
     // Unfortunately PERF_FORMAT_GROUP is not allowed with inherit
-    event.attr.read_format = PERF_FORMAT_ID | (event.attr.inherit ? 0 : PERF_FORMAT_GROUP);
-    // Always be on the CPU but only a perf_event_open group leader can be pinned
-    // We can only use perf_event_open groups if PERF_FORMAT_GROUP is used to sample group members
-    // If the group has no leader, then all members are in separate perf_event_open groups (and hence their own leader)
-    const bool isNotInAReadFormatGroup = ((event.attr.read_format & PERF_FORMAT_GROUP) == 0);
-    const bool everyAttributeInGroupIsPinned = (!requiresLeader());
-    event.attr.pinned = ((leader || isNotInAReadFormatGroup || everyAttributeInGroupIsPinned) ? 1 : 0);
+    // When multiplexing, the time each group was enabled and running are read too, so the host can scale the counts
+    event.attr.read_format =
+        PERF_FORMAT_ID | (event.attr.inherit ? 0 : PERF_FORMAT_GROUP) |
+        (sharedConfig.multiplexCounters ? PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING : 0);
+    // Always be on the CPU unless multiplexed, but only a perf_event_open group leader can be pinned
+    const bool leadsGroup = (event.leaderIndex == eventIndex);
+    event.attr.pinned = ((leadsGroup && !flexible) ? 1 : 0);
     // group leader must start disabled, all others enabled
-    event.attr.disabled = event.attr.pinned;
+    event.attr.disabled = (leadsGroup ? 1 : 0);
     /* have a sampling interrupt happen when we cross the wakeup_watermark boundary */
     event.attr.watermark = 1;
     /* Be conservative in flush size as only one buffer set is monitored */
@@ -195,13 +274,19 @@ bool PerfEventGroup::addEvent(const bool leader,
     /* sample_id_all should always be set (or should always match pinned); it is required for any non-grouped event, for grouped events it is ignored for anything but the leader */
     event.attr.sample_id_all = 1;
     event.attr.context_switch = attr.context_switch;
+    event.attr.write_backward = (sharedConfig.writeBackward ? 1 : 0);
     event.attr.exclude_kernel = (sharedConfig.perfConfig.exclude_kernel ? 1 : 0);
     event.attr.exclude_hv = (sharedConfig.perfConfig.exclude_kernel ? 1 : 0);
     event.attr.exclude_idle = (sharedConfig.perfConfig.exclude_kernel ? 1 : 0);
     event.attr.aux_watermark = hasAuxData ? sharedConfig.auxBufferLength / 2 : 0;
     event.key = key;
 
-    attrsConsumer.marshalPea(timestamp, &event.attr, key);
+    // The host is told about the samples as they will be once unwound
+    if ((sharedConfig.userStackUnwinder != nullptr) && sharedConfig.userStackUnwinder->requestUserStack(event.attr)) {
+        logg.logMessage("Unwinding user stacks for key %i", key);
+    }
+    const struct perf_event_attr sentAttr = PerfUserStackUnwinder::withoutUserStack(event.attr);
+    attrsConsumer.marshalPea(timestamp, &sentAttr, key);
 
     return true;
 }
@@ -323,6 +408,21 @@ bool PerfEventGroup::createCpuGroupLeader(const uint64_t timestamp, IPerfAttrsCo
     return true;
 }
 
+bool PerfEventGroup::createMultiplexGroupLeader(const uint64_t timestamp, IPerfAttrsConsumer & attrsConsumer)
+{
+    // As for an uncore PMU, the leader only samples to read the group, and only while the group is scheduled
+    IPerfGroups::Attr attr {};
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.sampleType =
+        PERF_SAMPLE_READ |
+        (groupIdentifier.getType() == PerfEventGroupIdentifier::Type::PER_CLUSTER_CPU ? PERF_SAMPLE_TID : 0);
+    attr.periodOrFreq =
+        (sharedConfig.sampleRate > 0 ? NANO_SECONDS_IN_ONE_SECOND / sharedConfig.sampleRate : NANO_SECONDS_IN_100_MS);
+
+    return addEvent(OWN_GROUP, true, timestamp, attrsConsumer, nextDummyKey(), attr, false);
+}
+
 bool PerfEventGroup::createUncoreGroupLeader(const uint64_t timestamp, IPerfAttrsConsumer & attrsConsumer)
 {
     IPerfGroups::Attr attr {};
@@ -433,24 +533,30 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
 
     std::map<int, std::map<int, lib::AutoClosingFd>> eventIndexToTidToFdMap;
 
-    const std::size_t numberOfEvents = events.size();
-    for (std::size_t eventIndex = 0; eventIndex < numberOfEvents; ++eventIndex) {
-        PerfEvent & event = events[eventIndex];
-
-        if (cpuToEventIndexToTidToFdMap[cpu].count(eventIndex) != 0) {
+    {
+        std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
+        const auto cpuIt = cpuToEventIndexToTidToFdMap.find(cpu);
+        if ((cpuIt != cpuToEventIndexToTidToFdMap.end()) && !cpuIt->second.empty()) {
             std::string message("CPU already online or not correctly cleaned up");
             return std::make_pair(OnlineResult::FAILURE, message);
         }
+    }
 
-        const char * typeLabel = selectTypeLabel(groupLabel, event.attr.type);
+    const std::size_t numberOfEvents = events.size();
+    for (std::size_t eventIndex = 0; eventIndex < numberOfEvents; ++eventIndex) {
+        PerfEvent & event = events[eventIndex];
 
+        // Other CPUs may be opening the same event, so each opens its own copy of the attr
         // Note we are modifying the attr after we have marshalled it
         // but we are assuming enable_on_exec will be ignored by Streamline
-        event.attr.enable_on_exec = (event.attr.pinned && enableOnExec) ? 1 : 0;
+        struct perf_event_attr attr = event.attr;
+        attr.enable_on_exec = (isGroupLeader(eventIndex) && enableOnExec) ? 1 : 0;
         if (replaceType) {
-            event.attr.type = replaceType.get();
+            attr.type = replaceType.get();
         }
 
+        const char * typeLabel = selectTypeLabel(groupLabel, attr.type);
+
         logg.logMessage(
             "Opening attribute:\n"
             "    cpu: %i\n"
@@ -463,71 +569,52 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
             event.key,
             (cluster != nullptr ? cluster->getId() : (uncorePmu != nullptr ? uncorePmu->getId() : "<nullptr>")),
             eventIndex,
-            perfAttrToString(event.attr, typeLabel, "    ", "\n").c_str());
+            perfAttrToString(attr, typeLabel, "    ", "\n").c_str());
 
         for (auto tidsIterator = tids.begin(); tidsIterator != tids.end();) {
             const int tid = *tidsIterator;
 
             // This assumes that group leader is added first
-            const int groupLeaderFd = event.attr.pinned ? -1 : *(eventIndexToTidToFdMap.at(0).at(tid));
+            const int groupLeaderFd =
+                isGroupLeader(eventIndex) ? -1 : *(eventIndexToTidToFdMap.at(event.leaderIndex).at(tid));
 
             lib::AutoClosingFd fd;
 
-            // try with exclude_kernel clear
+            // Start from the exclusions another CPU found were needed rather than repeat the failures
+            int exclusionLevel;
             {
-                // clear
-                event.attr.exclude_kernel = 0;
-                event.attr.exclude_hv = 0;
-                event.attr.exclude_idle = 0;
-
-                // open event
-                fd = sys_perf_event_open(&event.attr,
-                                         tid,
-                                         cpu,
-                                         groupLeaderFd,
-                                         // This is "(broken since Linux 2.6.35)" so can possibly be removed
-                                         // we use PERF_EVENT_IOC_SET_OUTPUT anyway
-                                         PERF_FLAG_FD_OUTPUT);
+                std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
+                exclusionLevel = event.exclusionLevel;
             }
-
-            // retry with just exclude_kernel set
-            if ((!fd) && (errno == EACCES)) {
-                logg.logMessage("Failed when exclude_kernel == 0, retrying with exclude_kernel = 1");
-
-                // set
-                event.attr.exclude_kernel = 1;
-                event.attr.exclude_hv = 0;
-                event.attr.exclude_idle = 0;
+            for (;; ++exclusionLevel) {
+                attr.exclude_kernel = (exclusionLevel >= EXCLUDE_KERNEL ? 1 : 0);
+                attr.exclude_hv = (exclusionLevel >= EXCLUDE_ALL ? 1 : 0);
+                attr.exclude_idle = (exclusionLevel >= EXCLUDE_ALL ? 1 : 0);
 
                 // open event
-                fd = sys_perf_event_open(&event.attr,
+                fd = sys_perf_event_open(&attr,
                                          tid,
                                          cpu,
                                          groupLeaderFd,
                                          // This is "(broken since Linux 2.6.35)" so can possibly be removed
                                          // we use PERF_EVENT_IOC_SET_OUTPUT anyway
                                          PERF_FLAG_FD_OUTPUT);
+                if (fd || (errno != EACCES) || (exclusionLevel == EXCLUDE_ALL)) {
+                    break;
+                }
 
-                // retry with exclude_kernel and all set
-                if ((!fd) && (errno == EACCES)) {
+                if (exclusionLevel == EXCLUDE_NONE) {
+                    logg.logMessage("Failed when exclude_kernel == 0, retrying with exclude_kernel = 1");
+                }
+                else {
                     logg.logMessage("Failed when exclude_kernel == 1, exclude_hv == 0, exclude_idle == 0, retrying "
                                     "with all exclusions enabled");
-
-                    // set
-                    event.attr.exclude_kernel = 1;
-                    event.attr.exclude_hv = 1;
-                    event.attr.exclude_idle = 1;
-
-                    // open event
-                    fd = sys_perf_event_open(&event.attr,
-                                             tid,
-                                             cpu,
-                                             groupLeaderFd,
-                                             // This is "(broken since Linux 2.6.35)" so can possibly be removed
-                                             // we use PERF_EVENT_IOC_SET_OUTPUT anyway
-                                             PERF_FLAG_FD_OUTPUT);
                 }
             }
+            if (fd) {
+                std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
+                event.exclusionLevel = std::max(event.exclusionLevel, exclusionLevel);
+            }
 
             logg.logMessage("perf_event_open: tid: %i, leader = %i -> fd = %i", tid, groupLeaderFd, *fd);
 
@@ -544,18 +631,18 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
                     tidsIterator = tids.erase(tidsIterator);
                     continue;
                 }
-                else if ((errno == ENOENT) && (!event.attr.pinned)) {
+                else if ((errno == ENOENT) && (!isGroupLeader(eventIndex))) {
                     // This event doesn't apply to this CPU but should apply to a different one, e.g. bigLittle
                     goto skipOtherTids;
                 }
                 std::ostringstream stringStream;
 
-                stringStream << "perf_event_open failed to online counter for " << typeLabel << ":" << event.attr.config
+                stringStream << "perf_event_open failed to online counter for " << typeLabel << ":" << attr.config
                              << " on CPU " << cpu << " due to errno = " << errno << "(" << strerror(errno) << ").";
 
                 if (sharedConfig.perfConfig.is_system_wide) {
                     if (errno == EINVAL) {
-                        switch (event.attr.type) {
+                        switch (attr.type) {
                             case PERF_TYPE_BREAKPOINT:
                             case PERF_TYPE_SOFTWARE:
                             case PERF_TYPE_TRACEPOINT:
@@ -575,7 +662,7 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
                     logg.logWarning("%s", stringStream.str().c_str());
                 }
             }
-            else if (!addToBuffer(*fd, cpu, event.attr.aux_watermark != 0)) {
+            else if (!addToBuffer(*fd, cpu, attr.aux_watermark != 0)) {
                 std::string message("PerfBuffer::useFd failed");
                 if (sharedConfig.perfConfig.is_system_wide) {
                     return std::make_pair(OnlineResult::FAILURE, message.c_str());
@@ -597,6 +684,8 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
     skipOtherTids:;
     }
 
+    std::unique_lock<std::mutex> lock {sharedConfig.onlineMutex};
+
     if (sharedConfig.perfConfig.has_ioctl_read_id) {
         bool addedEvents = false;
         std::vector<int> coreKeys;
@@ -626,6 +715,19 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
                 coreKeys.push_back(key);
                 ids.emplace_back(id);
 
+                if (sharedConfig.userStackUnwinder != nullptr) {
+                    sharedConfig.userStackUnwinder->addEvent(id, event.attr);
+                }
+                const struct perf_event_attr unwoundAttr = PerfUserStackUnwinder::withoutUserStack(event.attr);
+                if ((sharedConfig.sampleAggregator != nullptr) &&
+                    sharedConfig.sampleAggregator->addEvent(id, key, unwoundAttr)) {
+                    logg.logMessage("Aggregating samples for key %i", key);
+                }
+                if ((sharedConfig.callchainInterner != nullptr) &&
+                    sharedConfig.callchainInterner->addEvent(id, unwoundAttr)) {
+                    logg.logMessage("Interning callchains for key %i", key);
+                }
+
                 // log it
                 logg.logMessage("Perf id for key : %i, fd : %i  -->  %" PRIu64, key, *fd, id);
 
@@ -648,7 +750,7 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
             const PerfEvent & event = events.at(eventIndex);
             const bool isLeader = requiresLeader() && (eventIndex == 0);
 
-            if (event.attr.pinned && !isLeader) {
+            if (isGroupLeader(eventIndex) && !isLeader) {
                 for (const auto & tidToFdPair : eventIndexToTidToFdPair.second) {
                     const auto & fd = tidToFdPair.second;
                     if (!readAndSend(timestamp, attrsConsumer, event.attr, *fd, 1, &event.key)) {
@@ -676,6 +778,8 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
         }
     }
 
+    lock.unlock();
+
     if (enableNow) {
         if (!enable(eventIndexToTidToFdMap) || !checkEnabled(eventIndexToTidToFdMap)) {
             return std::make_pair(OnlineResult::OTHER_FAILURE, "Unable to enable a perf event");
@@ -683,6 +787,7 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
     }
 
     // everything enabled successfully, move into map
+    lock.lock();
     cpuToEventIndexToTidToFdMap[cpu] = std::move(eventIndexToTidToFdMap);
 
     return std::make_pair(OnlineResult::SUCCESS, "");
@@ -690,6 +795,9 @@ std::pair<OnlineResult, std::string> PerfEventGroup::onlineCPU(uint64_t timestam
 
 bool PerfEventGroup::offlineCPU(int cpu)
 {
+    // setSamplePeriodScale may be walking the map from another thread
+    std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
+
     auto & eventIndexToTidToFdMap = cpuToEventIndexToTidToFdMap[cpu];
 
     // we disable in the opposite order that we enabled for some reason
@@ -718,12 +826,11 @@ bool PerfEventGroup::enable(const std::map<int, std::map<int, lib::AutoClosingFd
     // Enable group leaders, others should be enabled by default
     for (const auto & eventIndexToTidToFdPair : eventIndexToTidToFdMap) {
         const int eventIndex = eventIndexToTidToFdPair.first;
-        const PerfEvent & event = events.at(eventIndex);
 
         for (const auto & tidToFdPair : eventIndexToTidToFdPair.second) {
             const auto & fd = tidToFdPair.second;
 
-            if (event.attr.pinned && (lib::ioctl(*fd, PERF_EVENT_IOC_ENABLE, 0) != 0)) {
+            if (isGroupLeader(eventIndex) && (lib::ioctl(*fd, PERF_EVENT_IOC_ENABLE, 0) != 0)) {
                 logg.logError("Unable to enable a perf event");
                 return false;
             }
@@ -747,7 +854,7 @@ bool PerfEventGroup::checkEnabled(const std::map<int, std::map<int, lib::AutoClo
             const auto tid = tidToFdPair.first;
             const auto & fd = tidToFdPair.second;
 
-            if (event.attr.pinned) {
+            if (isGroupLeader(eventIndex)) {
                 const auto readResult = lib::read(*fd, buf, sizeof(buf));
                 if (readResult < 0) {
                     logg.logError("Unable to read all perf groups, perhaps too many events were enabled (%d, %s)",
@@ -784,6 +891,45 @@ bool PerfEventGroup::checkEnabled(const std::map<int, std::map<int, lib::AutoClo
     return true;
 }
 
+bool PerfEventGroup::setSamplePeriodScale(const int scale)
+{
+    bool result = true;
+
+    // CPUs may come online or go offline concurrently, adding to or removing from the map
+    std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
+
+    for (const auto & cpuToEventIndexToTidToFdPair : cpuToEventIndexToTidToFdMap) {
+        for (const auto & eventIndexToTidToFdPair : cpuToEventIndexToTidToFdPair.second) {
+            const PerfEvent & event = events.at(eventIndexToTidToFdPair.first);
+
+            // Only events that sample the PC; tracepoints, context switches, SPE and frequency based events
+            // must keep their period as it is
+            const bool isPcSampling = (!event.attr.freq) && (event.attr.sample_period != 0) &&
+                                      (event.attr.type != PERF_TYPE_TRACEPOINT) &&
+                                      ((event.attr.sample_type & PERF_SAMPLE_IP) != 0) &&
+                                      (event.attr.aux_watermark == 0);
+            if (!isPcSampling) {
+                continue;
+            }
+
+            uint64_t period = event.attr.sample_period * scale;
+            for (const auto & tidToFdPair : eventIndexToTidToFdPair.second) {
+                const auto & fd = tidToFdPair.second;
+                if (lib::ioctl(*fd, PERF_EVENT_IOC_PERIOD, reinterpret_cast<unsigned long>(&period)) != 0) {
+                    logg.logMessage("Unable to set the period of key %i to %" PRIu64 " (%d) %s",
+                                    event.key,
+                                    period,
+                                    errno,
+                                    strerror(errno));
+                    result = false;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
 void PerfEventGroup::start()
 {
     // Enable everything before checking to avoid losing data
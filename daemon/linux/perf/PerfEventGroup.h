@@ -15,11 +15,15 @@
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <mutex>
 #include <set>
 #include <vector>
 
 class IPerfAttrsConsumer;
 class GatorCpu;
+class PerfCallchainInterner;
+class PerfSampleAggregator;
+class PerfUserStackUnwinder;
 
 enum class OnlineResult {
     SUCCESS,
@@ -50,7 +54,14 @@ struct PerfEventGroupSharedConfig {
           sampleRate(sampleRate),
           enablePeriodicSampling(enablePeriodicSampling),
           clusters(clusters),
-          clusterIds(clusterIds)
+          clusterIds(clusterIds),
+          sampleAggregator(nullptr),
+          callchainInterner(nullptr),
+          userStackUnwinder(nullptr),
+          writeBackward(false),
+          multiplexCounters(false),
+          multiplexCounterLimit(0),
+          onlineMutex()
     {
     }
 
@@ -66,6 +77,21 @@ struct PerfEventGroupSharedConfig {
     bool enablePeriodicSampling;
     lib::Span<const GatorCpu> clusters;
     lib::Span<const int> clusterIds;
+    /// when not null, EBS events are registered with it as they come online
+    PerfSampleAggregator * sampleAggregator;
+    /// when not null, events with callchains are registered with it as they come online
+    PerfCallchainInterner * callchainInterner;
+    /// when not null, events with callchains copy the user stack for it to unwind
+    PerfUserStackUnwinder * userStackUnwinder;
+    /// for overwriting perf buffers, every event sharing a buffer must match
+    bool writeBackward;
+    /// split the counters of each PMU into flexible groups that fit it, for the kernel to rotate through
+    bool multiplexCounters;
+    /// when not 0, the counters in each of those groups instead of the PMU's, with the software counters moved into
+    /// the CPU groups and counted too, so that multiplexing can be exercised without a PMU, see PerfGroups::add
+    int multiplexCounterLimit;
+    /// CPUs may be onlined concurrently, this guards the attrs consumer and the state the groups share between CPUs
+    std::mutex onlineMutex;
 };
 
 class PerfEventGroup {
@@ -82,6 +108,7 @@ public:
                   bool hasAuxData);
     bool createGroupLeader(uint64_t timestamp, IPerfAttrsConsumer & attrsConsumer);
 
+    /** May be called concurrently for different CPUs, addToMonitor and addToBuffer must allow that */
     std::pair<OnlineResult, std::string> onlineCPU(uint64_t timestamp,
                                                    int cpu,
                                                    std::set<int> & tids,
@@ -94,10 +121,21 @@ public:
     void start();
     void stop();
 
+    /**
+     * Multiply the sample period of every online sampling event by scale, relative to the period it was created with
+     *
+     * @return false if any event could not be updated
+     */
+    bool setSamplePeriodScale(int scale);
+
 private:
     struct PerfEvent {
         struct perf_event_attr attr;
         int key;
+        /// the first exclusions to try opening with, raised when a CPU finds that fewer are not permitted
+        int exclusionLevel;
+        /// the index of the event that leads this one's perf_event_open group, its own index if it is the leader
+        int leaderIndex;
     };
 
     PerfEventGroup(const PerfEventGroup &) = delete;
@@ -105,8 +143,28 @@ private:
     PerfEventGroup(PerfEventGroup &&) = delete;
     PerfEventGroup & operator=(PerfEventGroup &&) = delete;
 
+    /**
+     * @param leaderIndex The index of the group's leader or OWN_GROUP to lead a new one
+     * @param flexible The group is not pinned, so the kernel may multiplex it
+     */
+    bool addEvent(int leaderIndex,
+                  bool flexible,
+                  uint64_t timestamp,
+                  IPerfAttrsConsumer & attrsConsumer,
+                  int key,
+                  const IPerfGroups::Attr & attr,
+                  bool hasAuxData);
+    bool isReadFormatGroup() const;
+    bool isGroupLeader(std::size_t eventIndex) const
+    {
+        return events[eventIndex].leaderIndex == static_cast<int>(eventIndex);
+    }
+    /** @return The counters of the PMU, from the pmus.xml, or INT_MAX if that is unknown */
+    int getNumberOfCounters() const;
+
     bool createCpuGroupLeader(uint64_t timestamp, IPerfAttrsConsumer & attrsConsumer);
     bool createUncoreGroupLeader(uint64_t timestamp, IPerfAttrsConsumer & attrsConsumer);
+    bool createMultiplexGroupLeader(uint64_t timestamp, IPerfAttrsConsumer & attrsConsumer);
 
     bool enable(const std::map<int, std::map<int, lib::AutoClosingFd>> & eventIndexToTidToFdMap);
     bool checkEnabled(const std::map<int, std::map<int, lib::AutoClosingFd>> & eventIndexToTidToFdMap);
@@ -116,11 +174,16 @@ private:
     const PerfEventGroupIdentifier groupIdentifier;
     PerfEventGroupSharedConfig & sharedConfig;
 
-    // list of events associated with the group, where the first must be the group leader
+    // list of events associated with the group, where the first must be the group leader; when multiplexing,
+    // counters follow the leaders of their own subgroups
     std::vector<PerfEvent> events;
 
     // map from cpu -> (map from mEvents index -> (map from tid -> file descriptor))
     std::map<int, std::map<int, std::map<int, lib::AutoClosingFd>>> cpuToEventIndexToTidToFdMap;
+
+    /// when multiplexing, the leader of the flexible group counters are being added to, or OWN_GROUP if none is yet
+    int multiplexLeaderIndex;
+    int countersInMultiplexGroup;
 };
 
 #endif /* INCLUDE_LINUX_PERF_PERF_EVENT_GROUP_H */
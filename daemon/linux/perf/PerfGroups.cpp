@@ -3,6 +3,7 @@
 #include "linux/perf/PerfGroups.h"
 
 #include "Logging.h"
+#include "xml/PmuXML.h"
 
 #include <cassert>
 #include <cerrno>
@@ -77,6 +78,7 @@ PerfGroups::PerfGroups(const PerfConfig & perfConfig,
                    clusterIds,
                    schedSwitchId),
       perfEventGroupMap(),
+      counterReader(nullptr),
       eventsOpenedPerCpu(),
       maxFiles(maxFiles),
       numberOfEventsAdded(0)
@@ -113,8 +115,32 @@ bool PerfGroups::add(const uint64_t timestamp,
                      const IPerfGroups::Attr & attr,
                      bool hasAuxData)
 {
+    // To exercise multiplexing without a PMU, the software counters are counted in the CPU groups as if they were
+    // CPU counters
+    if ((sharedConfig.multiplexCounterLimit > 0) &&
+        (groupIdentifier.getType() == PerfEventGroupIdentifier::Type::GLOBAL) && (attr.type == PERF_TYPE_SOFTWARE) &&
+        (attr.periodOrFreq == 0)) {
+        bool added = true;
+        for (const GatorCpu & cluster : sharedConfig.clusters) {
+            added &= add(timestamp, attrsConsumer, PerfEventGroupIdentifier(cluster), key, attr, hasAuxData);
+        }
+        return added;
+    }
 
+    // Even if the event is read by gatord, the group leader does its own sampling
     PerfEventGroup & eventGroup = getGroup(timestamp, attrsConsumer, groupIdentifier);
+
+    if ((counterReader != nullptr) && PerfCounterReader::canRead(groupIdentifier, attr, hasAuxData)) {
+        logg.logMessage("Adding event: group='%s', key=%i, type=%" PRIu32 ", config=%" PRIu64 " to be read by gatord",
+                        std::string(groupIdentifier).c_str(),
+                        key,
+                        attr.type,
+                        attr.config);
+        counterReader->add(groupIdentifier, key, attr);
+        numberOfEventsAdded++;
+        return true;
+    }
+
     logg.logMessage("Adding event: timestamp=%" PRIu64 ", group='%s', key=%i, type=%" PRIu32 ", config=%" PRIu64
                     ", config1=%" PRIu64 ", config2=%" PRIu64 ", period=%" PRIu64 ", sampleType=0x%" PRIx64
                     ", mmap=%d, comm=%d, freq=%d, task=%d, context_switch=%d, hasAuxData=%d",
@@ -189,12 +215,16 @@ std::pair<OnlineResult, std::string> PerfGroups::onlineCPU(uint64_t timestamp,
     // Check to see if there are too many events/ not enough fds
     // This is an over estimation because not every event will be opened.
     const unsigned int amountOfEventsAboutToOpen = tids.size() * numberOfEventsAdded;
-    eventsOpenedPerCpu[cpu] = amountOfEventsAboutToOpen;
-    const unsigned int currentAmountOfEvents = std::accumulate(
-        std::begin(eventsOpenedPerCpu),
-        std::end(eventsOpenedPerCpu),
-        0,
-        [](unsigned int total, const std::map<int, unsigned int>::value_type & p) { return total + p.second; });
+    unsigned int currentAmountOfEvents;
+    {
+        std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
+        eventsOpenedPerCpu[cpu] = amountOfEventsAboutToOpen;
+        currentAmountOfEvents = std::accumulate(
+            std::begin(eventsOpenedPerCpu),
+            std::end(eventsOpenedPerCpu),
+            0,
+            [](unsigned int total, const std::map<int, unsigned int>::value_type & p) { return total + p.second; });
+    }
 
     if (maxFiles < currentAmountOfEvents) {
         logg.logError("Not enough file descriptors for the amount of events requested.");
@@ -208,6 +238,10 @@ std::pair<OnlineResult, std::string> PerfGroups::onlineCPU(uint64_t timestamp,
             return result;
         }
     }
+
+    if (counterReader != nullptr) {
+        counterReader->onlineCPU(cpu, tids, enabledState);
+    }
     return std::make_pair(OnlineResult::SUCCESS, "");
 }
 
@@ -221,9 +255,14 @@ bool PerfGroups::offlineCPU(int cpu, const std::function<void(int)> & removeFrom
         }
     }
 
+    if (counterReader != nullptr) {
+        counterReader->offlineCPU(cpu);
+    }
+
     // Mark the buffer so that it will be released next time it's read
     removeFromBuffer(cpu);
 
+    std::lock_guard<std::mutex> lock {sharedConfig.onlineMutex};
     eventsOpenedPerCpu.erase(cpu);
 
     return true;
@@ -234,6 +273,9 @@ void PerfGroups::start()
     for (auto & pair : perfEventGroupMap) {
         pair.second->start();
     }
+    if (counterReader != nullptr) {
+        counterReader->start();
+    }
 }
 
 void PerfGroups::stop()
@@ -241,6 +283,18 @@ void PerfGroups::stop()
     for (auto & pair : perfEventGroupMap) {
         pair.second->stop();
     }
+    if (counterReader != nullptr) {
+        counterReader->stop();
+    }
+}
+
+bool PerfGroups::setSamplePeriodScale(int scale)
+{
+    bool result = true;
+    for (auto & pair : perfEventGroupMap) {
+        result &= pair.second->setSamplePeriodScale(scale);
+    }
+    return result;
 }
 
 bool PerfGroups::hasSPE() const
@@ -4,6 +4,7 @@
 #define PERF_GROUPS_H
 
 #include "linux/perf/IPerfGroups.h"
+#include "linux/perf/PerfCounterReader.h"
 #include "linux/perf/PerfEventGroup.h"
 #include "linux/perf/PerfEventGroupIdentifier.h"
 
@@ -59,7 +60,8 @@ public:
      * @param appPids ignored if system wide
      * @param enableNow
      * @return
-     * @note Not safe to call concurrently.
+     * @note May be called concurrently for different CPUs, but not with offlineCPU, start or stop. addToMonitor
+     * and addToBuffer must allow that too.
      */
     std::pair<OnlineResult, std::string> onlineCPU(uint64_t timestamp,
                                                    int cpu,
@@ -73,7 +75,31 @@ public:
     bool offlineCPU(int cpu, const std::function<void(int)> & removeFromBuffer);
     void start();
     void stop();
+    bool setSamplePeriodScale(int scale);
     bool hasSPE() const;
+    void setSampleAggregator(PerfSampleAggregator * sampleAggregator)
+    {
+        sharedConfig.sampleAggregator = sampleAggregator;
+    }
+    void setCallchainInterner(PerfCallchainInterner * callchainInterner)
+    {
+        sharedConfig.callchainInterner = callchainInterner;
+    }
+    /** Must be called before any events are added */
+    void setUserStackUnwinder(PerfUserStackUnwinder * userStackUnwinder)
+    {
+        sharedConfig.userStackUnwinder = userStackUnwinder;
+    }
+    /** Must be called before any events are added */
+    void setMultiplexCounters(bool multiplexCounters, int counterLimit = 0)
+    {
+        sharedConfig.multiplexCounters = multiplexCounters;
+        sharedConfig.multiplexCounterLimit = counterLimit;
+    }
+    /** Must be called before any events are added */
+    void setWriteBackward(bool writeBackward) { sharedConfig.writeBackward = writeBackward; }
+    /** Must be called before any events are added, the counting events it can read are then given to it */
+    void setCounterReader(PerfCounterReader * reader) { counterReader = reader; }
 
 private:
     /// Get the group and create the group leader if needed
@@ -84,6 +110,7 @@ private:
     PerfEventGroupSharedConfig sharedConfig;
     std::map<PerfEventGroupIdentifier, std::unique_ptr<PerfEventGroup>> perfEventGroupMap;
 
+    PerfCounterReader * counterReader;
     std::map<int, unsigned int> eventsOpenedPerCpu;
     unsigned int maxFiles;
     unsigned int numberOfEventsAdded;
@@ -0,0 +1,276 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfSampleAggregator.h"
+
+#include "BufferUtils.h"
+#include "ISender.h"
+#include "Logging.h"
+#include "Protocol.h"
+#include "linux/perf/PerfUtils.h"
+
+#include <cinttypes>
+
+namespace {
+    /// The sample fields that can appear in an aggregated sample, anything else means the sample is sent raw
+    constexpr std::uint64_t AGGREGATABLE_SAMPLE_TYPE = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID |
+                                                       PERF_SAMPLE_TIME | PERF_SAMPLE_ID | PERF_SAMPLE_CPU |
+                                                       PERF_SAMPLE_PERIOD | PERF_SAMPLE_READ |
+                                                       PERF_SAMPLE_CALLCHAIN;
+
+    /// Longer callchains are truncated, the kernel default limit is 127
+    constexpr std::uint64_t MAX_CALLCHAIN_DEPTH = 512;
+
+    /** Writes a PERF_HISTOGRAM or PERF_SAMPLE_READS frame, only one sort of entry may be added to each */
+    class PerfHistogramFrame {
+    public:
+        PerfHistogramFrame(ISender & sender, FrameType type, std::uint64_t windowStart, std::uint64_t windowLength)
+            : mSender(sender), mType(type), mWindowStart(windowStart), mWindowLength(windowLength), mWritePos(-1)
+        {
+        }
+
+        ~PerfHistogramFrame() { send(); }
+
+        void add(int key, int pid, int tid, const std::vector<std::uint64_t> & ips, std::uint64_t count)
+        {
+            const std::size_t entrySize = (4 * buffer_utils::MAXSIZE_PACK32) +
+                                          ((ips.size() + 1) * buffer_utils::MAXSIZE_PACK64);
+            if (sizeof(mBuf) <= mWritePos + entrySize) {
+                send();
+            }
+            frameHeader();
+
+            buffer_utils::packInt(mBuf, mWritePos, key);
+            buffer_utils::packInt(mBuf, mWritePos, pid);
+            buffer_utils::packInt(mBuf, mWritePos, tid);
+            buffer_utils::packInt64(mBuf, mWritePos, count);
+            buffer_utils::packInt(mBuf, mWritePos, ips.size());
+            for (const std::uint64_t ip : ips) {
+                buffer_utils::packInt64(mBuf, mWritePos, ip);
+            }
+        }
+
+        void addRead(std::uint64_t id, std::uint64_t time, const std::vector<std::uint64_t> & values)
+        {
+            const std::size_t entrySize = (2 * buffer_utils::MAXSIZE_PACK64) + buffer_utils::MAXSIZE_PACK32 +
+                                          (values.size() * buffer_utils::MAXSIZE_PACK64);
+            if (sizeof(mBuf) <= mWritePos + entrySize) {
+                send();
+            }
+            frameHeader();
+
+            buffer_utils::packInt64(mBuf, mWritePos, id);
+            buffer_utils::packInt64(mBuf, mWritePos, time);
+            buffer_utils::packInt(mBuf, mWritePos, values.size());
+            for (const std::uint64_t value : values) {
+                buffer_utils::packInt64(mBuf, mWritePos, value);
+            }
+        }
+
+        void send()
+        {
+            if (mWritePos > 0) {
+                mSender.writeData(mBuf, mWritePos, ResponseType::APC_DATA);
+                mWritePos = -1;
+            }
+        }
+
+    private:
+        void frameHeader()
+        {
+            if (mWritePos < 0) {
+                mWritePos = 0;
+                buffer_utils::packInt(mBuf, mWritePos, static_cast<uint32_t>(mType));
+                buffer_utils::packInt64(mBuf, mWritePos, mWindowStart);
+                buffer_utils::packInt64(mBuf, mWritePos, mWindowLength);
+            }
+        }
+
+        // Same size as PerfDataFrame
+        char mBuf[1 << 16];
+        ISender & mSender;
+        FrameType mType;
+        std::uint64_t mWindowStart;
+        std::uint64_t mWindowLength;
+        int mWritePos;
+    };
+}
+
+std::size_t PerfSampleAggregator::SampleKeyHash::operator()(const SampleKey & sampleKey) const
+{
+    // FNV-1a over the words
+    std::uint64_t hash = 14695981039346656037ULL;
+    const auto mix = [&hash](std::uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ULL;
+    };
+    mix(static_cast<std::uint32_t>(sampleKey.key));
+    mix((static_cast<std::uint64_t>(static_cast<std::uint32_t>(sampleKey.pid)) << 32) |
+        static_cast<std::uint32_t>(sampleKey.tid));
+    for (const std::uint64_t ip : sampleKey.ips) {
+        mix(ip);
+    }
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+}
+
+PerfSampleAggregator::PerfSampleAggregator(std::uint64_t windowLength)
+    : mMutex(),
+      mWindowLength(windowLength),
+      mEvents(),
+      mWindows(),
+      mScratchKey(),
+      mSamplesConsumed(0),
+      mEntriesSent(0)
+{
+}
+
+bool PerfSampleAggregator::addEvent(std::uint64_t id, int key, const struct perf_event_attr & attr)
+{
+    // Only EBS events; frequency based events are the periodic counters whose period is the counter value
+    const bool isEbs = (attr.sample_period != 0) && (!attr.freq);
+    const bool canParse = ((attr.sample_type & PERF_SAMPLE_IDENTIFIER) != 0) &&
+                          ((attr.sample_type & PERF_SAMPLE_IP) != 0) &&
+                          ((attr.sample_type & ~AGGREGATABLE_SAMPLE_TYPE) == 0);
+
+    if (!isEbs || !canParse) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock {mMutex};
+    mEvents[id] = EventInfo {key, attr.sample_type, attr.read_format};
+    return true;
+}
+
+bool PerfSampleAggregator::hasEvents()
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+    return !mEvents.empty();
+}
+
+bool PerfSampleAggregator::consume(const struct perf_event_header * record)
+{
+    if ((record->type != PERF_RECORD_SAMPLE) || (record->size < sizeof(*record) + sizeof(std::uint64_t))) {
+        return false;
+    }
+
+    const auto * const words = reinterpret_cast<const std::uint64_t *>(record + 1);
+    const std::size_t numberOfWords = (record->size - sizeof(*record)) / sizeof(std::uint64_t);
+
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    // PERF_SAMPLE_IDENTIFIER is always first
+    const auto eventIt = mEvents.find(words[0]);
+    if (eventIt == mEvents.end()) {
+        return false;
+    }
+    const EventInfo & event = eventIt->second;
+
+    std::size_t pos = 1;
+    const auto next = [&](std::uint64_t & value) -> bool {
+        if (pos >= numberOfWords) {
+            return false;
+        }
+        value = words[pos++];
+        return true;
+    };
+
+    std::uint64_t ip = 0;
+    std::uint64_t pidTid = 0;
+    std::uint64_t time = 0;
+    std::uint64_t ignored;
+    if (!next(ip) //
+        || (((event.sampleType & PERF_SAMPLE_TID) != 0) && !next(pidTid))
+        || (((event.sampleType & PERF_SAMPLE_TIME) != 0) && !next(time))
+        || (((event.sampleType & PERF_SAMPLE_ID) != 0) && !next(ignored))
+        || (((event.sampleType & PERF_SAMPLE_CPU) != 0) && !next(ignored))
+        || (((event.sampleType & PERF_SAMPLE_PERIOD) != 0) && !next(ignored))) {
+        return false;
+    }
+
+    const std::uint64_t * readValues = nullptr;
+    std::size_t readSize = 0;
+    if ((event.sampleType & PERF_SAMPLE_READ) != 0) {
+        readSize = (pos < numberOfWords ? perf_utils::sampleReadSize(event.readFormat, words + pos, numberOfWords - pos)
+                                        : 0);
+        if (readSize == 0) {
+            return false;
+        }
+        readValues = words + pos;
+        pos += readSize;
+    }
+
+    std::uint64_t depth = 0;
+    if (((event.sampleType & PERF_SAMPLE_CALLCHAIN) != 0) &&
+        (!next(depth) || (depth > numberOfWords - pos))) {
+        return false;
+    }
+    if (depth > MAX_CALLCHAIN_DEPTH) {
+        depth = MAX_CALLCHAIN_DEPTH;
+    }
+
+    // pid and tid are two u32 in that order, so pid is in the low half on little endian targets
+    mScratchKey.key = event.key;
+    mScratchKey.pid = static_cast<int>(static_cast<std::uint32_t>(pidTid));
+    mScratchKey.tid = static_cast<int>(static_cast<std::uint32_t>(pidTid >> 32));
+    mScratchKey.ips.clear();
+    mScratchKey.ips.push_back(ip);
+    mScratchKey.ips.insert(mScratchKey.ips.end(), words + pos, words + pos + depth);
+
+    Window & window = mWindows[time / mWindowLength];
+    Histogram & histogram = window.histogram;
+    const auto entryIt = histogram.find(mScratchKey);
+    if (entryIt != histogram.end()) {
+        entryIt->second += 1;
+    }
+    else {
+        histogram.emplace(mScratchKey, 1);
+    }
+
+    if (readValues != nullptr) {
+        LastRead & lastRead = window.reads[words[0]];
+        if (lastRead.values.empty() || (time >= lastRead.time)) {
+            lastRead.time = time;
+            lastRead.values.assign(readValues, readValues + readSize);
+        }
+    }
+
+    ++mSamplesConsumed;
+    return true;
+}
+
+void PerfSampleAggregator::send(ISender & sender, std::uint64_t now)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    bool sentAny = false;
+    while (!mWindows.empty()) {
+        const auto windowIt = mWindows.begin();
+        const std::uint64_t windowStart = windowIt->first * mWindowLength;
+        if ((now != UINT64_MAX) && (windowStart + mWindowLength > now)) {
+            break;
+        }
+
+        const Window & window = windowIt->second;
+        {
+            PerfHistogramFrame frame {sender, FrameType::PERF_HISTOGRAM, windowStart, mWindowLength};
+            for (const auto & entry : window.histogram) {
+                frame.add(entry.first.key, entry.first.pid, entry.first.tid, entry.first.ips, entry.second);
+            }
+        }
+        if (!window.reads.empty()) {
+            PerfHistogramFrame frame {sender, FrameType::PERF_SAMPLE_READS, windowStart, mWindowLength};
+            for (const auto & read : window.reads) {
+                frame.addRead(read.first, read.second.time, read.second.values);
+            }
+        }
+
+        mEntriesSent += window.histogram.size();
+        mWindows.erase(windowIt);
+        sentAny = true;
+    }
+
+    if (sentAny && (now == UINT64_MAX)) {
+        logg.logMessage("Aggregated %" PRIu64 " samples into %" PRIu64 " histogram entries",
+                        mSamplesConsumed,
+                        mEntriesSent);
+    }
+}
@@ -0,0 +1,116 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PERF_PERF_SAMPLE_AGGREGATOR_H
+#define INCLUDE_LINUX_PERF_PERF_SAMPLE_AGGREGATOR_H
+
+#include "k/perf_event.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ISender;
+
+/**
+ * Replaces the raw PERF_RECORD_SAMPLE records of EBS events with per time window hit counts.
+ *
+ * Samples are counted per (window, key, pid, tid, ip + callchain) and each closed window is sent as one or more
+ * PERF_HISTOGRAM frames. A window may be reported in more than one frame (for example when a CPU's ring is drained
+ * late), the counts in those frames are additive.
+ *
+ * Only events whose samples have a fixed layout and begin with PERF_SAMPLE_IDENTIFIER are aggregated; everything
+ * else (including mmap and comm records) is still sent raw.
+ *
+ * System-wide, the samples also carry the values of the rest of their group (PERF_SAMPLE_READ). As those values are
+ * totals, only the last read of each perf id in a window is kept, and it is sent after the window's histogram in a
+ * PERF_SAMPLE_READS frame. The counter values are therefore per window and per CPU rather than per sample and thread.
+ */
+class PerfSampleAggregator {
+public:
+    /**
+     * @param windowLength The window length in the perf clock, which must be CLOCK_MONOTONIC_RAW
+     */
+    PerfSampleAggregator(std::uint64_t windowLength);
+
+    /**
+     * Register a perf id, does nothing if the event's samples cannot be aggregated
+     *
+     * @return true if samples from this id will be aggregated
+     */
+    bool addEvent(std::uint64_t id, int key, const struct perf_event_attr & attr);
+
+    /** @return true if any event has been registered by addEvent */
+    bool hasEvents();
+
+    /**
+     * Count the record if it is an aggregatable sample
+     *
+     * @param record A complete record, 8 byte aligned
+     * @return true if the record was consumed, false if it must be sent as is
+     */
+    bool consume(const struct perf_event_header * record);
+
+    /**
+     * Send all windows that ended at or before now
+     *
+     * @param now Pass UINT64_MAX to send everything
+     */
+    void send(ISender & sender, std::uint64_t now);
+
+private:
+    struct EventInfo {
+        int key;
+        std::uint64_t sampleType;
+        std::uint64_t readFormat;
+    };
+
+    /// the PERF_SAMPLE_READ field of the last sample of a perf id
+    struct LastRead {
+        std::uint64_t time;
+        std::vector<std::uint64_t> values;
+    };
+
+    struct SampleKey {
+        int key;
+        int pid;
+        int tid;
+        /// the sampled ip followed by the callchain, if any
+        std::vector<std::uint64_t> ips;
+
+        bool operator==(const SampleKey & other) const
+        {
+            return key == other.key && pid == other.pid && tid == other.tid && ips == other.ips;
+        }
+    };
+
+    struct SampleKeyHash {
+        std::size_t operator()(const SampleKey & sampleKey) const;
+    };
+
+    using Histogram = std::unordered_map<SampleKey, std::uint64_t, SampleKeyHash>;
+
+    struct Window {
+        Histogram histogram;
+        /// perf id -> last read
+        std::unordered_map<std::uint64_t, LastRead> reads;
+    };
+
+    std::mutex mMutex;
+    const std::uint64_t mWindowLength;
+    std::unordered_map<std::uint64_t, EventInfo> mEvents;
+    /// window index -> window
+    std::map<std::uint64_t, Window> mWindows;
+    SampleKey mScratchKey;
+    std::uint64_t mSamplesConsumed;
+    std::uint64_t mEntriesSent;
+
+    // Intentionally unimplemented
+    PerfSampleAggregator(const PerfSampleAggregator &) = delete;
+    PerfSampleAggregator & operator=(const PerfSampleAggregator &) = delete;
+    PerfSampleAggregator(PerfSampleAggregator &&) = delete;
+    PerfSampleAggregator & operator=(PerfSampleAggregator &&) = delete;
+};
+
+#endif // INCLUDE_LINUX_PERF_PERF_SAMPLE_AGGREGATOR_H
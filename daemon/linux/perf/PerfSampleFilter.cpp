@@ -0,0 +1,237 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfSampleFilter.h"
+
+#include "GatordStats.h"
+#include "Logging.h"
+#include "k/perf_event.h"
+#include "lib/Syscall.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <linux/bpf.h>
+#include <vector>
+
+namespace {
+    // plenty for the threads of the profiled processes, hash maps used from perf must be preallocated
+    constexpr std::uint32_t MAX_TIDS = 16384;
+
+    // the elements of the stats map
+    constexpr std::uint32_t PASSED_INDEX = 0;
+    constexpr std::uint32_t DROPPED_INDEX = 1;
+    constexpr std::uint32_t NUMBER_OF_STATS = 2;
+
+    constexpr std::uint8_t R0 = 0;
+    constexpr std::uint8_t R1 = 1;
+    constexpr std::uint8_t R2 = 2;
+    constexpr std::uint8_t R6 = 6;
+    constexpr std::uint8_t R10 = 10;
+
+    struct bpf_insn insn(std::uint8_t code, std::uint8_t dst, std::uint8_t src, std::int16_t off, std::int32_t imm)
+    {
+        struct bpf_insn result;
+        memset(&result, 0, sizeof(result));
+        result.code = code;
+        result.dst_reg = dst;
+        result.src_reg = src;
+        result.off = off;
+        result.imm = imm;
+        return result;
+    }
+
+    /**
+     * There is no BPF compiler in the build so the program is assembled here, it is equivalent to
+     *
+     *     int filter(struct bpf_perf_event_data * ctx)
+     *     {
+     *         u32 tgid = bpf_get_current_pid_tgid() >> 32;
+     *         void * allowed = bpf_map_lookup_elem(&tids, &tgid);
+     *         u32 index = (allowed != NULL ? PASSED_INDEX : DROPPED_INDEX);
+     *         u64 * count = bpf_map_lookup_elem(&stats, &index);
+     *         if (count != NULL) {
+     *             __sync_fetch_and_add(count, 1);
+     *         }
+     *         return allowed != NULL;
+     *     }
+     */
+    std::vector<struct bpf_insn> assembleProgram(int tidsMapFd, int statsMapFd)
+    {
+        return {
+            insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_get_current_pid_tgid),
+            insn(BPF_ALU64 | BPF_RSH | BPF_K, R0, 0, 0, 32),
+            insn(BPF_STX | BPF_MEM | BPF_W, R10, R0, -4, 0),
+            insn(BPF_LD | BPF_DW | BPF_IMM, R1, BPF_PSEUDO_MAP_FD, 0, tidsMapFd),
+            insn(0, 0, 0, 0, 0),
+            insn(BPF_ALU64 | BPF_MOV | BPF_X, R2, R10, 0, 0),
+            insn(BPF_ALU64 | BPF_ADD | BPF_K, R2, 0, 0, -4),
+            insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+            insn(BPF_ALU64 | BPF_MOV | BPF_X, R6, R0, 0, 0),
+            insn(BPF_ST | BPF_MEM | BPF_W, R10, 0, -8, PASSED_INDEX),
+            insn(BPF_JMP | BPF_JNE | BPF_K, R6, 0, 1, 0),
+            insn(BPF_ST | BPF_MEM | BPF_W, R10, 0, -8, DROPPED_INDEX),
+            insn(BPF_LD | BPF_DW | BPF_IMM, R1, BPF_PSEUDO_MAP_FD, 0, statsMapFd),
+            insn(0, 0, 0, 0, 0),
+            insn(BPF_ALU64 | BPF_MOV | BPF_X, R2, R10, 0, 0),
+            insn(BPF_ALU64 | BPF_ADD | BPF_K, R2, 0, 0, -8),
+            insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+            insn(BPF_JMP | BPF_JEQ | BPF_K, R0, 0, 2, 0),
+            insn(BPF_ALU64 | BPF_MOV | BPF_K, R1, 0, 0, 1),
+            insn(BPF_STX | BPF_XADD | BPF_DW, R0, R1, 0, 0),
+            // returning 0 discards the sample
+            insn(BPF_ALU64 | BPF_MOV | BPF_K, R0, 0, 0, 0),
+            insn(BPF_JMP | BPF_JEQ | BPF_K, R6, 0, 1, 0),
+            insn(BPF_ALU64 | BPF_MOV | BPF_K, R0, 0, 0, 1),
+            insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        };
+    }
+
+    int createMap(std::uint32_t type, std::uint32_t keySize, std::uint32_t valueSize, std::uint32_t maxEntries)
+    {
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.map_type = type;
+        attr.key_size = keySize;
+        attr.value_size = valueSize;
+        attr.max_entries = maxEntries;
+        return lib::bpf(BPF_MAP_CREATE, &attr, sizeof(attr));
+    }
+
+    std::uint64_t toAttrPointer(const void * pointer) { return reinterpret_cast<std::uintptr_t>(pointer); }
+}
+
+PerfSampleFilter::PerfSampleFilter() : mTidsMapFd(), mStatsMapFd(), mProgramFd(), mTids(), mLoggedMapFull(false)
+{
+}
+
+bool PerfSampleFilter::init()
+{
+    lib::AutoClosingFd tidsMapFd {createMap(BPF_MAP_TYPE_HASH, sizeof(std::uint32_t), sizeof(std::uint32_t), MAX_TIDS)};
+    if (!tidsMapFd) {
+        logg.logMessage("Unable to create the tids map (%d) %s", errno, strerror(errno));
+        return false;
+    }
+
+    lib::AutoClosingFd statsMapFd {
+        createMap(BPF_MAP_TYPE_ARRAY, sizeof(std::uint32_t), sizeof(std::uint64_t), NUMBER_OF_STATS)};
+    if (!statsMapFd) {
+        logg.logMessage("Unable to create the stats map (%d) %s", errno, strerror(errno));
+        return false;
+    }
+
+    const std::vector<struct bpf_insn> program = assembleProgram(*tidsMapFd, *statsMapFd);
+    static constexpr char LICENSE[] = "GPL";
+    char log[4096] = {0};
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_PERF_EVENT;
+    attr.insn_cnt = program.size();
+    attr.insns = toAttrPointer(program.data());
+    attr.license = toAttrPointer(LICENSE);
+    attr.log_level = 1;
+    attr.log_size = sizeof(log);
+    attr.log_buf = toAttrPointer(log);
+    lib::AutoClosingFd programFd {lib::bpf(BPF_PROG_LOAD, &attr, sizeof(attr))};
+    if (!programFd) {
+        logg.logMessage("Unable to load the sample filter (%d) %s\n%s", errno, strerror(errno), log);
+        return false;
+    }
+
+    mTidsMapFd = std::move(tidsMapFd);
+    mStatsMapFd = std::move(statsMapFd);
+    mProgramFd = std::move(programFd);
+
+    return true;
+}
+
+void PerfSampleFilter::attach(int perfFd)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    if (lib::ioctl(perfFd, PERF_EVENT_IOC_SET_BPF, *mProgramFd) != 0) {
+        // EINVAL for tracepoints
+        logg.logMessage("Unable to filter the samples of fd %d (%d) %s", perfFd, errno, strerror(errno));
+    }
+}
+
+void PerfSampleFilter::setTids(const std::set<int> & tids)
+{
+    if (!enabled()) {
+        return;
+    }
+
+    std::vector<int> removed;
+    std::set_difference(mTids.begin(), mTids.end(), tids.begin(), tids.end(), std::back_inserter(removed));
+    for (const int tid : removed) {
+        if (updateTid(tid, false)) {
+            mTids.erase(tid);
+        }
+    }
+
+    std::vector<int> added;
+    std::set_difference(tids.begin(), tids.end(), mTids.begin(), mTids.end(), std::back_inserter(added));
+    for (const int tid : added) {
+        if (updateTid(tid, true)) {
+            mTids.insert(tid);
+        }
+    }
+}
+
+bool PerfSampleFilter::updateTid(int tid, bool add)
+{
+    const std::uint32_t key = tid;
+    const std::uint32_t value = 1;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = *mTidsMapFd;
+    attr.key = toAttrPointer(&key);
+    if (add) {
+        attr.value = toAttrPointer(&value);
+        attr.flags = BPF_ANY;
+    }
+
+    if (lib::bpf(add ? BPF_MAP_UPDATE_ELEM : BPF_MAP_DELETE_ELEM, &attr, sizeof(attr)) != 0) {
+        if ((errno == E2BIG) && !mLoggedMapFull) {
+            logg.logWarning("More than %u threads are being profiled, the samples of some will be discarded",
+                            MAX_TIDS);
+            mLoggedMapFull = true;
+        }
+        else if (errno != E2BIG) {
+            logg.logMessage("Unable to update tid %d in the sample filter (%d) %s", tid, errno, strerror(errno));
+        }
+        return false;
+    }
+
+    return true;
+}
+
+std::uint64_t PerfSampleFilter::readStat(std::uint32_t index) const
+{
+    std::uint64_t value = 0;
+
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = *mStatsMapFd;
+    attr.key = toAttrPointer(&index);
+    attr.value = toAttrPointer(&value);
+    if (lib::bpf(BPF_MAP_LOOKUP_ELEM, &attr, sizeof(attr)) != 0) {
+        return 0;
+    }
+
+    return value;
+}
+
+void PerfSampleFilter::updateStats()
+{
+    if (!enabled()) {
+        return;
+    }
+
+    gGatordStats.mPerfFilterPassed.store(readStat(PASSED_INDEX), std::memory_order_relaxed);
+    gGatordStats.mPerfFilterDropped.store(readStat(DROPPED_INDEX), std::memory_order_relaxed);
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PERF_PERF_SAMPLE_FILTER_H
+#define INCLUDE_LINUX_PERF_PERF_SAMPLE_FILTER_H
+
+#include "lib/AutoClosingFd.h"
+
+#include <cstdint>
+#include <set>
+
+/**
+ * Drops the samples of processes that are not being profiled in the kernel, before they reach the perf rings,
+ * for system-wide captures that only care about some processes.
+ *
+ * A BPF overflow handler attached to each event looks the tgid of the current task up in a map of allowed tids and
+ * returns 0 to discard the sample if it is not there. Keying on the tgid means a new thread passes as soon as it
+ * exists, only a newly forked process is dropped until setTids is called with it. Tracepoint events cannot have an
+ * overflow handler so are never filtered.
+ *
+ * Requires Linux 4.9 or later and CAP_SYS_ADMIN, if init fails all samples are sent as before.
+ */
+class PerfSampleFilter {
+public:
+    PerfSampleFilter();
+
+    /**
+     * Create the maps and load the program
+     *
+     * @return False if the kernel does not support it
+     */
+    bool init();
+
+    bool enabled() const { return mProgramFd; }
+
+    /** Filter the samples of a perf event, does nothing if not enabled */
+    void attach(int perfFd);
+
+    /** Make the map contain exactly these tids */
+    void setTids(const std::set<int> & tids);
+
+    /** Copy the running totals into gGatordStats */
+    void updateStats();
+
+private:
+    lib::AutoClosingFd mTidsMapFd;
+    lib::AutoClosingFd mStatsMapFd;
+    lib::AutoClosingFd mProgramFd;
+    std::set<int> mTids;
+    bool mLoggedMapFull;
+
+    bool updateTid(int tid, bool add);
+    std::uint64_t readStat(std::uint32_t index) const;
+
+    // Intentionally unimplemented
+    PerfSampleFilter(const PerfSampleFilter &) = delete;
+    PerfSampleFilter & operator=(const PerfSampleFilter &) = delete;
+    PerfSampleFilter(PerfSampleFilter &&) = delete;
+    PerfSampleFilter & operator=(PerfSampleFilter &&) = delete;
+};
+
+#endif // INCLUDE_LINUX_PERF_PERF_SAMPLE_FILTER_H
@@ -0,0 +1,36 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfSamplingGovernor.h"
+
+#include <algorithm>
+
+constexpr int PerfSamplingGovernor::HIGH_WATER_PERCENT;
+constexpr int PerfSamplingGovernor::LOW_WATER_PERCENT;
+constexpr int PerfSamplingGovernor::QUIET_UPDATES;
+
+PerfSamplingGovernor::PerfSamplingGovernor(int maxScale) : mMaxScale(std::max(maxScale, 1)), mScale(1), mQuietUpdates(0)
+{
+}
+
+bool PerfSamplingGovernor::update(int fillPercent)
+{
+    if (fillPercent >= HIGH_WATER_PERCENT) {
+        mQuietUpdates = 0;
+        if (mScale < mMaxScale) {
+            mScale = std::min(mScale * 2, mMaxScale);
+            return true;
+        }
+    }
+    else if (fillPercent <= LOW_WATER_PERCENT) {
+        if ((++mQuietUpdates >= QUIET_UPDATES) && (mScale > 1)) {
+            mQuietUpdates = 0;
+            mScale = std::max(mScale / 2, 1);
+            return true;
+        }
+    }
+    else {
+        mQuietUpdates = 0;
+    }
+
+    return false;
+}
@@ -0,0 +1,34 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PERF_PERF_SAMPLING_GOVERNOR_H
+#define INCLUDE_LINUX_PERF_PERF_SAMPLING_GOVERNOR_H
+
+/**
+ * Decides how much to stretch the sample periods based on how full the perf rings were when they were drained.
+ *
+ * The scale doubles as soon as a ring is found more than HIGH_WATER_PERCENT full and halves again once the rings
+ * have stayed below LOW_WATER_PERCENT for QUIET_UPDATES consecutive updates. It never leaves [1, maxScale].
+ */
+class PerfSamplingGovernor {
+public:
+    static constexpr int HIGH_WATER_PERCENT = 75;
+    static constexpr int LOW_WATER_PERCENT = 10;
+    static constexpr int QUIET_UPDATES = 20;
+
+    PerfSamplingGovernor(int maxScale);
+
+    /**
+     * @param fillPercent The highest ring fill level seen since the last update
+     * @return true if the scale changed
+     */
+    bool update(int fillPercent);
+
+    int getScale() const { return mScale; }
+
+private:
+    int mMaxScale;
+    int mScale;
+    int mQuietUpdates;
+};
+
+#endif // INCLUDE_LINUX_PERF_PERF_SAMPLING_GOVERNOR_H
@@ -4,6 +4,7 @@
 
 #include "Child.h"
 #include "DynBuf.h"
+#include "GatordStats.h"
 #include "ICpuInfo.h"
 #include "Logging.h"
 #include "OlyUtility.h"
@@ -11,6 +12,7 @@
 #include "Protocol.h"
 #include "Sender.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
 #include "lib/FileDescriptor.h"
 #include "lib/Time.h"
 #include "linux/perf/PerfAttrsBuffer.h"
@@ -20,6 +22,7 @@
 #include "linux/proc/ProcessChildren.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cinttypes>
 #include <csignal>
 #include <cstring>
@@ -27,13 +30,20 @@
 #include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <thread>
 #include <unistd.h>
 #include <utility>
+#include <vector>
 
 #ifndef SCHED_RESET_ON_FORK
 #define SCHED_RESET_ON_FORK 0x40000000
 #endif
 
+// Opening the events is mostly waiting on the kernel, but there is little to gain from more threads than this
+static constexpr std::size_t MAX_ONLINE_WORKERS = 16;
+// No more often than UserSpaceSource reads the gatord counters, each update is two bpf syscalls
+static constexpr uint64_t SAMPLE_FILTER_STATS_INTERVAL = NS_PER_S / 10;
+
 static PerfBuffer::Config createPerfBufferConfig()
 {
     return {
@@ -44,6 +54,7 @@ static PerfBuffer::Config createPerfBufferConfig()
         static_cast<size_t>(gSessionData.mPerfMmapSizeInPages > 0
                                 ? gSessionData.mPageSize * gSessionData.mPerfMmapSizeInPages
                                 : gSessionData.mTotalBufferSize * 1024 * 1024 * 64),
+        gSessionData.mFlightRecorder,
     };
 }
 
@@ -57,6 +68,9 @@ PerfSource::PerfSource(PerfDriver & driver,
                        ICpuInfo & cpuInfo)
     : Source(child),
       mSummary(1024 * 1024, senderSem),
+      mSampleAggregator(),
+      mCallchainInterner(),
+      mUserStackUnwinder(),
       mCountersBuf(createPerfBufferConfig()),
       mCountersGroup(driver.getConfig(),
                      mCountersBuf.getDataBufferLength(),
@@ -71,7 +85,10 @@ PerfSource::PerfSource(PerfDriver & driver,
                      getTracepointId(SCHED_SWITCH)),
       mMonitor(),
       mUEvent(),
+      mCpuOnlineStates([this](unsigned cpu, bool online) { return handleCpuOnlineStateChange(cpu, online); }),
       mAppTids(std::move(appTids)),
+      mProcessTree(),
+      mSampleFilter(),
       mDriver(driver),
       mAttrsBuffer(),
       mProcBuffer(),
@@ -82,10 +99,84 @@ PerfSource::PerfSource(PerfDriver & driver,
       mFtraceDriver(ftraceDriver),
       mCpuInfo(cpuInfo),
       mSyncThreads(),
+      mSamplingGovernor(),
+      mAttrsMutex(),
+      mCounterReader(),
       enableOnCommandExec(false)
 {
     const PerfConfig & mConfig = mDriver.getConfig();
 
+    if (gSessionData.mSampleAggregationWindowMs > 0) {
+        // The aggregator finds the event from the sample id and compares the sample times against getTime()
+        if (mConfig.has_sample_identifier && mConfig.has_ioctl_read_id && mConfig.has_attr_clockid_support) {
+            mSampleAggregator.reset(new PerfSampleAggregator(gSessionData.mSampleAggregationWindowMs * NS_PER_MS));
+            mCountersBuf.setSampleAggregator(mSampleAggregator.get());
+            mCountersGroup.setSampleAggregator(mSampleAggregator.get());
+        }
+        else {
+            logg.logWarning("Sample aggregation requires Linux 4.1 or later, samples will be sent unaggregated");
+        }
+    }
+
+    if (gSessionData.mInternedCallchains > 0) {
+        // The interner finds the event from the sample id
+        if (mConfig.has_sample_identifier && mConfig.has_ioctl_read_id) {
+            mCallchainInterner.reset(new PerfCallchainInterner(gSessionData.mInternedCallchains));
+            mCountersBuf.setCallchainInterner(mCallchainInterner.get());
+            mCountersGroup.setCallchainInterner(mCallchainInterner.get());
+        }
+        else {
+            logg.logWarning("Callchain interning requires Linux 3.12 or later, callchains will be sent as they are");
+        }
+    }
+
+    if ((gSessionData.mUserStackSize > 0) && (gSessionData.mBacktraceDepth > 0)) {
+        // The unwinder finds the event from the sample id
+        if (!PerfUserStackUnwinder::isSupported()) {
+            logg.logWarning("gatord cannot unwind user stacks on this architecture, frame pointers will be used");
+        }
+        else if (mConfig.has_sample_identifier && mConfig.has_ioctl_read_id) {
+            mUserStackUnwinder.reset(
+                new PerfUserStackUnwinder(gSessionData.mUserStackSize, gSessionData.mBacktraceDepth));
+            mCountersBuf.setUserStackUnwinder(mUserStackUnwinder.get());
+            mCountersGroup.setUserStackUnwinder(mUserStackUnwinder.get());
+        }
+        else {
+            logg.logWarning("Unwinding user stacks requires Linux 3.12 or later, frame pointers will be used");
+        }
+    }
+
+    if (gSessionData.mFlightRecorder) {
+        if (!mConfig.has_write_backward) {
+            logg.logError("--flight-recorder requires Linux 4.7 or later");
+            handleException();
+        }
+        mCountersGroup.setWriteBackward(true);
+    }
+
+    if (gSessionData.mMultiplexCounters) {
+        // Each multiplexed group is sent by id, which the host can only map to keys with PERF_EVENT_IOC_ID
+        if (mConfig.has_ioctl_read_id) {
+            mCountersGroup.setMultiplexCounters(true, gSessionData.mMultiplexCounterLimit);
+        }
+        else {
+            logg.logWarning("Multiplexing counters requires Linux 3.12 or later, counters will not be multiplexed");
+        }
+    }
+
+    if (gSessionData.mUserspaceCounters) {
+        mCounterReader.reset(new PerfCounterReader(mConfig,
+                                                   cpuInfo.getClusters(),
+                                                   cpuInfo.getClusterIds(),
+                                                   gSessionData.mSampleRate,
+                                                   senderSem));
+        mCountersGroup.setCounterReader(mCounterReader.get());
+    }
+
+    if (gSessionData.mAdaptiveSamplingMaxScale > 1) {
+        mSamplingGovernor.reset(new PerfSamplingGovernor(gSessionData.mAdaptiveSamplingMaxScale));
+    }
+
     if ((!mConfig.is_system_wide) && (!mConfig.has_attr_clockid_support)) {
         logg.logMessage("Tracing gatord as well as target application as no clock_id support");
         mAppTids.insert(getpid());
@@ -119,6 +210,46 @@ bool PerfSource::prepare()
         logg.logMessage("uevent setup failed");
         return false;
     }
+    if (mUEvent.enabled()) {
+        // Needed to recover if any uevents are lost
+        mCpuOnlineStates.rescan(false);
+    }
+
+    // Must be before any events are opened so that it is attached to all of them
+    if (mConfig.is_system_wide && gSessionData.mKernelFilter) {
+        if (mAppTids.empty()) {
+            logg.logMessage("No processes to filter samples for");
+        }
+        else if (!mSampleFilter.init()) {
+            logg.logWarning("Kernel sample filtering requires Linux 4.9 or later and root, samples from all processes "
+                            "will be sent");
+        }
+    }
+
+    // Follow forks and exits so that the tids do not have to be reread from /proc as each CPU comes online
+    const bool trackProcesses = (!mConfig.is_system_wide) || mSampleFilter.enabled();
+    if (trackProcesses && mProcessTree.init(mAppTids) && !mMonitor.add(mProcessTree.getFd())) {
+        logg.logMessage("process tree setup failed");
+        return false;
+    }
+    if (trackProcesses && (!mProcessTree.enabled())) {
+        logg.logMessage("Unable to listen for process events, the process tree will be read from /proc");
+    }
+
+    if (mSampleFilter.enabled()) {
+        if (mProcessTree.enabled()) {
+            mSampleFilter.setTids(mProcessTree.getAllTids());
+        }
+        else {
+            // Processes forked later will have their samples dropped
+            std::set<int> tids;
+            for (const int pid : mAppTids) {
+                const std::set<int> childTids = lnx::getChildTids(pid);
+                tids.insert(childTids.begin(), childTids.end());
+            }
+            mSampleFilter.setTids(tids);
+        }
+    }
 
     if (mConfig.can_access_tracepoints && !mDriver.sendTracepointFormats(currTime, *mAttrsBuffer)) {
         logg.logMessage("could not send tracepoint formats");
@@ -130,25 +261,29 @@ bool PerfSource::prepare()
         return false;
     }
 
-    // online them later
+    // online them later, start enables every CPU's events in one pass
     const OnlineEnabledState onlineEnabledState =
         (enableOnCommandExec ? OnlineEnabledState::ENABLE_ON_EXEC : OnlineEnabledState::NOT_ENABLED);
+    const std::size_t numberOfCores = mCpuInfo.getNumberOfCores();
+    std::vector<std::pair<OnlineResult, std::string>> results(numberOfCores);
     int numOnlined = 0;
 
-    for (size_t cpu = 0; cpu < mCpuInfo.getNumberOfCores(); ++cpu) {
-        using Result = OnlineResult;
-        const std::pair<OnlineResult, std::string> result = mCountersGroup.onlineCPU(
+    const auto onlineCpu = [&](std::size_t cpu) {
+        results[cpu] = mCountersGroup.onlineCPU(
             currTime,
             cpu,
             mAppTids,
             onlineEnabledState,
             *mAttrsBuffer, //
-            [this](int fd) -> bool { return mMonitor.add(fd); },
+            [this](int fd) -> bool { return addToMonitor(fd); },
             [this](int fd, int cpu, bool hasAux) -> bool { return mCountersBuf.useFd(fd, cpu, hasAux); },
-            &lnx::getChildTids);
-        switch (result.first) {
+            [this](int pid) { return getChildTids(pid); });
+    };
+    const auto handleResult = [&](std::size_t cpu) {
+        using Result = OnlineResult;
+        switch (results[cpu].first) {
             case Result::FAILURE:
-                logg.logError("\n%s", result.second.c_str());
+                logg.logError("\n%s", results[cpu].second.c_str());
                 handleException();
                 break;
             case Result::SUCCESS:
@@ -159,14 +294,61 @@ bool PerfSource::prepare()
                 // why distinguish between FAILURE and OTHER_FAILURE?
                 break;
         }
+    };
+
+    const uint64_t onlineStart = getTime();
+
+    // The first CPU is onlined alone, so the others start from the exclusions it found were needed
+    if (numberOfCores > 0) {
+        onlineCpu(0);
+        handleResult(0);
     }
 
+    // Then the rest are shared between workers, as each perf_event_open and mmap can take a while
+    std::atomic<std::size_t> nextCpu {1};
+    const auto onlineWorker = [&]() {
+        for (std::size_t cpu = nextCpu++; cpu < numberOfCores; cpu = nextCpu++) {
+            onlineCpu(cpu);
+        }
+    };
+    const std::size_t numberOfWorkers =
+        std::min<std::size_t>({numberOfCores, std::max(1U, std::thread::hardware_concurrency()), MAX_ONLINE_WORKERS});
+    std::vector<std::thread> workers;
+    for (std::size_t worker = 1; worker < numberOfWorkers; ++worker) {
+        workers.push_back(thread_factory::create(ThreadRole::SOURCE, [&onlineWorker]() {
+            prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-online"), 0, 0, 0);
+            onlineWorker();
+        }));
+    }
+    onlineWorker();
+    for (std::thread & worker : workers) {
+        worker.join();
+    }
+
+    for (std::size_t cpu = 1; cpu < numberOfCores; ++cpu) {
+        handleResult(cpu);
+    }
+
+    const uint64_t onlineTimeNs = getTime() - onlineStart;
+    logg.logMessage("Onlined %i of %zu cores in %" PRIu64 " us using %zu threads",
+                    numOnlined,
+                    numberOfCores,
+                    onlineTimeNs / 1000,
+                    numberOfWorkers);
+
     if (numOnlined <= 0) {
         logg.logMessage("PerfGroups::onlineCPU failed on all cores");
     }
 
+    if (mSampleAggregator && (numOnlined > 0) && !mSampleAggregator->hasEvents()) {
+        logg.logWarning("None of the event based samples can be aggregated, they will be sent unaggregated");
+    }
+
     // Send the summary right before the start so that the monotonic delta is close to the start time
-    if (!mDriver.summary(mSummary, []() -> uint64_t { return (gSessionData.mMonotonicStarted = getTime()); })) {
+    if (!mDriver.summary(
+            mSummary,
+            []() -> uint64_t { return (gSessionData.mMonotonicStarted = getTime()); },
+            onlineTimeNs)) {
         logg.logError("PerfDriver::summary failed");
         handleException();
     }
@@ -182,14 +364,12 @@ struct ProcThreadArgs {
     std::atomic_bool mIsDone {false};
 };
 
-static void * procFunc(void * arg)
+static void procFunc(const ProcThreadArgs * args)
 {
-    const auto * const args = reinterpret_cast<const ProcThreadArgs *>(arg);
-
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-proc"), 0, 0, 0);
 
     // Gator runs at a high priority, reset the priority to the default
-    if (setpriority(PRIO_PROCESS, syscall(__NR_gettid), 0) == -1) {
+    if (!thread_factory::resetPriority(ThreadRole::HOUSEKEEPING)) {
         logg.logError("setpriority failed");
         handleException();
     }
@@ -204,8 +384,6 @@ static void * procFunc(void * arg)
         handleException();
     }
     args->mProcBuffer->commit(args->mCurrTime);
-
-    return nullptr;
 }
 
 static const char CPU_DEVPATH[] = "/devices/system/cpu/cpu";
@@ -213,7 +391,7 @@ static const char CPU_DEVPATH[] = "/devices/system/cpu/cpu";
 void PerfSource::run()
 {
     int pipefd[2];
-    pthread_t procThread;
+    std::thread procThread;
     ProcThreadArgs procThreadArgs;
 
     if (lib::pipe_cloexec(pipefd) != 0) {
@@ -262,43 +440,46 @@ void PerfSource::run()
         procThreadArgs.mProcBuffer = mProcBuffer.get();
         procThreadArgs.mCurrTime = currTime;
         procThreadArgs.mIsDone = false;
-        if (pthread_create(&procThread, nullptr, procFunc, &procThreadArgs) != 0) {
-            logg.logError("pthread_create failed");
-            handleException();
-        }
+        procThread =
+            thread_factory::create(ThreadRole::HOUSEKEEPING, [&procThreadArgs]() { procFunc(&procThreadArgs); });
     }
 
     // monitor online cores if no uevents
     std::unique_ptr<PerfCpuOnlineMonitor> onlineMonitorThread;
     if (!mUEvent.enabled()) {
-        onlineMonitorThread.reset(new PerfCpuOnlineMonitor([&](unsigned cpu, bool online) -> void {
-            logg.logMessage("CPU online state changed: %u -> %s", cpu, (online ? "online" : "offline"));
-            const uint64_t currTime = getTime() - gSessionData.mMonotonicStarted;
-            if (online) {
-                handleCpuOnline(currTime, cpu);
-            }
-            else {
-                handleCpuOffline(currTime, cpu);
-            }
-        }));
+        onlineMonitorThread.reset(new PerfCpuOnlineMonitor(
+            [this](unsigned cpu, bool online) { return handleCpuOnlineStateChange(cpu, online); }));
     }
 
     // start sync threads
     mSyncThreads = PerfSyncThreadBuffer::create(gSessionData.mMonotonicStarted,
                                                 this->mDriver.getConfig().has_attr_clockid_support,
                                                 this->mCountersGroup.hasSPE(),
+                                                gSessionData.mSingleSyncThread,
                                                 mSenderSem);
 
+    if (mCounterReader) {
+        mCounterReader->startThreads(gSessionData.mMonotonicStarted);
+    }
+
     // start profiling
     mProfilingStartedCallback();
 
     const uint64_t NO_RATE = ~0ULL;
     const uint64_t rate = gSessionData.mLiveRate > 0 && gSessionData.mSampleRate > 0 ? gSessionData.mLiveRate : NO_RATE;
     uint64_t nextTime = 0;
+    uint64_t nextStatsTime = 0;
     int timeout = rate != NO_RATE ? 0 : -1;
+    // The governor must also run when nothing is happening so that it can relax again,
+    // likewise the flight recorder trigger must be checked
+    const bool needsPolling = (mSamplingGovernor != nullptr) || (gSessionData.mFlightRecorderTrigger != nullptr);
+    const int pollTimeout = 100;
+    if (needsPolling && ((timeout < 0) || (timeout > pollTimeout))) {
+        timeout = pollTimeout;
+    }
     while (gSessionData.mSessionIsActive) {
-        // +1 for uevents, +1 for pipe
-        std::vector<struct epoll_event> events {mCpuInfo.getNumberOfCores() + 2};
+        // +1 for uevents, +1 for process events, +1 for pipe
+        std::vector<struct epoll_event> events {mCpuInfo.getNumberOfCores() + 3};
         int ready = mMonitor.wait(events.data(), events.size(), timeout);
         if (ready < 0) {
             logg.logError("Monitor::wait failed");
@@ -308,12 +489,36 @@ void PerfSource::run()
 
         for (int i = 0; i < ready; ++i) {
             if (events[i].data.fd == mUEvent.getFd()) {
-                if (!handleUEvent(currTime)) {
+                if (!handleUEvent()) {
                     logg.logError("PerfSource::handleUEvent failed");
                     handleException();
                 }
-                break;
             }
+            else if (mProcessTree.enabled() && (events[i].data.fd == mProcessTree.getFd())) {
+                bool tidsChanged;
+                if (!mProcessTree.handleEvents(tidsChanged)) {
+                    logg.logError("ProcessTreeTracker::handleEvents failed");
+                    handleException();
+                }
+                if (tidsChanged) {
+                    mSampleFilter.setTids(mProcessTree.getAllTids());
+                }
+            }
+        }
+
+        if (mSamplingGovernor) {
+            updateSamplingGovernor(currTime);
+        }
+
+        if (currTime >= nextStatsTime) {
+            mSampleFilter.updateStats();
+            nextStatsTime = currTime + SAMPLE_FILTER_STATS_INTERVAL;
+        }
+
+        if ((gSessionData.mFlightRecorderTrigger != nullptr) && gSessionData.mSessionIsActive &&
+            (access(gSessionData.mFlightRecorderTrigger, F_OK) == 0)) {
+            logg.logMessage("Flight recorder triggered by %s", gSessionData.mFlightRecorderTrigger);
+            mChild.endSession();
         }
 
         // send a notification that data is ready
@@ -334,23 +539,59 @@ void PerfSource::run()
             // + NS_PER_MS - 1 to ensure always rounding up
             timeout =
                 std::max<int>(0, (nextTime + NS_PER_MS - 1 - getTime() + gSessionData.mMonotonicStarted) / NS_PER_MS);
+            if (needsPolling) {
+                timeout = std::min(timeout, pollTimeout);
+            }
         }
     }
 
+    if (gSessionData.mFlightRecorder) {
+        // The PerfCpuOnlineMonitor thread is still running and must not write to mAttrsBuffer or the fd map meanwhile
+        std::lock_guard<std::mutex> lock {mAttrsMutex};
+
+        // Before anything else so that as little as possible of what led up to the end is overwritten
+        mCountersBuf.pauseOutput();
+
+        // The mmap and comm records of processes started during the capture may have been overwritten, so describe
+        // the processes as they are now. They are dated from the start so that all the kept samples can use them, and
+        // committed before the snapshot is released so they are sent ahead of it.
+        const uint64_t snapshotTime = getTime() - gSessionData.mMonotonicStarted;
+        readProcComms(procThreadArgs.mCurrTime, *mAttrsBuffer);
+        readProcMaps(procThreadArgs.mCurrTime, *mAttrsBuffer);
+        mAttrsBuffer->commit(snapshotTime);
+
+        mCountersBuf.snapshot();
+        logg.logMessage("Flight recorder snapshot taken after %" PRIu64 " ns",
+                        getTime() - gSessionData.mMonotonicStarted - snapshotTime);
+    }
+
+    if (mSampleFilter.enabled()) {
+        mSampleFilter.updateStats();
+        logg.logMessage("Kernel sample filter passed %" PRIu64 " samples and dropped %" PRIu64,
+                        gGatordStats.mPerfFilterPassed.load(std::memory_order_relaxed),
+                        gGatordStats.mPerfFilterDropped.load(std::memory_order_relaxed));
+    }
+
     if (onlineMonitorThread) {
         onlineMonitorThread->terminate();
     }
 
     procThreadArgs.mIsDone = true;
-    pthread_join(procThread, nullptr);
+    if (procThread.joinable()) {
+        procThread.join();
+    }
     mCountersGroup.stop();
+    if (mCounterReader) {
+        // After stopping so the last reads are the final counts
+        mCounterReader->stopThreads();
+    }
     mAttrsBuffer->setDone();
     mProcBuffer->setDone();
     mIsDone = true;
 
     // terminate all remaining sync threads
-    for (auto & ptr : mSyncThreads) {
-        ptr->terminate();
+    if (mSyncThreads) {
+        mSyncThreads->terminate();
     }
 
     // send a notification that data is ready
@@ -361,12 +602,19 @@ void PerfSource::run()
     close(pipefd[1]);
 }
 
-bool PerfSource::handleUEvent(const uint64_t currTime)
+bool PerfSource::handleUEvent()
 {
     UEventResult result;
-    if (!mUEvent.read(&result)) {
-        logg.logMessage("UEvent::Read failed");
-        return false;
+    switch (mUEvent.read(&result)) {
+        case UEvent::ReadResult::OK:
+            break;
+        case UEvent::ReadResult::LOST_EVENTS:
+            // Catch up from sysfs rather than waiting for the next hotplug
+            return mCpuOnlineStates.rescan(true);
+        case UEvent::ReadResult::FAILED:
+        default:
+            logg.logMessage("UEvent::Read failed");
+            return false;
     }
 
     if (strcmp(result.mSubsystem, "cpu") == 0) {
@@ -380,27 +628,53 @@ bool PerfSource::handleUEvent(const uint64_t currTime)
             return false;
         }
 
-        if (static_cast<size_t>(cpu) >= mCpuInfo.getNumberOfCores()) {
-            logg.logError("Only %zu cores are expected but core %i reports %s",
-                          mCpuInfo.getNumberOfCores(),
-                          cpu,
-                          result.mAction);
-            handleException();
-        }
-
         if (strcmp(result.mAction, "online") == 0) {
-            return handleCpuOnline(currTime, cpu);
+            return mCpuOnlineStates.update(cpu, true);
         }
         else if (strcmp(result.mAction, "offline") == 0) {
-            return handleCpuOffline(currTime, cpu);
+            return mCpuOnlineStates.update(cpu, false);
         }
     }
 
     return true;
 }
 
+bool PerfSource::handleCpuOnlineStateChange(unsigned cpu, bool online)
+{
+    if (cpu >= mCpuInfo.getNumberOfCores()) {
+        logg.logError("Only %zu cores are expected but core %u reports %s",
+                      mCpuInfo.getNumberOfCores(),
+                      cpu,
+                      (online ? "online" : "offline"));
+        handleException();
+    }
+
+    logg.logMessage("CPU online state changed: %u -> %s", cpu, (online ? "online" : "offline"));
+    const uint64_t currTime = getTime() - gSessionData.mMonotonicStarted;
+    if (online) {
+        return handleCpuOnline(currTime, cpu);
+    }
+    return handleCpuOffline(currTime, cpu);
+}
+
+bool PerfSource::addToMonitor(int fd)
+{
+    // Every event fd comes through here before it is enabled
+    mSampleFilter.attach(fd);
+    return mMonitor.add(fd);
+}
+
+std::set<int> PerfSource::getChildTids(int pid) const
+{
+    // May be called from the PerfCpuOnlineMonitor thread
+    return (mProcessTree.enabled() ? mProcessTree.getChildTids(pid) : lnx::getChildTids(pid));
+}
+
 bool PerfSource::handleCpuOnline(uint64_t currTime, unsigned cpu)
 {
+    // Held throughout so that the governor cannot change the scale between the new events being added and scaled
+    std::lock_guard<std::mutex> lock {mAttrsMutex};
+
     mAttrsBuffer->onlineCPU(currTime, cpu);
 
     bool ret;
@@ -410,12 +684,16 @@ bool PerfSource::handleCpuOnline(uint64_t currTime, unsigned cpu)
         mAppTids,
         OnlineEnabledState::ENABLE_NOW,
         *mAttrsBuffer, //
-        [this](int fd) -> bool { return mMonitor.add(fd); },
+        [this](int fd) -> bool { return addToMonitor(fd); },
         [this](int fd, int cpu, bool hasAux) -> bool { return mCountersBuf.useFd(fd, cpu, hasAux); },
-        &lnx::getChildTids);
+        [this](int pid) { return getChildTids(pid); });
 
     switch (result.first) {
         case OnlineResult::SUCCESS:
+            // The new events were opened with the configured period
+            if (mSamplingGovernor && (mSamplingGovernor->getScale() > 1)) {
+                mCountersGroup.setSamplePeriodScale(mSamplingGovernor->getScale());
+            }
             // This a bit fragile, we are assuming the driver will only write one counter per CPU
             // which is true at the time of writing (just the cpu freq)
             mAttrsBuffer->perfCounterHeader(currTime, 1);
@@ -439,8 +717,30 @@ bool PerfSource::handleCpuOnline(uint64_t currTime, unsigned cpu)
     return ret;
 }
 
+void PerfSource::updateSamplingGovernor(uint64_t currTime)
+{
+    std::lock_guard<std::mutex> lock {mAttrsMutex};
+
+    if (!mSamplingGovernor->update(mCountersBuf.takeMaxFillPercent())) {
+        return;
+    }
+
+    const int scale = mSamplingGovernor->getScale();
+    logg.logMessage("Sample periods are now %i times their configured value", scale);
+
+    if (!mCountersGroup.setSamplePeriodScale(scale)) {
+        logg.logMessage("Unable to change the period of some events");
+    }
+    gSessionData.mSamplePeriodScale = scale;
+
+    mAttrsBuffer->marshalSamplePeriodScale(currTime, scale);
+    mAttrsBuffer->commit(currTime);
+}
+
 bool PerfSource::handleCpuOffline(uint64_t currTime, unsigned cpu)
 {
+    std::lock_guard<std::mutex> lock {mAttrsMutex};
+
     const bool ret = mCountersGroup.offlineCPU(cpu, [this](int cpu) { mCountersBuf.discard(cpu); });
     mAttrsBuffer->offlineCPU(currTime, cpu);
     return ret;
@@ -460,10 +760,11 @@ void PerfSource::interrupt()
 
 bool PerfSource::isDone()
 {
-    for (const auto & syncThread : mSyncThreads) {
-        if (!syncThread->complete()) {
-            return false;
-        }
+    if (mSyncThreads && !mSyncThreads->complete()) {
+        return false;
+    }
+    if (mCounterReader && !mCounterReader->isDone()) {
+        return false;
     }
     return mAttrsBuffer->isDone() && mProcBuffer->isDone() &&
            mIsDone
@@ -491,9 +792,14 @@ void PerfSource::write(ISender & sender)
         logg.logError("PerfBuffer::send failed");
         handleException();
     }
-    for (auto & syncThread : mSyncThreads) {
-        if (!syncThread->complete()) {
-            syncThread->send(sender);
-        }
+    if (mSampleAggregator) {
+        // Once done, send the partial windows too
+        mSampleAggregator->send(sender, mIsDone ? UINT64_MAX : getTime());
+    }
+    if (mSyncThreads && !mSyncThreads->complete()) {
+        mSyncThreads->send(sender);
+    }
+    if (mCounterReader) {
+        mCounterReader->write(sender);
     }
 }
@@ -8,9 +8,18 @@
 #include "SummaryBuffer.h"
 #include "UEvent.h"
 #include "linux/perf/PerfBuffer.h"
+#include "linux/perf/PerfCallchainInterner.h"
+#include "linux/perf/PerfCounterReader.h"
+#include "linux/perf/PerfCpuOnlineMonitor.h"
 #include "linux/perf/PerfGroups.h"
+#include "linux/perf/PerfSampleAggregator.h"
+#include "linux/perf/PerfSampleFilter.h"
+#include "linux/perf/PerfSamplingGovernor.h"
+#include "linux/perf/PerfUserStackUnwinder.h"
+#include "linux/proc/ProcessTreeTracker.h"
 
 #include <functional>
+#include <mutex>
 #include <semaphore.h>
 #include <set>
 
@@ -39,16 +48,29 @@ public:
     virtual void write(ISender & sender) override;
 
 private:
-    bool handleUEvent(uint64_t currTime);
+    bool handleUEvent();
+    bool handleCpuOnlineStateChange(unsigned cpu, bool online);
     bool handleCpuOnline(uint64_t currTime, unsigned cpu);
     bool handleCpuOffline(uint64_t currTime, unsigned cpu);
+    void updateSamplingGovernor(uint64_t currTime);
+    std::set<int> getChildTids(int pid) const;
+    bool addToMonitor(int fd);
 
     SummaryBuffer mSummary;
+    std::unique_ptr<PerfSampleAggregator> mSampleAggregator;
+    std::unique_ptr<PerfCallchainInterner> mCallchainInterner;
+    std::unique_ptr<PerfUserStackUnwinder> mUserStackUnwinder;
     PerfBuffer mCountersBuf;
     PerfGroups mCountersGroup;
     Monitor mMonitor;
     UEvent mUEvent;
+    // only used with mUEvent, PerfCpuOnlineMonitor tracks the states otherwise
+    PerfCpuOnlineStates mCpuOnlineStates;
     std::set<int> mAppTids;
+    // only used when profiling an application or filtering samples, and if the proc connector is available
+    lnx::ProcessTreeTracker mProcessTree;
+    // only used for system-wide captures with --kernel-filter
+    PerfSampleFilter mSampleFilter;
     PerfDriver & mDriver;
     std::unique_ptr<PerfAttrsBuffer> mAttrsBuffer;
     std::unique_ptr<PerfAttrsBuffer> mProcBuffer;
@@ -58,7 +80,12 @@ private:
     bool mIsDone;
     FtraceDriver & mFtraceDriver;
     ICpuInfo & mCpuInfo;
-    std::vector<std::unique_ptr<PerfSyncThreadBuffer>> mSyncThreads;
+    std::unique_ptr<PerfSyncThreadBuffer> mSyncThreads;
+    std::unique_ptr<PerfSamplingGovernor> mSamplingGovernor;
+    // serialises the run thread and the PerfCpuOnlineMonitor thread, guards mAttrsBuffer and the sample period scale
+    std::mutex mAttrsMutex;
+    // only used with --userspace-counters
+    std::unique_ptr<PerfCounterReader> mCounterReader;
     bool enableOnCommandExec;
 
     // Intentionally undefined
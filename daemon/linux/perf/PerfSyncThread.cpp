@@ -3,8 +3,10 @@
 #include "linux/perf/PerfSyncThread.h"
 
 #include "Logging.h"
+#include "ThreadFactory.h"
 #include "lib/Assert.h"
 #include "lib/GenericTimer.h"
+#include "lib/GenericTimerClock.h"
 
 #include <cerrno>
 #include <csignal>
@@ -41,8 +43,6 @@ namespace {
     }
 }
 
-extern std::uint64_t getTime();
-
 #define NS_PER_S 1000000000ULL
 #define NS_TO_US 1000ULL
 #define NS_TO_SLEEP (NS_PER_S / 2)
@@ -62,7 +62,8 @@ PerfSyncThread::PerfSyncThread(unsigned cpu,
 {
     runtime_assert(enableSyncThreadMode || readTimer, "At least one of enableSyncThreadMode or readTimer are required");
 
-    thread = std::thread(launch, this);
+    // run pins the thread to its CPU itself, as it must not continue if that fails
+    thread = thread_factory::create(ThreadRole::PER_CPU_READER, [this]() { launch(this); });
 }
 
 PerfSyncThread::~PerfSyncThread()
@@ -157,8 +158,8 @@ void PerfSyncThread::run() noexcept
 
     // main loop (always executes at least once to ensure we always capture at least one sync point
     do {
-        // get current timestamp
-        const std::uint64_t syncTime = getTime();
+        // get current timestamp, from clock_gettime as this is what the generic timer clock is measured against
+        const std::uint64_t syncTime = lib::GenericTimerClock::readSyscallNs();
 
         // read CNTFREQ_EL0
         const std::uint64_t frequency = get_cntfreq_el0(readTimer);
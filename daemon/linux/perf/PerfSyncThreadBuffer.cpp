@@ -5,54 +5,141 @@
 #include "linux/perf/PerfSyncThreadBuffer.h"
 
 #include "BufferUtils.h"
+#include "GatordStats.h"
 #include "ISender.h"
+#include "Logging.h"
 #include "SessionData.h"
 
-std::vector<std::unique_ptr<PerfSyncThreadBuffer>> PerfSyncThreadBuffer::create(std::uint64_t monotonicRawBase,
-                                                                                bool supportsClockId,
-                                                                                bool hasSPEConfiguration,
-                                                                                sem_t & senderSem)
+#include <cinttypes>
+
+constexpr unsigned PerfSyncThreadBuffer::RecordRing::CAPACITY;
+
+// the largest a single record can be once packed
+static constexpr int MAX_RECORD_SIZE = (2 * buffer_utils::MAXSIZE_PACK32) + (3 * buffer_utils::MAXSIZE_PACK64);
+
+std::unique_ptr<PerfSyncThreadBuffer> PerfSyncThreadBuffer::create(std::uint64_t monotonicRawBase,
+                                                                   bool supportsClockId,
+                                                                   bool hasSPEConfiguration,
+                                                                   bool singleThread,
+                                                                   sem_t & senderSem)
 {
     // the number of cores to enable:
     // * If the user wanted to capture SPE data, then send thread for all of them as we need per-core VCNT data
     // * If the user did not select SPE, but the kernel does not support clock_id then just sync on core 0
     // * Otherwise no sync required
     const unsigned count = (hasSPEConfiguration ? std::thread::hardware_concurrency() : (supportsClockId ? 0 : 1));
+    if (count == 0) {
+        return nullptr;
+    }
+
+    const bool enableSyncThreadMode = !supportsClockId;
+    const bool readTimer = hasSPEConfiguration;
+    return std::unique_ptr<PerfSyncThreadBuffer>(new PerfSyncThreadBuffer(monotonicRawBase,
+                                                                          count,
+                                                                          singleThread || (count == 1),
+                                                                          enableSyncThreadMode,
+                                                                          readTimer,
+                                                                          senderSem));
+}
 
-    std::vector<std::unique_ptr<PerfSyncThreadBuffer>> result;
+PerfSyncThreadBuffer::RecordRing::RecordRing() : records(), head(0), tail(0)
+{
+}
 
-    // fill result
-    for (unsigned cpu = 0; cpu < count; ++cpu) {
-        const bool enableSyncThreadMode = (!supportsClockId) && (cpu == 0);
-        const bool readTimer = hasSPEConfiguration;
-        result.emplace_back(
-            new PerfSyncThreadBuffer(monotonicRawBase, cpu, enableSyncThreadMode, readTimer, senderSem));
+bool PerfSyncThreadBuffer::RecordRing::push(const Record & record)
+{
+    const unsigned currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead - tail.load(std::memory_order_acquire) >= CAPACITY) {
+        return false;
     }
 
-    return result;
+    records[currentHead % CAPACITY] = record;
+    head.store(currentHead + 1, std::memory_order_release);
+    return true;
+}
+
+bool PerfSyncThreadBuffer::RecordRing::pop(Record & record)
+{
+    const unsigned currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail == head.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    record = records[currentTail % CAPACITY];
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+}
+
+unsigned PerfSyncThreadBuffer::RecordRing::size() const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
 }
 
 PerfSyncThreadBuffer::PerfSyncThreadBuffer(std::uint64_t monotonicRawBase,
-                                           unsigned cpu,
+                                           unsigned numberOfCpus,
+                                           bool singleThread,
                                            bool enableSyncThreadMode,
                                            bool readTimer,
-                                           sem_t & readerSem)
+                                           sem_t & senderSem)
     : monotonicRawBase(monotonicRawBase),
-      buffer(cpu, FrameType::PERF_SYNC, 1024 * 1024, readerSem),
-      thread(cpu,
-             enableSyncThreadMode,
-             readTimer,
-             monotonicRawBase,
-             [this](unsigned c, pid_t p, pid_t t, std::uint64_t f, std::uint64_t cmr, std::uint64_t vcnt) {
-                 write(c, p, t, cmr, vcnt, f);
-             })
+      senderSem(senderSem),
+      bufferSem(),
+      // each frame carries its own core number
+      buffer(0, FrameType::UNKNOWN, 1024 * 1024, bufferSem),
+      rings(),
+      threads(),
+      terminated(false),
+      dropped(0)
+{
+    sem_init(&bufferSem, 0, 0);
+
+    for (unsigned cpu = 0; cpu < numberOfCpus; ++cpu) {
+        rings.emplace_back(new RecordRing());
+    }
+
+    const auto consumer = [this](unsigned c, pid_t p, pid_t t, std::uint64_t f, std::uint64_t cmr, std::uint64_t vcnt) {
+        write(c, p, t, cmr, vcnt, f);
+    };
+
+    if (singleThread) {
+        const auto allCpus = [numberOfCpus, consumer](unsigned /*unused*/,
+                                                      pid_t p,
+                                                      pid_t t,
+                                                      std::uint64_t f,
+                                                      std::uint64_t cmr,
+                                                      std::uint64_t vcnt) {
+            for (unsigned cpu = 0; cpu < numberOfCpus; ++cpu) {
+                consumer(cpu, p, t, f, cmr, vcnt);
+            }
+        };
+        // only the thread on CPU 0 does the 'gatord-sync' rename, so that is the one to keep
+        threads.emplace_back(new PerfSyncThread(0, enableSyncThreadMode, readTimer, monotonicRawBase, allCpus));
+    }
+    else {
+        for (unsigned cpu = 0; cpu < numberOfCpus; ++cpu) {
+            threads.emplace_back(
+                new PerfSyncThread(cpu, enableSyncThreadMode && (cpu == 0), readTimer, monotonicRawBase, consumer));
+        }
+    }
+}
+
+PerfSyncThreadBuffer::~PerfSyncThreadBuffer()
 {
+    // the threads never touch bufferSem, so they do not need to have stopped yet
+    sem_destroy(&bufferSem);
 }
 
 void PerfSyncThreadBuffer::terminate()
 {
-    thread.terminate();
-    buffer.setDone();
+    for (auto & thread : threads) {
+        thread->terminate();
+    }
+    terminated.store(true, std::memory_order_release);
+
+    const std::uint64_t droppedRecords = dropped.load(std::memory_order_relaxed);
+    if (droppedRecords > 0) {
+        logg.logMessage("%" PRIu64 " sync records were dropped as they were not sent in time", droppedRecords);
+    }
 }
 
 bool PerfSyncThreadBuffer::complete() const
@@ -60,39 +147,72 @@ bool PerfSyncThreadBuffer::complete() const
     return buffer.isDone();
 }
 
-void PerfSyncThreadBuffer::write(unsigned /*unused*/,
+void PerfSyncThreadBuffer::write(unsigned cpu,
                                  pid_t pid,
                                  pid_t tid,
                                  std::uint64_t monotonicRaw,
                                  std::uint64_t vcnt,
                                  std::uint64_t freq)
 {
-    if (buffer.isDone()) {
+    RecordRing & ring = *rings[cpu];
+    if (!ring.push({pid, tid, freq, monotonicRaw, vcnt})) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        GatordStats::add(gGatordStats.mPerfSyncDropped, 1);
         return;
     }
 
-    // make sure there is space for at least one more record
-    const int minBytesRequired =
-        ((1 * buffer_utils::MAXSIZE_PACK64) + (3 * buffer_utils::MAXSIZE_PACK32)) + (2 * buffer_utils::MAXSIZE_PACK64);
-
-    const auto currTime = monotonicRaw - monotonicRawBase;
-    // wait for write space
-    buffer.waitForSpace(minBytesRequired, currTime);
+    // in live mode the sender is woken often enough anyway, but otherwise it may not be until the rings fill up
+    if (ring.size() == RecordRing::CAPACITY / 2) {
+        sem_post(&senderSem);
+    }
+}
 
-    // write header
-    buffer.packInt(pid);
-    buffer.packInt(tid);
-    buffer.packInt64(freq);
+bool PerfSyncThreadBuffer::harvest()
+{
+    std::uint64_t currTime = 0;
+    bool result = true;
+
+    for (std::size_t cpu = 0; cpu < rings.size(); ++cpu) {
+        RecordRing & ring = *rings[cpu];
+        const unsigned count = ring.size();
+        if (count == 0) {
+            continue;
+        }
+        if (buffer.bytesAvailable() < static_cast<int>(buffer_utils::MAX_FRAME_HEADER_SIZE + count * MAX_RECORD_SIZE)) {
+            // leave the rest for the next call
+            result = false;
+            break;
+        }
+
+        const int frameStart = buffer.beginFrameOrMessage(FrameType::PERF_SYNC, cpu);
+        Record record;
+        for (unsigned i = 0; (i < count) && ring.pop(record); ++i) {
+            buffer.packInt(record.pid);
+            buffer.packInt(record.tid);
+            buffer.packInt64(record.freq);
+            buffer.packInt64(record.monotonicRaw);
+            buffer.packInt64(record.vcnt);
+            currTime = record.monotonicRaw - monotonicRawBase;
+        }
+        buffer.endFrame(currTime, false, frameStart);
+    }
 
-    // write record
-    buffer.packInt64(monotonicRaw);
-    buffer.packInt64(vcnt);
+    // the commits post bufferSem but there is nobody to take them
+    while (sem_trywait(&bufferSem) == 0) {
+    }
 
-    // commit data (always do this so that the record is pushed to the host in live mode in a timely fashion)
-    buffer.commit(currTime, true);
+    return result;
 }
 
 void PerfSyncThreadBuffer::send(ISender & sender)
 {
+    if (!buffer.isDone()) {
+        // read before harvesting so that no record written before terminate is left behind
+        const bool isTerminated = terminated.load(std::memory_order_acquire);
+        if (harvest() && isTerminated) {
+            buffer.setDone();
+        }
+    }
+
     buffer.write(sender);
 }
@@ -6,7 +6,9 @@
 #include "Buffer.h"
 #include "linux/perf/PerfSyncThread.h"
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <semaphore.h>
 #include <thread>
 #include <unistd.h>
@@ -14,6 +16,13 @@
 
 class ISender;
 
+/**
+ * Collects the records of the sync threads and sends them as PERF_SYNC frames.
+ *
+ * The sync threads only store each record in a per CPU ring, the sender thread then writes everything collected since
+ * its last call as one frame per CPU and commits them together. This keeps the sync threads, which run SCHED_FIFO,
+ * from contending on the buffer and waking the sender for every record.
+ */
 class PerfSyncThreadBuffer {
 public:
     /**
@@ -22,29 +31,37 @@ public:
      * @param monotonicRawBase The monotonic raw value that equates to monotonic delta 0
      * @param supportsClockId True if the kernel perf API supports configuring clock_id
      * @param hasSPEConfiguration True if the user selected at least one SPE configuration
-     * @return The list of buffer objects
+     * @param singleThread True to take the per CPU SPE sync records from one thread, only valid if CNTVCT_EL0 is
+     * synchronized across all CPUs
+     * @return The buffer object, or nullptr if no sync is required
      */
-    static std::vector<std::unique_ptr<PerfSyncThreadBuffer>> create(std::uint64_t monotonicRawBase,
-                                                                     bool supportsClockId,
-                                                                     bool hasSPEConfiguration,
-                                                                     sem_t & senderSem);
+    static std::unique_ptr<PerfSyncThreadBuffer> create(std::uint64_t monotonicRawBase,
+                                                        bool supportsClockId,
+                                                        bool hasSPEConfiguration,
+                                                        bool singleThread,
+                                                        sem_t & senderSem);
 
     /**
      * Constructor
      *
-     * @param cpu The number of the CPU the thread is affined to
+     * @param numberOfCpus The number of CPUs to send sync records for
+     * @param singleThread True to have one thread, on CPU 0, whose records are used for every CPU, otherwise there is
+     * a thread affined to each CPU
      * @param enableSyncThreadMode True to enable 'gatord-sync' thread mode
      * @param readTimer True to read the arch timer, false otherwise
-     * @param readerSem The buffer reader semaphore
+     * @param senderSem The sender semaphore
      */
     PerfSyncThreadBuffer(std::uint64_t monotonicRawBase,
-                         unsigned cpu,
+                         unsigned numberOfCpus,
+                         bool singleThread,
                          bool enableSyncThreadMode,
                          bool readTimer,
-                         sem_t & readerSem);
+                         sem_t & senderSem);
+
+    ~PerfSyncThreadBuffer();
 
     /**
-     * Stop thread
+     * Stop threads, the remaining records are written by the next call to send
      */
     void terminate();
 
@@ -54,17 +71,61 @@ public:
     bool complete() const;
 
     /**
-     * Write buffer to sender
+     * Write the records collected since the last call, then the buffer to sender.
+     * Must only be called from the sender thread.
+     *
      * @param sender
      */
     void send(ISender & sender);
 
 private:
+    struct Record {
+        pid_t pid;
+        pid_t tid;
+        std::uint64_t freq;
+        std::uint64_t monotonicRaw;
+        std::uint64_t vcnt;
+    };
+
+    /** Single producer (the sync thread) single consumer (the sender thread) ring of records for one CPU */
+    class RecordRing {
+    public:
+        // At a record every 0.5s this holds 8s worth
+        static constexpr unsigned CAPACITY = 16;
+
+        RecordRing();
+
+        /** @return False if full */
+        bool push(const Record & record);
+        bool pop(Record & record);
+        unsigned size() const;
+
+    private:
+        Record records[CAPACITY];
+        std::atomic<unsigned> head;
+        std::atomic<unsigned> tail;
+    };
+
+    void write(unsigned cpu, pid_t pid, pid_t tid, std::uint64_t monotonicRaw, std::uint64_t vcnt, std::uint64_t freq);
+    /** @return False if there was not enough space for everything */
+    bool harvest();
+
     std::uint64_t monotonicRawBase;
+    sem_t & senderSem;
+    // nothing waits on this as the buffer is always written out straight after send fills it
+    sem_t bufferSem;
     Buffer buffer;
-    PerfSyncThread thread;
+    std::vector<std::unique_ptr<RecordRing>> rings;
+    // after rings so the threads are stopped first
+    std::vector<std::unique_ptr<PerfSyncThread>> threads;
+    std::atomic_bool terminated;
+    std::atomic<std::uint64_t> dropped;
 
-    void write(unsigned cpu, pid_t pid, pid_t tid, std::uint64_t monotonicRaw, std::uint64_t vcnt, std::uint64_t freq);
+    // Intentionally unimplemented
+    PerfSyncThreadBuffer(const PerfSyncThreadBuffer &) = delete;
+    PerfSyncThreadBuffer & operator=(const PerfSyncThreadBuffer &) = delete;
+    PerfSyncThreadBuffer(PerfSyncThreadBuffer &&) = delete;
+    PerfSyncThreadBuffer & operator=(PerfSyncThreadBuffer &&) = delete;
 };
 
 #endif /* INCLUDE_LINUX_PERF_PERFSYNCTHREADBUFFER_H */
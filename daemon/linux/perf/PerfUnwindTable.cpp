@@ -0,0 +1,1242 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfUnwindTable.h"
+
+#include "lib/AutoClosingFd.h"
+#include "lib/Syscall.h"
+
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    constexpr std::uint32_t SEGMENT_GNU_EH_FRAME = 0x6474e550;
+    constexpr std::uint32_t SEGMENT_ARM_EXIDX = 0x70000001;
+
+    // The DW_EH_PE pointer encodings, the low nibble is the format and the next three bits what it is relative to
+    constexpr std::uint8_t EH_PE_ABSPTR = 0x00;
+    constexpr std::uint8_t EH_PE_ULEB128 = 0x01;
+    constexpr std::uint8_t EH_PE_UDATA2 = 0x02;
+    constexpr std::uint8_t EH_PE_UDATA4 = 0x03;
+    constexpr std::uint8_t EH_PE_UDATA8 = 0x04;
+    constexpr std::uint8_t EH_PE_SLEB128 = 0x09;
+    constexpr std::uint8_t EH_PE_SDATA2 = 0x0a;
+    constexpr std::uint8_t EH_PE_SDATA4 = 0x0b;
+    constexpr std::uint8_t EH_PE_SDATA8 = 0x0c;
+    constexpr std::uint8_t EH_PE_PCREL = 0x10;
+    constexpr std::uint8_t EH_PE_DATAREL = 0x30;
+    constexpr std::uint8_t EH_PE_OMIT = 0xff;
+
+    // DW_CFA instructions
+    constexpr std::uint8_t CFA_ADVANCE_LOC = 0x40;
+    constexpr std::uint8_t CFA_OFFSET = 0x80;
+    constexpr std::uint8_t CFA_RESTORE = 0xc0;
+    constexpr std::uint8_t CFA_NOP = 0x00;
+    constexpr std::uint8_t CFA_SET_LOC = 0x01;
+    constexpr std::uint8_t CFA_ADVANCE_LOC1 = 0x02;
+    constexpr std::uint8_t CFA_ADVANCE_LOC2 = 0x03;
+    constexpr std::uint8_t CFA_ADVANCE_LOC4 = 0x04;
+    constexpr std::uint8_t CFA_OFFSET_EXTENDED = 0x05;
+    constexpr std::uint8_t CFA_RESTORE_EXTENDED = 0x06;
+    constexpr std::uint8_t CFA_UNDEFINED = 0x07;
+    constexpr std::uint8_t CFA_SAME_VALUE = 0x08;
+    constexpr std::uint8_t CFA_REGISTER = 0x09;
+    constexpr std::uint8_t CFA_REMEMBER_STATE = 0x0a;
+    constexpr std::uint8_t CFA_RESTORE_STATE = 0x0b;
+    constexpr std::uint8_t CFA_DEF_CFA = 0x0c;
+    constexpr std::uint8_t CFA_DEF_CFA_REGISTER = 0x0d;
+    constexpr std::uint8_t CFA_DEF_CFA_OFFSET = 0x0e;
+    constexpr std::uint8_t CFA_DEF_CFA_EXPRESSION = 0x0f;
+    constexpr std::uint8_t CFA_EXPRESSION = 0x10;
+    constexpr std::uint8_t CFA_OFFSET_EXTENDED_SF = 0x11;
+    constexpr std::uint8_t CFA_DEF_CFA_SF = 0x12;
+    constexpr std::uint8_t CFA_DEF_CFA_OFFSET_SF = 0x13;
+    constexpr std::uint8_t CFA_VAL_OFFSET = 0x14;
+    constexpr std::uint8_t CFA_VAL_OFFSET_SF = 0x15;
+    constexpr std::uint8_t CFA_VAL_EXPRESSION = 0x16;
+    constexpr std::uint8_t CFA_AARCH64_NEGATE_RA_STATE = 0x2d;
+    constexpr std::uint8_t CFA_GNU_ARGS_SIZE = 0x2e;
+    constexpr std::uint8_t CFA_GNU_NEGATIVE_OFFSET_EXTENDED = 0x2f;
+
+    /// DW_CFA_remember_state nesting that is followed, compilers use one or two
+    constexpr int MAX_REMEMBERED_STATES = 8;
+
+    /// the pointer authentication code of a signed return address is in the bits above a 48-bit user address
+    constexpr std::uint64_t AARCH64_PAC_MASK = 0x0000ffffffffffffULL;
+
+    constexpr std::uint32_t EXIDX_CANTUNWIND = 1;
+    /// the personality routines' opcodes are at most the 3 bytes in the first word and 255 more words
+    constexpr std::size_t MAX_EXIDX_OPCODES = 3 + (255 * 4);
+
+    struct ProgramHeader {
+        std::uint32_t type;
+        std::uint64_t offset;
+        std::uint64_t address;
+        std::uint64_t fileSize;
+        std::uint64_t memorySize;
+    };
+
+    template<typename Ehdr, typename Phdr>
+    bool readProgramHeaders(const char * data, std::size_t size, std::vector<ProgramHeader> & headers)
+    {
+        Ehdr ehdr;
+        if (size < sizeof(ehdr)) {
+            return false;
+        }
+        memcpy(&ehdr, data, sizeof(ehdr));
+        if ((ehdr.e_phentsize != sizeof(Phdr)) || (ehdr.e_phoff > size) ||
+            ((size - ehdr.e_phoff) / sizeof(Phdr) < ehdr.e_phnum)) {
+            return false;
+        }
+
+        for (unsigned index = 0; index < ehdr.e_phnum; ++index) {
+            Phdr phdr;
+            memcpy(&phdr, data + ehdr.e_phoff + (index * sizeof(phdr)), sizeof(phdr));
+            headers.push_back(ProgramHeader {phdr.p_type, phdr.p_offset, phdr.p_vaddr, phdr.p_filesz, phdr.p_memsz});
+        }
+        return true;
+    }
+}
+
+bool UnwindStack::read(std::uint64_t address, std::size_t length, std::uint64_t & value) const
+{
+    if ((address < start) || (address - start > size) || (size - (address - start) < length) ||
+        (length > sizeof(value))) {
+        return false;
+    }
+    // every supported architecture is little endian
+    value = 0;
+    memcpy(&value, data + (address - start), length);
+    return true;
+}
+
+struct PerfUnwindTable::Cie {
+    std::uint64_t codeAlignment;
+    std::int64_t dataAlignment;
+    std::uint64_t returnAddressRegister;
+    std::uint8_t fdeEncoding;
+    bool hasAugmentationData;
+    std::uint64_t instructions;
+    std::uint64_t end;
+};
+
+struct PerfUnwindTable::CfiState {
+    enum class Rule : std::uint8_t { SAME_VALUE, UNDEFINED, OFFSET, VAL_OFFSET, REGISTER, EXPRESSION };
+
+    struct Register {
+        Rule rule;
+        std::int64_t value;
+    };
+
+    std::uint64_t cfaRegister = 0;
+    std::int64_t cfaOffset = 0;
+    bool cfaIsExpression = false;
+    bool returnAddressSigned = false;
+    Register registers[UnwindRegisters::NUMBER_OF_REGISTERS] = {};
+
+    void set(std::uint64_t reg, Rule rule, std::int64_t value)
+    {
+        // Other registers, such as the vector registers, are not needed to find the callers
+        if (reg < UnwindRegisters::NUMBER_OF_REGISTERS) {
+            registers[reg] = Register {rule, value};
+        }
+    }
+};
+
+std::unique_ptr<PerfUnwindTable> PerfUnwindTable::load(const char * path)
+{
+    lib::AutoClosingFd fd {lib::open(path, O_RDONLY | O_CLOEXEC)};
+    if (!fd) {
+        return nullptr;
+    }
+
+    struct stat fileStat;
+    if ((fstat(*fd, &fileStat) != 0) || (fileStat.st_size < EI_NIDENT)) {
+        return nullptr;
+    }
+    const std::size_t size = fileStat.st_size;
+    void * const mapping = lib::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    const auto * const ident = static_cast<const unsigned char *>(mapping);
+    const bool isElf = (memcmp(ident, ELFMAG, SELFMAG) == 0) && (ident[EI_DATA] == ELFDATA2LSB) &&
+                       ((ident[EI_CLASS] == ELFCLASS32) || (ident[EI_CLASS] == ELFCLASS64)) &&
+                       (size >= sizeof(Elf32_Ehdr));
+    if (!isElf) {
+        lib::munmap(mapping, size);
+        return nullptr;
+    }
+
+    // e_machine is at the same offset in both classes
+    const bool is64Bit = (ident[EI_CLASS] == ELFCLASS64);
+    Elf32_Half machine;
+    memcpy(&machine, ident + offsetof(Elf32_Ehdr, e_machine), sizeof(machine));
+
+    UnwindArch arch;
+    if (is64Bit && (machine == EM_X86_64)) {
+        arch = UnwindArch::X86_64;
+    }
+    else if (is64Bit && (machine == EM_AARCH64)) {
+        arch = UnwindArch::AARCH64;
+    }
+    else if (!is64Bit && (machine == EM_ARM)) {
+        arch = UnwindArch::ARM;
+    }
+    else {
+        lib::munmap(mapping, size);
+        return nullptr;
+    }
+
+    std::unique_ptr<PerfUnwindTable> table {
+        new PerfUnwindTable(static_cast<const char *>(mapping), size, arch, is64Bit)};
+    if (!table->parseProgramHeaders()) {
+        return nullptr;
+    }
+    return table;
+}
+
+PerfUnwindTable::PerfUnwindTable(const char * data, std::size_t size, UnwindArch arch, bool is64Bit)
+    : mData(data),
+      mSize(size),
+      mArch(arch),
+      mIs64Bit(is64Bit),
+      mSegments(),
+      mEhFrameHdr(0),
+      mExidx(0),
+      mExidxSize(0)
+{
+}
+
+PerfUnwindTable::~PerfUnwindTable()
+{
+    lib::munmap(const_cast<char *>(mData), mSize);
+}
+
+bool PerfUnwindTable::parseProgramHeaders()
+{
+    std::vector<ProgramHeader> headers;
+    const bool read = (mIs64Bit ? readProgramHeaders<Elf64_Ehdr, Elf64_Phdr>(mData, mSize, headers)
+                                : readProgramHeaders<Elf32_Ehdr, Elf32_Phdr>(mData, mSize, headers));
+    if (!read) {
+        return false;
+    }
+
+    for (const ProgramHeader & header : headers) {
+        switch (header.type) {
+            case PT_LOAD:
+                if ((header.offset <= mSize) && (header.fileSize <= mSize - header.offset)) {
+                    mSegments.push_back(Segment {header.address, header.offset, header.fileSize});
+                }
+                break;
+            case SEGMENT_GNU_EH_FRAME:
+                mEhFrameHdr = header.address;
+                break;
+            case SEGMENT_ARM_EXIDX:
+                mExidx = header.address;
+                mExidxSize = header.memorySize;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return !mSegments.empty() && ((mEhFrameHdr != 0) || (mExidx != 0));
+}
+
+bool PerfUnwindTable::fileOffsetToAddress(std::uint64_t offset, std::uint64_t & address) const
+{
+    for (const Segment & segment : mSegments) {
+        if ((offset >= segment.offset) && (offset - segment.offset < segment.fileSize)) {
+            address = offset - segment.offset + segment.address;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PerfUnwindTable::read(std::uint64_t address, void * out, std::size_t length) const
+{
+    for (const Segment & segment : mSegments) {
+        if ((address >= segment.address) && (address - segment.address <= segment.fileSize) &&
+            (segment.fileSize - (address - segment.address) >= length)) {
+            memcpy(out, mData + segment.offset + (address - segment.address), length);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PerfUnwindTable::readU8(std::uint64_t & address, std::uint8_t & value) const
+{
+    if (!read(address, &value, sizeof(value))) {
+        return false;
+    }
+    address += sizeof(value);
+    return true;
+}
+
+bool PerfUnwindTable::readU16(std::uint64_t & address, std::uint16_t & value) const
+{
+    if (!read(address, &value, sizeof(value))) {
+        return false;
+    }
+    address += sizeof(value);
+    return true;
+}
+
+bool PerfUnwindTable::readU32(std::uint64_t & address, std::uint32_t & value) const
+{
+    if (!read(address, &value, sizeof(value))) {
+        return false;
+    }
+    address += sizeof(value);
+    return true;
+}
+
+bool PerfUnwindTable::readU64(std::uint64_t & address, std::uint64_t & value) const
+{
+    if (!read(address, &value, sizeof(value))) {
+        return false;
+    }
+    address += sizeof(value);
+    return true;
+}
+
+bool PerfUnwindTable::readUleb128(std::uint64_t & address, std::uint64_t & value) const
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        std::uint8_t byte;
+        if (!readU8(address, byte)) {
+            return false;
+        }
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PerfUnwindTable::readSleb128(std::uint64_t & address, std::int64_t & value) const
+{
+    std::uint64_t result = 0;
+    for (unsigned shift = 0; shift < 64;) {
+        std::uint8_t byte;
+        if (!readU8(address, byte)) {
+            return false;
+        }
+        result |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            if ((shift < 64) && ((byte & 0x40) != 0)) {
+                result |= ~static_cast<std::uint64_t>(0) << shift;
+            }
+            value = static_cast<std::int64_t>(result);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * DW_EH_PE_indirect is not followed as it is only used for the personality routine, whose value is not needed
+ */
+bool PerfUnwindTable::readEncoded(std::uint64_t & address,
+                                  std::uint8_t encoding,
+                                  std::uint64_t dataBase,
+                                  std::uint64_t & value) const
+{
+    if (encoding == EH_PE_OMIT) {
+        return false;
+    }
+
+    const std::uint64_t fieldAddress = address;
+    std::uint64_t raw;
+    switch (encoding & 0x0f) {
+        case EH_PE_ABSPTR:
+            if (mIs64Bit) {
+                if (!readU64(address, raw)) {
+                    return false;
+                }
+            }
+            else {
+                std::uint32_t word;
+                if (!readU32(address, word)) {
+                    return false;
+                }
+                raw = word;
+            }
+            break;
+        case EH_PE_ULEB128:
+            if (!readUleb128(address, raw)) {
+                return false;
+            }
+            break;
+        case EH_PE_UDATA2:
+        case EH_PE_SDATA2: {
+            std::uint16_t half;
+            if (!readU16(address, half)) {
+                return false;
+            }
+            raw = ((encoding & 0x0f) == EH_PE_SDATA2 ? static_cast<std::uint64_t>(static_cast<std::int16_t>(half))
+                                                     : half);
+            break;
+        }
+        case EH_PE_UDATA4:
+        case EH_PE_SDATA4: {
+            std::uint32_t word;
+            if (!readU32(address, word)) {
+                return false;
+            }
+            raw = ((encoding & 0x0f) == EH_PE_SDATA4 ? static_cast<std::uint64_t>(static_cast<std::int32_t>(word))
+                                                     : word);
+            break;
+        }
+        case EH_PE_UDATA8:
+        case EH_PE_SDATA8:
+            if (!readU64(address, raw)) {
+                return false;
+            }
+            break;
+        case EH_PE_SLEB128: {
+            std::int64_t signedValue;
+            if (!readSleb128(address, signedValue)) {
+                return false;
+            }
+            raw = static_cast<std::uint64_t>(signedValue);
+            break;
+        }
+        default:
+            return false;
+    }
+
+    switch (encoding & 0x70) {
+        case 0:
+            break;
+        case EH_PE_PCREL:
+            raw += fieldAddress;
+            break;
+        case EH_PE_DATAREL:
+            if (dataBase == 0) {
+                return false;
+            }
+            raw += dataBase;
+            break;
+        default:
+            return false;
+    }
+
+    value = (mIs64Bit ? raw : (raw & 0xffffffff));
+    return true;
+}
+
+bool PerfUnwindTable::findFde(std::uint64_t address, std::uint64_t & fde) const
+{
+    if (mEhFrameHdr == 0) {
+        return false;
+    }
+
+    // version, eh_frame_ptr encoding, fde_count encoding, table encoding, eh_frame_ptr, fde_count, table
+    std::uint64_t cursor = mEhFrameHdr;
+    std::uint8_t version;
+    std::uint8_t ehFramePtrEncoding;
+    std::uint8_t fdeCountEncoding;
+    std::uint8_t tableEncoding;
+    std::uint64_t ehFrame;
+    std::uint64_t fdeCount;
+    if (!readU8(cursor, version) || (version != 1) || !readU8(cursor, ehFramePtrEncoding) ||
+        !readU8(cursor, fdeCountEncoding) || !readU8(cursor, tableEncoding) ||
+        !readEncoded(cursor, ehFramePtrEncoding, mEhFrameHdr, ehFrame) ||
+        !readEncoded(cursor, fdeCountEncoding, mEhFrameHdr, fdeCount)) {
+        return false;
+    }
+    // Only a table of fixed size entries can be searched, which is what the linkers write
+    if (tableEncoding != (EH_PE_DATAREL | EH_PE_SDATA4)) {
+        return false;
+    }
+
+    const auto entryStart = [this, cursor](std::uint64_t index, std::int32_t & start) -> bool {
+        return read(cursor + (index * 8), &start, sizeof(start));
+    };
+
+    // Find the last entry that starts at or before the address
+    std::uint64_t low = 0;
+    std::uint64_t high = fdeCount;
+    while (low < high) {
+        const std::uint64_t middle = low + ((high - low) / 2);
+        std::int32_t start;
+        if (!entryStart(middle, start)) {
+            return false;
+        }
+        if (mEhFrameHdr + static_cast<std::int64_t>(start) <= address) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    if (low == 0) {
+        return false;
+    }
+
+    std::int32_t fdeOffset;
+    if (!read(cursor + ((low - 1) * 8) + 4, &fdeOffset, sizeof(fdeOffset))) {
+        return false;
+    }
+    fde = mEhFrameHdr + static_cast<std::int64_t>(fdeOffset);
+    return true;
+}
+
+bool PerfUnwindTable::parseCie(std::uint64_t cieAddress, Cie & cie) const
+{
+    std::uint64_t cursor = cieAddress;
+    std::uint32_t length;
+    if (!readU32(cursor, length) || (length == 0)) {
+        return false;
+    }
+    std::uint64_t id;
+    if (length == 0xffffffff) {
+        std::uint64_t extendedLength;
+        if (!readU64(cursor, extendedLength)) {
+            return false;
+        }
+        cie.end = cursor + extendedLength;
+        if (!readU64(cursor, id)) {
+            return false;
+        }
+    }
+    else {
+        cie.end = cursor + length;
+        std::uint32_t shortId;
+        if (!readU32(cursor, shortId)) {
+            return false;
+        }
+        id = shortId;
+    }
+
+    std::uint8_t version;
+    if ((id != 0) || !readU8(cursor, version) || ((version != 1) && (version != 3) && (version != 4))) {
+        return false;
+    }
+
+    char augmentation[8];
+    std::size_t augmentationLength = 0;
+    for (;;) {
+        std::uint8_t character;
+        if (!readU8(cursor, character) || (augmentationLength == sizeof(augmentation))) {
+            return false;
+        }
+        augmentation[augmentationLength++] = static_cast<char>(character);
+        if (character == 0) {
+            break;
+        }
+    }
+    if ((augmentation[0] != 0) && (augmentation[0] != 'z')) {
+        return false;
+    }
+
+    if (version == 4) {
+        // address_size and segment_selector_size
+        std::uint8_t ignored;
+        if (!readU8(cursor, ignored) || !readU8(cursor, ignored)) {
+            return false;
+        }
+    }
+
+    if (!readUleb128(cursor, cie.codeAlignment) || !readSleb128(cursor, cie.dataAlignment)) {
+        return false;
+    }
+    if (version == 1) {
+        std::uint8_t returnAddressRegister;
+        if (!readU8(cursor, returnAddressRegister)) {
+            return false;
+        }
+        cie.returnAddressRegister = returnAddressRegister;
+    }
+    else if (!readUleb128(cursor, cie.returnAddressRegister)) {
+        return false;
+    }
+
+    cie.fdeEncoding = EH_PE_ABSPTR;
+    cie.hasAugmentationData = (augmentation[0] == 'z');
+    if (cie.hasAugmentationData) {
+        std::uint64_t dataLength;
+        if (!readUleb128(cursor, dataLength)) {
+            return false;
+        }
+        const std::uint64_t dataEnd = cursor + dataLength;
+        for (const char * character = augmentation + 1; *character != 0; ++character) {
+            std::uint8_t encoding;
+            std::uint64_t ignored;
+            if (*character == 'R') {
+                if (!readU8(cursor, cie.fdeEncoding)) {
+                    return false;
+                }
+            }
+            else if (*character == 'P') {
+                if (!readU8(cursor, encoding) || !readEncoded(cursor, encoding, 0, ignored)) {
+                    return false;
+                }
+            }
+            else if (*character == 'L') {
+                if (!readU8(cursor, encoding)) {
+                    return false;
+                }
+            }
+            else if ((*character != 'S') && (*character != 'B') && (*character != 'G')) {
+                // The length says where the data ends, so anything unknown can be skipped
+                break;
+            }
+        }
+        cursor = dataEnd;
+    }
+
+    cie.instructions = cursor;
+    return cursor <= cie.end;
+}
+
+bool PerfUnwindTable::runCfi(const Cie & cie,
+                             std::uint64_t instructions,
+                             std::uint64_t end,
+                             std::uint64_t location,
+                             std::uint64_t address,
+                             const CfiState & initial,
+                             CfiState & state) const
+{
+    using Rule = CfiState::Rule;
+
+    CfiState remembered[MAX_REMEMBERED_STATES];
+    int numberRemembered = 0;
+
+    const auto advance = [&location, &cie, address](std::uint64_t delta) -> bool {
+        location += delta * cie.codeAlignment;
+        return location <= address;
+    };
+
+    std::uint64_t cursor = instructions;
+    while (cursor < end) {
+        std::uint8_t opcode;
+        if (!readU8(cursor, opcode)) {
+            return false;
+        }
+
+        std::uint64_t reg;
+        std::uint64_t operand;
+        std::int64_t signedOperand;
+
+        switch (opcode & 0xc0) {
+            case CFA_ADVANCE_LOC:
+                if (!advance(opcode & 0x3f)) {
+                    return true;
+                }
+                continue;
+            case CFA_OFFSET:
+                if (!readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.set(opcode & 0x3f, Rule::OFFSET, static_cast<std::int64_t>(operand) * cie.dataAlignment);
+                continue;
+            case CFA_RESTORE:
+                reg = opcode & 0x3f;
+                if (reg < UnwindRegisters::NUMBER_OF_REGISTERS) {
+                    state.registers[reg] = initial.registers[reg];
+                }
+                continue;
+            default:
+                break;
+        }
+
+        switch (opcode) {
+            case CFA_NOP:
+                break;
+            case CFA_SET_LOC:
+                if (!readEncoded(cursor, cie.fdeEncoding, 0, operand)) {
+                    return false;
+                }
+                if (operand > address) {
+                    return true;
+                }
+                location = operand;
+                break;
+            case CFA_ADVANCE_LOC1: {
+                std::uint8_t delta;
+                if (!readU8(cursor, delta)) {
+                    return false;
+                }
+                if (!advance(delta)) {
+                    return true;
+                }
+                break;
+            }
+            case CFA_ADVANCE_LOC2: {
+                std::uint16_t delta;
+                if (!readU16(cursor, delta)) {
+                    return false;
+                }
+                if (!advance(delta)) {
+                    return true;
+                }
+                break;
+            }
+            case CFA_ADVANCE_LOC4: {
+                std::uint32_t delta;
+                if (!readU32(cursor, delta)) {
+                    return false;
+                }
+                if (!advance(delta)) {
+                    return true;
+                }
+                break;
+            }
+            case CFA_OFFSET_EXTENDED:
+                if (!readUleb128(cursor, reg) || !readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.set(reg, Rule::OFFSET, static_cast<std::int64_t>(operand) * cie.dataAlignment);
+                break;
+            case CFA_RESTORE_EXTENDED:
+                if (!readUleb128(cursor, reg)) {
+                    return false;
+                }
+                if (reg < UnwindRegisters::NUMBER_OF_REGISTERS) {
+                    state.registers[reg] = initial.registers[reg];
+                }
+                break;
+            case CFA_UNDEFINED:
+                if (!readUleb128(cursor, reg)) {
+                    return false;
+                }
+                state.set(reg, Rule::UNDEFINED, 0);
+                break;
+            case CFA_SAME_VALUE:
+                if (!readUleb128(cursor, reg)) {
+                    return false;
+                }
+                state.set(reg, Rule::SAME_VALUE, 0);
+                break;
+            case CFA_REGISTER:
+                if (!readUleb128(cursor, reg) || !readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.set(reg, Rule::REGISTER, static_cast<std::int64_t>(operand));
+                break;
+            case CFA_REMEMBER_STATE:
+                if (numberRemembered == MAX_REMEMBERED_STATES) {
+                    return false;
+                }
+                remembered[numberRemembered++] = state;
+                break;
+            case CFA_RESTORE_STATE:
+                if (numberRemembered == 0) {
+                    return false;
+                }
+                {
+                    // The CFA is not part of the remembered state
+                    const std::uint64_t cfaRegister = state.cfaRegister;
+                    const std::int64_t cfaOffset = state.cfaOffset;
+                    const bool cfaIsExpression = state.cfaIsExpression;
+                    state = remembered[--numberRemembered];
+                    state.cfaRegister = cfaRegister;
+                    state.cfaOffset = cfaOffset;
+                    state.cfaIsExpression = cfaIsExpression;
+                }
+                break;
+            case CFA_DEF_CFA:
+                if (!readUleb128(cursor, reg) || !readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.cfaRegister = reg;
+                state.cfaOffset = static_cast<std::int64_t>(operand);
+                state.cfaIsExpression = false;
+                break;
+            case CFA_DEF_CFA_REGISTER:
+                if (!readUleb128(cursor, reg)) {
+                    return false;
+                }
+                state.cfaRegister = reg;
+                state.cfaIsExpression = false;
+                break;
+            case CFA_DEF_CFA_OFFSET:
+                if (!readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.cfaOffset = static_cast<std::int64_t>(operand);
+                break;
+            case CFA_DEF_CFA_EXPRESSION:
+                // Only used in a few places such as PLTs and signal trampolines, which are not followed
+                if (!readUleb128(cursor, operand)) {
+                    return false;
+                }
+                cursor += operand;
+                state.cfaIsExpression = true;
+                break;
+            case CFA_EXPRESSION:
+            case CFA_VAL_EXPRESSION:
+                if (!readUleb128(cursor, reg) || !readUleb128(cursor, operand)) {
+                    return false;
+                }
+                cursor += operand;
+                state.set(reg, Rule::EXPRESSION, 0);
+                break;
+            case CFA_OFFSET_EXTENDED_SF:
+                if (!readUleb128(cursor, reg) || !readSleb128(cursor, signedOperand)) {
+                    return false;
+                }
+                state.set(reg, Rule::OFFSET, signedOperand * cie.dataAlignment);
+                break;
+            case CFA_DEF_CFA_SF:
+                if (!readUleb128(cursor, reg) || !readSleb128(cursor, signedOperand)) {
+                    return false;
+                }
+                state.cfaRegister = reg;
+                state.cfaOffset = signedOperand * cie.dataAlignment;
+                state.cfaIsExpression = false;
+                break;
+            case CFA_DEF_CFA_OFFSET_SF:
+                if (!readSleb128(cursor, signedOperand)) {
+                    return false;
+                }
+                state.cfaOffset = signedOperand * cie.dataAlignment;
+                break;
+            case CFA_VAL_OFFSET:
+                if (!readUleb128(cursor, reg) || !readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.set(reg, Rule::VAL_OFFSET, static_cast<std::int64_t>(operand) * cie.dataAlignment);
+                break;
+            case CFA_VAL_OFFSET_SF:
+                if (!readUleb128(cursor, reg) || !readSleb128(cursor, signedOperand)) {
+                    return false;
+                }
+                state.set(reg, Rule::VAL_OFFSET, signedOperand * cie.dataAlignment);
+                break;
+            case CFA_AARCH64_NEGATE_RA_STATE:
+                // DW_CFA_GNU_window_save elsewhere, which is for SPARC
+                if (mArch != UnwindArch::AARCH64) {
+                    return false;
+                }
+                state.returnAddressSigned = !state.returnAddressSigned;
+                break;
+            case CFA_GNU_ARGS_SIZE:
+                if (!readUleb128(cursor, operand)) {
+                    return false;
+                }
+                break;
+            case CFA_GNU_NEGATIVE_OFFSET_EXTENDED:
+                if (!readUleb128(cursor, reg) || !readUleb128(cursor, operand)) {
+                    return false;
+                }
+                state.set(reg, Rule::OFFSET, -static_cast<std::int64_t>(operand) * cie.dataAlignment);
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool PerfUnwindTable::stepCfi(UnwindRegisters & regs,
+                              std::uint64_t address,
+                              const UnwindStack & stack,
+                              bool & found) const
+{
+    using Rule = CfiState::Rule;
+
+    found = false;
+    std::uint64_t fde;
+    if (!findFde(address, fde)) {
+        return false;
+    }
+
+    // length, CIE pointer, pc_begin, pc_range, augmentation data, instructions
+    std::uint64_t cursor = fde;
+    std::uint32_t length;
+    if (!readU32(cursor, length) || (length == 0)) {
+        return false;
+    }
+    std::uint64_t end;
+    std::uint64_t ciePointer;
+    const std::uint64_t ciePointerAddress = (length == 0xffffffff ? cursor + 8 : cursor);
+    if (length == 0xffffffff) {
+        std::uint64_t extendedLength;
+        if (!readU64(cursor, extendedLength) || !readU64(cursor, ciePointer)) {
+            return false;
+        }
+        end = ciePointerAddress + extendedLength;
+    }
+    else {
+        std::uint32_t shortPointer;
+        if (!readU32(cursor, shortPointer)) {
+            return false;
+        }
+        end = ciePointerAddress + length;
+        ciePointer = shortPointer;
+    }
+    if ((ciePointer == 0) || (ciePointer > ciePointerAddress)) {
+        return false;
+    }
+
+    Cie cie;
+    if (!parseCie(ciePointerAddress - ciePointer, cie)) {
+        return false;
+    }
+
+    std::uint64_t pcBegin;
+    std::uint64_t pcRange;
+    if (!readEncoded(cursor, cie.fdeEncoding, 0, pcBegin) || !readEncoded(cursor, cie.fdeEncoding & 0x0f, 0, pcRange)) {
+        return false;
+    }
+    if ((address < pcBegin) || (address - pcBegin >= pcRange)) {
+        return false;
+    }
+    found = true;
+
+    if (cie.hasAugmentationData) {
+        std::uint64_t dataLength;
+        if (!readUleb128(cursor, dataLength)) {
+            return false;
+        }
+        cursor += dataLength;
+    }
+
+    CfiState initial;
+    if (!runCfi(cie, cie.instructions, cie.end, pcBegin, pcBegin, initial, initial)) {
+        return false;
+    }
+    CfiState state = initial;
+    if (!runCfi(cie, cursor, end, pcBegin, address, initial, state)) {
+        return false;
+    }
+
+    if (state.cfaIsExpression || !regs.isValid(state.cfaRegister)) {
+        return false;
+    }
+    std::uint64_t cfa = regs.values[state.cfaRegister] + state.cfaOffset;
+    if (!mIs64Bit) {
+        cfa &= 0xffffffff;
+    }
+
+    const std::size_t wordSize = (mIs64Bit ? 8 : 4);
+    UnwindRegisters caller = regs;
+    for (unsigned reg = 0; reg < UnwindRegisters::NUMBER_OF_REGISTERS; ++reg) {
+        const CfiState::Register & rule = state.registers[reg];
+        std::uint64_t value;
+        switch (rule.rule) {
+            case Rule::SAME_VALUE:
+                break;
+            case Rule::OFFSET:
+                if (stack.read(cfa + rule.value, wordSize, value)) {
+                    caller.set(reg, value);
+                }
+                else {
+                    caller.valid &= ~(1U << reg);
+                }
+                break;
+            case Rule::VAL_OFFSET:
+                caller.set(reg, cfa + rule.value);
+                break;
+            case Rule::REGISTER:
+                if (regs.isValid(rule.value)) {
+                    caller.set(reg, regs.values[rule.value]);
+                }
+                else {
+                    caller.valid &= ~(1U << reg);
+                }
+                break;
+            case Rule::UNDEFINED:
+            case Rule::EXPRESSION:
+            default:
+                caller.valid &= ~(1U << reg);
+                break;
+        }
+    }
+
+    const unsigned sp = UnwindRegisters::stackPointer(mArch);
+    if (state.registers[sp].rule == Rule::SAME_VALUE) {
+        caller.set(sp, cfa);
+    }
+
+    // An undefined return address marks the outermost frame
+    const std::uint64_t returnAddress = cie.returnAddressRegister;
+    if ((returnAddress >= UnwindRegisters::NUMBER_OF_REGISTERS) ||
+        (state.registers[returnAddress].rule == Rule::UNDEFINED) || !caller.isValid(returnAddress)) {
+        return false;
+    }
+    caller.pc = caller.values[returnAddress];
+    if (state.returnAddressSigned) {
+        caller.pc &= AARCH64_PAC_MASK;
+    }
+
+    regs = caller;
+    return true;
+}
+
+bool PerfUnwindTable::readPrel31(std::uint64_t address, std::uint64_t & value) const
+{
+    std::uint64_t cursor = address;
+    std::uint32_t word;
+    if (!readU32(cursor, word)) {
+        return false;
+    }
+    // sign extend the 31 bit offset
+    const std::int32_t offset = static_cast<std::int32_t>(word << 1) >> 1;
+    value = (address + offset) & 0xffffffff;
+    return true;
+}
+
+bool PerfUnwindTable::stepExidx(UnwindRegisters & regs, std::uint64_t address, const UnwindStack & stack) const
+{
+    if (mExidxSize < 8) {
+        return false;
+    }
+
+    // The thumb bit is not part of the function addresses
+    address &= ~static_cast<std::uint64_t>(1);
+
+    // Find the last entry for a function that starts at or before the address
+    std::uint64_t low = 0;
+    std::uint64_t high = mExidxSize / 8;
+    while (low < high) {
+        const std::uint64_t middle = low + ((high - low) / 2);
+        std::uint64_t function;
+        if (!readPrel31(mExidx + (middle * 8), function)) {
+            return false;
+        }
+        if ((function & ~static_cast<std::uint64_t>(1)) <= address) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    if (low == 0) {
+        return false;
+    }
+    const std::uint64_t entry = mExidx + ((low - 1) * 8);
+
+    std::uint64_t cursor = entry + 4;
+    std::uint32_t word;
+    if (!readU32(cursor, word) || (word == EXIDX_CANTUNWIND)) {
+        return false;
+    }
+
+    std::uint8_t opcodes[MAX_EXIDX_OPCODES];
+    std::size_t numberOfOpcodes = 0;
+    const auto addBytes = [&opcodes, &numberOfOpcodes](std::uint32_t bytes, int count) {
+        for (int index = count - 1; index >= 0; --index) {
+            opcodes[numberOfOpcodes++] = static_cast<std::uint8_t>(bytes >> (index * 8));
+        }
+    };
+
+    int extraWords = 0;
+    if ((word & 0x80000000) != 0) {
+        // The compact model inline, only personality routine 0 can be
+        if (((word >> 24) & 0x0f) != 0) {
+            return false;
+        }
+        addBytes(word, 3);
+    }
+    else {
+        std::uint64_t extab;
+        if (!readPrel31(entry + 4, extab)) {
+            return false;
+        }
+        cursor = extab;
+        if (!readU32(cursor, word)) {
+            return false;
+        }
+        if ((word & 0x80000000) != 0) {
+            const unsigned personality = (word >> 24) & 0x0f;
+            if (personality == 0) {
+                addBytes(word, 3);
+            }
+            else if ((personality == 1) || (personality == 2)) {
+                extraWords = (word >> 16) & 0xff;
+                addBytes(word, 2);
+            }
+            else {
+                return false;
+            }
+        }
+        else {
+            // A generic personality routine, such as __gxx_personality_v0, followed by the same format
+            if (!readU32(cursor, word)) {
+                return false;
+            }
+            extraWords = (word >> 24) & 0xff;
+            addBytes(word, 3);
+        }
+        for (int index = 0; index < extraWords; ++index) {
+            if (!readU32(cursor, word)) {
+                return false;
+            }
+            addBytes(word, 4);
+        }
+    }
+
+    UnwindRegisters caller = regs;
+    if (!caller.isValid(13)) {
+        return false;
+    }
+    std::uint64_t vsp = caller.values[13];
+    bool pcPopped = false;
+
+    const auto pop = [&caller, &vsp, &stack](unsigned reg) -> bool {
+        std::uint64_t value;
+        if (!stack.read(vsp, 4, value)) {
+            return false;
+        }
+        vsp += 4;
+        caller.set(reg, value);
+        return true;
+    };
+    const auto popMask = [&pop, &pcPopped, &vsp, &caller](unsigned firstRegister, std::uint32_t mask) -> bool {
+        bool spPopped = false;
+        for (unsigned bit = 0; bit < 16; ++bit) {
+            if ((mask & (1U << bit)) != 0) {
+                const unsigned reg = firstRegister + bit;
+                if (!pop(reg)) {
+                    return false;
+                }
+                spPopped = spPopped || (reg == 13);
+                pcPopped = pcPopped || (reg == 15);
+            }
+        }
+        if (spPopped) {
+            vsp = caller.values[13];
+        }
+        return true;
+    };
+
+    std::size_t index = 0;
+    const auto nextByte = [&opcodes, &numberOfOpcodes, &index](std::uint8_t & byte) -> bool {
+        if (index >= numberOfOpcodes) {
+            return false;
+        }
+        byte = opcodes[index++];
+        return true;
+    };
+
+    while (index < numberOfOpcodes) {
+        const std::uint8_t opcode = opcodes[index++];
+        std::uint8_t operand;
+
+        if ((opcode & 0xc0) == 0x00) {
+            // vsp = vsp + (xxxxxx << 2) + 4
+            vsp += ((opcode & 0x3f) << 2) + 4;
+        }
+        else if ((opcode & 0xc0) == 0x40) {
+            // vsp = vsp - (xxxxxx << 2) - 4
+            vsp -= ((opcode & 0x3f) << 2) + 4;
+        }
+        else if ((opcode & 0xf0) == 0x80) {
+            // pop up to 12 integer registers under mask {r15-r12}, {r11-r4}, 0 means refuse to unwind
+            if (!nextByte(operand)) {
+                return false;
+            }
+            const std::uint32_t mask = ((opcode & 0x0f) << 8) | operand;
+            if ((mask == 0) || !popMask(4, mask)) {
+                return false;
+            }
+        }
+        else if ((opcode & 0xf0) == 0x90) {
+            // vsp = r[nnnn], not r13 or r15
+            const unsigned reg = opcode & 0x0f;
+            if ((reg == 13) || (reg == 15) || !caller.isValid(reg)) {
+                return false;
+            }
+            vsp = caller.values[reg];
+        }
+        else if ((opcode & 0xf0) == 0xa0) {
+            // pop r4-r[4+nnn], and r14 if bit 3 is set
+            const std::uint32_t mask = (1U << ((opcode & 0x07) + 1)) - 1;
+            if (!popMask(4, mask) || (((opcode & 0x08) != 0) && !pop(14))) {
+                return false;
+            }
+        }
+        else if (opcode == 0xb0) {
+            // finish
+            break;
+        }
+        else if (opcode == 0xb1) {
+            // pop integer registers under mask {r3, r2, r1, r0}
+            if (!nextByte(operand) || (operand == 0) || ((operand & 0xf0) != 0) || !popMask(0, operand)) {
+                return false;
+            }
+        }
+        else if (opcode == 0xb2) {
+            // vsp = vsp + 0x204 + (uleb128 << 2)
+            std::uint64_t value = 0;
+            unsigned shift = 0;
+            do {
+                if (!nextByte(operand) || (shift >= 32)) {
+                    return false;
+                }
+                value |= static_cast<std::uint64_t>(operand & 0x7f) << shift;
+                shift += 7;
+            } while ((operand & 0x80) != 0);
+            vsp += 0x204 + (value << 2);
+        }
+        else if ((opcode == 0xb3) || (opcode == 0xc8) || (opcode == 0xc9) || (opcode == 0xc6)) {
+            // pop VFP or iWMMXt registers, sssscccc, FSTMFDX for 0xb3 so one more word
+            if (!nextByte(operand)) {
+                return false;
+            }
+            vsp += (((operand & 0x0f) + 1) * 8) + (opcode == 0xb3 ? 4 : 0);
+        }
+        else if ((opcode & 0xf8) == 0xb8) {
+            // pop VFP d8-d[8+nnn] saved by FSTMFDX
+            vsp += (((opcode & 0x07) + 1) * 8) + 4;
+        }
+        else if (opcode == 0xc7) {
+            // pop iWMMXt wCGR registers under mask {wCGR3, 2, 1, 0}
+            if (!nextByte(operand) || (operand == 0) || ((operand & 0xf0) != 0)) {
+                return false;
+            }
+            vsp += __builtin_popcount(operand) * 4;
+        }
+        else if (((opcode & 0xf8) == 0xc0) || ((opcode & 0xf8) == 0xd0)) {
+            // pop iWMMXt wR10-wR[10+nnn] or VFP d8-d[8+nnn] saved by VPUSH
+            vsp += ((opcode & 0x07) + 1) * 8;
+        }
+        else {
+            // spare
+            return false;
+        }
+        vsp &= 0xffffffff;
+    }
+
+    caller.set(13, vsp);
+    if (pcPopped) {
+        caller.pc = caller.values[15];
+    }
+    else if (caller.isValid(14)) {
+        caller.pc = caller.values[14];
+        caller.set(15, caller.pc);
+    }
+    else {
+        return false;
+    }
+
+    regs = caller;
+    return true;
+}
+
+bool PerfUnwindTable::step(UnwindRegisters & regs, std::uint64_t address, const UnwindStack & stack) const
+{
+    if (regs.arch != mArch) {
+        return false;
+    }
+
+    bool found = false;
+    if (stepCfi(regs, address, stack, found)) {
+        return true;
+    }
+    // 32-bit Arm code is mostly described by .ARM.exidx rather than .eh_frame
+    return !found && (mArch == UnwindArch::ARM) && (mExidx != 0) && stepExidx(regs, address, stack);
+}
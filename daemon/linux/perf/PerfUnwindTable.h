@@ -0,0 +1,141 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PERF_PERF_UNWIND_TABLE_H
+#define INCLUDE_LINUX_PERF_PERF_UNWIND_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+enum class UnwindArch { X86_64, AARCH64, ARM };
+
+/** The registers of one frame, numbered as DWARF numbers them for the architecture */
+struct UnwindRegisters {
+    /// enough for x0-x30 and sp on aarch64, which is the most of the supported architectures
+    static constexpr int NUMBER_OF_REGISTERS = 32;
+
+    UnwindArch arch;
+    std::uint64_t values[NUMBER_OF_REGISTERS];
+    /// a bit per register, set if its value is known
+    std::uint32_t valid;
+    std::uint64_t pc;
+
+    /** @return The DWARF number of the stack pointer */
+    static unsigned stackPointer(UnwindArch arch)
+    {
+        switch (arch) {
+            case UnwindArch::X86_64:
+                return 7;
+            case UnwindArch::AARCH64:
+                return 31;
+            case UnwindArch::ARM:
+            default:
+                return 13;
+        }
+    }
+
+    bool isValid(unsigned reg) const { return (reg < NUMBER_OF_REGISTERS) && ((valid & (1U << reg)) != 0); }
+
+    void set(unsigned reg, std::uint64_t value)
+    {
+        values[reg] = value;
+        valid |= (1U << reg);
+    }
+};
+
+/** The copy of the user stack that came with a sample */
+struct UnwindStack {
+    /// the stack pointer when the sample was taken
+    std::uint64_t start;
+    const char * data;
+    std::size_t size;
+
+    bool read(std::uint64_t address, std::size_t length, std::uint64_t & value) const;
+};
+
+/**
+ * The unwind tables of one ELF binary, that is the .eh_frame CFI found through PT_GNU_EH_FRAME and, for 32-bit Arm,
+ * the .ARM.exidx table found through PT_ARM_EXIDX. The file is mapped and only read as frames are looked up.
+ */
+class PerfUnwindTable {
+public:
+    /** @return nullptr if the file is not an ELF for a supported architecture or has no unwind tables */
+    static std::unique_ptr<PerfUnwindTable> load(const char * path);
+
+    ~PerfUnwindTable();
+
+    UnwindArch getArch() const { return mArch; }
+
+    /**
+     * Convert a file offset, as in a mapping's pgoff, to the address the ELF gives it
+     *
+     * @return false if the offset is not in a loadable segment
+     */
+    bool fileOffsetToAddress(std::uint64_t offset, std::uint64_t & address) const;
+
+    /**
+     * Step from a frame to its caller, on success regs is the caller's frame
+     *
+     * @param address The address in this ELF to look up, the pc less one if the pc is a return address
+     * @return false if the caller cannot be found
+     */
+    bool step(UnwindRegisters & regs, std::uint64_t address, const UnwindStack & stack) const;
+
+private:
+    struct Segment {
+        std::uint64_t address;
+        std::uint64_t offset;
+        std::uint64_t fileSize;
+    };
+
+    struct Cie;
+    struct CfiState;
+
+    PerfUnwindTable(const char * data, std::size_t size, UnwindArch arch, bool is64Bit);
+
+    bool parseProgramHeaders();
+
+    /** Read from the file at an address the ELF gives it */
+    bool read(std::uint64_t address, void * out, std::size_t length) const;
+    bool readU8(std::uint64_t & address, std::uint8_t & value) const;
+    bool readU16(std::uint64_t & address, std::uint16_t & value) const;
+    bool readU32(std::uint64_t & address, std::uint32_t & value) const;
+    bool readU64(std::uint64_t & address, std::uint64_t & value) const;
+    bool readUleb128(std::uint64_t & address, std::uint64_t & value) const;
+    bool readSleb128(std::uint64_t & address, std::int64_t & value) const;
+    bool readEncoded(std::uint64_t & address, std::uint8_t encoding, std::uint64_t dataBase, std::uint64_t & value)
+        const;
+
+    bool findFde(std::uint64_t address, std::uint64_t & fde) const;
+    bool parseCie(std::uint64_t cieAddress, Cie & cie) const;
+    bool runCfi(const Cie & cie,
+                std::uint64_t instructions,
+                std::uint64_t end,
+                std::uint64_t location,
+                std::uint64_t address,
+                const CfiState & initial,
+                CfiState & state) const;
+    bool stepCfi(UnwindRegisters & regs, std::uint64_t address, const UnwindStack & stack, bool & found) const;
+
+    bool stepExidx(UnwindRegisters & regs, std::uint64_t address, const UnwindStack & stack) const;
+    bool readPrel31(std::uint64_t address, std::uint64_t & value) const;
+
+    const char * const mData;
+    const std::size_t mSize;
+    const UnwindArch mArch;
+    const bool mIs64Bit;
+    std::vector<Segment> mSegments;
+    /// 0 if there is none
+    std::uint64_t mEhFrameHdr;
+    std::uint64_t mExidx;
+    std::uint64_t mExidxSize;
+
+    // Intentionally unimplemented
+    PerfUnwindTable(const PerfUnwindTable &) = delete;
+    PerfUnwindTable & operator=(const PerfUnwindTable &) = delete;
+    PerfUnwindTable(PerfUnwindTable &&) = delete;
+    PerfUnwindTable & operator=(PerfUnwindTable &&) = delete;
+};
+
+#endif // INCLUDE_LINUX_PERF_PERF_UNWIND_TABLE_H
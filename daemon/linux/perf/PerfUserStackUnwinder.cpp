@@ -0,0 +1,512 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfUserStackUnwinder.h"
+
+#include "Logging.h"
+#include "lib/FsEntry.h"
+#include "linux/perf/PerfUtils.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+#include <sys/mman.h>
+
+namespace {
+    /// The one word sample fields that come between the identifier and PERF_SAMPLE_READ
+    constexpr std::uint64_t FIELDS_BEFORE_READ = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+                                                 PERF_SAMPLE_ADDR | PERF_SAMPLE_ID | PERF_SAMPLE_STREAM_ID |
+                                                 PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD;
+
+    /// Fields between the callchain and the registers that are not parsed
+    constexpr std::uint64_t UNSUPPORTED_FIELDS = PERF_SAMPLE_RAW | PERF_SAMPLE_BRANCH_STACK;
+
+    constexpr std::uint64_t USER_STACK_FIELDS = PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+
+    /// Marks a register of the sample that is not needed
+    constexpr std::int8_t IGNORED = -2;
+    /// Marks the pc in the sample's registers
+    constexpr std::int8_t PC = -1;
+
+#if defined(__x86_64__)
+    // The general purpose registers, AX BX CX DX SI DI BP SP IP then R8-R15, not the flags or segment registers
+    constexpr std::uint64_t REGS_USER_MASK = 0xff01ff;
+    // The DWARF number of each of them
+    constexpr std::int8_t DWARF_REGISTERS_64[] = {0, 3, 2, 1, 4, 5, 6, 7, PC, 8, 9, 10, 11, 12, 13, 14, 15};
+    constexpr UnwindArch ARCH_64 = UnwindArch::X86_64;
+#elif defined(__aarch64__)
+    // X0-X30, SP and PC
+    constexpr std::uint64_t REGS_USER_MASK = (1ULL << 33) - 1;
+    constexpr std::int8_t DWARF_REGISTERS_64[] = {0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15, 16,
+                                                  17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, PC};
+    constexpr UnwindArch ARCH_64 = UnwindArch::AARCH64;
+    // A 32-bit process has R0-R14 in X0-X14, and its pc in PC
+    constexpr std::int8_t DWARF_REGISTERS_32[] = {
+        0,       1,       2,       3,       4,       5,       6,       7,       8,       9,       10,
+        11,      12,      13,      14,      IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED,
+        IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, IGNORED, PC};
+#elif defined(__arm__)
+    // R0-R15
+    constexpr std::uint64_t REGS_USER_MASK = 0xffff;
+    constexpr std::int8_t DWARF_REGISTERS_32[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, PC};
+#else
+    constexpr std::uint64_t REGS_USER_MASK = 0;
+#endif
+
+    void loadRegisters(const std::int8_t * dwarfRegisters,
+                       const std::uint64_t * values,
+                       std::size_t count,
+                       UnwindRegisters & regs)
+    {
+        regs.valid = 0;
+        regs.pc = 0;
+        const std::uint64_t mask = (regs.arch == UnwindArch::ARM ? 0xffffffff : ~static_cast<std::uint64_t>(0));
+        for (std::size_t index = 0; index < count; ++index) {
+            const std::int8_t reg = dwarfRegisters[index];
+            if (reg == PC) {
+                regs.pc = values[index] & mask;
+            }
+            else if (reg >= 0) {
+                regs.set(reg, values[index] & mask);
+            }
+        }
+        if (regs.arch == UnwindArch::ARM) {
+            regs.set(15, regs.pc);
+        }
+    }
+
+    /** @return false if gatord cannot unwind processes with this ABI */
+    bool loadRegisters(std::uint64_t abi, const std::uint64_t * values, std::size_t count, UnwindRegisters & regs)
+    {
+#if defined(__x86_64__) || defined(__aarch64__)
+        if ((abi == PERF_SAMPLE_REGS_ABI_64) && (count == sizeof(DWARF_REGISTERS_64))) {
+            regs.arch = ARCH_64;
+            loadRegisters(DWARF_REGISTERS_64, values, count, regs);
+            return true;
+        }
+#endif
+#if defined(__aarch64__) || defined(__arm__)
+        if ((abi == PERF_SAMPLE_REGS_ABI_32) && (count == sizeof(DWARF_REGISTERS_32))) {
+            regs.arch = UnwindArch::ARM;
+            loadRegisters(DWARF_REGISTERS_32, values, count, regs);
+            return true;
+        }
+#endif
+        (void) abi;
+        (void) values;
+        (void) count;
+        (void) regs;
+        return false;
+    }
+}
+
+PerfUserStackUnwinder::PerfUserStackUnwinder(std::uint32_t stackSize, int maxFrames)
+    : mMutex(),
+      mStackSize(stackSize),
+      mMaxFrames(maxFrames),
+      mFormats(),
+      mProcesses(),
+      mTables(),
+      mIps(),
+      mStats {0, 0, 0, 0}
+{
+}
+
+PerfUserStackUnwinder::~PerfUserStackUnwinder()
+{
+    logg.logMessage("Unwound %" PRIu64 " of %" PRIu64 " user stacks to %" PRIu64 " frames using %" PRIu64
+                    " binaries",
+                    mStats.unwound,
+                    mStats.samples,
+                    mStats.frames,
+                    mStats.binaries);
+}
+
+bool PerfUserStackUnwinder::isSupported()
+{
+    return REGS_USER_MASK != 0;
+}
+
+bool PerfUserStackUnwinder::requestUserStack(struct perf_event_attr & attr) const
+{
+    const std::uint64_t required = PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TID;
+    if (!isSupported() || ((attr.sample_type & required) != required) ||
+        ((attr.sample_type & (UNSUPPORTED_FIELDS | USER_STACK_FIELDS)) != 0)) {
+        return false;
+    }
+
+    attr.sample_type |= USER_STACK_FIELDS;
+    attr.sample_regs_user = REGS_USER_MASK;
+    attr.sample_stack_user = mStackSize;
+    // The user part of the callchain is found here instead
+    attr.exclude_callchain_user = 1;
+    return true;
+}
+
+struct perf_event_attr PerfUserStackUnwinder::withoutUserStack(const struct perf_event_attr & attr)
+{
+    struct perf_event_attr result = attr;
+    if ((result.sample_type & USER_STACK_FIELDS) != 0) {
+        result.sample_type &= ~USER_STACK_FIELDS;
+        result.sample_regs_user = 0;
+        result.sample_stack_user = 0;
+        result.exclude_callchain_user = 0;
+    }
+    return result;
+}
+
+void PerfUserStackUnwinder::addEvent(std::uint64_t id, const struct perf_event_attr & attr)
+{
+    if ((attr.sample_type & USER_STACK_FIELDS) != USER_STACK_FIELDS) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock {mMutex};
+    mFormats[id] = Format {attr.sample_type, attr.read_format, attr.sample_regs_user};
+}
+
+bool PerfUserStackUnwinder::process(const struct perf_event_header * record, std::vector<std::uint64_t> & unwound)
+{
+    const char * const body = reinterpret_cast<const char *>(record + 1);
+    const std::size_t bodySize = record->size - sizeof(*record);
+
+    switch (record->type) {
+        case PERF_RECORD_SAMPLE:
+            return unwindSample(record, unwound);
+
+        case PERF_RECORD_MMAP:
+        case PERF_RECORD_MMAP2: {
+            // u32 pid, tid; u64 addr, len, pgoff; for MMAP2 then u32 maj, min; u64 ino, ino_generation or the build
+            // id; u32 prot, flags; then for both char filename[]
+            const bool isMmap2 = (record->type == PERF_RECORD_MMAP2);
+            const std::size_t filenameOffset = (isMmap2 ? 64 : 32);
+            if ((bodySize <= filenameOffset) || ((record->misc & PERF_RECORD_MISC_MMAP_DATA) != 0)) {
+                return false;
+            }
+            std::uint32_t pid;
+            std::uint64_t addr;
+            std::uint64_t len;
+            std::uint64_t pgoff;
+            memcpy(&pid, body, sizeof(pid));
+            memcpy(&addr, body + 8, sizeof(addr));
+            memcpy(&len, body + 16, sizeof(len));
+            memcpy(&pgoff, body + 24, sizeof(pgoff));
+            if (isMmap2) {
+                std::uint32_t prot;
+                memcpy(&prot, body + 56, sizeof(prot));
+                if ((prot & PROT_EXEC) == 0) {
+                    return false;
+                }
+            }
+            const char * const filename = body + filenameOffset;
+            const std::size_t filenameLength = strnlen(filename, bodySize - filenameOffset);
+            if ((static_cast<int>(pid) > 0) && (filenameLength < bodySize - filenameOffset)) {
+                addMapping(pid, addr, len, pgoff, filename);
+            }
+            return false;
+        }
+
+        case PERF_RECORD_FORK:
+        case PERF_RECORD_EXIT: {
+            // u32 pid, ppid, tid, ptid
+            std::uint32_t ids[4];
+            if (bodySize < sizeof(ids)) {
+                return false;
+            }
+            memcpy(ids, body, sizeof(ids));
+            const int pid = ids[0];
+            const int ppid = ids[1];
+            const int tid = ids[2];
+            if (record->type == PERF_RECORD_EXIT) {
+                if (pid == tid) {
+                    mProcesses.erase(pid);
+                }
+            }
+            else if (pid != ppid) {
+                // A new process starts with a copy of its parent's mappings
+                const auto parent = mProcesses.find(ppid);
+                if (parent != mProcesses.end()) {
+                    const Process copy = parent->second;
+                    mProcesses[pid] = copy;
+                }
+            }
+            return false;
+        }
+
+        case PERF_RECORD_COMM: {
+            // u32 pid, tid; char comm[], only set by the kernel for an exec if the event has comm_exec
+            std::uint32_t pid;
+            if ((bodySize >= sizeof(pid)) && ((record->misc & PERF_RECORD_MISC_COMM_EXEC) != 0)) {
+                memcpy(&pid, body, sizeof(pid));
+                Process & process = mProcesses[pid];
+                process.mappings.clear();
+                process.procMapsRead = true;
+            }
+            return false;
+        }
+
+        default:
+            return false;
+    }
+}
+
+void PerfUserStackUnwinder::addMapping(int pid,
+                                       std::uint64_t start,
+                                       std::uint64_t length,
+                                       std::uint64_t pgoff,
+                                       const char * path)
+{
+    // Only files can be unwound, not anonymous memory, [vdso] and so on
+    if ((path[0] != '/') || (path[1] == '/') || (length == 0)) {
+        return;
+    }
+
+    std::map<std::uint64_t, Mapping> & mappings = mProcesses[pid].mappings;
+    const std::uint64_t end = start + length;
+
+    // A new mapping replaces whatever was there
+    auto it = mappings.lower_bound(start);
+    if (it != mappings.begin()) {
+        const auto previous = std::prev(it);
+        if (previous->second.end > start) {
+            if (previous->second.end > end) {
+                Mapping tail = previous->second;
+                tail.pgoff += end - previous->first;
+                mappings.emplace(end, std::move(tail));
+            }
+            previous->second.end = start;
+        }
+    }
+    while ((it != mappings.end()) && (it->first < end)) {
+        if (it->second.end > end) {
+            Mapping tail = it->second;
+            tail.pgoff += end - it->first;
+            mappings.erase(it);
+            mappings.emplace(end, std::move(tail));
+            break;
+        }
+        it = mappings.erase(it);
+    }
+
+    mappings.emplace(start, Mapping {end, pgoff, path});
+}
+
+void PerfUserStackUnwinder::readProcMaps(int pid, Process & process)
+{
+    process.procMapsRead = true;
+
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/%i/maps", pid);
+    std::istringstream maps {lib::readFileContents(lib::FsEntry::create(path))};
+
+    // start-end perms offset dev inode path
+    std::string line;
+    while (std::getline(maps, line)) {
+        std::uint64_t start;
+        std::uint64_t end;
+        char perms[5];
+        std::uint64_t offset;
+        int pathStart = -1;
+        if ((sscanf(line.c_str(), "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %*s %*s %n", &start, &end, perms, &offset,
+                    &pathStart) < 4) ||
+            (pathStart < 0) || (perms[2] != 'x')) {
+            continue;
+        }
+
+        // What the mmap records have already said is more recent
+        const auto next = process.mappings.lower_bound(start);
+        const bool overlapsNext = (next != process.mappings.end()) && (next->first < end);
+        const bool overlapsPrevious =
+            (next != process.mappings.begin()) && (std::prev(next)->second.end > start);
+        if (!overlapsNext && !overlapsPrevious && (line[pathStart] == '/')) {
+            process.mappings.emplace(start, Mapping {end, offset, line.substr(pathStart)});
+        }
+    }
+}
+
+PerfUserStackUnwinder::Process & PerfUserStackUnwinder::getProcess(int pid)
+{
+    Process & process = mProcesses[pid];
+    if (!process.procMapsRead) {
+        readProcMaps(pid, process);
+    }
+    return process;
+}
+
+const PerfUnwindTable * PerfUserStackUnwinder::getTable(const std::string & path)
+{
+    auto it = mTables.find(path);
+    if (it == mTables.end()) {
+        std::unique_ptr<PerfUnwindTable> table = PerfUnwindTable::load(path.c_str());
+        if (table) {
+            ++mStats.binaries;
+        }
+        else {
+            logg.logMessage("No unwind tables for %s", path.c_str());
+        }
+        it = mTables.emplace(path, std::move(table)).first;
+    }
+    return it->second.get();
+}
+
+bool PerfUserStackUnwinder::unwindSample(const struct perf_event_header * record, std::vector<std::uint64_t> & unwound)
+{
+    if (record->size < sizeof(*record) + sizeof(std::uint64_t)) {
+        return false;
+    }
+
+    const auto * const words = reinterpret_cast<const std::uint64_t *>(record + 1);
+    const std::size_t numberOfWords = (record->size - sizeof(*record)) / sizeof(std::uint64_t);
+
+    Format format;
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+
+        // PERF_SAMPLE_IDENTIFIER is always first
+        const auto formatIt = mFormats.find(words[0]);
+        if (formatIt == mFormats.end()) {
+            return false;
+        }
+        format = formatIt->second;
+    }
+    if ((format.sampleType & UNSUPPORTED_FIELDS) != 0) {
+        return false;
+    }
+
+    // u32 pid, tid follows the identifier and the ip
+    const std::size_t tidPos = ((format.sampleType & PERF_SAMPLE_IP) != 0 ? 2 : 1);
+    if (tidPos >= numberOfWords) {
+        return false;
+    }
+    const int pid = static_cast<std::uint32_t>(words[tidPos]);
+
+    std::size_t pos = 1 + __builtin_popcountll(format.sampleType & FIELDS_BEFORE_READ);
+    if ((format.sampleType & PERF_SAMPLE_READ) != 0) {
+        const std::size_t size =
+            (pos < numberOfWords ? perf_utils::sampleReadSize(format.readFormat, words + pos, numberOfWords - pos) : 0);
+        if (size == 0) {
+            return false;
+        }
+        pos += size;
+    }
+
+    // u64 nr, u64 ips[nr]
+    const std::size_t callchainPos = pos;
+    if ((pos >= numberOfWords) || (words[pos] > numberOfWords - pos - 1)) {
+        return false;
+    }
+    const std::uint64_t nr = words[pos];
+    pos += 1 + nr;
+
+    // u64 abi, u64 regs[weight(mask)] if abi is not PERF_SAMPLE_REGS_ABI_NONE
+    if (pos >= numberOfWords) {
+        return false;
+    }
+    const std::uint64_t abi = words[pos++];
+    const std::size_t regsPos = pos;
+    const std::size_t numberOfRegs = (abi != PERF_SAMPLE_REGS_ABI_NONE ? __builtin_popcountll(format.regsUser) : 0);
+    pos += numberOfRegs;
+
+    // u64 size, char data[size], u64 dyn_size if size is not 0
+    if (pos >= numberOfWords) {
+        return false;
+    }
+    const std::uint64_t stackSize = words[pos++];
+    const std::size_t stackPos = pos;
+    if ((stackSize % sizeof(std::uint64_t) != 0) || (stackSize / sizeof(std::uint64_t) > numberOfWords - pos)) {
+        return false;
+    }
+    pos += stackSize / sizeof(std::uint64_t);
+    std::uint64_t dynSize = 0;
+    if (stackSize != 0) {
+        if (pos >= numberOfWords) {
+            return false;
+        }
+        dynSize = std::min(words[pos++], stackSize);
+    }
+
+    ++mStats.samples;
+
+    mIps.clear();
+    UnwindRegisters regs;
+    if ((pid > 0) && loadRegisters(abi, words + regsPos, numberOfRegs, regs)) {
+        const unsigned sp = UnwindRegisters::stackPointer(regs.arch);
+        const UnwindStack stack {regs.values[sp], reinterpret_cast<const char *>(words + stackPos), dynSize};
+        mIps.push_back(regs.pc);
+        if (regs.isValid(sp)) {
+            unwindStack(getProcess(pid), regs, stack);
+        }
+    }
+
+    // Any user part of the callchain is replaced
+    std::uint64_t kernelNr = 0;
+    while ((kernelNr < nr) && (words[callchainPos + 1 + kernelNr] != PERF_CONTEXT_USER)) {
+        ++kernelNr;
+    }
+    const std::size_t userNr = (mIps.empty() ? 0 : 1 + mIps.size());
+    const std::size_t tailSize = numberOfWords - pos;
+
+    // The header, the fields before the callchain, the new callchain and whatever follows the stack
+    const std::size_t size = 1 + callchainPos + 1 + kernelNr + userNr + tailSize;
+    if (size * sizeof(std::uint64_t) > UINT16_MAX) {
+        return false;
+    }
+    unwound.resize(size);
+    std::uint64_t * out = unwound.data() + 1;
+    memcpy(out, words, callchainPos * sizeof(std::uint64_t));
+    out += callchainPos;
+    *out++ = kernelNr + userNr;
+    memcpy(out, words + callchainPos + 1, kernelNr * sizeof(std::uint64_t));
+    out += kernelNr;
+    if (!mIps.empty()) {
+        *out++ = PERF_CONTEXT_USER;
+        memcpy(out, mIps.data(), mIps.size() * sizeof(std::uint64_t));
+        out += mIps.size();
+    }
+    memcpy(out, words + pos, tailSize * sizeof(std::uint64_t));
+
+    struct perf_event_header header = *record;
+    header.size = size * sizeof(std::uint64_t);
+    memcpy(unwound.data(), &header, sizeof(header));
+    return true;
+}
+
+void PerfUserStackUnwinder::unwindStack(Process & process, UnwindRegisters & regs, const UnwindStack & stack)
+{
+    const unsigned sp = UnwindRegisters::stackPointer(regs.arch);
+
+    for (int frame = 1; frame < mMaxFrames; ++frame) {
+        // A return address is after the call, so look up the call
+        const std::uint64_t pc = (frame == 1 ? regs.pc : regs.pc - 1);
+
+        auto mapping = process.mappings.upper_bound(pc);
+        if (mapping == process.mappings.begin()) {
+            break;
+        }
+        mapping = std::prev(mapping);
+        if (pc >= mapping->second.end) {
+            break;
+        }
+
+        const PerfUnwindTable * const table = getTable(mapping->second.path);
+        std::uint64_t address;
+        if ((table == nullptr) ||
+            !table->fileOffsetToAddress(pc - mapping->first + mapping->second.pgoff, address)) {
+            break;
+        }
+
+        const std::uint64_t previousPc = regs.pc;
+        const std::uint64_t previousSp = regs.values[sp];
+        if (!table->step(regs, address, stack) || (regs.pc == 0) || !regs.isValid(sp) ||
+            ((regs.pc == previousPc) && (regs.values[sp] == previousSp))) {
+            break;
+        }
+        mIps.push_back(regs.pc);
+    }
+
+    if (mIps.size() > 1) {
+        ++mStats.unwound;
+        mStats.frames += mIps.size();
+    }
+}
@@ -0,0 +1,119 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PERF_PERF_USER_STACK_UNWINDER_H
+#define INCLUDE_LINUX_PERF_PERF_USER_STACK_UNWINDER_H
+
+#include "k/perf_event.h"
+#include "linux/perf/PerfUnwindTable.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Unwinds the user stacks of samples in gatord, for code built without frame pointers.
+ *
+ * Events that have callchains are asked for PERF_SAMPLE_REGS_USER and a copy of the user stack (PERF_SAMPLE_STACK_USER)
+ * instead of the kernel's frame pointer walk of the user stack. Each sample is unwound here with the .eh_frame or
+ * .ARM.exidx tables of the binaries that the process has mapped, and rewritten as if the kernel had found those
+ * frames: the user ips are appended to the callchain after PERF_CONTEXT_USER and the registers and stack copy are
+ * removed, so they are never sent. The host sees the events as having only PERF_SAMPLE_CALLCHAIN.
+ *
+ * The mappings of each process are followed from the mmap, fork, comm and exit records as they go past, and read from
+ * /proc/<pid>/maps the first time a process is sampled. Apart from addEvent, everything must be called from the thread
+ * that sends the perf data.
+ */
+class PerfUserStackUnwinder {
+public:
+    struct Stats {
+        std::uint64_t samples;
+        /// samples where at least one caller was found
+        std::uint64_t unwound;
+        std::uint64_t frames;
+        std::uint64_t binaries;
+    };
+
+    /**
+     * @param stackSize How much of the user stack to copy with each sample, a multiple of 8
+     * @param maxFrames The most user frames to report
+     */
+    PerfUserStackUnwinder(std::uint32_t stackSize, int maxFrames);
+    ~PerfUserStackUnwinder();
+
+    /** @return true if gatord was built for an architecture it can unwind */
+    static bool isSupported();
+
+    /**
+     * Add PERF_SAMPLE_REGS_USER and PERF_SAMPLE_STACK_USER to an event if its callchains can be unwound here
+     *
+     * @return true if the attr was changed
+     */
+    bool requestUserStack(struct perf_event_attr & attr) const;
+
+    /** @return The attr as the host must see it, that is how the samples are after they are unwound */
+    static struct perf_event_attr withoutUserStack(const struct perf_event_attr & attr);
+
+    /** Register a perf id, does nothing if the event did not ask for the user stack */
+    void addEvent(std::uint64_t id, const struct perf_event_attr & attr);
+
+    /**
+     * Follow a record that changes a process's mappings, or unwind a sample
+     *
+     * @param record A complete record, 8 byte aligned
+     * @param unwound Set to the record to send instead, the header is the first word
+     * @return true if unwound was set, false if the record must be sent as is
+     */
+    bool process(const struct perf_event_header * record, std::vector<std::uint64_t> & unwound);
+
+    const Stats & getStats() const { return mStats; }
+
+private:
+    struct Format {
+        std::uint64_t sampleType;
+        std::uint64_t readFormat;
+        std::uint64_t regsUser;
+    };
+
+    struct Mapping {
+        std::uint64_t end;
+        std::uint64_t pgoff;
+        std::string path;
+    };
+
+    struct Process {
+        /// by start address
+        std::map<std::uint64_t, Mapping> mappings;
+        bool procMapsRead;
+    };
+
+    void addMapping(int pid, std::uint64_t start, std::uint64_t length, std::uint64_t pgoff, const char * path);
+    void readProcMaps(int pid, Process & process);
+    Process & getProcess(int pid);
+    const PerfUnwindTable * getTable(const std::string & path);
+
+    bool unwindSample(const struct perf_event_header * record, std::vector<std::uint64_t> & unwound);
+    void unwindStack(Process & process, UnwindRegisters & regs, const UnwindStack & stack);
+
+    /// only for mFormats
+    mutable std::mutex mMutex;
+    const std::uint32_t mStackSize;
+    const int mMaxFrames;
+    std::unordered_map<std::uint64_t, Format> mFormats;
+    std::unordered_map<int, Process> mProcesses;
+    /// by path, null if the binary cannot be unwound
+    std::unordered_map<std::string, std::unique_ptr<PerfUnwindTable>> mTables;
+    std::vector<std::uint64_t> mIps;
+    Stats mStats;
+
+    // Intentionally unimplemented
+    PerfUserStackUnwinder(const PerfUserStackUnwinder &) = delete;
+    PerfUserStackUnwinder & operator=(const PerfUserStackUnwinder &) = delete;
+    PerfUserStackUnwinder(PerfUserStackUnwinder &&) = delete;
+    PerfUserStackUnwinder & operator=(PerfUserStackUnwinder &&) = delete;
+};
+
+#endif // INCLUDE_LINUX_PERF_PERF_USER_STACK_UNWINDER_H
@@ -3,9 +3,12 @@
 #ifndef PERF_UTILS_H
 #define PERF_UTILS_H
 
+#include "k/perf_event.h"
 #include "lib/Format.h"
 #include "lib/Utils.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <set>
 #include <string>
 
@@ -15,6 +18,32 @@ namespace perf_utils {
         std::string path = lib::Format() << "/sys/bus/event_source/devices/" << pmncName << "/cpumask";
         return lib::readCpuMaskFromFile(path.c_str());
     }
+
+    /**
+     * @param words The PERF_SAMPLE_READ field of a sample and whatever follows it
+     * @return The number of words in the field, or 0 if numberOfWords is too few
+     */
+    static inline std::size_t sampleReadSize(std::uint64_t readFormat,
+                                             const std::uint64_t * words,
+                                             std::size_t numberOfWords)
+    {
+        const std::size_t times = ((readFormat & PERF_FORMAT_TOTAL_TIME_ENABLED) != 0 ? 1 : 0) +
+                                  ((readFormat & PERF_FORMAT_TOTAL_TIME_RUNNING) != 0 ? 1 : 0);
+        const std::size_t perValue = ((readFormat & PERF_FORMAT_ID) != 0 ? 2 : 1);
+        std::size_t size;
+        if ((readFormat & PERF_FORMAT_GROUP) == 0) {
+            // the value, the times, the id
+            size = times + perValue;
+        }
+        else {
+            // nr, the times, then the values
+            if ((numberOfWords == 0) || (words[0] > numberOfWords)) {
+                return 0;
+            }
+            size = 1 + times + (words[0] * perValue);
+        }
+        return (size <= numberOfWords ? size : 0);
+    }
 }
 
 #endif // PERF_UTILS_H
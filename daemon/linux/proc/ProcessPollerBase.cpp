@@ -2,6 +2,7 @@
 
 #include "linux/proc/ProcessPollerBase.h"
 
+#include "GatordStats.h"
 #include "lib/Format.h"
 
 #include <cctype>
@@ -104,6 +105,8 @@ namespace lnx {
 
     void ProcessPollerBase::poll(bool wantThreads, bool wantStats, IProcessPollerReceiver & receiver)
     {
+        GatordStats::ScopedTimer scanTimer {gGatordStats.mProcScanTime};
+
         // scan directory /proc for all pid files
         lib::FsEntryDirectoryIterator iterator = procDir.children();
 
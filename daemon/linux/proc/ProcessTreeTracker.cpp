@@ -0,0 +1,173 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "linux/proc/ProcessTreeTracker.h"
+
+#include "Logging.h"
+#include "OlySocket.h"
+#include "linux/proc/ProcessChildren.h"
+
+#include <cerrno>
+#include <cstring>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+
+namespace lnx {
+    ProcessTreeTracker::ProcessTreeTracker() : mFd(), mRootPids(), mMutex(), mTidToRootPid()
+    {
+    }
+
+    bool ProcessTreeTracker::init(const std::set<int> & rootPids)
+    {
+        lib::AutoClosingFd fd {socket_cloexec(PF_NETLINK, SOCK_DGRAM, NETLINK_CONNECTOR)};
+        if (!fd) {
+            logg.logMessage("socket failed (%d) %s", errno, strerror(errno));
+            return false;
+        }
+
+        struct sockaddr_nl sockaddr;
+        memset(&sockaddr, 0, sizeof(sockaddr));
+        sockaddr.nl_family = AF_NETLINK;
+        sockaddr.nl_groups = CN_IDX_PROC;
+        sockaddr.nl_pid = 0;
+        if (bind(*fd, reinterpret_cast<struct sockaddr *>(&sockaddr), sizeof(sockaddr)) != 0) {
+            // EPERM without CAP_NET_ADMIN
+            logg.logMessage("bind failed (%d) %s", errno, strerror(errno));
+            return false;
+        }
+
+        constexpr size_t payloadLength = sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op);
+        alignas(struct nlmsghdr) char request[NLMSG_SPACE(payloadLength)];
+        memset(request, 0, sizeof(request));
+        auto * const header = reinterpret_cast<struct nlmsghdr *>(request);
+        header->nlmsg_len = NLMSG_LENGTH(payloadLength);
+        header->nlmsg_type = NLMSG_DONE;
+        auto * const message = reinterpret_cast<struct cn_msg *>(NLMSG_DATA(header));
+        message->id.idx = CN_IDX_PROC;
+        message->id.val = CN_VAL_PROC;
+        message->len = sizeof(enum proc_cn_mcast_op);
+        const enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+        memcpy(message->data, &op, sizeof(op));
+        if (send(*fd, request, header->nlmsg_len, 0) != static_cast<ssize_t>(header->nlmsg_len)) {
+            logg.logMessage("send failed (%d) %s", errno, strerror(errno));
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock {mMutex};
+
+        mFd = std::move(fd);
+        mRootPids = rootPids;
+
+        // now that events are being queued nothing forked from here on can be missed, anything already in the scan
+        // is just seen twice
+        rescan();
+
+        return true;
+    }
+
+    bool ProcessTreeTracker::handleEvents(bool & changed)
+    {
+        alignas(struct nlmsghdr) char buf[4096];
+
+        changed = false;
+
+        std::lock_guard<std::mutex> lock {mMutex};
+
+        while (true) {
+            const ssize_t bytes = recv(*mFd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (bytes < 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                    return true;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == ENOBUFS) {
+                    logg.logMessage("process events lost, rereading /proc");
+                    rescan();
+                    changed = true;
+                    continue;
+                }
+                logg.logMessage("recv failed (%d) %s", errno, strerror(errno));
+                return false;
+            }
+
+            int remaining = bytes;
+            for (const auto * header = reinterpret_cast<const struct nlmsghdr *>(buf); NLMSG_OK(header, remaining);
+                 header = NLMSG_NEXT(header, remaining)) {
+                const auto * const message = reinterpret_cast<const struct cn_msg *>(NLMSG_DATA(header));
+                if ((message->id.idx != CN_IDX_PROC) || (message->id.val != CN_VAL_PROC)) {
+                    continue;
+                }
+
+                const auto * const event = reinterpret_cast<const struct proc_event *>(message->data);
+                switch (event->what) {
+                    case proc_event::PROC_EVENT_FORK: {
+                        const auto & fork = event->event_data.fork;
+                        changed |= handleFork(fork.parent_pid, fork.parent_tgid, fork.child_pid, fork.child_tgid);
+                        break;
+                    }
+                    case proc_event::PROC_EVENT_EXIT:
+                        changed |= (mTidToRootPid.erase(event->event_data.exit.process_pid) > 0);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    std::set<int> ProcessTreeTracker::getChildTids(int pid) const
+    {
+        std::set<int> result;
+
+        std::lock_guard<std::mutex> lock {mMutex};
+        for (const auto & tidToRootPid : mTidToRootPid) {
+            if (tidToRootPid.second == pid) {
+                result.insert(tidToRootPid.first);
+            }
+        }
+
+        return result;
+    }
+
+    std::set<int> ProcessTreeTracker::getAllTids() const
+    {
+        std::set<int> result;
+
+        std::lock_guard<std::mutex> lock {mMutex};
+        for (const auto & tidToRootPid : mTidToRootPid) {
+            result.insert(result.end(), tidToRootPid.first);
+        }
+
+        return result;
+    }
+
+    void ProcessTreeTracker::rescan()
+    {
+        mTidToRootPid.clear();
+        for (const int rootPid : mRootPids) {
+            for (const int tid : lnx::getChildTids(rootPid)) {
+                mTidToRootPid.insert(std::make_pair(tid, rootPid));
+            }
+        }
+    }
+
+    bool ProcessTreeTracker::handleFork(int parentPid, int parentTgid, int childPid, int childTgid)
+    {
+        // For a new thread the parent is the parent of its process rather than the thread that created it,
+        // so also look for the process it belongs to
+        auto it = mTidToRootPid.find(childTgid);
+        if (it == mTidToRootPid.end()) {
+            it = mTidToRootPid.find(parentPid);
+        }
+        if (it == mTidToRootPid.end()) {
+            it = mTidToRootPid.find(parentTgid);
+        }
+        if (it == mTidToRootPid.end()) {
+            return false;
+        }
+        return mTidToRootPid.insert(std::make_pair(childPid, it->second)).second;
+    }
+}
@@ -0,0 +1,73 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PROC_PROCESS_TREE_TRACKER_H
+#define INCLUDE_LINUX_PROC_PROCESS_TREE_TRACKER_H
+
+#include "lib/AutoClosingFd.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace lnx {
+    /**
+     * Keeps the tids of the process trees being profiled up to date from the fork and exit events of the netlink proc
+     * connector, so that /proc only has to be walked once rather than every time a CPU comes online.
+     *
+     * Listening to the proc connector requires CAP_NET_ADMIN, if init fails getChildTids should be used instead.
+     */
+    class ProcessTreeTracker {
+    public:
+        ProcessTreeTracker();
+
+        /**
+         * Subscribe to fork and exit events, then find the current members of each tree
+         *
+         * @param rootPids The pids at the root of the trees to track
+         * @return False if the proc connector is not available
+         */
+        bool init(const std::set<int> & rootPids);
+
+        int getFd() const { return *mFd; }
+
+        bool enabled() const { return mFd; }
+
+        /**
+         * Apply all the pending events, rereading /proc if any were lost
+         *
+         * @param changed Set to whether the known tids changed, most events are for processes that are not tracked
+         * @return False if the socket failed
+         */
+        bool handleEvents(bool & changed);
+
+        /**
+         * Thread safe with respect to handleEvents
+         *
+         * @param pid One of the root pids passed to init
+         * @return The known tids of the tree rooted at pid
+         */
+        std::set<int> getChildTids(int pid) const;
+
+        /** Thread safe with respect to handleEvents, the known tids of all the trees */
+        std::set<int> getAllTids() const;
+
+    private:
+        void rescan();
+        /** @return True if the child is in a tree */
+        bool handleFork(int parentPid, int parentTgid, int childPid, int childTgid);
+
+        lib::AutoClosingFd mFd;
+        std::set<int> mRootPids;
+        mutable std::mutex mMutex;
+        // each known tid -> the root pid of its tree
+        std::map<int, int> mTidToRootPid;
+
+        // Intentionally unimplemented
+        ProcessTreeTracker(const ProcessTreeTracker &) = delete;
+        ProcessTreeTracker & operator=(const ProcessTreeTracker &) = delete;
+        ProcessTreeTracker(ProcessTreeTracker &&) = delete;
+        ProcessTreeTracker & operator=(ProcessTreeTracker &&) = delete;
+    };
+}
+
+#endif
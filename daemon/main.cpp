@@ -13,7 +13,9 @@
 #include "OlyUtility.h"
 #include "Sender.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
 #include "lib/FileDescriptor.h"
+#include "lib/LargeBuffer.h"
 #include "lib/Memory.h"
 #include "lib/Utils.h"
 #include "xml/EventsXML.h"
@@ -46,6 +48,8 @@ static pthread_mutex_t numChildProcesses_mutex;
 static std::unique_ptr<OlyServerSocket> socketUds;
 static std::unique_ptr<OlyServerSocket> socketTcp;
 static Monitor monitor;
+// gator-main's end of the capturing gator-child's watcher channel, see Child::createLive
+static lib::AutoClosingFd watcherChannel;
 
 static const char NO_TCP_PIPE[] = "\0streamline-data";
 
@@ -91,6 +95,7 @@ static StateAndPid handleSigchld(StateAndPid currentStateAndChildPid, Drivers &
     for (const auto & driver : drivers.getAll()) {
         driver->postChildExitInParent();
     }
+    watcherChannel.close();
 
     int exitStatus;
     if (WIFEXITED(status)) {
@@ -261,8 +266,17 @@ static StateAndPid handleClient(StateAndPid currentStateAndChildPid,
                                 OlyServerSocket * otherSock)
 {
     if (currentStateAndChildPid.state != State::IDLE) {
-        // A temporary socket connection to host, to transfer error message
         OlySocket client(sock.acceptConnection());
+
+        // Pass it on to watch the session, gator-child then owns a copy of it
+        if (watcherChannel && (currentStateAndChildPid.state == State::CAPTURING) &&
+            sendFd(*watcherChannel, client.getFd())) {
+            logg.logMessage("Passed a new connection on to watch the session in progress");
+            client.closeSocket();
+            return currentStateAndChildPid;
+        }
+
+        // A temporary socket connection to host, to transfer error message
         logg.logError("Session already in progress");
         Sender sender(&client);
         sender.writeData(logg.getLastError(), strlen(logg.getLastError()), ResponseType::ERROR, true);
@@ -275,6 +289,16 @@ static StateAndPid handleClient(StateAndPid currentStateAndChildPid,
     }
 
     OlySocket client(sock.acceptConnection());
+
+    int channel[2] = {-1, -1};
+    if ((gSessionData.mWatchHistorySize > 0) &&
+        (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel) != 0)) {
+        logg.logWarning("socketpair failed (%d) %s, other connections will not be able to watch the capture",
+                        errno,
+                        strerror(errno));
+        channel[0] = channel[1] = -1;
+    }
+
     for (const auto & driver : drivers.getAll()) {
         driver->preChildFork();
     }
@@ -297,8 +321,11 @@ static StateAndPid handleClient(StateAndPid currentStateAndChildPid,
         udpListener.close();
         monitor.close();
         annotateListener.close();
+        if (channel[0] >= 0) {
+            close(channel[0]);
+        }
 
-        auto child = Child::createLive(drivers, client);
+        auto child = Child::createLive(drivers, client, lib::AutoClosingFd {channel[1]});
         child->run();
         child.reset();
         exit(0);
@@ -309,6 +336,10 @@ static StateAndPid handleClient(StateAndPid currentStateAndChildPid,
             driver->postChildForkInParent();
         }
         client.closeSocket();
+        if (channel[1] >= 0) {
+            close(channel[1]);
+        }
+        watcherChannel.reset(channel[0]);
         return {.state = State::CAPTURING, .pid = pid};
     }
 }
@@ -400,8 +431,27 @@ void updateSessionData(const ParserResult & result)
     gSessionData.mAllowCommands = result.mAllowCommands;
     gSessionData.parameterSetFlag = result.parameterSetFlag;
     gSessionData.mStopOnExit = result.mStopGator;
+    gSessionData.mCompression = result.mCompression;
+    gSessionData.mSingleSyncThread = result.mSpeSingleSyncThread;
+    gSessionData.mFlightRecorder = result.mFlightRecorder;
+    gSessionData.mKernelFilter = result.mKernelFilter;
+    gSessionData.mUserspaceCounters = result.mUserspaceCounters;
+    gSessionData.mMultiplexCounters = result.mMultiplexCounters;
+    gSessionData.mMultiplexCounterLimit = result.mMultiplexCounterLimit;
+    lib::LargeBuffer::setUseReservedHugePages(result.mReservedHugePages);
+    gSessionData.mFlightRecorderTrigger = result.mFlightRecorderTrigger;
+    gSessionData.mMirrorTargets = result.mMirrorTargets;
+    gSessionData.mMirrorPolicy = result.mMirrorPolicy;
+    gSessionData.mWatchHistorySize = static_cast<std::size_t>(result.mWatchHistoryMB) * 1024 * 1024;
+    std::copy(std::begin(result.mThreadPlacements),
+              std::end(result.mThreadPlacements),
+              std::begin(gSessionData.mThreadPlacements));
     gSessionData.mPerfMmapSizeInPages = result.mPerfMmapSizeInPages;
     gSessionData.mSpeSampleRate = result.mSpeSampleRate;
+    gSessionData.mSampleAggregationWindowMs = result.mSampleAggregationWindowMs;
+    gSessionData.mInternedCallchains = result.mInternedCallchains;
+    gSessionData.mUserStackSize = result.mUserStackSize;
+    gSessionData.mAdaptiveSamplingMaxScale = result.mAdaptiveSamplingMaxScale;
 
     // use value from perf_event_mlock_kb
     if ((gSessionData.mPerfMmapSizeInPages <= 0) && (geteuid() != 0) && (gSessionData.mPageSize >= 1024)) {
@@ -527,6 +577,10 @@ int main(int argc, char ** argv)
     }
     updateSessionData(result);
 
+    // The threads of the other roles apply their own placements as they start
+    thread_factory::saveDefaults();
+    thread_factory::applyPlacement(ThreadRole::HOUSEKEEPING);
+
     PmuXML pmuXml = readPmuXml(result.pmuPath);
     // detect the primary source
     // Call before setting up the SIGCHLD handler, as system() spawns child processes
@@ -535,9 +589,7 @@ int main(int argc, char ** argv)
 
     if (result.mode == ParserResult::ExecutionMode::PRINT) {
         if (result.printables.count(ParserResult::Printable::EVENTS_XML) == 1) {
-            std::cout << events_xml::getDynamicXML(drivers.getAllConst(),
-                                                   drivers.getPrimarySourceProvider().getCpuInfo().getClusters())
-                             .get();
+            std::cout << events_xml::getDynamicXML(drivers.getStaticEventsXml(), drivers.getAllConst()).get();
         }
         if (result.printables.count(ParserResult::Printable::COUNTERS_XML) == 1) {
             std::cout << counters_xml::getXML(drivers.getPrimarySourceProvider().supportsMultiEbs(),
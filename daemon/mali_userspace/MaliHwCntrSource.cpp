@@ -11,6 +11,7 @@
 #include "PrimarySourceProvider.h"
 #include "Protocol.h"
 #include "SessionData.h"
+#include "ThreadFactory.h"
 #include "mali_userspace/IMaliHwCntrReader.h"
 #include "mali_userspace/MaliHwCntrDriver.h"
 #include "mali_userspace/MaliHwCntrReader.h"
@@ -76,10 +77,10 @@ namespace mali_userspace {
         const bool isOneShot = gSessionData.mOneShot;
         for (auto const & task : tasks) {
             MaliHwCntrTask * const taskPtr = task.get();
-            threadsCreated.emplace_back([=]() -> void {
+            threadsCreated.push_back(thread_factory::create(ThreadRole::SOURCE, [=]() -> void {
                 prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-malihtsk"), 0, 0, 0);
                 taskPtr->execute(sampleRate, isOneShot);
-            });
+            }));
         }
         std::for_each(threadsCreated.begin(), threadsCreated.end(), std::mem_fn(&std::thread::join));
     }
@@ -6,6 +6,8 @@
 #include "SessionData.h"
 #include "lib/Syscall.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <unistd.h>
 #include <utility>
 
@@ -45,7 +47,21 @@ namespace mali_userspace {
         }
         // create the list of enabled counters
         const MaliDeviceCounterList countersList(mReader.getDevice().createCounterList(mCallback));
+        int samplePeriodScale = 1;
         while (isSessionActive() && !terminated) {
+            // follow the perf sampling governor so that the GPU counters are stretched by the same amount
+            const int newSamplePeriodScale = gSessionData.mSamplePeriodScale;
+            if (newSamplePeriodScale != samplePeriodScale) {
+                const uint64_t scaledIntervalNs = static_cast<uint64_t>(sampleIntervalNs) * newSamplePeriodScale;
+                if (mReader.startPeriodicSampling(
+                        static_cast<uint32_t>(std::min<uint64_t>(scaledIntervalNs, UINT32_MAX)))) {
+                    samplePeriodScale = newSamplePeriodScale;
+                }
+                else {
+                    logg.logMessage("Could not change the periodic sampling interval");
+                }
+            }
+
             SampleBuffer waitStatus = mReader.waitForBuffer(10000);
 
             switch (waitStatus.status) {
@@ -10,6 +10,7 @@
 #include "lib/File.h"
 #include "xml/EventsXMLProcessor.h"
 #include "xml/PmuXML.h"
+#include "xml/XmlWriter.h"
 
 namespace events_xml {
 
@@ -61,44 +62,71 @@ namespace events_xml {
         return mainXml;
     }
 
-    static std::unique_ptr<mxml_node_t, void (*)(mxml_node_t *)> getDynamicTree(lib::Span<const Driver * const> drivers,
-                                                                                lib::Span<const GatorCpu> clusters)
-    {
-        auto xml = getStaticTree(clusters);
-        // Add dynamic events from the drivers
-        mxml_node_t * events = getEventsElement(xml.get());
-        if (events == nullptr) {
-            logg.logError(
-                "Unable to find <events> node in the events.xml, please ensure the first two lines of events XML are:\n"
-                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-                "<events>");
-            handleException();
+    /**
+     * Adds the events of the drivers to the end of the <events> element of a static tree, and removes them again when
+     * destroyed. The drivers' events may change between sessions, but the static tree does not, so it is parsed once
+     */
+    class DynamicEvents {
+    public:
+        DynamicEvents(mxml_node_t & staticTree, lib::Span<const Driver * const> drivers)
+            : mEvents(getEventsElement(&staticTree)), mLastStaticNode(nullptr)
+        {
+            if (mEvents == nullptr) {
+                logg.logError("Unable to find <events> node in the events.xml, please ensure the first two lines of "
+                              "events XML are:\n"
+                              "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                              "<events>");
+                handleException();
+            }
+
+            // Drivers only append to <events>, so everything after this was added by them
+            mLastStaticNode = mxmlGetLastChild(mEvents);
+            for (const Driver * driver : drivers) {
+                driver->writeEvents(mEvents);
+            }
         }
-        for (const Driver * driver : drivers) {
-            driver->writeEvents(events);
+
+        ~DynamicEvents()
+        {
+            mxml_node_t * node =
+                (mLastStaticNode != nullptr ? mxmlGetNextSibling(mLastStaticNode) : mxmlGetFirstChild(mEvents));
+            while (node != nullptr) {
+                mxml_node_t * const next = mxmlGetNextSibling(node);
+                mxmlDelete(node);
+                node = next;
+            }
         }
 
-        return xml;
-    }
+    private:
+        mxml_node_t * const mEvents;
+        mxml_node_t * mLastStaticNode;
+
+        // Intentionally unimplemented
+        DynamicEvents(const DynamicEvents &) = delete;
+        DynamicEvents & operator=(const DynamicEvents &) = delete;
+        DynamicEvents(DynamicEvents &&) = delete;
+        DynamicEvents & operator=(DynamicEvents &&) = delete;
+    };
 
-    std::unique_ptr<char, void (*)(void *)> getDynamicXML(lib::Span<const Driver * const> drivers,
-                                                          lib::Span<const GatorCpu> clusters)
+    std::unique_ptr<char, void (*)(void *)> getDynamicXML(mxml_node_t & staticTree,
+                                                          lib::Span<const Driver * const> drivers)
     {
-        const auto xml = getDynamicTree(drivers, clusters);
-        return {mxmlSaveAllocString(xml.get(), mxmlWhitespaceCB), &free};
+        const DynamicEvents dynamicEvents {staticTree, drivers};
+        XmlWriter writer;
+        writer.writeTree(&staticTree);
+        return writer.release();
     }
 
-    std::map<std::string, int> getCounterToEventMap(lib::Span<const Driver * const> drivers,
-                                                    lib::Span<const GatorCpu> clusters)
+    std::map<std::string, int> getCounterToEventMap(mxml_node_t & staticTree, lib::Span<const Driver * const> drivers)
     {
         std::map<std::string, int> counterToEventMap {};
 
-        auto xml = events_xml::getDynamicTree(drivers, clusters);
+        const DynamicEvents dynamicEvents {staticTree, drivers};
 
         // build map of counter->event
-        mxml_node_t * node = xml.get();
+        mxml_node_t * node = &staticTree;
         while (true) {
-            node = mxmlFindElement(node, xml.get(), "event", nullptr, nullptr, MXML_DESCEND);
+            node = mxmlFindElement(node, &staticTree, "event", nullptr, nullptr, MXML_DESCEND);
             if (node == nullptr) {
                 break;
             }
@@ -119,14 +147,14 @@ namespace events_xml {
         return counterToEventMap;
     }
 
-    void write(const char * path, lib::Span<const Driver * const> drivers, lib::Span<const GatorCpu> clusters)
+    void write(const char * path, mxml_node_t & staticTree, lib::Span<const Driver * const> drivers)
     {
         char file[PATH_MAX];
 
         // Set full path
         snprintf(file, PATH_MAX, "%s/events.xml", path);
 
-        if (writeToDisk(file, getDynamicXML(drivers, clusters).get()) < 0) {
+        if (writeToDisk(file, getDynamicXML(staticTree, drivers).get()) < 0) {
             logg.logError("Error writing %s\nPlease verify the path.", file);
             handleException();
         }
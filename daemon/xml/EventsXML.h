@@ -18,13 +18,13 @@ namespace events_xml {
     std::unique_ptr<mxml_node_t, void (*)(mxml_node_t *)> getStaticTree(lib::Span<const GatorCpu> clusters);
 
     /// Gets the events that come from commandline/builtin events.xml plus ones added by drivers
-    std::unique_ptr<char, void (*)(void *)> getDynamicXML(lib::Span<const Driver * const> drivers,
-                                                          lib::Span<const GatorCpu> clusters);
+    /// The drivers' events are added to staticTree, from getStaticTree, and removed again before returning
+    std::unique_ptr<char, void (*)(void *)> getDynamicXML(mxml_node_t & staticTree,
+                                                          lib::Span<const Driver * const> drivers);
 
-    std::map<std::string, int> getCounterToEventMap(lib::Span<const Driver * const> drivers,
-                                                    lib::Span<const GatorCpu> clusters);
+    std::map<std::string, int> getCounterToEventMap(mxml_node_t & staticTree, lib::Span<const Driver * const> drivers);
 
-    void write(const char * path, lib::Span<const Driver * const> drivers, lib::Span<const GatorCpu> clusters);
+    void write(const char * path, mxml_node_t & staticTree, lib::Span<const Driver * const> drivers);
 };
 
 #endif // EVENTS_XML_H
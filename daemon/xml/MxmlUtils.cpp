@@ -2,6 +2,15 @@
 
 #include "xml/MxmlUtils.h"
 
+#include <cstring>
+
+namespace {
+    // mxml's default
+    constexpr int DEFAULT_WRAP_MARGIN = 72;
+
+    thread_local int wrapMargin = DEFAULT_WRAP_MARGIN;
+}
+
 // mxml doesn't have a function to do this, so dip into its private API
 // Copy all the attributes from src to dst
 void copyMxmlElementAttrs(mxml_node_t * dest, mxml_node_t * src)
@@ -21,10 +30,22 @@ void copyMxmlElementAttrs(mxml_node_t * dest, mxml_node_t * src)
 // whitespace callback utility function used with mini-xml
 const char * mxmlWhitespaceCB(mxml_node_t * node, int loc)
 {
-    const char * name;
+    return getXmlWhitespace(mxmlGetElement(node), loc);
+}
 
-    name = mxmlGetElement(node);
+void setMxmlWrapMargin(int column)
+{
+    mxmlSetWrapMargin(column);
+    wrapMargin = column;
+}
 
+int getMxmlWrapMargin()
+{
+    return wrapMargin;
+}
+
+const char * getXmlWhitespace(const char * name, int loc)
+{
     if (loc == MXML_WS_BEFORE_OPEN) {
         // Single indentation
         if ((strcmp(name, "target") == 0) || (strcmp(name, "counters") == 0)) {
@@ -19,6 +19,11 @@ inline mxml_unique_ptr makeMxmlUniquePtr(mxml_node_t * node)
 }
 
 const char * mxmlWhitespaceCB(mxml_node_t * node, int loc);
+/** The whitespace mxmlWhitespaceCB puts at loc for an element of this name, shared with XmlWriter */
+const char * getXmlWhitespace(const char * name, int loc);
+/** As mxmlSetWrapMargin, which is per thread, but remembered for XmlWriter as mxml cannot be asked for it */
+void setMxmlWrapMargin(int column);
+int getMxmlWrapMargin();
 void copyMxmlElementAttrs(mxml_node_t * dest, mxml_node_t * src);
 
 #endif // MXML_UTILS_H
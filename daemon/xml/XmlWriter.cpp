@@ -0,0 +1,385 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#include "xml/XmlWriter.h"
+
+#include "Logging.h"
+#include "xml/MxmlUtils.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    constexpr std::size_t MIN_CAPACITY = 1 << 12;
+    constexpr char XML_DECLARATION[] = "?xml version=\"1.0\" encoding=\"utf-8\"?";
+
+    /** @return The entity mxml writes for this character, or nullptr if it is written as it is */
+    const char * getEntity(const char c)
+    {
+        switch (c) {
+            case '&':
+                return "&amp;";
+            case '<':
+                return "&lt;";
+            case '>':
+                return "&gt;";
+            case '"':
+                return "&quot;";
+            default:
+                return nullptr;
+        }
+    }
+
+    /** ? and ! elements have no end tag */
+    bool hasEndTag(const char * name) { return (name[0] != '!') && (name[0] != '?'); }
+}
+
+XmlWriter::XmlWriter()
+    : mBuffer(nullptr),
+      mLength(0),
+      mCapacity(0),
+      mColumn(0),
+      mWrapMargin(getMxmlWrapMargin()),
+      mElements(),
+      mStartTagOpen(false)
+{
+}
+
+XmlWriter::~XmlWriter()
+{
+    free(mBuffer);
+}
+
+void XmlWriter::startDocument()
+{
+    startElement(XML_DECLARATION);
+}
+
+void XmlWriter::startElement(const char * const name)
+{
+    closeStartTag();
+    openStartTag(name);
+    mElements.emplace_back(name);
+    mStartTagOpen = true;
+}
+
+void XmlWriter::attribute(const char * const name, const char * const value)
+{
+    const int width = strlen(name) + (value != nullptr ? strlen(value) + 3 : 0);
+
+    if ((mWrapMargin > 0) && (mColumn + width > mWrapMargin)) {
+        append('\n');
+        mColumn = 0;
+    }
+    else {
+        append(' ');
+        ++mColumn;
+    }
+
+    appendName(name);
+    if (value != nullptr) {
+        append("=\"", 2);
+        appendEscaped(value);
+        append('"');
+    }
+
+    mColumn += width;
+}
+
+void XmlWriter::attributef(const char * const name, const char * const format, ...)
+{
+    char value[256];
+
+    va_list ap;
+    va_start(ap, format);
+    const int length = vsnprintf(value, sizeof(value), format, ap);
+    va_end(ap);
+
+    if ((length >= 0) && (static_cast<std::size_t>(length) < sizeof(value))) {
+        attribute(name, value);
+        return;
+    }
+
+    std::unique_ptr<char[]> longValue {new char[length + 1]};
+    va_start(ap, format);
+    vsnprintf(longValue.get(), length + 1, format, ap);
+    va_end(ap);
+    attribute(name, longValue.get());
+}
+
+void XmlWriter::text(const char * const text)
+{
+    closeStartTag();
+    appendEscaped(text);
+    mColumn += strlen(text);
+}
+
+void XmlWriter::endElement()
+{
+    const std::string name = std::move(mElements.back());
+    mElements.pop_back();
+    endElement(name.c_str(), !mStartTagOpen);
+    mStartTagOpen = false;
+}
+
+void XmlWriter::writeTree(mxml_node_t * const node)
+{
+    closeStartTag();
+    writeNode(node);
+}
+
+std::unique_ptr<char, void (*)(void *)> XmlWriter::release()
+{
+    while (!mElements.empty()) {
+        endElement();
+    }
+
+    if (mColumn > 0) {
+        append('\n');
+    }
+    append('\0');
+
+    char * const document = mBuffer;
+    mBuffer = nullptr;
+    mLength = 0;
+    mCapacity = 0;
+    mColumn = 0;
+    return {document, &free};
+}
+
+void XmlWriter::reserve(const std::size_t bytes)
+{
+    if (mLength + bytes <= mCapacity) {
+        return;
+    }
+
+    std::size_t capacity = 2 * mCapacity;
+    if (capacity < mLength + bytes) {
+        capacity = mLength + bytes;
+    }
+    if (capacity < MIN_CAPACITY) {
+        capacity = MIN_CAPACITY;
+    }
+
+    char * const buffer = static_cast<char *>(realloc(mBuffer, capacity));
+    if (buffer == nullptr) {
+        logg.logError("Unable to allocate %zu bytes for xml", capacity);
+        handleException();
+    }
+    mBuffer = buffer;
+    mCapacity = capacity;
+}
+
+void XmlWriter::append(const char * const data, const std::size_t length)
+{
+    reserve(length);
+    memcpy(mBuffer + mLength, data, length);
+    mLength += length;
+}
+
+void XmlWriter::append(const char c)
+{
+    reserve(1);
+    mBuffer[mLength++] = c;
+}
+
+void XmlWriter::appendEscaped(const char * string)
+{
+    while (*string != '\0') {
+        // copy the run up to the next character that needs an entity in one go
+        const std::size_t run = strcspn(string, "&<>\"");
+        append(string, run);
+        string += run;
+
+        if (*string != '\0') {
+            const char * const entity = getEntity(*string);
+            append(entity, strlen(entity));
+            ++string;
+        }
+    }
+}
+
+void XmlWriter::appendName(const char * name)
+{
+    // As mxml_write_name, a quoted name is written up to the closing quote with entities
+    if ((*name != '"') && (*name != '\'')) {
+        append(name, strlen(name));
+        return;
+    }
+
+    const char quote = *name++;
+    append(quote);
+    for (; (*name != '\0') && (*name != quote); ++name) {
+        const char * const entity = getEntity(*name);
+        if (entity != nullptr) {
+            append(entity, strlen(entity));
+        }
+        else {
+            append(*name);
+        }
+    }
+    append(quote);
+}
+
+void XmlWriter::appendWhitespace(const char * const name, const int loc)
+{
+    const char * whitespace = getXmlWhitespace(name, loc);
+    if (whitespace == nullptr) {
+        return;
+    }
+
+    for (; *whitespace != '\0'; ++whitespace) {
+        append(*whitespace);
+        if (*whitespace == '\n') {
+            mColumn = 0;
+        }
+        else if (*whitespace == '\t') {
+            mColumn += MXML_TAB;
+            mColumn -= mColumn % MXML_TAB;
+        }
+        else {
+            ++mColumn;
+        }
+    }
+}
+
+void XmlWriter::closeStartTag()
+{
+    if (!mStartTagOpen) {
+        return;
+    }
+
+    append('>');
+    ++mColumn;
+    appendWhitespace(mElements.back().c_str(), MXML_WS_AFTER_OPEN);
+    mStartTagOpen = false;
+}
+
+void XmlWriter::openStartTag(const char * const name)
+{
+    appendWhitespace(name, MXML_WS_BEFORE_OPEN);
+    append('<');
+    // Comments, processing instructions and CDATA do not use entities
+    if ((name[0] == '?') || (strncmp(name, "!--", 3) == 0)) {
+        append(name, strlen(name));
+    }
+    else if (strncmp(name, "![CDATA[", 8) == 0) {
+        append(name, strlen(name));
+        append("]]", 2);
+    }
+    else {
+        appendName(name);
+    }
+    mColumn += strlen(name) + 1;
+}
+
+void XmlWriter::endElement(const char * const name, const bool hasChildren)
+{
+    if (!hasChildren) {
+        if (hasEndTag(name)) {
+            append(" />", 3);
+            mColumn += 3;
+        }
+        else {
+            append('>');
+            ++mColumn;
+        }
+        appendWhitespace(name, MXML_WS_AFTER_OPEN);
+    }
+    else if (hasEndTag(name)) {
+        appendWhitespace(name, MXML_WS_BEFORE_CLOSE);
+        append("</", 2);
+        appendEscaped(name);
+        append('>');
+        mColumn += strlen(name) + 3;
+        appendWhitespace(name, MXML_WS_AFTER_CLOSE);
+    }
+}
+
+void XmlWriter::writeNode(mxml_node_t * const node)
+{
+    switch (mxmlGetType(node)) {
+        case MXML_ELEMENT: {
+            const char * const name = mxmlGetElement(node);
+            openStartTag(name);
+
+            const int numberOfAttrs = mxmlElementGetAttrCount(node);
+            for (int index = 0; index < numberOfAttrs; ++index) {
+                const char * attrName;
+                const char * const value = mxmlElementGetAttrByIndex(node, index, &attrName);
+                attribute(attrName, value);
+            }
+
+            mxml_node_t * child = mxmlGetFirstChild(node);
+            if (child == nullptr) {
+                endElement(name, false);
+                break;
+            }
+
+            append('>');
+            ++mColumn;
+            appendWhitespace(name, MXML_WS_AFTER_OPEN);
+            for (; child != nullptr; child = mxmlGetNextSibling(child)) {
+                writeNode(child);
+            }
+            endElement(name, true);
+            break;
+        }
+
+        case MXML_TEXT: {
+            int whitespace = 0;
+            const char * const string = mxmlGetText(node, &whitespace);
+            if ((whitespace != 0) && (mColumn > 0)) {
+                if ((mWrapMargin > 0) && (mColumn > mWrapMargin)) {
+                    append('\n');
+                    mColumn = 0;
+                }
+                else {
+                    append(' ');
+                    ++mColumn;
+                }
+            }
+            appendEscaped(string);
+            mColumn += strlen(string);
+            break;
+        }
+
+        case MXML_OPAQUE: {
+            const char * const string = mxmlGetOpaque(node);
+            appendEscaped(string);
+            mColumn += strlen(string);
+            break;
+        }
+
+        case MXML_INTEGER:
+        case MXML_REAL: {
+            if (mxmlGetPrevSibling(node) != nullptr) {
+                if ((mWrapMargin > 0) && (mColumn > mWrapMargin)) {
+                    append('\n');
+                    mColumn = 0;
+                }
+                else {
+                    append(' ');
+                    ++mColumn;
+                }
+            }
+            char number[255];
+            if (mxmlGetType(node) == MXML_INTEGER) {
+                snprintf(number, sizeof(number), "%d", mxmlGetInteger(node));
+            }
+            else {
+                snprintf(number, sizeof(number), "%f", mxmlGetReal(node));
+            }
+            appendEscaped(number);
+            mColumn += strlen(number);
+            break;
+        }
+
+        case MXML_CUSTOM:
+        case MXML_IGNORE:
+        default:
+            // gatord does not create these, and mxml cannot save custom nodes without a callback either
+            break;
+    }
+}
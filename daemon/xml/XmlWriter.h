@@ -0,0 +1,80 @@
+/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+
+#ifndef XML_XML_WRITER_H
+#define XML_XML_WRITER_H
+
+#include "mxml/mxml.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Writes xml straight into a growing buffer, without building an mxml tree first.
+ *
+ * The output is byte for byte what mxmlSaveAllocString would give for the same tree with mxmlWhitespaceCB, including
+ * mxml's wrapping at the margin set with setMxmlWrapMargin, so documents may be moved between the two freely.
+ */
+class XmlWriter {
+public:
+    XmlWriter();
+    ~XmlWriter();
+
+    /** Starts the <?xml?> element that mxmlNewXML creates, which the rest of the document is nested in */
+    void startDocument();
+
+    /** Starts a child of the current element, closing the current element's start tag if needed */
+    void startElement(const char * name);
+
+    /** Adds an attribute to the element just started, before any children are added */
+    void attribute(const char * name, const char * value);
+    __attribute__((format(printf, 3, 4))) void attributef(const char * name, const char * format, ...);
+
+    /** Adds text to the current element, as mxmlNewText(element, 0, text) */
+    void text(const char * text);
+
+    void endElement();
+
+    /** Writes an mxml node and its descendants as a child of the current element */
+    void writeTree(mxml_node_t * node);
+
+    /**
+     * Ends any elements still open and hands over the document
+     *
+     * @return The nul terminated document, to be freed with free
+     */
+    std::unique_ptr<char, void (*)(void *)> release();
+
+private:
+    void reserve(std::size_t bytes);
+    void append(const char * data, std::size_t length);
+    void append(char c);
+    void appendEscaped(const char * string);
+    void appendName(const char * name);
+    void appendWhitespace(const char * name, int loc);
+    void closeStartTag();
+
+    void openStartTag(const char * name);
+    void endElement(const char * name, bool hasChildren);
+    void writeNode(mxml_node_t * node);
+
+    char * mBuffer;
+    std::size_t mLength;
+    std::size_t mCapacity;
+    // the column mxml would be at, for wrapping
+    int mColumn;
+    const int mWrapMargin;
+    // the names of the open elements
+    std::vector<std::string> mElements;
+    // whether the start tag of the innermost open element is still waiting for its '>'
+    bool mStartTagOpen;
+
+    // Intentionally unimplemented
+    XmlWriter(const XmlWriter &) = delete;
+    XmlWriter & operator=(const XmlWriter &) = delete;
+    XmlWriter(XmlWriter &&) = delete;
+    XmlWriter & operator=(XmlWriter &&) = delete;
+};
+
+#endif // XML_XML_WRITER_H